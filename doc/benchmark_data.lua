@@ -1,7 +1,15 @@
 -- benchmark_data
 -- @short: Retrieve gathered benchmarking values.
--- @outargs: nticks, tickcosttbl, framecount, frametimetbl, costcount, framecosttbl
+-- @outargs: nticks, tickcosttbl, framecount, frametimetbl, costcount, framecosttbl, rastertbl
 -- @group: system
+-- @note: The rastertbl covers the engine side rasterization of TPACK
+-- frameservers and is gathered regardless of benchmark_enable. It has the
+-- fields contexts (number of shared font/size raster contexts), glyphs and
+-- glyph_slots (glyph cache occupancy), glyph_hits and glyph_misses (glyph
+-- cache lookups), lines and lines_reused (rows submitted and rows skipped as
+-- they were already drawn). The fields ttf_glyphs, ttf_bytes, ttf_hits,
+-- ttf_misses and ttf_evictions cover the glyph caches of the fonts used for
+-- text rendering. The counters accumulate from startup.
 -- @cfunction: getbenchvals
 -- @related: benchmark_enable, benchmark_timestamp
 
@@ -28,6 +28,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 
 int a12_trace_targets = 0;
 FILE* a12_trace_dst = NULL;
@@ -49,6 +50,14 @@ size_t a12int_header_size(int kind)
 
 static void unlink_node(struct a12_state*, struct blob_out*);
 
+/* monotonic ms, shared with the decoder side for the jitter buffer */
+uint64_t a12int_now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static uint8_t* grow_array(uint8_t* dst, size_t* cur_sz, size_t new_sz, int ind)
 {
 	if (new_sz < *cur_sz)
@@ -86,6 +95,43 @@ static uint8_t* grow_array(uint8_t* dst, size_t* cur_sz, size_t new_sz, int ind)
 	return res;
 }
 
+bool a12int_tgrid_resize(struct tpack_grid* G, size_t rows, size_t cols)
+{
+	if (G->cells && G->rows == rows && G->cols == cols){
+		memset(G->cells, '\0', rows * cols * 12);
+		memset(G->lines, '\0', rows * 2);
+		memset(G->hash, '\0', rows * sizeof(uint32_t));
+		return true;
+	}
+
+	a12int_tgrid_free(G);
+	if (!rows || !cols)
+		return false;
+
+	G->cells = calloc(rows * cols, 12);
+	G->lines = calloc(rows, 2);
+	G->hash = calloc(rows, sizeof(uint32_t));
+
+	if (!G->cells || !G->lines || !G->hash){
+		a12int_trace(A12_TRACE_ALLOC,
+			"kind=error:status=ENOMEM:rows=%zu:cols=%zu", rows, cols);
+		a12int_tgrid_free(G);
+		return false;
+	}
+
+	G->rows = rows;
+	G->cols = cols;
+	return true;
+}
+
+void a12int_tgrid_free(struct tpack_grid* G)
+{
+	free(G->cells);
+	free(G->lines);
+	free(G->hash);
+	*G = (struct tpack_grid){};
+}
+
 /* set the LAST SEEN sequence number in a CONTROL message */
 static void step_sequence(struct a12_state* S, uint8_t* outb)
 {
@@ -210,6 +256,23 @@ static struct a12_state* a12_setup(struct a12_context_options* opt)
 	return res;
 }
 
+/* both sides announce what they support, an older peer that doesn't send or
+ * fill in a hello is treated as supporting none of the optional features */
+static void send_hello(struct a12_state* S)
+{
+	uint8_t outb[CONTROL_PACKET_SIZE] = {0};
+
+/* last seen seq-nummer is nothing here */
+	outb[17] = COMMAND_HELLO;
+	uint32_t features = A12_FEATURES;
+	if (S->opts->bstream_cache)
+		features |= A12_FEATURE_BCACHE;
+	pack_u32(features, &outb[60]);
+
+	a12int_trace(A12_TRACE_SYSTEM, "channel open, add control packet");
+	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+}
+
 static void a12_init()
 {
 	static bool init;
@@ -236,6 +299,7 @@ struct a12_state* a12_build(struct a12_context_options* opt)
 	if (!res)
 		return NULL;
 
+	send_hello(res);
 	return res;
 }
 
@@ -252,13 +316,7 @@ struct a12_state* a12_open(struct a12_context_options* opt)
 
 /* send initial hello packet */
 	a12int_trace(A12_TRACE_MISSING, "authentication material in Hello");
-	uint8_t outb[CONTROL_PACKET_SIZE] = {0};
-
-/* last seen seq-nummer is nothing here */
-	outb[17] = 0;
-
-	a12int_trace(A12_TRACE_SYSTEM, "channel open, add control packet");
-	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+	send_hello(S);
 
 	return S;
 }
@@ -288,8 +346,11 @@ a12_channel_close(struct a12_state* S)
 	}
 
 	if (S->channels[S->out_channel].active){
+		a12int_decode_drain(&S->channels[S->out_channel]);
 		S->channels[S->out_channel].cont = NULL;
 		S->channels[S->out_channel].active = false;
+		a12int_tgrid_free(&S->channels[S->out_channel].tpack.front);
+		a12int_tgrid_free(&S->channels[S->out_channel].tpack.back);
 	}
 
 	a12int_trace(A12_TRACE_SYSTEM, "closing channel (%d)", S->out_channel);
@@ -309,6 +370,9 @@ a12_free(struct a12_state* S)
 		}
 	}
 
+	for (size_t i = 0; i < 256; i++)
+		a12int_decode_free(&S->channels[i]);
+
 	a12int_trace(A12_TRACE_ALLOC, "a12-state machine freed");
 	DYNAMIC_FREE(S->bufs[0]);
 	DYNAMIC_FREE(S->bufs[1]);
@@ -387,13 +451,19 @@ static bool process_mac(struct a12_state* S)
 	return true;
 }
 
-static void command_cancelstream(struct a12_state* S, uint32_t streamid)
+static void command_cancelstream(
+	struct a12_state* S, uint32_t streamid, uint8_t code)
 {
 	struct blob_out* node = S->pending;
 	while (node){
 		if (node->streamid == streamid){
-			a12int_trace(A12_TRACE_BTRANSFER,
-				"kind=cancelled:stream=%"PRIu32":source=remote", streamid);
+			if (code == STREAM_CANCEL_KNOWN)
+				a12int_trace(A12_TRACE_BTRANSFER,
+					"kind=cached:stream=%"PRIu32":saved=%zu", streamid, node->left);
+			else
+				a12int_trace(A12_TRACE_BTRANSFER,
+					"kind=cancelled:stream=%"PRIu32":source=remote:code=%d",
+					streamid, (int) code);
 			unlink_node(S, node);
 			return;
 		}
@@ -401,6 +471,8 @@ static void command_cancelstream(struct a12_state* S, uint32_t streamid)
 	}
 }
 
+static void stream_cancel(struct a12_state* S, uint8_t channel, uint8_t code);
+
 static void command_binarystream(struct a12_state* S)
 {
 /*
@@ -453,10 +525,14 @@ static void command_binarystream(struct a12_state* S)
 	int sc = A12_BHANDLER_DONTWANT;
 	struct a12_bhandler_meta bm = {
 		.state = A12_BHANDLER_INITIALIZE,
+		.type = bframe->type,
 		.known_size = bframe->size,
 		.streamid = bframe->streamid,
+		.channel = channel,
+		.dcont = cont,
 		.fd = -1
 	};
+	memcpy(bm.checksum, bframe->checksum, 16);
 
 	if (S->binary_handler){
 		struct a12_bhandler_res res = S->binary_handler(S, bm, S->binary_handler_tag);
@@ -464,14 +540,37 @@ static void command_binarystream(struct a12_state* S)
 		sc = res.flag;
 	}
 
-	if (sc == A12_BHANDLER_DONTWANT || sc == A12_BHANDLER_CACHED){
+	if (sc == A12_BHANDLER_DONTWANT){
 		a12_stream_cancel(S, channel);
 		a12int_trace(A12_TRACE_BTRANSFER,
 			"kind=reject:stream=%"PRId64":ch=%d", bframe->streamid, channel);
+		return;
+	}
+
+	if (sc != A12_BHANDLER_CACHED)
+		return;
+
+/* the descriptor is the cached copy rather than a destination, so it should
+ * not be forwarded as part of the cancellation but as a completed transfer */
+	int fd = bframe->tmp_fd;
+	bframe->tmp_fd = -1;
+	stream_cancel(S, channel, STREAM_CANCEL_KNOWN);
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=cached:stream=%"PRIu32":ch=%d", streamid, channel);
+
+	if (-1 != fd){
+		bm.state = A12_BHANDLER_COMPLETED;
+		bm.fd = fd;
+		S->binary_handler(S, bm, S->binary_handler_tag);
 	}
 }
 
 void a12_stream_cancel(struct a12_state* S, uint8_t channel)
+{
+	stream_cancel(S, channel, STREAM_CANCEL_DONTWANT);
+}
+
+static void stream_cancel(struct a12_state* S, uint8_t channel, uint8_t code)
 {
 	uint8_t outb[CONTROL_PACKET_SIZE] = {0};
 	step_sequence(S, outb);
@@ -484,6 +583,7 @@ void a12_stream_cancel(struct a12_state* S, uint8_t channel)
 	outb[16] = channel;
 	outb[17] = COMMAND_CANCELSTREAM;
 	pack_u32(bframe->streamid, &outb[18]); /* [18 .. 21] stream-id */
+	outb[22] = code;
 	bframe->active = false;
 	bframe->streamid = -1;
 	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
@@ -516,6 +616,8 @@ static void command_audioframe(struct a12_state* S)
 	aframe->channels = S->decode[22];
 	unpack_u16(&aframe->nsamples, &S->decode[24]);
 	unpack_u32(&aframe->rate, &S->decode[26]);
+	unpack_u32(&aframe->pts, &S->decode[30]);
+	aframe->adpcm_hdr_pos = 0;
 	S->in_channel = -1;
 
 /* developer error (or malicious client), set to skip decode/playback */
@@ -539,6 +641,9 @@ static void command_audioframe(struct a12_state* S)
 		a12int_trace(A12_TRACE_MISSING, "channel format repack");
 	}
 
+/* samples are forwarded as they arrive, so this is what video syncs against */
+	a12int_jitter_audio(&S->channels[channel], aframe->pts);
+
 /* just plug the samples into the normal abuf- as part of the shmif-cont */
 /* normal dynamic rate adjustment compensating for clock drift etc. go here */
 }
@@ -613,6 +718,8 @@ static void command_videoframe(struct a12_state* S)
 /* [41]     : commit: uint8 */
 	unpack_u32(&vframe->expanded_sz, &S->decode[40]);
 	vframe->commit = S->decode[44];
+/* [45..48] : timestamp: uint32 */
+	unpack_u32(&vframe->pts, &S->decode[45]);
 	S->in_channel = -1;
 
 /* If channel set, apply resize immediately - synch cost should be offset with
@@ -629,18 +736,19 @@ static void command_videoframe(struct a12_state* S)
 
 /* set the possible consumer presentation / repacking options, or resize
  * if the source / destination dimensions no longer match */
-	bool hints_changed = false;
-	if (vframe->postprocess == POSTPROCESS_VIDEO_TZ && !(cont->hints & SHMIF_RHINT_TPACK)){
-		cont->hints |= SHMIF_RHINT_TPACK;
-		hints_changed = true;
-	}
-	else if ((cont->hints & SHMIF_RHINT_TPACK) &&
-		vframe->postprocess != POSTPROCESS_VIDEO_TZ){
-		cont->hints = cont->hints & (~SHMIF_RHINT_TPACK);
-		hints_changed = true;
-	}
+	bool tpack = vframe->postprocess == POSTPROCESS_VIDEO_TZ ||
+		vframe->postprocess == POSTPROCESS_VIDEO_DTZ;
+	bool hints_changed = tpack != !!(cont->hints & SHMIF_RHINT_TPACK);
 
 	if (hints_changed || vframe->sw != cont->w || vframe->sh != cont->h){
+/* frames still in the jitter buffer were packed for the old hints/size */
+		a12int_decode_drain(channel);
+
+		if (tpack)
+			cont->hints |= SHMIF_RHINT_TPACK;
+		else
+			cont->hints &= ~SHMIF_RHINT_TPACK;
+
 		arcan_shmif_resize(cont, vframe->sw, vframe->sh);
 		if (vframe->sw != cont->w || vframe->sh != cont->h){
 			a12int_trace(A12_TRACE_SYSTEM, "parent size rejected");
@@ -740,6 +848,44 @@ static void command_videoframe(struct a12_state* S)
  * asymmetric connection as they won't fight with other transfers.
  *
  */
+/*
+ * Map the window of a file-backed blob of [total] bytes that covers the
+ * current position (or keep the one already mapped). Returns false at the end
+ * of the file or if it couldn't be mapped.
+ */
+static bool blob_window(struct blob_out* node, size_t total)
+{
+	if (node->map && node->pos < node->map_ofs + node->map_sz)
+		return true;
+
+	if (node->map){
+		munmap(node->map, node->map_sz);
+		node->map = NULL;
+	}
+
+	if (node->pos >= total)
+		return false;
+
+/* page aligned offset, the window is only ever moved forward */
+	size_t page = sysconf(_SC_PAGESIZE);
+	node->map_ofs = node->pos - (node->pos % page);
+	node->map_sz = total - node->map_ofs;
+	if (node->map_sz > BSTREAM_MAP_WINDOW)
+		node->map_sz = BSTREAM_MAP_WINDOW;
+
+	void* map = mmap(NULL, node->map_sz,
+		PROT_READ, MAP_FILE | MAP_PRIVATE, node->fd, node->map_ofs);
+
+	if (MAP_FAILED == map){
+		node->map_sz = 0;
+		return false;
+	}
+
+	madvise(map, node->map_sz, MADV_SEQUENTIAL);
+	node->map = map;
+	return true;
+}
+
 void a12_enqueue_bstream(
 	struct a12_state* S, int fd, int type, bool streaming, size_t sz)
 {
@@ -827,23 +973,29 @@ void a12_enqueue_bstream(
 
 /* this has the normal sigbus problem, though we don't care about that much now
  * being in the same sort of privilege domain - we can also defer the entire
- * thing and simply thread- process it, which is probably the better solution */
-	void* map = mmap(NULL, fend, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+ * thing and simply thread- process it, which is probably the better solution.
+ *
+ * the crypted packages are MACed together, but we always use the primitive
+ * for btransfer- checksums so the other side can compare against a cache and
+ * cancel the stream */
+	blake2b_state B;
+	blake2b_init(&B, 16);
+	next->left = fend;
 
-	if (!map){
+	while (blob_window(next, fend)){
+		size_t ntc = next->map_sz - (next->pos - next->map_ofs);
+		blake2b_update(&B, &next->map[next->pos - next->map_ofs], ntc);
+		next->pos += ntc;
+	}
+
+	if (next->pos != fend){
 		a12int_trace(A12_TRACE_SYSTEM, "kind=error:status=EMMAP");
 		goto fail;
 	}
 
-/* the crypted packages are MACed together, but we always use the primitive
- * for btransfer- checksums so the other side can compare against a cache and
- * cancel the stream */
-	blake2b_state B;
-	blake2b_init(&B, 16);
-	blake2b_update(&B, map, fend);
 	blake2b_final(&B, next->checksum, 16);
-	munmap(map, fend);
-	next->left = fend;
+	next->pos = 0;
+	next->mapped = true;
 	a12int_trace(A12_TRACE_BTRANSFER,
 		"kind=added:type=%d:stream=no:size=%zu", type, next->left);
 
@@ -853,10 +1005,74 @@ fail:
 	if (-1 != next->fd)
 		close(next->fd);
 
+	if (next->map)
+		munmap(next->map, next->map_sz);
+
 	*parent = NULL;
 	free(next);
 }
 
+/*
+ * [18..21] : ping-id : uint32
+ * [22]     : echo : uint8
+ *
+ * The ping is added last in an outgoing buffer. When the other side sends it
+ * back, everything up to and including that buffer has been processed.
+ */
+static void send_ping(struct a12_state* S, uint32_t id, bool echo)
+{
+	uint8_t outb[CONTROL_PACKET_SIZE] = {0};
+	step_sequence(S, outb);
+	outb[16] = 0;
+	outb[17] = COMMAND_PING;
+	pack_u32(id, &outb[18]);
+	outb[22] = echo;
+	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+}
+
+static void command_ping(struct a12_state* S)
+{
+	uint32_t id;
+	unpack_u32(&id, &S->decode[18]);
+
+	if (!S->decode[22]){
+		send_ping(S, id, true);
+		return;
+	}
+
+	struct ping_slot* slot = &S->link.pings[id % PING_SLOTS];
+	if (slot->id != id || !slot->ts){
+		a12int_trace(A12_TRACE_TRANSFER, "kind=ping:status=unknown:id=%"PRIu32, id);
+		return;
+	}
+
+	uint64_t ts = a12int_now_ms();
+	unsigned rtt = ts - slot->ts;
+	S->link.rtt = S->link.known ? (7 * S->link.rtt + rtt) / 8 : rtt;
+	if (!S->link.known || rtt < S->link.rtt_min)
+		S->link.rtt_min = rtt;
+
+/* delivery rate since the last acknowledged ping, this will be too low if the
+ * producer had nothing to send (application limited) so only the max over the
+ * last few samples is used as the capacity estimate */
+	if (S->link.known && ts > S->link.last_ack && slot->b_out > S->link.b_acked){
+		size_t rate = (slot->b_out - S->link.b_acked) * 1000 / (ts - S->link.last_ack);
+		S->link.rate[S->link.rate_ind] = rate;
+		S->link.rate_ind = (S->link.rate_ind + 1) % RATE_SAMPLES;
+	}
+
+	if (slot->b_out > S->link.b_acked)
+		S->link.b_acked = slot->b_out;
+	S->link.last_ack = ts;
+	S->link.known = true;
+	slot->ts = 0;
+
+	a12int_trace(A12_TRACE_TRANSFER,
+		"kind=ping:id=%"PRIu32":rtt=%u:srtt=%u:acked=%zu",
+		id, rtt, S->link.rtt, S->link.b_acked
+	);
+}
+
 /*
  * Control command,
  * current MAC calculation in s->mac_dec
@@ -882,6 +1098,9 @@ static void process_control(struct a12_state* S, void (*on_event)
 	 * CRYPTO- fixme: Update keymaterial etc. here.
 	 * Verify that this is the first packet.
 	 */
+		unpack_u32(&S->remote_features, &S->decode[60]);
+		a12int_trace(A12_TRACE_SYSTEM,
+			"kind=hello:features=%"PRIx32, S->remote_features);
 	break;
 	case COMMAND_SHUTDOWN:
 	/* terminate specific channel */
@@ -892,11 +1111,11 @@ static void process_control(struct a12_state* S, void (*on_event)
 	case COMMAND_CANCELSTREAM:{
 		uint32_t streamid;
 		unpack_u32(&streamid, &S->decode[18]);
-		command_cancelstream(S, streamid);
+		command_cancelstream(S, streamid, S->decode[22]);
 	}
 	break;
 	case COMMAND_PING:
-		a12int_trace(A12_TRACE_MISSING, "Check ping packet");
+		command_ping(S);
 	break;
 	case COMMAND_VIDEOFRAME:
 		command_videoframe(S);
@@ -1130,7 +1349,11 @@ static void process_video(struct a12_state* S)
 		if (left == 0 && cvf->commit != 255){
 			a12int_trace(
 				A12_TRACE_VIDEO, "kind=decbuf:channel=%d:commit", (int)S->in_channel);
-			a12int_decode_vbuffer(S, cvf, cont);
+			struct a12_channel* ch = &S->channels[S->in_channel];
+			if (a12int_jitter_queue(ch, cvf, S->opts->jitter_buffer))
+				a12int_jitter_present(ch, S->opts->jitter_buffer, S->opts->worker_decode);
+			else if (!S->opts->worker_decode || !a12int_decode_vbuffer_async(ch, cvf, cont))
+				a12int_decode_vbuffer(ch, cvf, cont);
 		}
 
 		reset_state(S);
@@ -1147,11 +1370,25 @@ static void process_video(struct a12_state* S)
 		return;
 	}
 
-/* finally unpack the raw video buffer */
+/* finally unpack the raw video buffer, a compressed frame might still be
+ * on its way into the same segment */
+	a12int_decode_drain(&S->channels[S->in_channel]);
 	a12int_unpack_vbuffer(S, cvf, cont);
 	reset_state(S);
 }
 
+static void audio_sample(int16_t val, void* tag)
+{
+	struct arcan_shmif_cont* cont = tag;
+	cont->audp[cont->abufpos++] = SHMIF_AINT16(val);
+
+	if (cont->abufcount - cont->abufpos <= 1){
+		a12int_trace(A12_TRACE_AUDIO,
+			"forward %zu samples", (size_t) cont->abufpos);
+		arcan_shmif_signal(cont, SHMIF_SIGAUD);
+	}
+}
+
 static void process_audio(struct a12_state* S)
 {
 	if (!process_mac(S))
@@ -1184,6 +1421,7 @@ static void process_audio(struct a12_state* S)
 /* passed the header stage, now it's the data block, make sure the segment
  * has registered that it can provide audio */
 	if (!cont->audp){
+		a12int_decode_drain(&S->channels[S->in_channel]);
 		a12int_trace(A12_TRACE_AUDIO,
 			"frame-resize, rate: %"PRIu32", channels: %"PRIu8,
 			caf->rate, caf->channels
@@ -1203,30 +1441,24 @@ static void process_audio(struct a12_state* S)
  * to match the defined source format in a previous stage. Resampling
  * might be needed here, both for rate and for drift/buffer */
 	size_t samples_in = S->decode_pos >> 1;
-	size_t pos = 0;
 
+	if (caf->encoding == POSTPROCESS_AUDIO_ADPCM){
+		samples_in = a12int_decode_aadpcm(
+			caf, S->decode, S->decode_pos, audio_sample, cont);
+	}
 /* assumed s16, stereo for now, if the sender didn't align properly, shame */
-	while (samples_in > 1){
-		int16_t l, r;
-		unpack_s16(&l, &S->decode[pos]);
-		pos += 2;
-		unpack_s16(&r, &S->decode[pos]);
-		pos += 2;
-		cont->audp[cont->abufpos++] = SHMIF_AINT16(l);
-		cont->audp[cont->abufpos++] = SHMIF_AINT16(r);
-		samples_in -= 2;
-
-		if (cont->abufcount - cont->abufpos <= 1){
-			a12int_trace(A12_TRACE_AUDIO,
-				"forward %zu samples", (size_t) cont->abufpos);
-			arcan_shmif_signal(cont, SHMIF_SIGAUD);
+	else {
+		for (size_t pos = 0; pos + 1 < S->decode_pos; pos += 2){
+			int16_t val;
+			unpack_s16(&val, &S->decode[pos]);
+			audio_sample(val, cont);
 		}
 	}
 
 /* now we can subtract the number of SAMPLES from the audio stream
  * packet, when that reases zero we reset state, this incorrectly
  * assumes 2 channels though */
-	caf->nsamples -= S->decode_pos >> 1;
+	caf->nsamples = samples_in > caf->nsamples ? 0 : caf->nsamples - samples_in;
 	if (!caf->nsamples && cont->abufused){
 /* might also be a slush buffer left */
 		if (cont->abufused)
@@ -1246,6 +1478,7 @@ struct a12_state* S, struct arcan_shmif_cont* wnd, uint8_t chid)
 		return;
 	}
 
+	a12int_decode_drain(&S->channels[chid]);
 	S->channels[chid].cont = wnd;
 	S->channels[chid].active = wnd != NULL;
 }
@@ -1372,46 +1605,103 @@ static void unlink_node(struct a12_state* S, struct blob_out* node)
 	a12int_trace(A12_TRACE_ALLOC, "unlinked:stream=%"PRIu64, node->streamid);
 	*dst = next;
 	close(node->fd);
+
+	if (node->map)
+		munmap(node->map, node->map_sz);
+
 	free(node);
 }
 
+static void blob_header(struct a12_state* S, struct blob_out* node)
+{
+	uint8_t outb[CONTROL_PACKET_SIZE] = {0};
+	step_sequence(S, outb);
+	S->out_stream++;
+	outb[16] = node->chid;
+	outb[17] = COMMAND_BINARYSTREAM;
+	pack_u32(S->out_stream, &outb[18]); /* [18 .. 21] stream-id */
+	pack_u64(node->left, &outb[22]); /* [22 .. 29] total-size */
+	outb[30] = node->type;
+	/* 31..34 : id-token, ignored for now */
+	memcpy(&outb[35], node->checksum, 16);
+	a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+	node->active = true;
+	node->streamid = S->out_stream;
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=created:size=%zu:stream:%"PRIu64":ch=%d",
+		node->left, node->streamid, node->chid
+	);
+}
+
+/* the header of a checksummed transfer has been sent, wait until the other
+ * side has processed it (which includes any cancel it might send due to
+ * having it cached already) or it takes unreasonably long */
+static bool node_held(struct a12_state* S, struct blob_out* node)
+{
+	if (!node->hold_pos)
+		return false;
+
+	if (S->link.b_acked < node->hold_pos &&
+		a12int_now_ms() - node->hold_ts < BSTREAM_HOLD_MS)
+		return true;
+
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=release:stream=%"PRIu64":acked=%d", node->streamid,
+		(int)(S->link.b_acked >= node->hold_pos)
+	);
+	node->hold_pos = 0;
+	return false;
+}
+
 static size_t queue_node(struct a12_state* S, struct blob_out* node)
 {
+/* with a known checksum, hold the data until the header is acknowledged -
+ * only worth it if the other side will echo the ping and check its cache */
+	if (!node->active && !node->streaming &&
+		(S->remote_features & A12_FEATURE_BCACHE)){
+		blob_header(S, node);
+		node->hold_pos = S->link.b_out + S->buf_ofs;
+		node->hold_ts = a12int_now_ms();
+		S->link.b_hold = node->hold_pos;
+		return CONTROL_PACKET_SIZE;
+	}
+
 	uint16_t nts;
 	size_t cap = node->left;
 	if (cap == 0 || cap > 64096)
 		cap = 64096;
 
-	bool die;
-	void* buf = read_data(node->fd, cap, &nts, &die);
-	if (!buf){
-		/* MISSING: SEND STREAM CANCEL */
-		if (die){
+/* file-backed, pack straight from the mapping */
+	void* buf = NULL;
+	uint8_t* data;
+
+	if (node->mapped){
+		if (!blob_window(node, node->pos + node->left)){
+			a12int_trace(A12_TRACE_SYSTEM, "kind=error:status=EMMAP");
 			unlink_node(S, node);
+			return 0;
 		}
-		return 0;
+
+		size_t avail = node->map_ofs + node->map_sz - node->pos;
+		nts = avail > cap ? cap : avail;
+		data = &node->map[node->pos - node->map_ofs];
+	}
+	else {
+		bool die;
+		buf = read_data(node->fd, cap, &nts, &die);
+		if (!buf){
+			/* MISSING: SEND STREAM CANCEL */
+			if (die){
+				unlink_node(S, node);
+			}
+			return 0;
+		}
+		data = buf;
 	}
 
 /* not activated, so build a header first */
-	if (!node->active){
-		uint8_t outb[CONTROL_PACKET_SIZE] = {0};
-		step_sequence(S, outb);
-		S->out_stream++;
-		outb[16] = node->chid;
-		outb[17] = COMMAND_BINARYSTREAM;
-		pack_u32(S->out_stream, &outb[18]); /* [18 .. 21] stream-id */
-		pack_u64(node->left, &outb[22]); /* [22 .. 29] total-size */
-		outb[30] = node->type;
-		/* 31..34 : id-token, ignored for now */
-		memcpy(&outb[35], node->checksum, 16);
-		a12int_append_out(S, STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
-		node->active = true;
-		node->streamid = S->out_stream;
-		a12int_trace(A12_TRACE_BTRANSFER,
-			"kind=created:size=%zu:stream:%"PRIu64":ch=%d",
-			node->left, node->streamid, node->chid
-		);
-	}
+	if (!node->active)
+		blob_header(S, node);
 
 /* prepend the bstream header */
 	uint8_t outb[1 + 4 + 2];
@@ -1419,7 +1709,8 @@ static size_t queue_node(struct a12_state* S, struct blob_out* node)
 	pack_u32(node->streamid, &outb[1]);
 	pack_u16(nts, &outb[5]);
 
-	a12int_append_out(S, STATE_BLOB_PACKET, buf, nts, outb, sizeof(outb));
+	a12int_append_out(S, STATE_BLOB_PACKET, data, nts, outb, sizeof(outb));
+	node->pos += nts;
 
 	if (node->left){
 		node->left -= nts;
@@ -1445,22 +1736,35 @@ static size_t queue_node(struct a12_state* S, struct blob_out* node)
 	return nts;
 }
 
+/* the other side tracks one incoming transfer per channel, so a node can't
+ * start while an earlier one on the same channel is in flight */
+static bool channel_busy(struct a12_state* S, struct blob_out* node)
+{
+	for (struct blob_out* cur = S->pending; cur != node; cur = cur->next)
+		if (cur->chid == node->chid && cur->active)
+			return true;
+
+	return false;
+}
+
 static size_t append_blob(struct a12_state* S, int mode)
 {
-/* find suitable blob */
-	if (mode == A12_FLUSH_NOBLOB || !S->pending)
-		return 0;
-/* only current channel? */
-	else if (mode == A12_FLUSH_CHONLY){
-		struct blob_out* parent = S->pending;
-		while (parent){
-			if (parent->chid == S->out_channel)
-				return queue_node(S, parent);
-			parent = parent->next;
-		}
+	if (mode == A12_FLUSH_NOBLOB)
 		return 0;
+
+/* find suitable blob, one that is held back waiting for its header to be
+ * acknowledged shouldn't stall the transfers queued on other channels */
+	for (struct blob_out* cur = S->pending; cur; cur = cur->next){
+		if (mode == A12_FLUSH_CHONLY && cur->chid != S->out_channel)
+			continue;
+
+		if (node_held(S, cur) || channel_busy(S, cur))
+			continue;
+
+		return queue_node(S, cur);
 	}
-	return queue_node(S, S->pending);
+
+	return 0;
 }
 
 size_t
@@ -1470,15 +1774,39 @@ a12_flush(struct a12_state* S, uint8_t** buf, int allow_blob)
 		return 0;
 
 /* nothing in the outgoing buffer? then we can pull in whatever data transfer
- * is pending, if there are any queued */
+ * is pending, if there are any queued - or if the tail of what has already
+ * been sent is not covered by a ping, add one so that the sender can learn
+ * when the link has drained even when it is holding back new frames. The
+ * tail is only tracked above a small size so the echoes themselves do not
+ * keep an otherwise idle link busy. */
+	uint64_t ts = a12int_now_ms();
+	bool ping_due = ts - S->link.last_ping >= PING_INTERVAL_MS;
+
 	if (S->buf_ofs == 0){
 		if (allow_blob > A12_FLUSH_NOBLOB && append_blob(S, allow_blob)){}
-		else
+		else if (!ping_due || S->link.b_out - S->link.b_pinged < PING_MIN_TAIL)
 			return 0;
 	}
 
+/* tag the end of the buffer so that we know when it has been delivered, a
+ * held binary transfer header also needs to be covered right away */
+	if (ping_due || S->link.b_hold > S->link.b_pinged){
+		uint32_t id = ++S->link.ping_id;
+		send_ping(S, id, false);
+		S->link.b_pinged = S->link.b_out + S->buf_ofs;
+		S->link.pings[id % PING_SLOTS] = (struct ping_slot){
+			.id = id,
+			.ts = ts,
+			.b_out = S->link.b_pinged
+		};
+		S->link.last_ping = ts;
+		if (!S->link.first_ping)
+			S->link.first_ping = ts;
+	}
+
 	size_t rv = S->buf_ofs;
 	int old_ind = S->buf_ind;
+	S->link.b_out += rv;
 
 /* switch out "output buffer" and return how much there is to send, it is
  * expected that by the next non-0 returning channel_flush, its contents have
@@ -1491,6 +1819,45 @@ a12_flush(struct a12_state* S, uint8_t** buf, int allow_blob)
 	return rv;
 }
 
+struct a12_iostat
+a12_state_iostat(struct a12_state* S)
+{
+	if (!S || S->cookie != 0xfeedface)
+		return (struct a12_iostat){};
+
+	struct a12_iostat res = {
+		.b_out = S->link.b_out,
+		.b_acked = S->link.b_acked,
+		.b_pending = S->link.b_out - S->link.b_acked + S->buf_ofs,
+		.rtt_ms = S->link.rtt,
+		.rtt_min_ms = S->link.rtt_min,
+		.latency_target = S->opts->latency_target ?
+			S->opts->latency_target : DEFAULT_LATENCY_TARGET
+	};
+
+	for (size_t i = 0; i < RATE_SAMPLES; i++)
+		if (S->link.rate[i] > res.bps)
+			res.bps = S->link.rate[i];
+
+/* The queue can hold whatever the link is expected to deliver within the
+ * target, on top of what is needed to keep it busy for one round-trip. Until
+ * there is a rate estimate, stay within an initial window - unless the first
+ * ping takes too long to be answered, then the other end is likely too old to
+ * answer at all and there is nothing to estimate from. */
+	size_t limit = INITIAL_WINDOW;
+	if (res.bps){
+		limit = res.bps * (res.rtt_min_ms + res.latency_target) / 1000;
+		if (limit < 16384)
+			limit = 16384;
+	}
+	else if (!S->link.known &&
+		(!S->link.first_ping || a12int_now_ms() - S->link.first_ping >= PING_TIMEOUT_MS))
+		return res;
+
+	res.congested = res.b_pending > limit;
+	return res;
+}
+
 int
 a12_poll(struct a12_state* S)
 {
@@ -1500,6 +1867,23 @@ a12_poll(struct a12_state* S)
 	return S->left > 0 ? 1 : 0;
 }
 
+int
+a12_present(struct a12_state* S)
+{
+	if (!S || S->cookie != 0xfeedface || !S->opts->jitter_buffer)
+		return -1;
+
+	int next = -1;
+	for (size_t i = 0; i < 256; i++){
+		int left = a12int_jitter_present(&S->channels[i],
+			S->opts->jitter_buffer, S->opts->worker_decode);
+		if (left != -1 && (next == -1 || left < next))
+			next = left;
+	}
+
+	return next;
+}
+
 void
 a12_channel_new(struct a12_state* S,
 	uint8_t chid, uint8_t segkind, uint32_t cookie)
@@ -1523,6 +1907,17 @@ a12_set_channel(struct a12_state* S, uint8_t chid)
 	S->out_channel = chid;
 }
 
+/*
+ * Frames are stamped when they are handed to us rather than when the encoder
+ * is done with them, the receiver uses this to pace presentation and the
+ * encoding time would only add to the jitter. 0 is reserved for 'unknown'.
+ */
+static void stamp_out(struct a12_state* S)
+{
+	uint32_t ts = a12int_now_ms();
+	S->channels[S->out_channel].out_pts = ts ? ts : 1;
+}
+
 void
 a12_channel_aframe(struct a12_state* S,
 		shmif_asample* buf,
@@ -1535,12 +1930,31 @@ a12_channel_aframe(struct a12_state* S,
 
 /* use a fix size now as the outb- writer lacks queueing and interleaving */
 	size_t chunk_sz = 16428;
+	stamp_out(S);
 
 	a12int_trace(A12_TRACE_AUDIO,
 		"encode %zu samples @ %"PRIu32" Hz /%"PRIu8" ch",
 		n_samples, cfg.samplerate, cfg.channels
 	);
-	a12int_encode_araw(S, S->out_channel, buf, n_samples/2, cfg, opts, chunk_sz);
+
+/* Stay compressed for a while after the link was last seen congested, audio
+ * is a small part of the total so flapping between the two only adds noise */
+	if (opts.method == AFRAME_METHOD_ADAPTIVE){
+		struct a12_channel* ch = &S->channels[S->out_channel];
+		uint64_t ts = a12int_now_ms();
+
+		if (a12_state_iostat(S).congested)
+			ch->aenc.last_congested = ts;
+
+		opts.method = ch->aenc.last_congested &&
+			ts - ch->aenc.last_congested < AUDIO_CONGESTION_HOLD_MS ?
+			AFRAME_METHOD_ADPCM : AFRAME_METHOD_RAW;
+	}
+
+	if (opts.method == AFRAME_METHOD_ADPCM)
+		a12int_encode_aadpcm(S, S->out_channel, buf, n_samples/2, cfg, opts, chunk_sz);
+	else
+		a12int_encode_araw(S, S->out_channel, buf, n_samples/2, cfg, opts, chunk_sz);
 }
 
 /*
@@ -1556,6 +1970,7 @@ a12_channel_vframe(struct a12_state* S,
 
 /* use a fix size now as the outb- writer lacks queueing and interleaving */
 	size_t chunk_sz = 32768;
+	stamp_out(S);
 
 /* avoid dumb updates */
 	size_t x = 0, y = 0, w = vb->w, h = vb->h;
@@ -1616,7 +2031,10 @@ a12_channel_vframe(struct a12_state* S,
 		a12int_encode_h264(argstr);
 	break;
 	case VFRAME_METHOD_TPACK:
-		a12int_encode_tz(argstr);
+		if (S->remote_features & A12_FEATURE_DTZ)
+			a12int_encode_dtz(argstr);
+		else
+			a12int_encode_tz(argstr);
 	break;
 /*
  * FLIV and dav1d missing
@@ -1625,6 +2043,48 @@ a12_channel_vframe(struct a12_state* S,
 		a12int_trace(A12_TRACE_SYSTEM, "unknown format: %d\n", opts.method);
 	break;
 	}
+
+/* The DPNG accumulation buffer is only kept in synch with the other side by
+ * DPNG frames, so if another method was actually used (the caller can switch
+ * per frame, and h264 can fallback) the next DPNG frame has to be a full one */
+	struct a12_channel* ch = &S->channels[S->out_channel];
+	if (ch->vstats.method != VFRAME_METHOD_DPNG && ch->acc.buffer){
+		a12int_trace(A12_TRACE_VIDEO,
+			"kind=status:ch=%d:message=reset dpng accumulator", S->out_channel);
+		free(ch->acc.buffer);
+		free(ch->compression);
+		ch->acc.buffer = NULL;
+		ch->compression = NULL;
+	}
+
+/* same applies to the tpack cell grid */
+	if (ch->vstats.method != VFRAME_METHOD_TPACK && ch->tpack.front.cells){
+		a12int_tgrid_free(&ch->tpack.front);
+		a12int_tgrid_free(&ch->tpack.back);
+	}
+}
+
+struct a12_vframe_stats
+a12_channel_vstats(struct a12_state* S, uint8_t chid)
+{
+	if (!S || S->cookie != 0xfeedface)
+		return (struct a12_vframe_stats){};
+
+	return S->channels[chid].vstats;
+}
+
+struct a12_jitter_stats
+a12_channel_jstats(struct a12_state* S, uint8_t chid)
+{
+	if (!S || S->cookie != 0xfeedface)
+		return (struct a12_jitter_stats){};
+
+	struct a12_channel* ch = &S->channels[chid];
+	struct a12_jitter_stats res = ch->jitter.stats;
+	res.audio_clock = ch->jitter.audio &&
+		(uint32_t) a12int_now_ms() - ch->jitter.alocal < JITTER_AUDIO_MS;
+
+	return res;
 }
 
 bool
@@ -64,6 +64,30 @@ struct a12_context_options {
  * networks */
 	uint8_t authk[64];
 	bool disable_authenticity;
+
+/* Upper bound (in ms) for how much outgoing data, measured in estimated link
+ * capacity, can be queued before the state is considered congested. 0 uses
+ * the default (100ms), see a12_state_iostat. */
+	unsigned latency_target;
+
+/* Decode compressed video frames on a thread per channel rather than inline
+ * in a12_unpack. Completion is still in order per channel, but events and
+ * other channels don't have to wait for a large frame to be decompressed.
+ * The destination segments are then written to and signalled from those
+ * threads. */
+	bool worker_decode;
+
+/* Upper bound (in ms) for how long completed video frames can be held back on
+ * the receiving side so that they are presented at the pace they were produced
+ * rather than the pace they arrived in. The actual delay follows the measured
+ * jitter, see a12_present. 0 presents frames as soon as they are decoded. */
+	unsigned jitter_buffer;
+
+/* Set if the binary stream handler checks incoming transfers against a cache
+ * of its own (A12_BHANDLER_CACHED). This is announced to the other side which
+ * then holds back the data of a checksummed transfer until it knows whether
+ * it is wanted, at the cost of up to a round-trip before it starts. */
+	bool bstream_cache;
 };
 
 /*
@@ -202,6 +226,45 @@ a12_enqueue_bstream(
 int
 a12_poll(struct a12_state*);
 
+/*
+ * With a jitter buffer (see a12_context_options), decode and signal the video
+ * frames that have become due for presentation. Returns the number of ms
+ * until the next held frame is due or -1 if there is none. This should be
+ * called whenever the wait for new data times out, and the returned value be
+ * used as the upper bound for that wait.
+ */
+int
+a12_present(struct a12_state*);
+
+/*
+ * Link estimation and congestion state. The state machine periodically adds a
+ * PING to outgoing buffers in a12_flush, and the other side echoes it back
+ * when it has been processed. This provides round-trip time and the amount of
+ * data that has actually been delivered, which in turn gives an estimate of
+ * link capacity.
+ *
+ * [b_pending] covers everything that has been produced but not confirmed, so
+ * data in the a12 buffers, in the caller and in the kernel socket buffers.
+ *
+ * [congested] is set when [b_pending] exceeds what the link is estimated to
+ * be able to deliver within the latency target. Producers should then defer
+ * or skip frames. Before the first PING has been answered (or if the other
+ * end is too old to answer) the estimate is considered unknown, [bps] is 0
+ * and [congested] is never set.
+ */
+struct a12_iostat {
+	size_t b_out;
+	size_t b_acked;
+	size_t b_pending;
+	size_t bps;
+	unsigned rtt_ms;
+	unsigned rtt_min_ms;
+	unsigned latency_target;
+	bool congested;
+};
+struct a12_iostat
+a12_state_iostat(struct a12_state*);
+
 /*
  * For sessions that support multiplexing operations for multiple
  * channels, switch the active encoded channel to the specified ID.
@@ -285,8 +348,28 @@ struct a12_vframe_opts {
 	};
 };
 
+/*
+ * Feedback on the last video frame that was encoded on a channel, this is
+ * intended for the caller to pick encoding parameters for the next frame,
+ * e.g. to avoid spending time deflating something that doesn't compress.
+ * [method] is the method that was actually used, which may differ from the
+ * one requested through a12_vframe_opts due to encoder fallbacks.
+ */
+struct a12_vframe_stats {
+	enum a12_vframe_method method;
+	size_t w, h;
+	size_t bytes_in;
+	size_t bytes_out;
+};
+
 enum a12_aframe_method {
 	AFRAME_METHOD_RAW = 0,
+
+/* 4:1 compressed IMA-ADPCM, only for mono or stereo */
+	AFRAME_METHOD_ADPCM = 1,
+
+/* raw while the link keeps up, adpcm when it is congested */
+	AFRAME_METHOD_ADAPTIVE = 2
 };
 
 struct a12_aframe_opts {
@@ -385,6 +468,33 @@ a12_channel_vframe(
 	struct a12_vframe_opts opts
 );
 
+/* Retrieve the statistics for the last video frame encoded on [chid] */
+struct a12_vframe_stats
+a12_channel_vstats(struct a12_state* S, uint8_t chid);
+
+/*
+ * Receiving side presentation statistics for the jitter buffer on [chid].
+ *
+ * [late] frames arrived after the time they should have been presented at.
+ * [dropped] frames were decoded but replaced by a newer frame that was also
+ * due before they could be shown.
+ * [repeated] counts the frame intervals where the previous frame was left on
+ * screen for longer than the source intended due to nothing having arrived.
+ * [target_ms] is the current added delay and [audio_clock] is set if video
+ * is currently being paced by the audio on the same channel.
+ */
+struct a12_jitter_stats {
+	size_t presented;
+	size_t late;
+	size_t dropped;
+	size_t repeated;
+	unsigned jitter_ms;
+	unsigned target_ms;
+	bool audio_clock;
+};
+struct a12_jitter_stats
+a12_channel_jstats(struct a12_state* S, uint8_t chid);
+
 /*
  * Forward / start a new channel intended for the 'real' client. If this
  * comes as a NEWSEGMENT event from the 'real' arcan instance, make sure
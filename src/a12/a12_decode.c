@@ -10,9 +10,11 @@
 #include <inttypes.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "a12.h"
 #include "a12_int.h"
+#include "../shmif/tui/raster/raster_const.h"
 
 #ifdef LOG_FRAME_OUTPUT
 #define STB_IMAGE_WRITE_STATIC
@@ -27,14 +29,115 @@ bool a12int_buffer_format(int method)
 		method == POSTPROCESS_VIDEO_H264 ||
 		method == POSTPROCESS_VIDEO_MINIZ ||
 		method == POSTPROCESS_VIDEO_DMINIZ ||
-		method == POSTPROCESS_VIDEO_TZ;
+		method == POSTPROCESS_VIDEO_TZ ||
+		method == POSTPROCESS_VIDEO_DTZ;
 }
 
+/* standard IMA-ADPCM tables */
+static const int16_t adpcm_steps[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+	45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+	230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+	963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+	3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493,
+	10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+	27086, 29794, 32767
+};
+
+static const int8_t adpcm_index[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+int a12int_adpcm_stepsize(struct adpcm_state* st)
+{
+	return adpcm_steps[st->index];
+}
+
+int16_t a12int_adpcm_step(struct adpcm_state* st, uint8_t nibble)
+{
+	int step = adpcm_steps[st->index];
+	int diff = step >> 3;
+
+	if (nibble & 4)
+		diff += step;
+	if (nibble & 2)
+		diff += step >> 1;
+	if (nibble & 1)
+		diff += step >> 2;
+
+	int pred = st->pred + (nibble & 8 ? -diff : diff);
+	if (pred > 32767)
+		pred = 32767;
+	else if (pred < -32768)
+		pred = -32768;
+
+	int index = st->index + adpcm_index[nibble & 0x0f];
+	if (index < 0)
+		index = 0;
+	else if (index > 88)
+		index = 88;
+
+	st->pred = pred;
+	st->index = index;
+	return pred;
+}
+
+/*
+ * Unpack a chunk of an adpcm audio frame: a 4 byte state (predictor, step
+ * index, reserved) per channel followed by 4-bit samples in the same
+ * interleaved order as the raw format, low nibble first. Returns the number
+ * of samples that were decoded.
+ */
+size_t a12int_decode_aadpcm(struct audio_frame* caf,
+	uint8_t* buf, size_t buf_sz, void (*out)(int16_t, void*), void* tag)
+{
+	size_t channels = caf->channels;
+	if (!channels || channels > 2)
+		return 0;
+
+	size_t hdr_sz = channels * 4;
+	while (caf->adpcm_hdr_pos < hdr_sz && buf_sz){
+		caf->adpcm_hdr[caf->adpcm_hdr_pos++] = *buf++;
+		buf_sz--;
+
+		if (caf->adpcm_hdr_pos == hdr_sz){
+			for (size_t i = 0; i < channels; i++){
+				unpack_s16(&caf->adpcm[i].pred, &caf->adpcm_hdr[i * 4]);
+				caf->adpcm[i].index = caf->adpcm_hdr[i * 4 + 2];
+				if (caf->adpcm[i].index > 88)
+					caf->adpcm[i].index = 88;
+			}
+			caf->adpcm_ch = 0;
+		}
+	}
+
+/* an odd number of samples leaves a padding nibble at the end */
+	size_t count = 0;
+	for (size_t i = 0; i < buf_sz; i++){
+		for (size_t j = 0; j < 2 && count < caf->nsamples; j++){
+			uint8_t nibble = j ? buf[i] >> 4 : buf[i] & 0x0f;
+			out(a12int_adpcm_step(&caf->adpcm[caf->adpcm_ch], nibble), tag);
+			caf->adpcm_ch = (caf->adpcm_ch + 1) % channels;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/* the frame being decoded is not necessarily the one in the channel unpack
+ * state as it can be running on the channel worker */
+struct miniz_dst {
+	struct video_frame* cvf;
+	struct arcan_shmif_cont* cont;
+};
+
 static int video_miniz(const void* buf, int len, void* user)
 {
-	struct a12_state* S = user;
-	struct video_frame* cvf = &S->channels[S->in_channel].unpack_state.vframe;
-	struct arcan_shmif_cont* cont = S->channels[S->in_channel].cont;
+	struct miniz_dst* dst = user;
+	struct video_frame* cvf = dst->cvf;
+	struct arcan_shmif_cont* cont = dst->cont;
 	const uint8_t* inbuf = buf;
 
 	if (!cont || len > cvf->expanded_sz){
@@ -191,15 +294,221 @@ bool a12int_vframe_setup(struct a12_channel* ch, struct video_frame* dst, int me
 	return true;
 }
 
+static size_t tpack_line(uint8_t* dst,
+	uint16_t row, uint16_t ofs, uint16_t n, uint8_t* meta, uint8_t* cells)
+{
+	pack_u16(row, &dst[0]);
+	pack_u16(n, &dst[2]);
+	pack_u16(ofs, &dst[4]);
+	dst[6] = meta[0];
+	dst[7] = 0;
+	dst[8] = meta[1];
+	memcpy(&dst[9], cells, n * raster_cell_sz);
+	return raster_line_sz + n * raster_cell_sz;
+}
+
+/*
+ * Apply a tpack cell delta (see a12int_encode_dtz) to the channel grid and
+ * build the tpack buffer for the consumer. If the grid has been reset every
+ * row is forwarded as a full frame, otherwise only the runs that changed with
+ * the scroll (if any) passed on in the header so that the consumer can move
+ * what it has already drawn.
+ *
+ * The delta is validated before anything is applied. If it still fails, or
+ * a frame has been lost on the way (sequence gap), the grid is dropped so
+ * that later deltas are rejected until the encoder sends the next reset,
+ * rather than applied to a grid that has diverged.
+ */
+static bool decode_dtz(struct a12_channel* ch,
+	uint8_t* buf, size_t buf_sz, struct arcan_shmif_cont* cont)
+{
+	struct tpack_grid* G = &ch->tpack.front;
+	uint32_t data_sz;
+	uint16_t rows, cols, n_runs, seq;
+	int16_t scroll;
+
+	if (buf_sz < 21)
+		goto fail;
+
+	uint8_t* hdr = buf;
+	unpack_u32(&data_sz, &buf[0]);
+	unpack_u16(&rows, &buf[4]);
+	unpack_u16(&cols, &buf[6]);
+	unpack_u16(&n_runs, &buf[8]);
+	unpack_s16(&scroll, &buf[10]);
+	bool reset = buf[12] & 1;
+	unpack_u16(&seq, &buf[18]);
+
+	if (data_sz != buf_sz || abs(scroll) >= rows)
+		goto fail;
+
+/* the full frame has to fit the segment, that also bounds the grid size */
+	size_t row_sz = cols * 12;
+	size_t cap = cont->h * cont->stride;
+	if (22 + (size_t) rows * (9 + row_sz) > cap){
+		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=TPACK grid too large:"
+			"rows=%"PRIu16":cols=%"PRIu16":cap=%zu", rows, cols, cap);
+		goto fail;
+	}
+
+	if (!reset && (!G->cells || G->rows != rows || G->cols != cols)){
+		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=TPACK delta without grid");
+		goto fail;
+	}
+
+	if (!reset && seq != (uint16_t)(ch->tpack.seq + 1)){
+		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=TPACK delta lost:"
+			"seq=%"PRIu16":expected=%"PRIu16, seq, (uint16_t)(ch->tpack.seq + 1));
+		goto fail;
+	}
+
+	buf += 21;
+	buf_sz -= 21;
+
+	size_t part_sz = raster_hdr_sz + (scroll ? raster_hdr_scroll_sz : 0);
+	uint8_t* run = buf;
+	size_t left = buf_sz;
+
+	for (size_t i = 0; i < n_runs; i++){
+		uint16_t row, col, n;
+		if (left < 8)
+			goto fail;
+
+		unpack_u16(&row, &run[0]);
+		unpack_u16(&col, &run[2]);
+		unpack_u16(&n, &run[4]);
+
+		if (row >= rows || !n || col + n > cols || left - 8 < n * 12)
+			goto fail;
+
+		part_sz += raster_line_sz + n * raster_cell_sz;
+		run += 8 + n * 12;
+		left -= 8 + n * 12;
+	}
+
+	if (reset && !a12int_tgrid_resize(G, rows, cols))
+		goto fail;
+
+	if (scroll > 0){
+		memmove(G->cells, &G->cells[scroll * row_sz], (rows - scroll) * row_sz);
+		memmove(G->lines, &G->lines[scroll * 2], (rows - scroll) * 2);
+		memset(&G->cells[(rows - scroll) * row_sz], '\0', scroll * row_sz);
+		memset(&G->lines[(rows - scroll) * 2], '\0', scroll * 2);
+	}
+	else if (scroll < 0){
+		memmove(&G->cells[-scroll * row_sz], G->cells, (rows + scroll) * row_sz);
+		memmove(&G->lines[-scroll * 2], G->lines, (rows + scroll) * 2);
+		memset(G->cells, '\0', -scroll * row_sz);
+		memset(G->lines, '\0', -scroll * 2);
+	}
+
+/* many short runs can take more space than all the rows, go full then. The
+ * consumer also needs all of it if the last frame wasn't signalled, as that
+ * one has been overwritten */
+	bool full = reset || part_sz > cap || ch->tpack.unsent;
+	ch->tpack.seq = seq;
+
+/* the scroll fields are only carried (RPACK_SCROLL) by a delta that scrolls, so
+ * that a consumer which predates them can still use the others */
+	bool has_scroll = !full && scroll;
+	size_t hdr_sz = raster_hdr_sz + (has_scroll ? raster_hdr_scroll_sz : 0);
+	uint8_t* out = cont->vidb;
+	size_t pos = hdr_sz;
+	size_t n_cells = 0;
+
+	for (size_t i = 0; i < n_runs; i++){
+		uint16_t row, col, n;
+		unpack_u16(&row, &buf[0]);
+		unpack_u16(&col, &buf[2]);
+		unpack_u16(&n, &buf[4]);
+
+		memcpy(&G->lines[row * 2], &buf[6], 2);
+		memcpy(&G->cells[row * row_sz + col * 12], &buf[8], n * 12);
+
+		if (!full){
+			pos += tpack_line(&out[pos], row, col, n, &buf[6], &buf[8]);
+			n_cells += n;
+		}
+
+		buf += 8 + n * 12;
+	}
+
+	if (full){
+		for (size_t row = 0; row < rows; row++)
+			pos += tpack_line(&out[pos],
+				row, 0, cols, &G->lines[row * 2], &G->cells[row * row_sz]);
+		n_cells = rows * cols;
+	}
+
+/* same header as the source would have produced, bgc and cursor state are
+ * carried in the delta header */
+	pack_u32(pos, &out[0]);
+	pack_u16(full ? rows : n_runs, &out[4]);
+	pack_u16(n_cells, &out[6]);
+	out[8] = hdr[20];
+	pack_u16((full ? RPACK_IFRAME : RPACK_DFRAME) |
+		(has_scroll ? RPACK_SCROLL : 0), &out[9]);
+	memcpy(&out[11], &hdr[14], 4);
+	out[15] = hdr[13];
+
+	if (has_scroll){
+		pack_s16(scroll, &out[16]);
+		pack_u16(0, &out[18]);
+		pack_u16(rows - 1, &out[20]);
+	}
+
+	return true;
+
+fail:
+	a12int_tgrid_free(G);
+	return false;
+}
+
 void a12int_decode_vbuffer(
-	struct a12_state* S, struct video_frame* cvf, struct arcan_shmif_cont* cont)
+	struct a12_channel* ch, struct video_frame* cvf, struct arcan_shmif_cont* cont)
 {
 	a12int_trace(A12_TRACE_VIDEO, "decode vbuffer, method: %d", cvf->postprocess);
-	if (cvf->postprocess == POSTPROCESS_VIDEO_MINIZ ||
+	if (cvf->postprocess == POSTPROCESS_VIDEO_DTZ){
+/* the size comes from the other side, a delta is never larger than the full
+ * tpack buffer it describes and that one has to fit the segment */
+		uint8_t* buf = NULL;
+		size_t out_sz = TINFL_DECOMPRESS_MEM_TO_MEM_FAILED;
+
+		if (cvf->expanded_sz <= (size_t) cont->h * cont->stride)
+			buf = malloc(cvf->expanded_sz);
+		else
+			a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=TPACK delta too large:"
+				"size=%"PRIu32, cvf->expanded_sz);
+
+		if (buf)
+			out_sz = tinfl_decompress_mem_to_mem(
+				buf, cvf->expanded_sz, cvf->inbuf, cvf->inbuf_pos, 0);
+
+		if (out_sz != cvf->expanded_sz ||
+			!decode_dtz(ch, buf, out_sz, cont)){
+			a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=corrupt TPACK delta");
+			a12int_tgrid_free(&ch->tpack.front);
+			cvf->commit = 255;
+		}
+		else
+			ch->tpack.unsent = !cvf->commit;
+
+		free(buf);
+		free(cvf->inbuf);
+		cvf->inbuf = NULL;
+
+		if (cvf->commit && cvf->commit != 255){
+			arcan_shmif_signal(cont, SHMIF_SIGVID);
+			cvf->commit = 0;
+		}
+		return;
+	}
+	else if (cvf->postprocess == POSTPROCESS_VIDEO_MINIZ ||
 			cvf->postprocess == POSTPROCESS_VIDEO_DMINIZ ||
 			cvf->postprocess == POSTPROCESS_VIDEO_TZ){
 		size_t inbuf_pos = cvf->inbuf_pos;
-		tinfl_decompress_mem_to_callback(cvf->inbuf, &inbuf_pos, video_miniz, S, 0);
+		struct miniz_dst dst = {.cvf = cvf, .cont = cont};
+		tinfl_decompress_mem_to_callback(cvf->inbuf, &inbuf_pos, video_miniz, &dst, 0);
 
 		a12int_trace(A12_TRACE_ALLOC, "freeing zlib/png input block");
 		free(cvf->inbuf);
@@ -277,6 +586,360 @@ out_h264:
  * that could offset the need to 'negotiate' */
 }
 
+/*
+ * Per-channel decode worker: the parser hands over a completed compressed
+ * frame and goes back to demultiplexing, one frame at a time per channel so
+ * that they complete (and get signalled) in the order they arrived.
+ */
+struct a12_worker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+
+	struct a12_channel* ch;
+	struct arcan_shmif_cont* cont;
+	struct video_frame job;
+
+	bool pending;
+	bool shutdown;
+};
+
+static void* decode_worker(void* arg)
+{
+	struct a12_worker* W = arg;
+
+	pthread_mutex_lock(&W->lock);
+	for (;;){
+		while (!W->pending && !W->shutdown)
+			pthread_cond_wait(&W->cond, &W->lock);
+
+		if (!W->pending)
+			break;
+
+		pthread_mutex_unlock(&W->lock);
+			a12int_decode_vbuffer(W->ch, &W->job, W->cont);
+		pthread_mutex_lock(&W->lock);
+
+		W->pending = false;
+		pthread_cond_broadcast(&W->cond);
+	}
+	pthread_mutex_unlock(&W->lock);
+
+	return NULL;
+}
+
+static struct a12_worker* worker_setup(struct a12_channel* ch)
+{
+	struct a12_worker* W = malloc(sizeof(struct a12_worker));
+	if (!W)
+		return NULL;
+
+	*W = (struct a12_worker){
+		.ch = ch
+	};
+
+	pthread_mutex_init(&W->lock, NULL);
+	pthread_cond_init(&W->cond, NULL);
+
+	if (0 != pthread_create(&W->thread, NULL, decode_worker, W)){
+		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=couldn't spawn decoder");
+		pthread_mutex_destroy(&W->lock);
+		pthread_cond_destroy(&W->cond);
+		free(W);
+		return NULL;
+	}
+
+	a12int_trace(A12_TRACE_ALLOC, "kind=decode_worker:status=spawned");
+	return W;
+}
+
+static int jitter_step(struct a12_channel*, unsigned, bool, bool);
+
+void a12int_decode_drain(struct a12_channel* ch)
+{
+	struct a12_worker* W = ch->worker;
+	if (W){
+		pthread_mutex_lock(&W->lock);
+		while (W->pending)
+			pthread_cond_wait(&W->cond, &W->lock);
+		pthread_mutex_unlock(&W->lock);
+	}
+
+/* anything held for presentation has to go in before the segment changes */
+	if (ch->jitter.count)
+		jitter_step(ch, 0, false, true);
+}
+
+bool a12int_decode_vbuffer_async(
+	struct a12_channel* ch, struct video_frame* cvf, struct arcan_shmif_cont* cont)
+{
+	if (!ch->worker && !(ch->worker = worker_setup(ch)))
+		return false;
+
+	struct a12_worker* W = ch->worker;
+	pthread_mutex_lock(&W->lock);
+	while (W->pending)
+		pthread_cond_wait(&W->cond, &W->lock);
+
+/* the worker takes over the input buffer */
+	W->job = *cvf;
+	W->cont = cont;
+	W->pending = true;
+	cvf->inbuf = NULL;
+
+	pthread_cond_broadcast(&W->cond);
+	pthread_mutex_unlock(&W->lock);
+
+	return true;
+}
+
+void a12int_decode_free(struct a12_channel* ch)
+{
+	for (; ch->jitter.count; ch->jitter.count--){
+		free(ch->jitter.queue[ch->jitter.head].vf.inbuf);
+		ch->jitter.head = (ch->jitter.head + 1) % JITTER_QUEUE;
+	}
+
+	struct a12_worker* W = ch->worker;
+	if (!W)
+		return;
+
+	pthread_mutex_lock(&W->lock);
+	W->shutdown = true;
+	pthread_cond_broadcast(&W->cond);
+	pthread_mutex_unlock(&W->lock);
+
+	pthread_join(W->thread, NULL);
+	pthread_mutex_destroy(&W->lock);
+	pthread_cond_destroy(&W->cond);
+	free(W);
+	ch->worker = NULL;
+}
+
+/*
+ * [JITTER BUFFER]
+ * Completed frames are queued and decoded when their presentation time comes
+ * up rather than when their last byte arrives. The timestamps are on the clock
+ * of the sender, so the presentation time is the timestamp shifted by the
+ * smallest transit time seen in the last window or two (clock offset and base
+ * link latency) and a target delay that follows the measured jitter. If the
+ * channel carries audio, the audio clock is used instead so that video lines
+ * up with what is being played back.
+ *
+ * Everything is in 32-bit ms with wrapping arithmetic as the offset between
+ * the two clocks is arbitrary.
+ */
+static uint32_t jitter_base(struct a12_channel* ch)
+{
+	return (int32_t)(ch->jitter.prev_min - ch->jitter.win_min) < 0 ?
+		ch->jitter.prev_min : ch->jitter.win_min;
+}
+
+/* the smoothed estimate misses delay that builds up over several frames (a
+ * burst after a stall), so the target also covers the worst seen recently */
+static uint32_t jitter_target(struct a12_channel* ch, unsigned max)
+{
+	uint32_t top = ch->jitter.win_max;
+	if ((int32_t)(ch->jitter.prev_max - top) > 0)
+		top = ch->jitter.prev_max;
+
+	uint32_t target = top - jitter_base(ch);
+	if (target < 3 * (ch->jitter.jitter >> 4))
+		target = 3 * (ch->jitter.jitter >> 4);
+
+	return target > max ? max : target;
+}
+
+static bool jitter_audio_clock(struct a12_channel* ch, uint32_t now)
+{
+	return ch->jitter.audio && now - ch->jitter.alocal < JITTER_AUDIO_MS;
+}
+
+static uint32_t jitter_due(
+	struct a12_channel* ch, struct jitter_frame* f, uint32_t now, unsigned max)
+{
+	uint32_t pts = f->vf.pts;
+
+/* the audio sent at [apts] is being played back around [alocal], but don't
+ * let diverging audio and video clocks hold a frame for longer than [max] */
+	if (jitter_audio_clock(ch, now)){
+		uint32_t due = ch->jitter.alocal + (pts - ch->jitter.apts);
+		if ((int32_t)(due - (f->arrived + max)) > 0)
+			due = f->arrived + max;
+		return due;
+	}
+
+	return pts + jitter_base(ch) + jitter_target(ch, max);
+}
+
+static void jitter_sample(struct a12_channel* ch, uint32_t pts, uint32_t now)
+{
+	uint32_t transit = now - pts;
+
+	if (!ch->jitter.samples){
+		ch->jitter.last_transit = transit;
+		ch->jitter.win_min = ch->jitter.prev_min = transit;
+		ch->jitter.win_max = ch->jitter.prev_max = transit;
+		ch->jitter.win_start = now;
+		ch->jitter.last_pts = pts;
+	}
+
+	int32_t d = transit - ch->jitter.last_transit;
+	if (d < 0)
+		d = -d;
+	ch->jitter.jitter += d - ((ch->jitter.jitter + 8) >> 4);
+	ch->jitter.last_transit = transit;
+
+/* the source interval is only used to tell a repeat from an idle source */
+	int32_t dp = pts - ch->jitter.last_pts;
+	if (dp > 0 && dp < 1000){
+		if (!ch->jitter.interval)
+			ch->jitter.interval = dp << 4;
+		else
+			ch->jitter.interval += dp - ((ch->jitter.interval + 8) >> 4);
+	}
+	ch->jitter.last_pts = pts;
+
+	if ((int32_t)(transit - ch->jitter.win_min) < 0)
+		ch->jitter.win_min = transit;
+	if ((int32_t)(transit - ch->jitter.win_max) > 0)
+		ch->jitter.win_max = transit;
+
+	if (now - ch->jitter.win_start > JITTER_WINDOW_MS){
+		ch->jitter.prev_min = ch->jitter.win_min;
+		ch->jitter.prev_max = ch->jitter.win_max;
+		ch->jitter.win_min = ch->jitter.win_max = transit;
+		ch->jitter.win_start = now;
+	}
+
+	ch->jitter.samples++;
+}
+
+static void jitter_show(
+	struct a12_channel* ch, struct jitter_frame* f, uint32_t now, bool async)
+{
+	struct arcan_shmif_cont* cont = ch->cont;
+	if (!cont){
+		free(f->vf.inbuf);
+		f->vf.inbuf = NULL;
+		return;
+	}
+
+	if (!f->vf.commit){
+		if (!async || !a12int_decode_vbuffer_async(ch, &f->vf, cont))
+			a12int_decode_vbuffer(ch, &f->vf, cont);
+		return;
+	}
+
+/* the previous frame stayed up for longer than the source intended */
+	uint32_t iv = ch->jitter.interval >> 4;
+	if (ch->jitter.stats.presented && iv){
+		int32_t over = (now - ch->jitter.shown_ts) - (f->vf.pts - ch->jitter.shown_pts);
+		if (over > (int32_t) iv){
+			ch->jitter.stats.repeated += over / iv;
+			a12int_trace(A12_TRACE_VDETAIL,
+				"kind=jitter:status=repeat:count=%"PRIu32, (uint32_t)(over / iv));
+		}
+	}
+
+	ch->jitter.shown_ts = now;
+	ch->jitter.shown_pts = f->vf.pts;
+	ch->jitter.stats.presented++;
+
+	if (!async || !a12int_decode_vbuffer_async(ch, &f->vf, cont))
+		a12int_decode_vbuffer(ch, &f->vf, cont);
+}
+
+/*
+ * Present everything that is due (or all of it with [flush]). Only the newest
+ * of the due frames is signalled, the ones before it are still decoded as the
+ * delta formats build on them.
+ */
+static int jitter_step(
+	struct a12_channel* ch, unsigned max, bool async, bool flush)
+{
+	uint32_t now = (uint32_t) a12int_now_ms();
+	size_t n_due = 0;
+	int next = -1;
+
+	for (size_t i = 0; i < ch->jitter.count; i++){
+		struct jitter_frame* f = &ch->jitter.queue[(ch->jitter.head + i) % JITTER_QUEUE];
+		int32_t left = jitter_due(ch, f, now, max) - now;
+		if (!flush && left > 0){
+			next = left;
+			break;
+		}
+		n_due = i + 1;
+	}
+
+	for (size_t i = 0; i < n_due; i++){
+		struct jitter_frame* f = &ch->jitter.queue[ch->jitter.head];
+		ch->jitter.head = (ch->jitter.head + 1) % JITTER_QUEUE;
+		ch->jitter.count--;
+
+		if (i < n_due - 1 && f->vf.commit){
+			f->vf.commit = 0;
+			ch->jitter.stats.dropped++;
+			a12int_trace(A12_TRACE_VDETAIL, "kind=jitter:status=drop:pts=%"PRIu32, f->vf.pts);
+		}
+
+		jitter_show(ch, f, now, async);
+	}
+
+	return next;
+}
+
+bool a12int_jitter_queue(
+	struct a12_channel* ch, struct video_frame* cvf, unsigned max)
+{
+	if (!max || !cvf->pts)
+		return false;
+
+/* out of room means the target is way off, catch up with what we have */
+	if (ch->jitter.count == JITTER_QUEUE)
+		a12int_decode_drain(ch);
+
+	uint32_t now = (uint32_t) a12int_now_ms();
+	jitter_sample(ch, cvf->pts, now);
+	ch->jitter.stats.jitter_ms = ch->jitter.jitter >> 4;
+	ch->jitter.stats.target_ms = jitter_target(ch, max);
+
+	struct jitter_frame* f =
+		&ch->jitter.queue[(ch->jitter.head + ch->jitter.count) % JITTER_QUEUE];
+	f->vf = *cvf;
+	f->arrived = now;
+	cvf->inbuf = NULL;
+	ch->jitter.count++;
+
+/* within half a frame of its slot still means it is shown in that slot */
+	int32_t late = now - jitter_due(ch, f, now, max);
+	if (late > (int32_t)(ch->jitter.interval >> 5)){
+		ch->jitter.stats.late++;
+		a12int_trace(A12_TRACE_VDETAIL,
+			"kind=jitter:status=late:pts=%"PRIu32":ms=%"PRId32, cvf->pts, late);
+	}
+
+	return true;
+}
+
+int a12int_jitter_present(struct a12_channel* ch, unsigned max, bool async)
+{
+	if (!ch->jitter.count)
+		return -1;
+
+	return jitter_step(ch, max, async, false);
+}
+
+void a12int_jitter_audio(struct a12_channel* ch, uint32_t pts)
+{
+	if (!pts)
+		return;
+
+	ch->jitter.apts = pts;
+	ch->jitter.alocal = (uint32_t) a12int_now_ms();
+	ch->jitter.audio = true;
+}
+
 void a12int_unpack_vbuffer(struct a12_state* S,
 	struct video_frame* cvf, struct arcan_shmif_cont* cont)
 {
@@ -10,7 +10,54 @@ bool a12int_buffer_format(int method);
 bool a12int_vframe_setup(struct a12_channel* ch, struct video_frame* dst, int method);
 
 void a12int_decode_vbuffer(
-	struct a12_state* S, struct video_frame*, struct arcan_shmif_cont*);
+	struct a12_channel* ch, struct video_frame*, struct arcan_shmif_cont*);
+
+/*
+ * Queue a completed frame for decoding on the channel worker thread, taking
+ * over its input buffer. This blocks until any previous frame on the channel
+ * has been completed. Returns false if no worker could be set up, then the
+ * frame should be decoded inline instead.
+ */
+bool a12int_decode_vbuffer_async(
+	struct a12_channel* ch, struct video_frame*, struct arcan_shmif_cont*);
+
+/*
+ * Wait for the channel worker (if any) to finish its current frame and push
+ * out any frames held for presentation, needed before anything else touches
+ * the destination segment.
+ */
+void a12int_decode_drain(struct a12_channel* ch);
+
+/*
+ * Queue a completed frame until its presentation time, taking over its input
+ * buffer. Returns false if the frame has no timestamp or the buffer is
+ * disabled ([max] is 0), then it should be decoded immediately.
+ */
+bool a12int_jitter_queue(
+	struct a12_channel* ch, struct video_frame* cvf, unsigned max);
+
+/*
+ * Decode and signal the queued frames that are due, returns the number of ms
+ * until the next one is or -1 if the queue is empty.
+ */
+int a12int_jitter_present(struct a12_channel* ch, unsigned max, bool async);
+
+/*
+ * Audio with timestamp [pts] is being forwarded on the channel.
+ */
+void a12int_jitter_audio(struct a12_channel* ch, uint32_t pts);
+
+/*
+ * Stop and release the channel worker (if any), held frames are discarded.
+ */
+void a12int_decode_free(struct a12_channel* ch);
+
+/*
+ * Decode [buf] as part of an adpcm encoded audio frame, forwarding each
+ * sample to [out]. Returns the number of samples decoded.
+ */
+size_t a12int_decode_aadpcm(struct audio_frame* caf,
+	uint8_t* buf, size_t buf_sz, void (*out)(int16_t, void*), void* tag);
 
 void a12int_unpack_vbuffer(
 	struct a12_state* S, struct video_frame* cvf, struct arcan_shmif_cont* cont);
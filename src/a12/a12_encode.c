@@ -14,12 +14,13 @@
 #include "a12.h"
 #include "a12_int.h"
 #include "a12_encode.h"
+#include "../shmif/tui/raster/raster_const.h"
 
 /*
  * create the control packet
  */
 static void a12int_vframehdr_build(uint8_t buf[CONTROL_PACKET_SIZE],
-	uint64_t last_seen, uint8_t chid,
+	uint64_t last_seen, uint32_t pts, uint8_t chid,
 	int type, uint32_t sid,
 	uint16_t sw, uint16_t sh, uint16_t w, uint16_t h, uint16_t x, uint16_t y,
 	uint32_t len, uint32_t exp_len, bool commit)
@@ -51,6 +52,23 @@ static void a12int_vframehdr_build(uint8_t buf[CONTROL_PACKET_SIZE],
 /* [40] Commit on completion, this is always set right now but will change
  * when 'chain of deltas' mode for shmif is added */
 	buf[44] = commit;
+	pack_u32(pts, &buf[45]); /* [45..48] : timestamp */
+}
+
+/*
+ * track how the last frame on a channel turned out so the caller can adjust
+ * encoding parameters, see a12_channel_vstats
+ */
+static void set_vstats(struct a12_state* S, uint8_t chid,
+	enum a12_vframe_method method, size_t w, size_t h, size_t in, size_t out)
+{
+	S->channels[chid].vstats = (struct a12_vframe_stats){
+		.method = method,
+		.w = w,
+		.h = h,
+		.bytes_in = in,
+		.bytes_out = out
+	};
 }
 
 /*
@@ -85,10 +103,11 @@ void a12int_encode_araw(struct a12_state* S,
 	struct a12_aframe_cfg cfg,
 	struct a12_aframe_opts opts, size_t chunk_sz)
 {
-/* repack the audio into a temporary buffer for format reasons */
-	size_t hdr_sz = a12int_header_size(STATE_AUDIO_PACKET);
-	size_t buf_sz = hdr_sz + n_samples * sizeof(uint16_t) * cfg.channels;
-	uint8_t* outb = malloc(hdr_sz + buf_sz);;
+/* repack the audio into a temporary buffer for format reasons, the control
+ * packet goes first so that the samples don't overwrite it */
+	size_t hdr_sz = CONTROL_PACKET_SIZE;
+	size_t buf_sz = n_samples * sizeof(uint16_t);
+	uint8_t* outb = malloc(hdr_sz + buf_sz);
 	if (!outb){
 		a12int_trace(A12_TRACE_ALLOC,
 			"failed to alloc %zu for s16aud", buf_sz);
@@ -96,12 +115,15 @@ void a12int_encode_araw(struct a12_state* S,
 	}
 
 /* audio control message header */
+	memset(outb, '\0', hdr_sz);
 	outb[16] = chid;
 	outb[17] = COMMAND_AUDIOFRAME;
 	pack_u32(0, &outb[18]); /* stream-id */
 	outb[22] = cfg.channels; /* channels */
-	outb[23] = 0; /* encoding, u16 */
+	outb[23] = POSTPROCESS_AUDIO_RAW; /* encoding, u16 */
 	pack_u16(n_samples, &outb[24]);
+	pack_u32(cfg.samplerate, &outb[26]);
+	pack_u32(S->channels[chid].out_pts, &outb[30]);
 
 /* repack into the right format (note, need _Generic on asample) */
 	size_t pos = hdr_sz;
@@ -116,6 +138,91 @@ void a12int_encode_araw(struct a12_state* S,
 	free(outb);
 }
 
+/*
+ * IMA-ADPCM, 4 bits per sample with the predictor state of each channel
+ * carried first so that every frame can be decoded on its own. The state
+ * continues from the previous frame as that avoids the discontinuity from
+ * restarting the predictor.
+ */
+void a12int_encode_aadpcm(struct a12_state* S,
+	uint8_t chid,
+	shmif_asample* buf,
+	uint16_t n_samples,
+	struct a12_aframe_cfg cfg,
+	struct a12_aframe_opts opts, size_t chunk_sz)
+{
+	size_t channels = cfg.channels;
+	if (!channels || channels > 2){
+		a12int_encode_araw(S, chid, buf, n_samples, cfg, opts, chunk_sz);
+		return;
+	}
+
+	struct adpcm_state* st = S->channels[chid].aenc.adpcm;
+	size_t buf_sz = channels * 4 + (n_samples + 1) / 2;
+	uint8_t* outb = malloc(CONTROL_PACKET_SIZE + buf_sz);
+	if (!outb){
+		a12int_trace(A12_TRACE_ALLOC,
+			"failed to alloc %zu for adpcm", buf_sz);
+		return;
+	}
+
+	memset(outb, '\0', CONTROL_PACKET_SIZE);
+	outb[16] = chid;
+	outb[17] = COMMAND_AUDIOFRAME;
+	pack_u32(0, &outb[18]); /* stream-id */
+	outb[22] = cfg.channels; /* channels */
+	outb[23] = POSTPROCESS_AUDIO_ADPCM; /* encoding */
+	pack_u16(n_samples, &outb[24]);
+	pack_u32(cfg.samplerate, &outb[26]);
+	pack_u32(S->channels[chid].out_pts, &outb[30]);
+
+	uint8_t* data = &outb[CONTROL_PACKET_SIZE];
+	for (size_t i = 0; i < channels; i++){
+		pack_s16(st[i].pred, &data[i * 4]);
+		data[i * 4 + 2] = st[i].index;
+		data[i * 4 + 3] = 0;
+	}
+
+	size_t pos = channels * 4;
+	for (size_t i = 0; i < n_samples; i++){
+		struct adpcm_state* cst = &st[i % channels];
+		int step = a12int_adpcm_stepsize(cst);
+		int diff = (int) buf[i] - cst->pred;
+		uint8_t nibble = 0;
+
+		if (diff < 0){
+			nibble = 8;
+			diff = -diff;
+		}
+		if (diff >= step){
+			nibble |= 4;
+			diff -= step;
+		}
+		if (diff >= step >> 1){
+			nibble |= 2;
+			diff -= step >> 1;
+		}
+		if (diff >= step >> 2)
+			nibble |= 1;
+
+/* track what the decoder will reconstruct, not the source sample */
+		a12int_adpcm_step(cst, nibble);
+
+		if (i % 2)
+			data[pos++] |= nibble << 4;
+		else
+			data[pos] = nibble;
+	}
+
+	a12int_trace(A12_TRACE_AUDIO,
+		"kind=status:codec=adpcm:samples=%zu:b_out=%zu", (size_t) n_samples, buf_sz);
+
+	a12int_append_out(S,
+		STATE_CONTROL_PACKET, outb, CONTROL_PACKET_SIZE, NULL, 0);
+	chunk_pack(S, STATE_AUDIO_PACKET, chid, data, buf_sz, chunk_sz);
+	free(outb);
+}
+
 /*
  * the rgb565, rgb and rgba function all follow the same pattern
  */
@@ -142,12 +249,14 @@ void a12int_encode_rgb565(PACK_ARGS)
 
 /* store the control frame that defines our video buffer */
 	uint8_t hdr_buf[CONTROL_PACKET_SIZE];
-	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr, chid,
+	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+		S->channels[chid].out_pts, chid,
 		POSTPROCESS_VIDEO_RGB565, 0, vb->w, vb->h, w, h, x, y,
 		w * h * px_sz, w * h * px_sz, 1
 	);
 	a12int_append_out(S,
 		STATE_CONTROL_PACKET, hdr_buf, CONTROL_PACKET_SIZE, NULL, 0);
+	set_vstats(S, chid, VFRAME_METHOD_RAW_RGB565, w, h, w * h * 4, w * h * px_sz);
 
 	outb[0] = chid; /* [0] : channel id */
 	pack_u32(0xbacabaca, &outb[1]); /* [1..4] : stream */
@@ -223,12 +332,14 @@ void a12int_encode_rgba(PACK_ARGS)
 
 /* store the control frame that defines our video buffer */
 	uint8_t hdr_buf[CONTROL_PACKET_SIZE];
-	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr, chid,
+	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+		S->channels[chid].out_pts, chid,
 		POSTPROCESS_VIDEO_RGBA, 0, vb->w, vb->h, w, h, x, y,
 		w * h * px_sz, w * h * px_sz, 1
 	);
 	a12int_append_out(S,
 		STATE_CONTROL_PACKET, hdr_buf, CONTROL_PACKET_SIZE, NULL, 0);
+	set_vstats(S, chid, VFRAME_METHOD_NORMAL, w, h, w * h * 4, w * h * px_sz);
 
 	outb[0] = chid; /* [0] : channel id */
 	pack_u32(0xbacabaca, &outb[1]); /* [1..4] : stream */
@@ -293,12 +404,14 @@ void a12int_encode_rgb(PACK_ARGS)
 
 /* store the control frame that defines our video buffer */
 	uint8_t hdr_buf[CONTROL_PACKET_SIZE];
-	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr, chid,
+	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+		S->channels[chid].out_pts, chid,
 		POSTPROCESS_VIDEO_RGB, 0, vb->w, vb->h, w, h, x, y,
 		w * h * px_sz, w * h * px_sz, 1
 	);
 	a12int_append_out(S,
 		STATE_CONTROL_PACKET, hdr_buf, CONTROL_PACKET_SIZE, NULL, 0);
+	set_vstats(S, chid, VFRAME_METHOD_RAW_NOALPHA, w, h, w * h * 4, w * h * px_sz);
 
 	outb[0] = chid; /* [0] : channel id */
 	pack_u32(0xbacabaca, &outb[1]); /* [1..4] : stream */
@@ -356,10 +469,19 @@ struct compress_res {
 	uint8_t* out_buf;
 };
 
+/* full header-size: 4 + 2 + 2 + 1 + 2 + 4 + 1 = 16 bytes, followed by the
+ * scroll fields 2 + 2 + 2 = 6 bytes when flags has RPACK_SCROLL set */
+static size_t tpack_header_size(struct shmifsrv_vbuffer* vb)
+{
+	uint16_t flags;
+	unpack_u16(&flags, &vb->buffer_bytes[9]);
+	return (flags & RPACK_SCROLL) ?
+		raster_hdr_sz + raster_hdr_scroll_sz : raster_hdr_sz;
+}
+
 static struct compress_res compress_tz(struct a12_state* S,
 	uint8_t ch, struct shmifsrv_vbuffer* vb)
 {
-/* full header-size: 4 + 2 + 2 + 1 + 2 + 4 + 1 = 16 bytes */
 /* first 4 bytes is length */
 	uint32_t compress_in_sz;
 	unpack_u32(&compress_in_sz, vb->buffer_bytes);
@@ -373,7 +495,8 @@ static struct compress_res compress_tz(struct a12_state* S,
 	unpack_u16(&n_cells, &vb->buffer_bytes[6]);
 
 /* line-header size (2 + 2 + 2 + 3 = 9 bytes), cell size = 12 bytes) */
-	if (compress_in_sz != n_lines * 9 + n_cells * 12 + 16){
+	if (compress_in_sz != n_lines * raster_line_sz +
+		n_cells * raster_cell_sz + tpack_header_size(vb)){
 		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=corrupt TPACK buffer");
 		return (struct compress_res){};
 	}
@@ -405,7 +528,8 @@ void a12int_encode_tz(PACK_ARGS)
 		return;
 
 	uint8_t hdr_buf[CONTROL_PACKET_SIZE];
-	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr, chid,
+	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+		S->channels[chid].out_pts, chid,
 		cres.type, 0, vb->w, vb->h, w, h, 0, 0,
 		cres.out_sz, cres.in_sz, 1
 	);
@@ -413,6 +537,7 @@ void a12int_encode_tz(PACK_ARGS)
 	a12int_trace(A12_TRACE_VDETAIL,
 		"kind=status:codec=tpack:b_in=%zu:b_out=%zu", cres.in_sz, cres.out_sz
 	);
+	set_vstats(S, chid, VFRAME_METHOD_TPACK, w, h, cres.in_sz, cres.out_sz);
 
 	a12int_append_out(S,
 		STATE_CONTROL_PACKET, hdr_buf, CONTROL_PACKET_SIZE, NULL, 0);
@@ -421,6 +546,279 @@ void a12int_encode_tz(PACK_ARGS)
 	free(cres.out_buf);
 }
 
+/*
+ * Cell-level delta for tpack. The incoming buffer (full or partial) is applied
+ * to a copy of the last known grid, then that is compared to the previous
+ * state row by row and only the changed runs of cells are forwarded, with a
+ * possible vertical scroll applied first so that scrolling text doesn't mean
+ * a new screen. The receiver keeps the same grid and rebuilds a tpack buffer
+ * from it, the format is described in net/HACKING.md.
+ */
+static uint32_t row_hash(uint8_t* row, size_t cols)
+{
+	uint32_t hash = 2166136261;
+	for (size_t i = 0; i < cols * 12; i++)
+		hash = (hash ^ row[i]) * 16777619;
+	return hash;
+}
+
+static bool tpack_apply(struct tpack_grid* G, uint8_t* buf, size_t n_lines)
+{
+	for (size_t i = 0; i < n_lines; i++){
+		uint16_t row, ncells, ofs;
+		unpack_u16(&row, &buf[0]);
+		unpack_u16(&ncells, &buf[2]);
+		unpack_u16(&ofs, &buf[4]);
+
+		if (row >= G->rows || ofs + ncells > G->cols)
+			return false;
+
+		G->lines[row * 2 + 0] = buf[6];
+		G->lines[row * 2 + 1] = buf[8];
+		buf += 9;
+
+/* skip cells are not part of the state, they just mark 'no change' */
+		uint8_t* dst = &G->cells[(row * G->cols + ofs) * 12];
+		for (size_t j = 0; j < ncells; j++, buf += 12, dst += 12)
+			if (!(buf[6] & 128))
+				memcpy(dst, buf, 12);
+	}
+
+	return true;
+}
+
+/* find the vertical shift of the old grid that gives the most matching rows,
+ * positive values mean that the contents have moved up */
+static int tpack_scroll(struct tpack_grid* old, struct tpack_grid* new)
+{
+	size_t best = 0;
+	int step = 0;
+
+	for (size_t i = 0; i < new->rows; i++)
+		best += new->hash[i] == old->hash[i];
+
+	for (int ofs = 1; ofs < (int) new->rows; ofs++){
+		for (int dir = 1; dir >= -1; dir -= 2){
+			size_t count = 0;
+			for (int i = 0; i < (int) new->rows; i++){
+				int src = i + ofs * dir;
+				if (src >= 0 && src < (int) old->rows)
+					count += new->hash[i] == old->hash[src];
+			}
+			if (count > best){
+				best = count;
+				step = ofs * dir;
+			}
+		}
+	}
+
+	return step;
+}
+
+static size_t tpack_delta(struct tpack_grid* old,
+	struct tpack_grid* new, int scroll, bool reset, uint8_t* out, size_t* n_runs)
+{
+	size_t pos = 0;
+	size_t row_sz = new->cols * 12;
+
+	for (size_t row = 0; row < new->rows; row++){
+		int src = (int) row + scroll;
+		uint8_t* cur = &new->cells[row * row_sz];
+		uint8_t* prev = NULL;
+
+		if (!reset && src >= 0 && src < (int) old->rows &&
+			new->lines[row * 2] == old->lines[src * 2] &&
+			new->lines[row * 2 + 1] == old->lines[src * 2 + 1]){
+			prev = &old->cells[src * row_sz];
+			if (new->hash[row] == old->hash[src] && memcmp(cur, prev, row_sz) == 0)
+				continue;
+		}
+
+/* collect the runs of changed cells, a run header costs less than a cell so
+ * there is no point in bridging unchanged ones */
+		size_t col = 0;
+		while (col < new->cols){
+			if (prev && memcmp(&cur[col * 12], &prev[col * 12], 12) == 0){
+				col++;
+				continue;
+			}
+
+			size_t start = col;
+			while (col < new->cols &&
+				(!prev || memcmp(&cur[col * 12], &prev[col * 12], 12) != 0))
+				col++;
+
+			pack_u16(row, &out[pos]);
+			pack_u16(start, &out[pos + 2]);
+			pack_u16(col - start, &out[pos + 4]);
+			out[pos + 6] = new->lines[row * 2 + 0];
+			out[pos + 7] = new->lines[row * 2 + 1];
+			memcpy(&out[pos + 8], &cur[start * 12], (col - start) * 12);
+			pos += 8 + (col - start) * 12;
+			(*n_runs)++;
+		}
+	}
+
+	return pos;
+}
+
+void a12int_encode_dtz(PACK_ARGS)
+{
+	struct a12_channel* ch = &S->channels[chid];
+	struct tpack_grid* front = &ch->tpack.front;
+	struct tpack_grid* back = &ch->tpack.back;
+
+/* same validation as compress_tz */
+	uint32_t in_sz;
+	uint16_t n_lines, n_cells, flags, scroll_top = 0, scroll_bottom = 0;
+	int16_t scroll_hint = 0;
+	size_t hdr_sz = tpack_header_size(vb);
+	unpack_u32(&in_sz, vb->buffer_bytes);
+	unpack_u16(&n_lines, &vb->buffer_bytes[4]);
+	unpack_u16(&n_cells, &vb->buffer_bytes[6]);
+	unpack_u16(&flags, &vb->buffer_bytes[9]);
+
+	if (in_sz != n_lines * raster_line_sz + n_cells * raster_cell_sz + hdr_sz){
+		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=corrupt TPACK buffer");
+		return;
+	}
+
+	if (flags & RPACK_SCROLL){
+		unpack_s16(&scroll_hint, &vb->buffer_bytes[16]);
+		unpack_u16(&scroll_top, &vb->buffer_bytes[18]);
+		unpack_u16(&scroll_bottom, &vb->buffer_bytes[20]);
+	}
+
+/* first pass, the lines need to agree with the number of cells and we need
+ * the dimensions of the grid to apply them to */
+	size_t rows = 0, cols = 0, cells = 0;
+	uint8_t* lines = &vb->buffer_bytes[hdr_sz];
+	uint8_t* cur = lines;
+
+	for (size_t i = 0; i < n_lines; i++){
+		uint16_t row, ncells, ofs;
+		unpack_u16(&row, &cur[0]);
+		unpack_u16(&ncells, &cur[2]);
+		unpack_u16(&ofs, &cur[4]);
+
+		cells += ncells;
+		if (cells > n_cells){
+			a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=corrupt TPACK buffer");
+			return;
+		}
+
+		if (row + 1 > rows)
+			rows = row + 1;
+		if (ofs + ncells > cols)
+			cols = ofs + ncells;
+
+		cur += 9 + ncells * 12;
+	}
+
+/* a full frame defines the grid, a partial one can only grow it and if it
+ * does, something has gone wrong at the source so treat it as full */
+	bool reset = !front->cells;
+	if (flags & 1){
+		reset |= rows != front->rows || cols != front->cols;
+	}
+	else if (front->cells){
+		reset |= rows > front->rows || cols > front->cols;
+		if (rows < front->rows)
+			rows = front->rows;
+		if (cols < front->cols)
+			cols = front->cols;
+	}
+
+	if (!a12int_tgrid_resize(back, rows, cols)){
+		a12int_encode_tz(FWD_ARGS);
+		return;
+	}
+
+	if (!reset && !(flags & 1)){
+		memcpy(back->cells, front->cells, rows * cols * 12);
+		memcpy(back->lines, front->lines, rows * 2);
+	}
+
+	if (!tpack_apply(back, lines, n_lines)){
+		a12int_trace(A12_TRACE_SYSTEM, "kind=error:message=corrupt TPACK buffer");
+		return;
+	}
+
+	for (size_t i = 0; i < rows; i++)
+		back->hash[i] = row_hash(&back->cells[i * cols * 12], cols);
+
+/* the receiver drops its grid if a delta fails to apply, so send all of it
+ * now and then for it to get back in synch */
+	if (ch->tpack.since_reset >= DTZ_RESET_INTERVAL)
+		reset = true;
+
+/* a scroll from the source that covers the grid saves searching for one, it
+ * is relative to the previous source frame which is normally what the front
+ * grid holds and if not, the delta is still correct just larger */
+	int scroll = 0;
+	if (!reset){
+		if (scroll_hint && !(flags & 1) &&
+			scroll_top == 0 && scroll_bottom + 1 == rows && abs(scroll_hint) < rows)
+			scroll = scroll_hint;
+		else
+			scroll = tpack_scroll(front, back);
+	}
+
+/* worst case is one run per cell */
+	size_t out_cap = 21 + rows * cols * (12 + 8);
+	uint8_t* out = malloc(out_cap);
+	if (!out){
+		a12int_trace(A12_TRACE_ALLOC, "failed to build TPACK delta buffer");
+		return;
+	}
+
+	size_t n_runs = 0;
+	size_t out_sz = 21 +
+		tpack_delta(front, back, scroll, reset, &out[21], &n_runs);
+	ch->tpack.since_reset = reset ? 0 : ch->tpack.since_reset + 1;
+
+	pack_u32(out_sz, &out[0]);
+	pack_u16(rows, &out[4]);
+	pack_u16(cols, &out[6]);
+	pack_u16(n_runs, &out[8]);
+	pack_s16(scroll, &out[10]);
+	out[12] = reset;
+	out[13] = vb->buffer_bytes[15];
+	memcpy(&out[14], &vb->buffer_bytes[11], 4);
+	pack_u16(++ch->tpack.seq, &out[18]);
+	out[20] = vb->buffer_bytes[8];
+
+	size_t z_sz;
+	uint8_t* z_buf = tdefl_compress_mem_to_heap(out, out_sz, &z_sz, 0);
+	free(out);
+
+	if (!z_buf){
+		a12int_trace(A12_TRACE_ALLOC, "failed to build compressed TPACK output");
+		return;
+	}
+
+	uint8_t hdr_buf[CONTROL_PACKET_SIZE];
+	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+		S->channels[chid].out_pts, chid,
+		POSTPROCESS_VIDEO_DTZ, 0, vb->w, vb->h, w, h, 0, 0, z_sz, out_sz, 1);
+
+	a12int_trace(A12_TRACE_VDETAIL,
+		"kind=status:codec=dtpack:b_in=%zu:b_out=%zu:runs=%zu:scroll=%d:reset=%d",
+		(size_t) in_sz, z_sz, n_runs, scroll, (int) reset
+	);
+	set_vstats(S, chid, VFRAME_METHOD_TPACK, w, h, in_sz, z_sz);
+
+	a12int_append_out(S,
+		STATE_CONTROL_PACKET, hdr_buf, CONTROL_PACKET_SIZE, NULL, 0);
+	chunk_pack(S, STATE_VIDEO_PACKET, chid, z_buf, z_sz, chunk_sz);
+	free(z_buf);
+
+/* the new state becomes the reference for the next frame */
+	struct tpack_grid tmp = *front;
+	*front = *back;
+	*back = tmp;
+}
+
 static struct compress_res compress_deltaz(struct a12_state* S, uint8_t ch,
 	struct shmifsrv_vbuffer* vb, size_t* x, size_t* y, size_t* w, size_t* h)
 {
@@ -532,7 +930,8 @@ void a12int_encode_dpng(PACK_ARGS)
 		return;
 
 	uint8_t hdr_buf[CONTROL_PACKET_SIZE];
-	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr, chid,
+	a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+		S->channels[chid].out_pts, chid,
 		cres.type, 0, vb->w, vb->h, w, h, x, y,
 		cres.out_sz, cres.in_sz, 1
 	);
@@ -540,6 +939,7 @@ void a12int_encode_dpng(PACK_ARGS)
 	a12int_trace(A12_TRACE_VDETAIL,
 		"kind=status:codec=dpng:b_in=%zu:b_out=%zu", w * h * 3, cres.out_sz
 	);
+	set_vstats(S, chid, VFRAME_METHOD_DPNG, w, h, cres.in_sz, cres.out_sz);
 
 	a12int_append_out(S,
 		STATE_CONTROL_PACKET, hdr_buf, CONTROL_PACKET_SIZE, NULL, 0);
@@ -573,12 +973,36 @@ void a12int_drop_videnc(struct a12_state* S, int chid, bool failed)
 	a12int_trace(A12_TRACE_VIDEO, "dropping h264 context");
 }
 
-static unsigned long pick_bitrate(size_t w, size_t h, struct a12_vframe_opts o)
+static unsigned long pick_bitrate(
+	struct a12_state* S, size_t w, size_t h, struct a12_vframe_opts o)
 {
 /* Just some rough 'better than nothing' table for when we don't get a CRF or a
- * specified bitrate by the caller during setup or through a later backpressure
- * estimation */
-	return 1000000;
+ * specified bitrate by the caller during setup */
+	unsigned long rate = 10000000;
+	size_t px = w * h;
+	if (px <= 640 * 480)
+		rate = 1000000;
+	else if (px <= 1280 * 720)
+		rate = 2500000;
+	else if (px <= 1920 * 1080)
+		rate = 5000000;
+
+	if (o.bias == VFRAME_BIAS_QUALITY)
+		rate = rate * 3 / 2;
+
+/* then cap against the link estimate, leaving room for audio, events and the
+ * estimate being somewhat optimistic */
+	struct a12_iostat ios = a12_state_iostat(S);
+	if (ios.bps){
+		unsigned long cap = ios.bps * 8 * 7 / 10;
+		if (cap < rate)
+			rate = cap;
+	}
+
+	if (rate < 100000)
+		rate = 100000;
+
+	return rate;
 }
 
 static bool open_videnc(struct a12_state* S,
@@ -639,7 +1063,7 @@ static bool open_videnc(struct a12_state* S,
 	}
 	else {
 		encoder->bit_rate = venc_opts.bitrate > 0 ?
-			(venc_opts.bitrate * 1000000.0f) : pick_bitrate(vb->w, vb->h, venc_opts);
+			(venc_opts.bitrate * 1000000.0f) : pick_bitrate(S, vb->w, vb->h, venc_opts);
 	}
 	encoder->width = vb->w;
 	encoder->height = vb->h;
@@ -742,6 +1166,18 @@ void a12int_encode_h264(PACK_ARGS)
 	AVPacket* packet = S->channels[chid].videnc.packet;
 	struct SwsContext* scaler = S->channels[chid].videnc.scaler;
 
+/* Follow the link estimate unless the caller has locked the rate, libx264
+ * picks up bit_rate changes and reconfigures without a new context */
+	if (!opts.variable && opts.bitrate <= 0){
+		unsigned long rate = pick_bitrate(S, vb->w, vb->h, opts);
+		unsigned long cur = encoder->bit_rate;
+		if (rate < cur * 9 / 10 || rate > cur * 11 / 10){
+			a12int_trace(A12_TRACE_VIDEO,
+				"kind=bitrate:ch=%d:old=%lu:new=%lu", chid, cur, rate);
+			encoder->bit_rate = rate;
+		}
+	}
+
 /* and color-convert from src into frame */
 	int ret;
 	const uint8_t* const src[] = {(uint8_t*)vb->buffer};
@@ -778,11 +1214,14 @@ again:
 		}
 
 		a12int_trace(A12_TRACE_VDETAIL, "videnc: %5d", packet->size);
+		set_vstats(S, chid, VFRAME_METHOD_H264,
+			vb->w, vb->h, vb->w * vb->h * 4, packet->size);
 
 /* don't see a nice way to combine ffmpegs view of 'packets' and ours,
  * maybe we could avoid it and the extra copy but uncertain */
 		uint8_t hdr_buf[CONTROL_PACKET_SIZE];
-		a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr, chid,
+		a12int_vframehdr_build(hdr_buf, S->last_seen_seqnr,
+			S->channels[chid].out_pts, chid,
 			POSTPROCESS_VIDEO_H264, 0, vb->w, vb->h, vb->w, vb->h,
 			0, 0, packet->size, vb->w * vb->h * 4, 1
 		);
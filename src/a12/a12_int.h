@@ -64,8 +64,51 @@ enum control_commands {
 	COMMAND_REKEY = 8
 };
 
+/* optional parts of the protocol, announced in the hello so that they are
+ * only used when the other side knows about them, see net/HACKING.md */
+enum a12_features {
+	A12_FEATURE_DTZ = 1,
+	A12_FEATURE_BCACHE = 2
+};
+/* always announced, the rest depend on the context options */
+#define A12_FEATURES (A12_FEATURE_DTZ)
+
+enum stream_cancel {
+	STREAM_CANCEL_DONTWANT = 0,
+	STREAM_CANCEL_DECODE_ERROR = 1,
+	STREAM_CANCEL_KNOWN = 2
+};
+
 #define SEQUENCE_NUMBER_SIZE 8
 
+/* link estimation, see a12_state_iostat */
+#define PING_INTERVAL_MS 50
+#define PING_SLOTS 16
+#define RATE_SAMPLES 8
+#define DEFAULT_LATENCY_TARGET 100
+#define INITIAL_WINDOW 65536
+#define PING_TIMEOUT_MS 5000
+#define PING_MIN_TAIL 1024
+#define AUDIO_CONGESTION_HOLD_MS 5000
+
+/* tpack cell deltas are sent as a full grid at this interval so that a
+ * receiver which has dropped a delta gets back in synch */
+#define DTZ_RESET_INTERVAL 256
+
+/* how long a checksummed binary transfer waits for the other side to reject
+ * it as already known before the data starts flowing regardless */
+#define BSTREAM_HOLD_MS 1000
+
+/* file-backed binary transfers are mapped a window at a time, this bounds the
+ * address space and resident set a transfer can use */
+#define BSTREAM_MAP_WINDOW (8 * 1024 * 1024)
+
+/* receiving side jitter buffer, frames held per channel, how long the base
+ * transit time is tracked over and how long audio keeps driving the clock */
+#define JITTER_QUEUE 8
+#define JITTER_WINDOW_MS 2000
+#define JITTER_AUDIO_MS 500
+
 #ifdef _DEBUG
 #define DEBUG 1
 #else
@@ -79,11 +122,29 @@ enum {
 	POSTPROCESS_VIDEO_DMINIZ = 3,
 	POSTPROCESS_VIDEO_MINIZ = 4,
 	POSTPROCESS_VIDEO_H264 = 5,
-	POSTPROCESS_VIDEO_TZ = 6
+	POSTPROCESS_VIDEO_TZ = 6,
+	POSTPROCESS_VIDEO_DTZ = 7
 };
 
+enum {
+	POSTPROCESS_AUDIO_RAW = 0,
+	POSTPROCESS_AUDIO_ADPCM = 1
+};
+
+/* IMA-ADPCM predictor, one per audio channel. The same update is used by the
+ * encoder so that the two sides can't drift apart */
+struct adpcm_state {
+	int16_t pred;
+	uint8_t index;
+};
+
+int a12int_adpcm_stepsize(struct adpcm_state* st);
+int16_t a12int_adpcm_step(struct adpcm_state* st, uint8_t nibble);
+
 size_t a12int_header_size(int type);
 
+uint64_t a12int_now_ms();
+
 struct audio_frame {
 	uint32_t rate;
 	uint8_t encoding;
@@ -91,6 +152,14 @@ struct audio_frame {
 	uint8_t format;
 	uint16_t nsamples;
 	uint8_t commit;
+	uint32_t pts;
+
+/* adpcm: per-channel state header is read first, it can in theory be split
+ * across packets so it is buffered */
+	struct adpcm_state adpcm[2];
+	uint8_t adpcm_hdr[8];
+	size_t adpcm_hdr_pos;
+	size_t adpcm_ch;
 
 /* only used for some postprocessing mode (i.e. decompression) */
 	uint8_t* inbuf;
@@ -116,6 +185,7 @@ struct video_frame {
 	uint32_t flags;
 	uint8_t postprocess;
 	uint8_t commit; /* finish after this transfer? */
+	uint32_t pts; /* sender clock, ms, 0 if unknown */
 
 	uint8_t* inbuf; /* decode buffer, not used for all modes */
 	uint32_t inbuf_pos;
@@ -144,6 +214,18 @@ struct video_frame {
 	/* bytes left on current row for raw-dec */
 };
 
+/* last known state of a tpack screen, cells are kept in their packed (12b)
+ * form so that they can be compared and copied without unpacking */
+struct tpack_grid {
+	uint8_t* cells;
+	uint8_t* lines; /* content_dir, line_state per row */
+	uint32_t* hash; /* per row, used for scroll detection */
+	size_t rows, cols;
+};
+
+bool a12int_tgrid_resize(struct tpack_grid* G, size_t rows, size_t cols);
+void a12int_tgrid_free(struct tpack_grid* G);
+
 struct blob_out;
 struct blob_out {
 	uint8_t checksum[16];
@@ -154,13 +236,36 @@ struct blob_out {
 	bool streaming;
 	bool active;
 	uint64_t streamid;
+
+/* set while the header waits to be acknowledged, the data is held back so
+ * that the other side gets the chance to cancel if it has a cached copy */
+	size_t hold_pos;
+	uint64_t hold_ts;
+
+/* file-backed source, the data is packed from the mapped window directly
+ * rather than read into an intermediate buffer */
+	bool mapped;
+	uint8_t* map;
+	size_t map_sz;
+	size_t map_ofs;
+	size_t pos;
 	struct blob_out* next;
 };
 
+struct a12_worker;
+
+struct jitter_frame {
+	struct video_frame vf;
+	uint32_t arrived;
+};
+
 struct a12_channel {
 	bool active;
 	struct arcan_shmif_cont* cont;
 
+/* set if compressed frames are decoded on a separate thread */
+	struct a12_worker* worker;
+
 /* can have one of each stream- type being prepared for unpack at the same time */
 	struct {
 		struct video_frame vframe;
@@ -170,6 +275,40 @@ struct a12_channel {
 
 /* used for both encoding and decoding, state is aliased into unpack_state */
 	struct shmifsrv_vbuffer acc;
+
+/* encoder feedback, updated for each outgoing video frame */
+	struct a12_vframe_stats vstats;
+
+/* timestamp for the frame being encoded, set when it is handed to us */
+	uint32_t out_pts;
+
+/* completed frames waiting for presentation, see a12int_jitter_queue */
+	struct {
+		struct jitter_frame queue[JITTER_QUEUE];
+		size_t head, count;
+		size_t samples;
+		uint32_t last_transit, win_start;
+		uint32_t win_min, prev_min, win_max, prev_max;
+		uint32_t jitter, interval; /* 1/16 ms */
+		uint32_t last_pts, shown_pts, shown_ts;
+		uint32_t apts, alocal;
+		bool audio;
+		struct a12_jitter_stats stats;
+	} jitter;
+
+/* audio encoder state, kept across frames */
+	struct {
+		struct adpcm_state adpcm[2];
+		uint64_t last_congested;
+	} aenc;
+
+/* cell grid for tpack diffs, the encoder builds the next state in back */
+	struct {
+		struct tpack_grid front, back;
+		unsigned since_reset;
+		uint16_t seq;
+		bool unsent;
+	} tpack;
 	struct {
 		uint8_t* compression;
 #if defined(WANT_H264_ENC) || defined(WANT_H264_DEC)
@@ -187,6 +326,12 @@ struct a12_channel {
 	};
 };
 
+struct ping_slot {
+	uint32_t id;
+	uint64_t ts;
+	size_t b_out;
+};
+
 struct a12_state;
 struct a12_state {
 	struct a12_context_options* opts;
@@ -206,6 +351,27 @@ struct a12_state {
 	uint8_t buf_ind;
 	size_t buf_ofs;
 
+/* outstanding pings and delivery rate samples for the link estimate */
+	struct {
+		struct ping_slot pings[PING_SLOTS];
+		uint32_t ping_id;
+		uint64_t first_ping;
+		uint64_t last_ping;
+		uint64_t last_ack;
+		size_t b_out;
+		size_t b_acked;
+		size_t b_pinged;
+		size_t b_hold;
+		size_t rate[RATE_SAMPLES];
+		uint8_t rate_ind;
+		unsigned rtt;
+		unsigned rtt_min;
+		bool known;
+	} link;
+
+/* features announced by the other side in its hello */
+	uint32_t remote_features;
+
 /* linked list of pending binary transfers, can be re-ordered and affect
  * blocking / transfer state of events on the other side */
 	struct blob_out* pending;
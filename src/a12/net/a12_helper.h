@@ -33,6 +33,15 @@ struct a12helper_opts {
 /* a12cl_shmifsrv- specific: set to a valid local connection-point and it will
  * be set as the DEVICE_NODE alternate for incoming connections */
 	const char* devicehint_cp;
+
+/* a12cl_shmifsrv- specific: set to a writable descriptor (or -1 to disable)
+ * and the video buffers of all segments will be appended to it, see
+ * a12_record.h for the format */
+	int record_fd;
+
+/* a12cl_shmifsrv- specific: arcan_timemillis() when [record_fd] was opened,
+ * frame timestamps in the recording are relative to this */
+	uint64_t record_start;
 };
 
 /*
@@ -59,4 +68,23 @@ void a12helper_a12cl_shmifsrv(struct a12_state* S,
 int a12helper_a12srv_shmifcl(
 	struct a12_state* S, const char* cp, int fd_in, int fd_out);
 
+/*
+ * Single- process alternative to running a12helper_a12srv_shmifcl for each
+ * client in a process or thread of its own (Linux only). The sessions share
+ * one pollset that is serviced by a pool of [n_workers] threads, and their
+ * segments are polled by the pool rather than having a thread each. The
+ * resident memory per client is periodically traced (A12_TRACE_SYSTEM).
+ *
+ * Returns NULL if [cp] is invalid or the pool couldn't be set up.
+ */
+struct a12helper_mt;
+struct a12helper_mt* a12helper_a12srv_mt(const char* cp, size_t n_workers);
+
+/*
+ * Add a prenegotiated connection [S] on the socket [fd] to the pool, the
+ * pool takes ownership of both, also on failure.
+ */
+bool a12helper_a12srv_mt_add(
+	struct a12helper_mt*, struct a12_state* S, int fd);
+
 #endif
@@ -23,6 +23,10 @@
 #include <pthread.h>
 #include <semaphore.h>
 
+#ifdef __LINUX
+#include <sys/epoll.h>
+#endif
+
 #include "a12.h"
 #include "a12_int.h"
 #include "a12_helper.h"
@@ -37,6 +41,8 @@
 #define BEGIN_CRITICAL(X, Y) do{pthread_mutex_lock(&((X)->giant_lock)); (X)->last_lock = Y;} while(0);
 #define END_CRITICAL(X) do{pthread_mutex_unlock(&(X)->giant_lock);} while(0);
 
+struct shmif_thread_data;
+
 struct cl_state{
 	int kill_fd;
 	pthread_mutex_t giant_lock;
@@ -44,6 +50,12 @@ struct cl_state{
 	const char* last_lock;
 	volatile _Atomic uint8_t alloc[256];
 	_Atomic size_t buffer_out;
+
+/* set when the segments are polled by the shared worker pool in the
+ * multi-client server rather than each having a thread of their own */
+	int epoll_fd;
+	void* epoll_tag;
+	struct shmif_thread_data* segments[256];
 };
 
 int get_free_id(struct cl_state* state)
@@ -192,6 +204,43 @@ static bool dispatch_event(struct shmif_thread_data* data, arcan_event* ev)
 	return dirty;
 }
 
+static void segment_death(struct shmif_thread_data* data)
+{
+/* free channel resources */
+	BEGIN_CRITICAL(data->state, "client-death");
+		a12_set_channel(data->S, data->chid);
+		a12_channel_shutdown(data->S, "");
+
+/* the worker pool has no kill pipe, it polls every segment on each step */
+		if (-1 != data->state->kill_fd)
+			write(data->state->kill_fd, &data->chid, 1);
+		a12_channel_close(data->S);
+
+#ifdef __LINUX
+		if (-1 != data->state->epoll_fd){
+			epoll_ctl(data->state->epoll_fd, EPOLL_CTL_DEL, data->C->epipe, NULL);
+			data->state->segments[data->chid] = NULL;
+		}
+#endif
+
+		arcan_shmif_drop(data->C);
+
+/* and if the primary dies, all die */
+		if (data->chid == 0 && -1 != data->state->kill_fd){
+			close(data->state->kill_fd);
+			data->state->kill_fd = -1;
+		}
+
+/* finally release the allocation, this will cause the main thread to
+ * stop spinning, ultimately killing data->S */
+		atomic_store(&data->state->alloc[data->chid], 0);
+		atomic_fetch_sub(&data->state->n_segments, 1);
+	END_CRITICAL(data->state);
+
+	free(data->C);
+	free(data);
+}
+
 static void* client_thread(void* inarg)
 {
 	struct shmif_thread_data* data = inarg;
@@ -229,26 +278,7 @@ static void* client_thread(void* inarg)
 			break;
 	}
 
-/* free channel resources */
-	BEGIN_CRITICAL(data->state, "client-death");
-		a12_set_channel(data->S, data->chid);
-		a12_channel_shutdown(data->S, "");
-		write(data->state->kill_fd, &data->chid, 1);
-		a12_channel_close(data->S);
-		arcan_shmif_drop(data->C);
-
-/* and if the primary dies, all die */
-		if (data->chid == 0)
-			close(data->state->kill_fd);
-
-/* finally release the allocation, this will cause the main thread to
- * stop spinning, ultimately killing data->S */
-		atomic_store(&data->state->alloc[data->chid], 0);
-		atomic_fetch_sub(&data->state->n_segments, 1);
-	END_CRITICAL(data->state);
-
-	free(data->C);
-	free(data);
+	segment_death(data);
 	return NULL;
 }
 
@@ -278,6 +308,29 @@ bool spawn_thread(struct a12_state* S,
 
 	a12_set_destination(S, cont, chid);
 
+/* with the worker pool, the segment is just added to the pollset */
+#ifdef __LINUX
+	if (-1 != cl->epoll_fd){
+		struct epoll_event ev = {
+			.events = EPOLLIN | EPOLLONESHOT,
+			.data.ptr = cl->epoll_tag
+		};
+
+		if (-1 == epoll_ctl(cl->epoll_fd, EPOLL_CTL_ADD, cont->epipe, &ev)){
+			a12int_trace(A12_TRACE_ALLOC, "could not add segment to pollset");
+			a12_set_channel(S, chid);
+			a12_channel_close(S);
+			free(data);
+			free(cont);
+			return false;
+		}
+
+		atomic_fetch_add(&cl->n_segments, 1);
+		cl->segments[chid] = data;
+		return true;
+	}
+#endif
+
 /* and detach, cleanup is up to each thread */
 	pthread_t pth;
 	pthread_attr_t pthattr;
@@ -314,7 +367,8 @@ int a12helper_a12srv_shmifcl(
 	}
 
 	struct cl_state cl = {
-		.giant_lock = PTHREAD_MUTEX_INITIALIZER
+		.giant_lock = PTHREAD_MUTEX_INITIALIZER,
+		.epoll_fd = -1
 	};
 
 /* primary segment is created without any type or activation, as it is the remote
@@ -354,7 +408,8 @@ int a12helper_a12srv_shmifcl(
 		{.fd = fd_out,       .events = POLLOUT | errmask}
 	};
 
-	while(-1 != poll(fds, n_fd, -1)){
+	int timeout = -1;
+	while(-1 != poll(fds, n_fd, timeout)){
 		if (
 			(fds[0].revents & errmask) ||
 			(fds[1].revents & errmask) ||
@@ -425,6 +480,11 @@ int a12helper_a12srv_shmifcl(
 			END_CRITICAL(&cl);
 		}
 
+/* frames held for presentation, wake up in time for the next one */
+		BEGIN_CRITICAL(&cl, "present");
+			timeout = a12_present(S);
+		END_CRITICAL(&cl);
+
 /* poll accordingly */
 		n_fd = outbuf_sz > 0 ? 3 : 2;
 	}
@@ -439,3 +499,394 @@ int a12helper_a12srv_shmifcl(
 
 	return 0;
 }
+
+#ifdef __LINUX
+/*
+ * [MULTI-CLIENT]
+ * All sessions share one epoll set, with every descriptor (socket and segment
+ * event pipes) tagged with the session it belongs to and registered as one-
+ * shot. A dispatcher thread turns events into session jobs and a fixed pool of
+ * workers process them, a session is only ever processed by one worker at a
+ * time and its descriptors are re-armed when the worker is done with it.
+ *
+ * The per-session giant lock is recursive here as the worker holds it for the
+ * entire step while the event- and segment- handlers above take it as well.
+ */
+#define MT_REPORT_MS 10000
+#define MT_READS_PER_STEP 8
+
+struct mt_session {
+	struct cl_state cl;
+	struct a12_state* S;
+	int fd;
+	uint8_t* outbuf;
+	size_t outbuf_sz;
+
+/* protected by the a12helper_mt lock */
+	bool queued;
+	bool running;
+	bool rerun;
+	bool dead;
+	struct mt_session* next;
+};
+
+struct a12helper_mt {
+	int epoll_fd;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct mt_session* jobs;
+	struct mt_session* jobs_last;
+	struct mt_session* dead;
+	size_t n_sessions;
+	uint64_t last_report;
+};
+
+static void mt_arm(struct a12helper_mt* M, struct mt_session* s)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN | EPOLLONESHOT | (s->outbuf_sz ? EPOLLOUT : 0),
+		.data.ptr = s
+	};
+	epoll_ctl(M->epoll_fd, EPOLL_CTL_MOD, s->fd, &ev);
+
+	for (size_t i = 0; i < 256; i++){
+		if (!s->cl.segments[i])
+			continue;
+
+		ev.events = EPOLLIN | EPOLLONESHOT;
+		epoll_ctl(M->epoll_fd, EPOLL_CTL_MOD, s->cl.segments[i]->C->epipe, &ev);
+	}
+}
+
+/*
+ * Same stages as the loop in a12helper_a12srv_shmifcl, but non-blocking and
+ * with the segments polled here instead of in their own threads. Returns false
+ * when the session is dead.
+ */
+static bool mt_step(struct mt_session* s)
+{
+	uint8_t inbuf[9000];
+	bool alive = true;
+
+	BEGIN_CRITICAL(&s->cl, "mt-step");
+
+/* bounded number of reads so that one busy session can't starve the rest,
+ * the descriptor is level- triggered so the rest comes on the next step */
+	for (size_t i = 0; i < MT_READS_PER_STEP; i++){
+		ssize_t nr = recv(s->fd, inbuf, sizeof(inbuf), MSG_DONTWAIT);
+		if (nr > 0){
+			a12_unpack(s->S, inbuf, nr, NULL, on_cl_event);
+			continue;
+		}
+
+		if (0 == nr){
+			a12int_trace(A12_TRACE_SYSTEM, "other side closed the connection");
+			alive = false;
+		}
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN && errno != EWOULDBLOCK){
+			a12int_trace(A12_TRACE_SYSTEM, "failed to read from input: %d", errno);
+			alive = false;
+		}
+		break;
+	}
+
+	for (size_t i = 0; i < 256 && alive; i++){
+		struct shmif_thread_data* data = s->cl.segments[i];
+		if (!data)
+			continue;
+
+		arcan_event ev;
+		int pv;
+		while ((pv = arcan_shmif_poll(data->C, &ev)) > 0)
+			dispatch_event(data, &ev);
+
+		if (pv < 0)
+			segment_death(data);
+	}
+
+/* and if the primary dies, all die */
+	if (!s->cl.segments[0])
+		alive = false;
+
+	while (alive){
+		if (!s->outbuf_sz)
+			s->outbuf_sz = a12_flush(s->S, &s->outbuf, A12_FLUSH_ALL);
+
+		if (!s->outbuf_sz)
+			break;
+
+		ssize_t nw = send(s->fd, s->outbuf, s->outbuf_sz, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (nw > 0){
+			s->outbuf += nw;
+			s->outbuf_sz -= nw;
+		}
+		else if (-1 == nw && errno == EINTR)
+			continue;
+		else if (-1 == nw && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		else
+			alive = false;
+	}
+
+	END_CRITICAL(&s->cl);
+	return alive;
+}
+
+static void mt_kill(struct a12helper_mt* M, struct mt_session* s)
+{
+	BEGIN_CRITICAL(&s->cl, "mt-kill");
+		for (size_t i = 0; i < 256; i++)
+			if (s->cl.segments[i])
+				segment_death(s->cl.segments[i]);
+
+		epoll_ctl(M->epoll_fd, EPOLL_CTL_DEL, s->fd, NULL);
+		close(s->fd);
+
+		if (!a12_free(s->S)){
+			a12int_trace(A12_TRACE_ALLOC, "error cleaning up a12 context");
+		}
+	END_CRITICAL(&s->cl);
+
+/* the dispatcher might still hold events for the session from before it was
+ * removed from the pollset, so it is the one to finally release it */
+	pthread_mutex_lock(&M->lock);
+		s->dead = true;
+		s->running = false;
+		s->next = M->dead;
+		M->dead = s;
+		M->n_sessions--;
+	pthread_mutex_unlock(&M->lock);
+}
+
+static void* mt_worker(void* tag)
+{
+	struct a12helper_mt* M = tag;
+
+	for(;;){
+		pthread_mutex_lock(&M->lock);
+		while (!M->jobs)
+			pthread_cond_wait(&M->cond, &M->lock);
+
+		struct mt_session* s = M->jobs;
+		M->jobs = s->next;
+		if (!M->jobs)
+			M->jobs_last = NULL;
+		s->next = NULL;
+		s->queued = false;
+		s->running = true;
+		pthread_mutex_unlock(&M->lock);
+
+		bool again;
+		do {
+			if (!mt_step(s)){
+				mt_kill(M, s);
+				break;
+			}
+
+			mt_arm(M, s);
+
+/* events that came in while running only set the rerun flag */
+			pthread_mutex_lock(&M->lock);
+				again = s->rerun;
+				s->rerun = false;
+				if (!again)
+					s->running = false;
+			pthread_mutex_unlock(&M->lock);
+		} while (again);
+	}
+
+	return NULL;
+}
+
+/*
+ * There is no per- allocation accounting in a12 or shmif, so the resident set
+ * of the process is used and spread over the number of sessions. Shared and
+ * per-segment mappings are included in that, as they are what a client costs.
+ */
+static void mt_report(struct a12helper_mt* M)
+{
+	size_t pages = 0, resident = 0;
+	FILE* fpek = fopen("/proc/self/statm", "r");
+	if (fpek){
+		if (2 != fscanf(fpek, "%zu %zu", &pages, &resident))
+			resident = 0;
+		fclose(fpek);
+	}
+
+	size_t rss = resident * sysconf(_SC_PAGESIZE);
+	a12int_trace(A12_TRACE_SYSTEM,
+		"kind=status:clients=%zu:rss=%zu:per_client=%zu", M->n_sessions,
+		rss, M->n_sessions ? rss / M->n_sessions : 0
+	);
+}
+
+static void* mt_dispatch(void* tag)
+{
+	struct a12helper_mt* M = tag;
+	struct epoll_event evs[64];
+
+	for(;;){
+		int nev = epoll_wait(M->epoll_fd, evs, 64, MT_REPORT_MS);
+
+		pthread_mutex_lock(&M->lock);
+		for (int i = 0; i < nev; i++){
+			struct mt_session* s = evs[i].data.ptr;
+			if (s->dead)
+				continue;
+
+			if (s->running){
+				s->rerun = true;
+				continue;
+			}
+
+			if (s->queued)
+				continue;
+
+			s->queued = true;
+			if (M->jobs_last)
+				M->jobs_last->next = s;
+			else
+				M->jobs = s;
+			M->jobs_last = s;
+		}
+
+		while (M->dead){
+			struct mt_session* s = M->dead;
+			M->dead = s->next;
+			pthread_mutex_destroy(&s->cl.giant_lock);
+			free(s);
+		}
+
+		uint64_t ts = arcan_timemillis();
+		if (ts - M->last_report >= MT_REPORT_MS){
+			mt_report(M);
+			M->last_report = ts;
+		}
+
+		pthread_cond_broadcast(&M->cond);
+		pthread_mutex_unlock(&M->lock);
+	}
+
+	return NULL;
+}
+
+struct a12helper_mt* a12helper_a12srv_mt(const char* cp, size_t n_workers)
+{
+	if (!cp)
+		cp = getenv("ARCAN_CONNPATH");
+	else
+		setenv("ARCAN_CONNPATH", cp, 1);
+
+	if (!cp){
+		a12int_trace(A12_TRACE_SYSTEM, "No connection point was specified");
+		return NULL;
+	}
+
+	struct a12helper_mt* M = malloc(sizeof(struct a12helper_mt));
+	if (!M)
+		return NULL;
+
+	*M = (struct a12helper_mt){
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.epoll_fd = epoll_create1(EPOLL_CLOEXEC),
+		.last_report = arcan_timemillis()
+	};
+
+	if (-1 == M->epoll_fd){
+		free(M);
+		return NULL;
+	}
+
+	if (!n_workers)
+		n_workers = 1;
+
+	pthread_t pth;
+	pthread_attr_t pthattr;
+	pthread_attr_init(&pthattr);
+	pthread_attr_setdetachstate(&pthattr, PTHREAD_CREATE_DETACHED);
+
+	if (0 != pthread_create(&pth, &pthattr, mt_dispatch, M)){
+		close(M->epoll_fd);
+		free(M);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < n_workers; i++){
+		if (0 != pthread_create(&pth, &pthattr, mt_worker, M)){
+			a12int_trace(A12_TRACE_SYSTEM,
+				"kind=error:message=worker pool limited to %zu threads", i);
+			break;
+		}
+	}
+
+	return M;
+}
+
+bool a12helper_a12srv_mt_add(
+	struct a12helper_mt* M, struct a12_state* S, int fd)
+{
+	struct mt_session* s = malloc(sizeof(struct mt_session));
+	if (!s)
+		return false;
+
+	*s = (struct mt_session){
+		.S = S,
+		.fd = fd,
+		.cl = {
+			.kill_fd = -1,
+			.epoll_fd = M->epoll_fd,
+			.epoll_tag = s
+		}
+	};
+
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&s->cl.giant_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	a12int_trace(A12_TRACE_ALLOC, "kind=segment:status=opening:chid=0");
+	struct arcan_shmif_cont cont =
+		arcan_shmif_open(SEGID_UNKNOWN, SHMIF_NOACTIVATE, NULL);
+
+	if (!cont.addr){
+		a12int_trace(A12_TRACE_SYSTEM, "Couldn't connect to an arcan display server");
+		goto fail;
+	}
+
+/* the segment only gets polled once the session is in the pollset, so the
+ * lock isn't needed for registering it */
+	atomic_store(&s->cl.alloc[0], 1);
+	cont.user = &s->cl;
+	if (!spawn_thread(S, &s->cl, &cont, 0)){
+		arcan_shmif_drop(&cont);
+		goto fail;
+	}
+
+	pthread_mutex_lock(&M->lock);
+		M->n_sessions++;
+	pthread_mutex_unlock(&M->lock);
+
+	struct epoll_event ev = {
+		.events = EPOLLIN | EPOLLOUT | EPOLLONESHOT,
+		.data.ptr = s
+	};
+
+	if (-1 == epoll_ctl(M->epoll_fd, EPOLL_CTL_ADD, fd, &ev)){
+		mt_kill(M, s);
+		return false;
+	}
+
+	return true;
+
+fail:
+	pthread_mutex_destroy(&s->cl.giant_lock);
+	free(s);
+	close(fd);
+	a12_free(S);
+	return false;
+}
+#endif
@@ -15,13 +15,36 @@
 #include "a12.h"
 #include "a12_int.h"
 #include "a12_helper.h"
+#include "a12_record.h"
 #include "arcan_mem.h"
 
+/*
+ * Content sampling state for adaptive encoding method selection, a sparse grid
+ * of the previous frame is kept so that changes can be estimated without a
+ * full copy or comparison.
+ */
+#define VSAMPLE_GRID 32
+struct vframe_sampler {
+	shmif_pixel grid[VSAMPLE_GRID * VSAMPLE_GRID];
+	size_t w, h;
+	bool valid;
+
+/* rolling estimates, 0..1 */
+	float motion;
+	float colors;
+
+/* hysteresis: a new method needs to win n- consecutive frames */
+	int method;
+	int candidate;
+	unsigned candidate_count;
+};
+
 struct shmifsrv_thread_data {
 	struct shmifsrv_client* C;
 	struct a12_state* S;
 	struct arcan_shmif_cont fake;
 	struct a12helper_opts opts;
+	struct vframe_sampler vsample;
 	float font_sz;
 	int kill_fd;
 	uint8_t chid;
@@ -39,7 +62,6 @@ struct shmifsrv_thread_data {
 static bool spawn_thread(struct shmifsrv_thread_data* inarg);
 static pthread_mutex_t giant_lock = PTHREAD_MUTEX_INITIALIZER;
 static const char* last_lock;
-static _Atomic volatile size_t buffer_out = 0;
 static _Atomic volatile uint8_t n_segments;
 
 #define BEGIN_CRITICAL(X, Y) do{pthread_mutex_lock(X); last_lock = Y;} while(0);
@@ -113,6 +135,191 @@ static struct a12_vframe_opts vopts_from_segment(
 	}
 }
 
+/*
+ * Sweep the sample grid, compare against the previous one and count the number
+ * of distinct colors. Returns the fraction of samples that changed.
+ */
+static float sample_frame(struct vframe_sampler* vs,
+	struct shmifsrv_vbuffer* vb, float* colors)
+{
+	uint32_t set[VSAMPLE_GRID * VSAMPLE_GRID * 2];
+	const size_t set_sz = COUNT_OF(set);
+	size_t n_colors = 0;
+	size_t n_changed = 0;
+	bool cmp = vs->valid && vs->w == vb->w && vs->h == vb->h;
+
+	memset(set, '\0', sizeof(set));
+
+	for (size_t gy = 0; gy < VSAMPLE_GRID; gy++){
+		size_t y = (gy * vb->h + (vb->h >> 1)) / VSAMPLE_GRID;
+		for (size_t gx = 0; gx < VSAMPLE_GRID; gx++){
+			size_t x = (gx * vb->w + (vb->w >> 1)) / VSAMPLE_GRID;
+			shmif_pixel px = vb->buffer[y * vb->pitch + x];
+			size_t ind = gy * VSAMPLE_GRID + gx;
+
+			if (cmp && vs->grid[ind] != px)
+				n_changed++;
+			vs->grid[ind] = px;
+
+/* open addressing, 0 marks an empty slot so mix that one in */
+			uint32_t key = px | 1;
+			size_t pos = (key * 2654435761u) % set_sz;
+			while (set[pos] && set[pos] != key)
+				pos = (pos + 1) % set_sz;
+			if (!set[pos]){
+				set[pos] = key;
+				n_colors++;
+			}
+		}
+	}
+
+	vs->w = vb->w;
+	vs->h = vb->h;
+	*colors = (float) n_colors / (float)(VSAMPLE_GRID * VSAMPLE_GRID);
+
+	if (!cmp){
+		vs->valid = true;
+		return 1.0;
+	}
+
+	return (float) n_changed / (float)(VSAMPLE_GRID * VSAMPLE_GRID);
+}
+
+/*
+ * The client controls the region, only trust it if it fits the buffer
+ */
+static bool region_valid(struct shmifsrv_vbuffer* vb)
+{
+	return vb->flags.subregion &&
+		vb->region.x1 < vb->region.x2 && vb->region.x2 <= vb->w &&
+		vb->region.y1 < vb->region.y2 && vb->region.y2 <= vb->h;
+}
+
+/*
+ * Refine the segment-type based guess with the actual contents of the frame
+ * and feedback from the encoder about how well the previous frame compressed.
+ *
+ * Small updates go out raw as the compression overhead dominates, frames that
+ * look like natural video (large changes, many colors) go h264 and the rest go
+ * through the DPNG delta encoder - unless that one stops compressing, then
+ * raw is cheaper for small changes and h264 for large ones.
+ */
+static struct a12_vframe_opts vopts_adaptive(
+	struct shmifsrv_thread_data* data, struct shmifsrv_vbuffer vb,
+	struct a12_vframe_opts base)
+{
+	struct vframe_sampler* vs = &data->vsample;
+
+/* text-packed and cursor contents are structured, don't touch */
+	if (base.method == VFRAME_METHOD_TPACK || vb.flags.tpack ||
+		shmifsrv_client_type(data->C) == SEGID_CURSOR || !vb.w || !vb.h)
+		return base;
+
+	if (!vs->valid){
+		vs->method = base.method;
+#ifndef WANT_H264_ENC
+		if (vs->method == VFRAME_METHOD_H264)
+			vs->method = VFRAME_METHOD_DPNG;
+#endif
+		vs->candidate = vs->method;
+	}
+
+	float colors;
+	float changed = sample_frame(vs, &vb, &colors);
+	size_t region_px = vb.w * vb.h;
+
+	if (region_valid(&vb)){
+		region_px =
+			(size_t)(vb.region.x2 - vb.region.x1) *
+			(size_t)(vb.region.y2 - vb.region.y1);
+		changed = (float) region_px / (float)(vb.w * vb.h);
+	}
+
+	vs->motion = 0.7 * vs->motion + 0.3 * changed;
+	vs->colors = 0.7 * vs->colors + 0.3 * colors;
+
+	struct a12_vframe_stats st = a12_channel_vstats(data->S, data->chid);
+	float ratio = st.bytes_in ? (float) st.bytes_out / (float) st.bytes_in : 0.5;
+
+/* per-region override, doesn't affect the hysteresis state. While DPNG is in
+ * use small regions stay with it, a raw frame in between would reset the
+ * accumulator and turn the next DPNG frame into a full one. */
+	if (region_px < 64 * 64){
+		base.method = vs->method == VFRAME_METHOD_DPNG ?
+			VFRAME_METHOD_DPNG : VFRAME_METHOD_NORMAL;
+		a12int_trace(A12_TRACE_VDETAIL,
+			"kind=vselect:ch=%d:region=%zu:method=%d",
+			(int) data->chid, region_px, base.method);
+		return base;
+	}
+
+/* without an encoder, the h264 cases fall back to what remains */
+	int candidate = VFRAME_METHOD_DPNG;
+#ifdef WANT_H264_ENC
+	if (vs->motion > 0.5 && vs->colors > 0.25)
+		candidate = VFRAME_METHOD_H264;
+	else if (st.method == VFRAME_METHOD_DPNG && ratio > 0.85)
+		candidate = vs->motion > 0.2 ? VFRAME_METHOD_H264 : VFRAME_METHOD_NORMAL;
+#else
+	if (st.method == VFRAME_METHOD_DPNG && ratio > 0.85)
+		candidate = VFRAME_METHOD_NORMAL;
+#endif
+
+/* switching to and away from h264 costs a full frame, be more conservative */
+	unsigned hold = 3;
+	if (candidate == VFRAME_METHOD_H264)
+		hold = 4;
+	else if (vs->method == VFRAME_METHOD_H264)
+		hold = 15;
+
+	if (candidate != vs->candidate){
+		vs->candidate = candidate;
+		vs->candidate_count = 0;
+	}
+
+	if (candidate != vs->method && ++vs->candidate_count >= hold){
+		a12int_trace(A12_TRACE_VIDEO, "kind=vselect:ch=%d:from=%d:to=%d:"
+			"motion=%.2f:colors=%.2f:ratio=%.2f", (int) data->chid,
+			vs->method, candidate, vs->motion, vs->colors, ratio
+		);
+		vs->method = candidate;
+		vs->candidate_count = 0;
+	}
+
+	base.method = vs->method;
+	return base;
+}
+
+/*
+ * Raw frames are cheap to produce but expensive to send, if the link can't
+ * carry one within the latency target, go through the delta encoder instead.
+ */
+static struct a12_vframe_opts vopts_link(
+	struct shmifsrv_thread_data* data, struct shmifsrv_vbuffer vb,
+	struct a12_vframe_opts base)
+{
+	if (base.method != VFRAME_METHOD_NORMAL &&
+		base.method != VFRAME_METHOD_RAW_NOALPHA &&
+		base.method != VFRAME_METHOD_RAW_RGB565)
+		return base;
+
+	size_t px = vb.w * vb.h;
+	if (region_valid(&vb))
+		px = (size_t)(vb.region.x2 - vb.region.x1) *
+			(size_t)(vb.region.y2 - vb.region.y1);
+
+	struct a12_iostat ios = a12_state_iostat(data->S);
+	size_t bytes = px * (base.method == VFRAME_METHOD_RAW_RGB565 ? 2 : 4);
+
+	if (ios.bps && bytes * 1000 / ios.bps > ios.latency_target){
+		a12int_trace(A12_TRACE_VDETAIL, "kind=vselect:ch=%d:message=raw->dpng:"
+			"bytes=%zu:bps=%zu", (int) data->chid, bytes, ios.bps);
+		base.method = VFRAME_METHOD_DPNG;
+	}
+
+	return base;
+}
+
 extern uint8_t* arcan_base64_encode(
 	const uint8_t* data, size_t inl, size_t* outl, enum arcan_memhint hint);
 
@@ -169,9 +376,109 @@ static void dispatch_bdata(
 	close(fd);
 }
 
+/*
+ * Cache entries are named by the hex- encoded checksum of their contents and
+ * the modification time is refreshed on every hit, so that an external tool
+ * can evict the least recently used ones.
+ */
+static bool has_checksum(uint8_t checksum[static 16])
+{
+	for (size_t i = 0; i < 16; i++)
+		if (checksum[i] != 0)
+			return true;
+	return false;
+}
+
+static void cache_name(uint8_t checksum[static 16], char out[static 33])
+{
+	for (size_t i = 0; i < 16; i++)
+		snprintf(&out[i * 2], 3, "%02x", checksum[i]);
+}
+
+static int cache_lookup(int dirfd, uint8_t checksum[static 16])
+{
+	char name[33];
+	cache_name(checksum, name);
+
+	int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (-1 == fd)
+		return -1;
+
+	futimens(fd, NULL);
+	a12int_trace(A12_TRACE_BTRANSFER, "kind=cache_hit:name=%s", name);
+	return fd;
+}
+
+static bool cache_known(int dirfd, uint8_t checksum[static 16])
+{
+	char name[33];
+	cache_name(checksum, name);
+	return 0 == faccessat(dirfd, name, F_OK, 0);
+}
+
+/*
+ * The checksum comes from the other side and is only trusted for the lookup,
+ * what goes into the cache has to actually match it or a client could taint
+ * the cache for the next session.
+ */
+static void cache_store(int dirfd, int fd, uint8_t checksum[static 16])
+{
+	char name[33];
+	char tmpname[sizeof(name) + 4];
+	cache_name(checksum, name);
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp", name);
+
+	int dfd = openat(dirfd, tmpname, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (-1 == dfd){
+		a12int_trace(A12_TRACE_BTRANSFER, "kind=error:cache_store:eperm");
+		return;
+	}
+
+	blake2b_state B;
+	blake2b_init(&B, 16);
+
+	uint8_t buf[65536];
+	off_t ofs = 0;
+	ssize_t nr;
+	bool ok = true;
+
+/* pread so the offset of the descriptor that gets forwarded is untouched */
+	while (ok && (nr = pread(fd, buf, sizeof(buf), ofs)) > 0){
+		blake2b_update(&B, buf, nr);
+		ofs += nr;
+
+		for (ssize_t pos = 0; pos < nr;){
+			ssize_t nw = write(dfd, &buf[pos], nr - pos);
+			if (-1 == nw){
+				if (errno == EINTR || errno == EAGAIN)
+					continue;
+				ok = false;
+				break;
+			}
+			pos += nw;
+		}
+	}
+	close(dfd);
+
+	uint8_t digest[16];
+	blake2b_final(&B, digest, 16);
+
+	if (!ok || memcmp(digest, checksum, 16) != 0 ||
+		-1 == renameat(dirfd, tmpname, dirfd, name)){
+		a12int_trace(A12_TRACE_BTRANSFER, "kind=error:cache_store:name=%s", name);
+		unlinkat(dirfd, tmpname, 0);
+		return;
+	}
+
+	a12int_trace(A12_TRACE_BTRANSFER,
+		"kind=cache_store:name=%s:size=%zu", name, (size_t) ofs);
+}
+
 static struct a12_bhandler_res incoming_bhandler(
 	struct a12_state* S, struct a12_bhandler_meta md, void* tag)
 {
+	struct a12helper_opts* opts = tag;
+
 	struct a12_bhandler_res res = {
 		.fd = -1,
 		.flag = A12_BHANDLER_DONTWANT
@@ -189,6 +496,14 @@ static struct a12_bhandler_res incoming_bhandler(
 			!md.streaming && md.state != A12_BHANDLER_CANCELLED){
 			a12int_trace(A12_TRACE_BTRANSFER,
 				"kind=accept:ch=%d:stream=%"PRIu64, md.channel, md.streamid);
+
+/* a cache hit is forwarded as a completed transfer as well, storing it again
+ * would just rewrite the same entry */
+			if (-1 != opts->dirfd_cache &&
+				md.state == A12_BHANDLER_COMPLETED && has_checksum(md.checksum) &&
+				!cache_known(opts->dirfd_cache, md.checksum))
+				cache_store(opts->dirfd_cache, md.fd, md.checksum);
+
 			dispatch_bdata(S, md.fd, md.type, md.dcont->user);
 		}
 /* already been dispatched as a pipe */
@@ -198,6 +513,10 @@ static struct a12_bhandler_res incoming_bhandler(
 		return res;
 	}
 
+/* nothing to forward or allocate on a cancelled transfer */
+	if (md.state != A12_BHANDLER_INITIALIZE)
+		return res;
+
 /* So the handler wants a descriptor for us to store or stream the transfer
  * into. If it is streaming, a pipe is sufficient and we can start the fwd
  * immediately. */
@@ -211,22 +530,17 @@ static struct a12_bhandler_res incoming_bhandler(
 		return res;
 	}
 
-/* INCOMPLETE
- * If there is a !0 checksum and a cache_dir has been set, check the cache for
- * a possible match by going to base64 and try to open. If successful, update
- * its timestamp, return that it was cached and trigger dispatch_bdata */
-	size_t i = 0;
-	for (; i < 16; i++){
-		if (md.checksum[i] != 0){
-			break;
+/* If there is a !0 checksum and a cache_dir has been set, check the cache for
+ * a possible match. The a12 state will cancel the transfer and send the cached
+ * descriptor back as completed, which triggers dispatch_bdata */
+	if (-1 != opts->dirfd_cache && has_checksum(md.checksum)){
+		int fd = cache_lookup(opts->dirfd_cache, md.checksum);
+		if (-1 != fd){
+			res.flag = A12_BHANDLER_CACHED;
+			res.fd = fd;
+			return res;
 		}
 	}
-	if (0 && i == 16){
-		a12int_trace(A12_TRACE_MISSING,
-			"btransfer cache-lookup and forward");
-		res.flag = A12_BHANDLER_CACHED;
-		return res;
-	}
 
 /*
  * Last case, real file with a known destination type and size. Since there is
@@ -397,6 +711,7 @@ static void on_srv_event(
 		return;
 	}
 	*new_data = *data;
+	new_data->vsample = (struct vframe_sampler){};
 
 /* Then we forward the subsegment to the local client */
 	new_data->chid = ev->tgt.ioevs[0].iv;
@@ -442,7 +757,7 @@ static void on_audio_cb(shmif_asample* buf,
 			.samplerate = rate
 		},
 		(struct a12_aframe_opts){
-			.method = AFRAME_METHOD_RAW
+			.method = AFRAME_METHOD_ADAPTIVE
 		}
 	);
 }
@@ -511,14 +826,23 @@ static void* client_thread(void* inarg)
 				goto out;
 			}
 
-/* the shared buffer_out marks if we should wait a bit before releasing the
- * client as to not keep oversaturating with incoming video frames, we could
- * threshold this to something more reasonable, or better yet, track the
- * trending curve and time-delay and use that to adjust the encoding parameters */
+/* if the link can't keep up, wait a bit before releasing the client so that
+ * we don't keep oversaturating with incoming video frames. The client will
+ * block on the unreleased buffer, so when the congestion clears the newest
+ * frame gets sent and the ones in between are skipped. */
 			if (pv & CLIENT_VBUFFER_READY){
-				if (atomic_load(&buffer_out) > 0){
+				BEGIN_CRITICAL(&giant_lock, "congestion");
+					struct a12_iostat ios = a12_state_iostat(data->S);
+					if (ios.congested){
+						a12int_trace(A12_TRACE_VDETAIL, "kind=congested:ch=%d:"
+							"pending=%zu:bps=%zu:rtt=%u", (int) data->chid,
+							ios.b_pending, ios.bps, ios.rtt_ms
+						);
+					}
+				END_CRITICAL(&giant_lock);
+
+				if (ios.congested)
 					break;
-				}
 
 /* two option, one is to map the dma-buf ourselves and do the readback, or with
  * streams map the stream and convert to h264 on gpu, but easiest now is to
@@ -528,8 +852,21 @@ static void* client_thread(void* inarg)
 				struct shmifsrv_vbuffer vb = shmifsrv_video(data->C);
 				BEGIN_CRITICAL(&giant_lock, "video-buffer");
 					a12_set_channel(data->S, data->chid);
-					a12_channel_vframe(data->S, &vb, vopts_from_segment(data, vb));
+					struct a12_vframe_opts vopts = vopts_from_segment(data, vb);
+					if (!data->opts.force_default){
+						vopts = vopts_adaptive(data, vb, vopts);
+						vopts = vopts_link(data, vb, vopts);
+					}
+					a12_channel_vframe(data->S, &vb, vopts);
 					dirty = true;
+
+/* the recording is shared between all segments, so write while locked */
+					uint64_t ts = arcan_timemillis() - data->opts.record_start;
+					if (-1 != data->opts.record_fd &&
+						!a12_record_vframe(data->opts.record_fd, data->chid, ts, &vb)){
+						a12int_trace(A12_TRACE_SYSTEM, "kind=error:recording_failed");
+						data->opts.record_fd = -1;
+					}
 				END_CRITICAL(&giant_lock);
 
 /* the other part is to, after a certain while of VBUFFER_READY but not any
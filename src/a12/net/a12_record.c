@@ -0,0 +1,157 @@
+/*
+ * Copyright: 2019, Bjorn Stahl
+ * License: 3-Clause BSD
+ * Description: Recording of client video buffers, see a12_record.h
+ */
+#include <arcan_shmif.h>
+#include <arcan_shmif_server.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "pack.h"
+#include "a12_record.h"
+
+static const uint8_t magic[8] = {'A', '1', '2', 'R', 'E', 'C', 0, 1};
+
+#define FRAME_HDR_SZ 26
+
+static bool write_all(int fd, uint8_t* buf, size_t sz)
+{
+	while (sz){
+		ssize_t nw = write(fd, buf, sz);
+		if (-1 == nw){
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return false;
+		}
+		buf += nw;
+		sz -= nw;
+	}
+	return true;
+}
+
+static bool read_all(int fd, uint8_t* buf, size_t sz)
+{
+	while (sz){
+		ssize_t nr = read(fd, buf, sz);
+		if (0 == nr)
+			return false;
+
+		if (-1 == nr){
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			return false;
+		}
+		buf += nr;
+		sz -= nr;
+	}
+	return true;
+}
+
+bool a12_record_open(int fd)
+{
+	return write_all(fd, (uint8_t*) magic, sizeof(magic));
+}
+
+bool a12_record_check(int fd)
+{
+	uint8_t buf[sizeof(magic)];
+	return read_all(fd, buf, sizeof(buf)) && memcmp(buf, magic, sizeof(buf)) == 0;
+}
+
+bool a12_record_vframe(int fd,
+	uint8_t chid, uint64_t ts, struct shmifsrv_vbuffer* vb)
+{
+	size_t data_sz = vb->w * vb->h * sizeof(shmif_pixel);
+
+/* tpack carries its own length, validated by the encoder */
+	if (vb->flags.tpack){
+		uint32_t tpack_sz;
+		unpack_u32(&tpack_sz, vb->buffer_bytes);
+		data_sz = tpack_sz;
+	}
+
+	uint8_t hdr[FRAME_HDR_SZ];
+	pack_u64(ts, &hdr[0]);
+	hdr[8] = chid;
+	hdr[9] =
+		(vb->flags.tpack ? 1 : 0) |
+		(vb->flags.ignore_alpha ? 2 : 0) |
+		(vb->flags.subregion ? 4 : 0) |
+		(vb->flags.origo_ll ? 8 : 0);
+	pack_u16(vb->w, &hdr[10]);
+	pack_u16(vb->h, &hdr[12]);
+	pack_u16(vb->region.x1, &hdr[14]);
+	pack_u16(vb->region.y1, &hdr[16]);
+	pack_u16(vb->region.x2, &hdr[18]);
+	pack_u16(vb->region.y2, &hdr[20]);
+	pack_u32(data_sz, &hdr[22]);
+
+	if (!write_all(fd, hdr, FRAME_HDR_SZ))
+		return false;
+
+	if (vb->flags.tpack || vb->pitch == vb->w)
+		return write_all(fd, vb->buffer_bytes, data_sz);
+
+	for (size_t y = 0; y < vb->h; y++){
+		if (!write_all(fd, (uint8_t*) &vb->buffer[y * vb->pitch],
+			vb->w * sizeof(shmif_pixel)))
+			return false;
+	}
+
+	return true;
+}
+
+bool a12_record_read(int fd, struct a12_record_frame* out)
+{
+	uint8_t hdr[FRAME_HDR_SZ];
+	if (!read_all(fd, hdr, FRAME_HDR_SZ))
+		return false;
+
+	uint16_t w, h, x1, y1, x2, y2;
+	uint32_t data_sz;
+
+	*out = (struct a12_record_frame){};
+	unpack_u64(&out->ts, &hdr[0]);
+	out->chid = hdr[8];
+	unpack_u16(&w, &hdr[10]);
+	unpack_u16(&h, &hdr[12]);
+	unpack_u16(&x1, &hdr[14]);
+	unpack_u16(&y1, &hdr[16]);
+	unpack_u16(&x2, &hdr[18]);
+	unpack_u16(&y2, &hdr[20]);
+	unpack_u32(&data_sz, &hdr[22]);
+
+	bool tpack = hdr[9] & 1;
+	if (!w || !h || data_sz > w * h * sizeof(shmif_pixel) ||
+		(!tpack && data_sz != w * h * sizeof(shmif_pixel)))
+		return false;
+
+	uint8_t* buf = malloc(data_sz);
+	if (!buf || !read_all(fd, buf, data_sz)){
+		free(buf);
+		return false;
+	}
+
+	out->buf_sz = data_sz;
+	out->vb = (struct shmifsrv_vbuffer){
+		.state = VBUFFER_OKDATA,
+		.buffer_bytes = buf,
+		.w = w,
+		.h = h,
+		.pitch = w,
+		.stride = w * sizeof(shmif_pixel),
+		.region = {
+			.x1 = x1, .y1 = y1, .x2 = x2, .y2 = y2
+		},
+		.flags = {
+			.tpack = tpack,
+			.ignore_alpha = hdr[9] & 2,
+			.subregion = hdr[9] & 4,
+			.origo_ll = hdr[9] & 8
+		}
+	};
+
+	return true;
+}
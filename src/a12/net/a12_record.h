@@ -0,0 +1,55 @@
+/*
+ * Copyright: 2019, Bjorn Stahl
+ * License: 3-Clause BSD
+ * Description: Recording of the video buffers that clients submit to the
+ * shmif- server side of arcan-net, before they are encoded. This is used to
+ * compare encoders offline on captured sessions (see tests/core/a12replay).
+ *
+ * The file is a 8 byte header (magic + version) followed by records:
+ * [0..7]   timestamp (ms since the recording started) : uint64
+ * [8]      channel-id : uint8
+ * [9]      flags (1: tpack, 2: ignore_alpha, 4: subregion, 8: origo_ll)
+ * [10..11] width : uint16
+ * [12..13] height : uint16
+ * [14..21] subregion x1, y1, x2, y2 : uint16
+ * [22..25] data length : uint32
+ * [26..n]  data, tightly packed rows of shmif_pixel or a tpack buffer
+ *
+ * All fields are little endian.
+ */
+
+#ifndef HAVE_A12_RECORD
+#define HAVE_A12_RECORD
+
+struct a12_record_frame {
+	uint64_t ts;
+	uint8_t chid;
+	size_t buf_sz;
+	struct shmifsrv_vbuffer vb;
+};
+
+/*
+ * Write the file header to [fd], returns false if it couldn't be written.
+ */
+bool a12_record_open(int fd);
+
+/*
+ * Append the contents of [vb] as channel [chid] to the recording in [fd],
+ * with [ts] as the timestamp. Returns false if it couldn't be written.
+ */
+bool a12_record_vframe(int fd,
+	uint8_t chid, uint64_t ts, struct shmifsrv_vbuffer* vb);
+
+/*
+ * Verify the header of the recording in [fd], call before reading frames.
+ */
+bool a12_record_check(int fd);
+
+/*
+ * Read the next frame from the recording in [fd] into [out]. The buffer in
+ * out->vb is allocated and needs to be freed by the caller. Returns false
+ * at the end of the recording or if it is corrupt.
+ */
+bool a12_record_read(int fd, struct a12_record_frame* out);
+
+#endif
@@ -12,6 +12,7 @@
 #include <sys/wait.h>
 #include <stdarg.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -20,11 +21,15 @@
 #include "a12.h"
 #include "a12_int.h"
 #include "a12_helper.h"
+#include "a12_record.h"
 #include "anet_helper.h"
 
 enum mt_mode {
 	MT_SINGLE = 0,
-	MT_FORK = 1
+	MT_FORK = 1,
+	MT_MULTI = 2,
+/* nothing requested, resolved when the connection mode is known */
+	MT_DEFAULT = 3
 };
 
 static const char* trace_groups[] = {
@@ -115,17 +120,84 @@ static void single_a12srv(struct a12_state* S, int fd, void* tag)
 	a12helper_a12srv_shmifcl(S, NULL, fd, fd);
 }
 
+#ifdef __LINUX
+static void multi_a12srv(struct a12_state* S, int fd, void* tag)
+{
+	if (!a12helper_a12srv_mt_add(tag, S, fd))
+		a12int_trace(A12_TRACE_SYSTEM, "couldn't add client to worker pool");
+}
+#endif
+
+/*
+ * Open the recording destination (if one has been requested), in fork mode
+ * each session gets its own file suffixed with the pid of the process.
+ */
+static int open_record(struct anet_options* args, bool per_process)
+{
+	if (!args->record)
+		return -1;
+
+	char buf[PATH_MAX];
+	if (per_process)
+		snprintf(buf, sizeof(buf), "%s.%d", args->record, (int) getpid());
+	else
+		snprintf(buf, sizeof(buf), "%s", args->record);
+
+	int fd = open(buf, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (-1 == fd){
+		fprintf(stderr, "couldn't open recording (%s): %s\n", buf, strerror(errno));
+		return -1;
+	}
+
+	if (!a12_record_open(fd)){
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*
+ * The binary transfer cache persists between sessions, any entry in it is
+ * named after the checksum of its contents so it can be shared between
+ * concurrent sessions as well.
+ */
+static int open_cache(struct anet_options* args)
+{
+	if (!args->cache_dir)
+		return -1;
+
+	int fd = open(args->cache_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (-1 == fd)
+		fprintf(stderr, "couldn't open cache (%s): %s\n",
+			args->cache_dir, strerror(errno));
+
+	return fd;
+}
+
 static void a12cl_dispatch(
 	struct anet_options* args,
 	struct a12_state* S, struct shmifsrv_client* cl, int fd)
 {
+	int record_fd = open_record(args, false);
+	uint64_t record_start = arcan_timemillis();
+	int cache_fd = open_cache(args);
+
 /* note that the a12helper will do the cleanup / free */
 	a12helper_a12cl_shmifsrv(S, cl, fd, fd, (struct a12helper_opts){
 		.dirfd_temp = -1,
-		.dirfd_cache = -1,
+		.dirfd_cache = cache_fd,
 		.redirect_exit = args->redirect_exit,
-		.devicehint_cp = args->devicehint_cp
+		.devicehint_cp = args->devicehint_cp,
+		.record_fd = record_fd,
+		.record_start = record_start
 	});
+
+	if (-1 != record_fd)
+		close(record_fd);
+
+	if (-1 != cache_fd)
+		close(cache_fd);
 }
 
 static void fork_a12cl_dispatch(
@@ -137,9 +209,11 @@ static void fork_a12cl_dispatch(
 /* missing: extend sandboxing, close stdio */
 		a12helper_a12cl_shmifsrv(S, cl, fd, fd, (struct a12helper_opts){
 			.dirfd_temp = -1,
-			.dirfd_cache = -1,
+			.dirfd_cache = open_cache(args),
 			.redirect_exit = args->redirect_exit,
-			.devicehint_cp = args->devicehint_cp
+			.devicehint_cp = args->devicehint_cp,
+			.record_fd = open_record(args, true),
+			.record_start = arcan_timemillis()
 		});
 		exit(EXIT_SUCCESS);
 	}
@@ -311,13 +385,18 @@ static int a12_preauth(struct anet_options* args,
 static bool show_usage(const char* msg)
 {
 	fprintf(stderr, "%s%sUsage:\n"
-	"\tForward local arcan applications: arcan-net [-Xtd] -s connpoint host port\n"
+	"\tForward local arcan applications: arcan-net [-Xtdrc] -s connpoint host port\n"
 	"\t                                  (inherit socket) -S fd_no host port\n"
-	"\tBridge remote arcan applications: arcan-net [-Xtd] -l port [ip]\n\n"
+	"\tBridge remote arcan applications: arcan-net [-Xtdj] -l port [ip]\n\n"
 	"Forward-local options:\n"
-	"\t-X        \t Disable EXIT-redirect to ARCAN_CONNPATH env (if set)\n\n"
+	"\t-X        \t Disable EXIT-redirect to ARCAN_CONNPATH env (if set)\n"
+	"\t-r file   \t Record client video buffers to file (file.pid in fork mode)\n"
+	"\t-c dir    \t Cache received fonts and other blobs in dir\n\n"
+	"Bridge-remote options:\n"
+	"\t-j ms     \t Pace video through a jitter buffer of at most ms\n\n"
 	"Options:\n"
 	"\t-t single- client (no fork/mt)\n"
+	"\t-M n      \t (-l only) all clients in one process, n worker threads\n"
 	"\t-d bitmap \t set trace bitmap (bitmask or key1,key2,...)\n"
 	"\nTrace groups (stderr):\n"
 	"\tvideo:1      audio:2      system:4    event:8      transfer:16\n"
@@ -431,9 +510,33 @@ static bool apply_commandline(int argc, char** argv, struct anet_options* opts)
 		else if (strcmp(argv[i], "-t") == 0){
 			opts->mt_mode = MT_SINGLE;
 		}
+		else if (strcmp(argv[i], "-M") == 0){
+			if (i == argc - 1)
+				return show_usage("-M without worker count argument");
+			opts->mt_mode = MT_MULTI;
+			opts->mt_workers = strtoul(argv[++i], NULL, 10);
+			if (!opts->mt_workers)
+				return show_usage("-M worker count should be > 0");
+		}
 		else if (strcmp(argv[i], "-X") == 0){
 			opts->redirect_exit = NULL;
 		}
+		else if (strcmp(argv[i], "-r") == 0){
+			if (i == argc - 1)
+				return show_usage("-r without destination argument");
+			opts->record = argv[++i];
+		}
+		else if (strcmp(argv[i], "-j") == 0){
+			if (i == argc - 1)
+				return show_usage("-j without latency argument");
+			opts->opts->jitter_buffer = strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "-c") == 0){
+			if (i == argc - 1)
+				return show_usage("-c without cache directory argument");
+			opts->cache_dir = argv[++i];
+			opts->opts->bstream_cache = true;
+		}
 	}
 
 	return true;
@@ -441,7 +544,9 @@ static bool apply_commandline(int argc, char** argv, struct anet_options* opts)
 
 int main(int argc, char** argv)
 {
-	struct anet_options anet = {};
+	struct anet_options anet = {
+		.mt_mode = MT_DEFAULT
+	};
 	anet.opts = a12_sensitive_alloc(sizeof(struct a12_context_options));
 
 /* set this as default, so the remote side can't actually close */
@@ -451,6 +556,9 @@ int main(int argc, char** argv)
 /* setup default / junk authentication key */
 	a12_plain_kdf(NULL, anet.opts);
 
+/* keep large frames from holding up input and other segments */
+	anet.opts->worker_decode = true;
+
 	if (!apply_commandline(argc, argv, &anet))
 		return show_usage("Invalid arguments");
 
@@ -458,6 +566,10 @@ int main(int argc, char** argv)
 	if (!anet.mode)
 		return show_usage("No mode specified, please use -s or -l form");
 
+/* listening forks per client, the outbound forms stay in one process */
+	if (anet.mt_mode == MT_DEFAULT)
+		anet.mt_mode = anet.mode == ANET_SHMIF_CL ? MT_FORK : MT_SINGLE;
+
 	char* errmsg;
 
 	if (anet.mode == ANET_SHMIF_CL){
@@ -470,11 +582,33 @@ int main(int argc, char** argv)
 			fprintf(stderr, "%s", errmsg ? errmsg : "");
 			free(errmsg);
 		break;
+#ifdef __LINUX
+/* the pool is the only set of threads doing decoding, with per-channel
+ * decode threads a large number of clients would defeat the point. Sessions
+ * are only stepped on activity, so there is nothing to present held frames
+ * from either. */
+		case MT_MULTI:{
+			anet.opts->worker_decode = false;
+			anet.opts->jitter_buffer = 0;
+			struct a12helper_mt* pool = a12helper_a12srv_mt(NULL, anet.mt_workers);
+			if (!pool){
+				fprintf(stderr, "couldn't setup worker pool, check ARCAN_CONNPATH\n");
+				break;
+			}
+			anet_listen(&anet, &errmsg, multi_a12srv, pool);
+			fprintf(stderr, "%s", errmsg ? errmsg : "");
+			free(errmsg);
+		}
+		break;
+#endif
 		default:
 		break;
 		}
 		return EXIT_FAILURE;
 	}
+
+	if (anet.mt_mode == MT_MULTI)
+		return show_usage("-M only applies to -l");
 	if (anet.mode == ANET_SHMIF_SRV_INHERIT){
 		return a12_preauth(&anet, a12cl_dispatch);
 	}
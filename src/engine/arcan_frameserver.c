@@ -109,6 +109,11 @@ arcan_errc arcan_frameserver_free(arcan_frameserver* src)
 	}
 	src->alocks = NULL;
 
+	tui_raster_rows_free(src->desc.tpack_rows);
+	tui_raster_grid_free(src->desc.tpack_grid);
+	src->desc.tpack_rows = NULL;
+	src->desc.tpack_grid = NULL;
+
 	char msg[32];
 	if (!platform_fsrv_lastwords(src, msg, COUNT_OF(msg)))
 		snprintf(msg, COUNT_OF(msg), "Couldn't access metadata (SIGBUS?)");
@@ -186,6 +191,22 @@ bool arcan_frameserver_control_chld(arcan_frameserver* src){
 	return true;
 }
 
+/*
+ * TPACK can be drawn as instanced cells against a glyph atlas texture rather
+ * than rasterized and uploaded in full, for now this is opt-in through the
+ * video_tpack_cells config key (or ARCAN_VIDEO_TPACK_CELLS)
+ */
+static bool tpack_cells()
+{
+	static int state = -1;
+	if (-1 == state){
+		uintptr_t tag;
+		cfg_lookup_fun get_config = platform_config_lookup(&tag);
+		state = get_config("video_tpack_cells", 0, NULL, tag);
+	}
+	return state;
+}
+
 static bool push_buffer(arcan_frameserver* src,
 	struct agp_vstore* store, struct arcan_shmif_region* dirty)
 {
@@ -239,6 +260,9 @@ static bool push_buffer(arcan_frameserver* src,
 			src->flags.no_alpha_copy ? GL_NOALPHA_PIXEL_FORMAT : GL_STORE_PIXEL_FORMAT;
 
 		arcan_video_resizefeed(src->vid, src->desc.width, src->desc.height);
+		tui_raster_rows_reset(src->desc.tpack_rows);
+		tui_raster_grid_free(src->desc.tpack_grid);
+		src->desc.tpack_grid = NULL;
 
 		src->desc.rz_flag = false;
 		explicit = true;
@@ -262,12 +286,30 @@ static bool push_buffer(arcan_frameserver* src,
 		if (mmsz <= EPSILON)
 			mmsz = 3.527780;
 
-		tui_raster_renderagp(
-			arcan_renderfun_fontraster(NULL, 0, ppcm, mmsz), store, (uint8_t*) buf,
-			src->desc.width * src->desc.height * sizeof(shmif_pixel));
+		struct tui_raster_context* raster =
+			arcan_renderfun_fontraster(NULL, 0, ppcm, mmsz);
+		size_t buf_sz = src->desc.width * src->desc.height * sizeof(shmif_pixel);
+
+		if (tpack_cells())
+			tui_raster_gridagp(raster,
+				store, &src->desc.tpack_grid, (uint8_t*) buf, buf_sz);
+		else
+			tui_raster_renderagp(raster,
+				store, &src->desc.tpack_rows, (uint8_t*) buf, buf_sz);
 		goto commit_mask;
 	}
 
+/* anything else replaces what the raster drew */
+	if (src->desc.tpack_rows){
+		tui_raster_rows_free(src->desc.tpack_rows);
+		src->desc.tpack_rows = NULL;
+	}
+
+	if (src->desc.tpack_grid){
+		tui_raster_grid_free(src->desc.tpack_grid);
+		src->desc.tpack_grid = NULL;
+	}
+
 	if (-1 != src->vstream.handle){
 		bool failev = src->vstream.dead;
 
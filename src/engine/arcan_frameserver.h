@@ -55,6 +55,11 @@ struct arcan_frameserver_meta {
 		int fd[2];
 	} hint;
 
+/* what the TPACK raster last drew into each row of the store, or the cells
+ * of the store when those are drawn on the GPU */
+	struct tui_raster_rows* tpack_rows;
+	struct tui_raster_grid* tpack_grid;
+
 /* primarily for feedcopy */
 	uint32_t synch_ts;
 
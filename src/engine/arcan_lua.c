@@ -10333,7 +10333,24 @@ static int getbenchvals(lua_State* ctx)
 		i = (i + 1) % bench_sz;
 	}
 
-	LUA_ETRACE("benchmark_data", NULL, 6);
+	struct arcan_raster_stats rstats;
+	arcan_renderfun_rasterstats(&rstats);
+	lua_newtable(ctx);
+	top = lua_gettop(ctx);
+	tblnum(ctx, "contexts", rstats.contexts, top);
+	tblnum(ctx, "glyphs", rstats.glyphs, top);
+	tblnum(ctx, "glyph_slots", rstats.glyph_slots, top);
+	tblnum(ctx, "glyph_hits", rstats.glyph_hits, top);
+	tblnum(ctx, "glyph_misses", rstats.glyph_misses, top);
+	tblnum(ctx, "lines", rstats.lines, top);
+	tblnum(ctx, "lines_reused", rstats.lines_reused, top);
+	tblnum(ctx, "ttf_glyphs", rstats.ttf_glyphs, top);
+	tblnum(ctx, "ttf_bytes", rstats.ttf_bytes, top);
+	tblnum(ctx, "ttf_hits", rstats.ttf_hits, top);
+	tblnum(ctx, "ttf_misses", rstats.ttf_misses, top);
+	tblnum(ctx, "ttf_evictions", rstats.ttf_evictions, top);
+
+	LUA_ETRACE("benchmark_data", NULL, 7);
 }
 
 static int timestamp(lua_State* ctx)
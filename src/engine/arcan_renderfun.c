@@ -21,6 +21,10 @@
 #define ARCAN_FONT_CACHE_LIMIT 8
 #endif
 
+#ifndef ARCAN_RASTER_CACHE_LIMIT
+#define ARCAN_RASTER_CACHE_LIMIT 4
+#endif
+
 #define ARCAN_TTF
 
 #include "arcan_math.h"
@@ -223,6 +227,9 @@ static void update_style(struct text_format* dst, struct font_entry* font)
 	dst->font = font;
 }
 
+/* glyph cache counters of the fonts that have been closed */
+static struct ttf_cache_stats font_closed;
+
 static void zap_slot(int i)
 {
 	for (size_t j = 0; j < font_cache[i].chain.count; j++){
@@ -231,8 +238,10 @@ static void zap_slot(int i)
 			font_cache[i].chain.fd[j] = BADFD;
 		}
 
-		if (font_cache[i].chain.data[j])
+		if (font_cache[i].chain.data[j]){
+			TTF_CacheStats(font_cache[i].chain.data[j], &font_closed);
 			TTF_CloseFont(font_cache[i].chain.data[j]);
+		}
 	}
 	free(font_cache[i].identifier);
 	memset(&font_cache[i], '\0', sizeof(font_cache[0]));
@@ -1464,10 +1473,24 @@ int arcan_renderfun_stretchblit(char* src, int inw, int inh,
 	return 1;
 }
 
+/*
+ * Raster contexts (and with them the glyph caches) are shared between all
+ * frameservers that resolve to the same font and pixel size. The fonts are
+ * always the builtin one for now, so the pixel size is the key. When the
+ * limit is reached the least recently used context is replaced, and its
+ * counters are kept so the stats cover the lifetime of the engine.
+ */
+static struct {
+	struct tui_raster_context* ctx;
+	size_t px_sz;
+	uint64_t last_use;
+} raster_cache[ARCAN_RASTER_CACHE_LIMIT];
+static uint64_t raster_clock;
+static struct tui_raster_stats raster_evicted;
+
 struct tui_raster_context*
 	arcan_renderfun_fontraster(uint64_t* refs, size_t n_fonts, float ppcm, float size_mm)
 {
-	static struct tui_raster_context* temp_ctx;
 	size_t w, h;
 
 	struct tui_font* fonts[1] = {
@@ -1486,12 +1509,74 @@ struct tui_raster_context*
  * and request that from the builtin bitmap font */
 	tui_pixelfont_setsz(builtin_bitmap.bitmap, px_sz, &w, &h);
 
-	if (!temp_ctx){
-		temp_ctx = tui_raster_setup(w, h);
-		tui_raster_setfont(temp_ctx, fonts, 1);
+	size_t slot = 0;
+	raster_clock++;
+
+	for (size_t i = 0; i < ARCAN_RASTER_CACHE_LIMIT; i++){
+		if (raster_cache[i].ctx && raster_cache[i].px_sz == px_sz){
+			raster_cache[i].last_use = raster_clock;
+			return raster_cache[i].ctx;
+		}
+
+		if (!raster_cache[i].ctx ||
+			(raster_cache[slot].ctx &&
+			raster_cache[i].last_use < raster_cache[slot].last_use))
+			slot = i;
+	}
+
+	struct tui_raster_context* ctx = tui_raster_setup(w, h);
+	if (!ctx)
+		return NULL;
+
+	tui_raster_setfont(ctx, fonts, 1);
+
+	if (raster_cache[slot].ctx){
+		tui_raster_stats(raster_cache[slot].ctx, &raster_evicted);
+		tui_raster_free(raster_cache[slot].ctx);
+	}
+
+	raster_cache[slot].ctx = ctx;
+	raster_cache[slot].px_sz = px_sz;
+	raster_cache[slot].last_use = raster_clock;
+
+	return ctx;
+}
+
+void arcan_renderfun_rasterstats(struct arcan_raster_stats* out)
+{
+	struct tui_raster_stats stats = raster_evicted;
+	*out = (struct arcan_raster_stats){0};
+
+/* only the live contexts count towards occupancy */
+	stats.glyphs = stats.glyph_slots = 0;
+
+	for (size_t i = 0; i < ARCAN_RASTER_CACHE_LIMIT; i++){
+		if (!raster_cache[i].ctx)
+			continue;
+
+		out->contexts++;
+		tui_raster_stats(raster_cache[i].ctx, &stats);
+	}
+
+	out->glyphs = stats.glyphs;
+	out->glyph_slots = stats.glyph_slots;
+	out->glyph_hits = stats.glyph_hits;
+	out->glyph_misses = stats.glyph_misses;
+	out->lines = stats.lines;
+	out->lines_reused = stats.lines_reused;
+
+	struct ttf_cache_stats fstats = font_closed;
+	fstats.glyphs = fstats.bytes = 0;
+
+	for (size_t i = 0; i < font_cache_size; i++){
+		for (size_t j = 0; j < font_cache[i].chain.count; j++)
+			if (font_cache[i].chain.data[j])
+				TTF_CacheStats(font_cache[i].chain.data[j], &fstats);
 	}
-	else
-		tui_raster_cell_size(temp_ctx, w, h);
 
-	return temp_ctx;
+	out->ttf_glyphs = fstats.glyphs;
+	out->ttf_bytes = fstats.bytes;
+	out->ttf_hits = fstats.hits;
+	out->ttf_misses = fstats.misses;
+	out->ttf_evictions = fstats.evictions;
 }
@@ -139,3 +139,27 @@ struct tui_raster_context;
 struct tui_raster_context*
 	arcan_renderfun_fontraster(
 		uint64_t* refs, size_t n_fonts, float ppcm, float size_mm);
+
+/*
+ * Usage statistics for the raster contexts returned by fontraster, summed
+ * over all of them. [glyphs] out of [glyph_slots] is the current occupancy of
+ * the glyph caches, the counters are accumulated since startup.
+ *
+ * The ttf_ fields cover the glyph caches of the vector fonts used for text
+ * rendering in the same way, [ttf_bytes] is their current size.
+ */
+struct arcan_raster_stats {
+	size_t contexts;
+	size_t glyphs;
+	size_t glyph_slots;
+	uint64_t glyph_hits;
+	uint64_t glyph_misses;
+	uint64_t lines;
+	uint64_t lines_reused;
+	size_t ttf_glyphs;
+	size_t ttf_bytes;
+	uint64_t ttf_hits;
+	uint64_t ttf_misses;
+	uint64_t ttf_evictions;
+};
+void arcan_renderfun_rasterstats(struct arcan_raster_stats* out);
@@ -58,6 +58,21 @@
 #define CACHED_BITMAP	0x01
 #define CACHED_PIXMAP	0x02
 
+/*
+ * Glyphs are cached per font in a hash table keyed on the codepoint (or
+ * index) along with the font state that changes how it is rasterized, i.e.
+ * style, outline and hinting, so that switching between these does not throw
+ * away what is already there. Entries are added as needed until the cache
+ * holds more than the budget (in bytes, bitmaps included), after which the
+ * least recently used entry is reused. Codepoints missing from the font are
+ * cached as well so that a fallback chain doesn't ask FreeType again.
+ */
+#ifndef TTF_GLYPH_CACHE_BUDGET
+#define TTF_GLYPH_CACHE_BUDGET (4 * 1024 * 1024)
+#endif
+
+#define GLYPH_BUCKETS 512
+
 /* Cached glyph information */
 typedef struct cached_glyph {
 	int stored;
@@ -72,6 +87,18 @@ typedef struct cached_glyph {
 	int advance;
 	uint32_t cached;
 
+/* rest of the cache key, see Find_Glyph */
+	int style;
+	int outline;
+	int hinting;
+	bool by_ind;
+	bool missing;
+
+/* hash chain and LRU order, these are cache indices + 1, 0 terminates */
+	uint32_t hnext;
+	uint32_t lprev;
+	uint32_t lnext;
+
 /* special case, set this to true when we deal with non- scalable fonts with
  * embedded bitmaps where we scale to fit the set pt- size (or, with a
  * render-chain, the cached height of the main font */
@@ -108,7 +135,18 @@ struct _TTF_Font {
 
 	/* Cache for style-transformed glyphs */
 	c_glyph *current;
-	c_glyph cache[257]; /* 257 is a prime */
+	c_glyph *cache;
+	uint32_t cache_sz;
+	uint32_t cache_used;
+	uint32_t buckets[GLYPH_BUCKETS];
+	uint32_t lru_first;
+	uint32_t lru_last;
+	uint32_t free_first;
+	uint32_t free_count;
+	size_t cache_bytes;
+	uint64_t cache_hits;
+	uint64_t cache_misses;
+	uint64_t cache_evictions;
 
 	/* We are responsible for closing the font stream */
 	FILE* src;
@@ -493,17 +531,146 @@ static void Flush_Glyph( c_glyph* glyph )
 
 void TTF_Flush_Cache( TTF_Font* font )
 {
-	int i;
-	int size = sizeof( font->cache ) / sizeof( font->cache[0] );
+	for (size_t i = 0; i < font->cache_used; i++)
+		Flush_Glyph(&font->cache[i]);
+
+	memset(font->buckets, '\0', sizeof(font->buckets));
+	font->cache_used = 0;
+	font->lru_first = font->lru_last = 0;
+	font->free_first = font->free_count = 0;
+	font->cache_bytes = 0;
+	font->current = NULL;
+}
 
-	for( i = 0; i < size; ++i ) {
-		if( font->cache[i].cached ) {
-			Flush_Glyph( &font->cache[i] );
-		}
+void TTF_CacheStats(TTF_Font* font, struct ttf_cache_stats* out)
+{
+	out->glyphs += font->cache_used - font->free_count;
+	out->bytes += font->cache_bytes;
+	out->hits += font->cache_hits;
+	out->misses += font->cache_misses;
+	out->evictions += font->cache_evictions;
+}
+
+static size_t glyph_bytes(c_glyph* glyph)
+{
+	size_t sz = sizeof(c_glyph);
+
+	if (glyph->bitmap.buffer)
+		sz += (size_t) glyph->bitmap.pitch * glyph->bitmap.rows;
+
+	if (glyph->pixmap.buffer)
+		sz += (size_t) glyph->pixmap.pitch * glyph->pixmap.rows;
+
+	return sz;
+}
+
+static uint32_t glyph_hash(
+	uint32_t ch, int style, int outline, int hinting, bool by_ind)
+{
+	uint32_t h = ch * 0x9e3779b1 ^
+		(uint32_t)(style | hinting << 8 | by_ind << 15) * 0x85ebca77 ^
+		(uint32_t) outline * 0xc2b2ae3d;
+
+	return (h ^ (h >> 15)) & (GLYPH_BUCKETS - 1);
+}
+
+static void lru_unlink(TTF_Font* font, uint32_t ind)
+{
+	c_glyph* glyph = &font->cache[ind-1];
+
+	if (glyph->lprev)
+		font->cache[glyph->lprev-1].lnext = glyph->lnext;
+	else
+		font->lru_first = glyph->lnext;
+
+	if (glyph->lnext)
+		font->cache[glyph->lnext-1].lprev = glyph->lprev;
+	else
+		font->lru_last = glyph->lprev;
+
+	glyph->lprev = glyph->lnext = 0;
+}
+
+static void lru_push(TTF_Font* font, uint32_t ind)
+{
+	c_glyph* glyph = &font->cache[ind-1];
+
+	glyph->lprev = 0;
+	glyph->lnext = font->lru_first;
+
+	if (font->lru_first)
+		font->cache[font->lru_first-1].lprev = ind;
+	else
+		font->lru_last = ind;
+
+	font->lru_first = ind;
+}
+
+/* take the least recently used entry out of the cache */
+static uint32_t glyph_evict(TTF_Font* font)
+{
+	uint32_t ind = font->lru_last;
+	c_glyph* glyph = &font->cache[ind-1];
+	uint32_t* link = &font->buckets[glyph_hash(glyph->cached,
+		glyph->style, glyph->outline, glyph->hinting, glyph->by_ind)];
+
+	while (*link != ind)
+		link = &font->cache[*link-1].hnext;
+	*link = glyph->hnext;
+
+	lru_unlink(font, ind);
+	font->cache_bytes -= glyph_bytes(glyph);
+	Flush_Glyph(glyph);
+	font->cache_evictions++;
+
+	return ind;
+}
 
+/* evict until the cache is within the budget again, [keep] is left alone
+ * and the entries freed are reused by glyph_alloc */
+static void glyph_trim(TTF_Font* font, uint32_t keep)
+{
+	while (font->cache_bytes > TTF_GLYPH_CACHE_BUDGET &&
+		font->lru_last && font->lru_last != keep){
+		uint32_t ind = glyph_evict(font);
+		font->cache[ind-1].hnext = font->free_first;
+		font->free_first = ind;
+		font->free_count++;
 	}
 }
 
+/* get an empty entry, growing the cache until the budget is reached */
+static uint32_t glyph_alloc(TTF_Font* font)
+{
+	uint32_t ind;
+
+	if (font->free_first){
+		ind = font->free_first;
+		font->free_first = font->cache[ind-1].hnext;
+		font->free_count--;
+	}
+	else if (font->lru_last && font->cache_bytes >= TTF_GLYPH_CACHE_BUDGET){
+		ind = glyph_evict(font);
+	}
+	else {
+		if (font->cache_used == font->cache_sz){
+			uint32_t nsz = font->cache_sz ? font->cache_sz * 2 : 64;
+			c_glyph* cache = realloc(font->cache, nsz * sizeof(c_glyph));
+			if (!cache)
+				return 0;
+			font->cache = cache;
+			font->cache_sz = nsz;
+		}
+		ind = ++font->cache_used;
+	}
+
+	memset(&font->cache[ind-1], '\0', sizeof(c_glyph));
+	font->cache_bytes += sizeof(c_glyph);
+	lru_push(font, ind);
+
+	return ind;
+}
+
 static FT_Error Load_Glyph(
 	TTF_Font* font, uint32_t ch, c_glyph* cached, int want, bool by_ind )
 {
@@ -836,16 +1003,63 @@ static FT_Error Find_Glyph(
 	TTF_Font* font, uint32_t ch, int want, bool by_ind)
 {
 	int retval = 0;
-	int hsize = sizeof( font->cache ) / sizeof( font->cache[0] );
+	int style = font->style & ~TTF_STYLE_NO_GLYPH_CHANGE;
+	uint32_t h = glyph_hash(ch, style, font->outline, font->hinting, by_ind);
+	uint32_t ind = font->buckets[h];
+	c_glyph* glyph;
+
+	for (; ind; ind = glyph->hnext){
+		glyph = &font->cache[ind-1];
+		if (glyph->cached == ch && glyph->by_ind == by_ind &&
+			glyph->style == style && glyph->outline == font->outline &&
+			glyph->hinting == font->hinting)
+			break;
+	}
+
+/* the entry is linked in before it is loaded, a failed load that isn't a
+ * missing glyph will be retried on the next lookup */
+	if (!ind){
+		ind = glyph_alloc(font);
+		if (!ind)
+			return FT_Err_Out_Of_Memory;
+
+		glyph = &font->cache[ind-1];
+		glyph->cached = ch;
+		glyph->style = style;
+		glyph->outline = font->outline;
+		glyph->hinting = font->hinting;
+		glyph->by_ind = by_ind;
+		glyph->hnext = font->buckets[h];
+		font->buckets[h] = ind;
+		font->cache_misses++;
+	}
+	else {
+		if (font->lru_first != ind){
+			lru_unlink(font, ind);
+			lru_push(font, ind);
+		}
 
-	int h = ch % hsize;
-	font->current = &font->cache[h];
+		if (glyph->missing || (glyph->stored & want) == want)
+			font->cache_hits++;
+		else
+			font->cache_misses++;
+	}
+
+	font->current = glyph;
+	if (glyph->missing)
+		return -1;
 
-	if (font->current->cached != ch)
-		Flush_Glyph( font->current );
+	if ( (glyph->stored & want) != want ) {
+		font->cache_bytes -= glyph_bytes(glyph);
+		retval = Load_Glyph( font, ch, glyph, want, by_ind );
+		font->cache_bytes += glyph_bytes(glyph);
 
-	if ( (font->current->stored & want) != want ) {
-		retval = Load_Glyph( font, ch, font->current, want, by_ind );
+/* the size is only known after loading, so this is where the budget can be
+ * exceeded - the glyph that was just loaded is at the front of the LRU */
+		glyph_trim(font, ind);
+
+		if (retval && !glyph->index)
+			glyph->missing = true;
 	}
 	return retval;
 }
@@ -876,6 +1090,7 @@ void TTF_CloseFont( TTF_Font* font )
 		if ( font->freesrc ) {
 			fclose( font->src );
 		}
+		free( font->cache );
 		free( font );
 	}
 }
@@ -1045,15 +1260,9 @@ int TTF_GlyphMetrics(TTF_Font *font, uint32_t ch,
 
 void TTF_SetFontStyle( TTF_Font* font, int style )
 {
-	int prev_style = font->style;
 	font->style = style | font->face_style;
 
-	/* Flush the cache if the style has changed.
-	* Ignore UNDERLINE which does not impact glyph drawning.
-	* */
-	if ( (font->style | TTF_STYLE_NO_GLYPH_CHANGE ) != ( prev_style | TTF_STYLE_NO_GLYPH_CHANGE )) {
-		TTF_Flush_Cache( font );
-	}
+/* no flush, the style is part of the glyph cache key */
 }
 
 _Thread_local static size_t pool_cnt;
@@ -1571,7 +1780,6 @@ int TTF_GetFontStyle( const TTF_Font* font )
 void TTF_SetFontOutline( TTF_Font* font, int outline )
 {
 	font->outline = outline;
-	TTF_Flush_Cache( font );
 }
 
 int TTF_GetFontOutline( const TTF_Font* font )
@@ -1593,8 +1801,6 @@ void TTF_SetFontHinting( TTF_Font* font, int hinting )
 		font->hinting = FT_RENDER_MODE_LCD_V;
 	else
 		font->hinting = FT_RENDER_MODE_NORMAL;
-
-	TTF_Flush_Cache( font );
 }
 
 int TTF_GetFontHinting( const TTF_Font* font )
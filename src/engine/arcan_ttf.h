@@ -191,6 +191,21 @@ bool TTF_RenderUNICODEglyph(PIXEL* dst,
 
 void TTF_Flush_Cache( TTF_Font* font );
 
+/*
+ * Glyph cache counters, these accumulate over the lifetime of the font. The
+ * values of [font] are added to those already in [out] so that the fonts of
+ * a chain (or any other set) can be summed up.
+ */
+struct ttf_cache_stats {
+	size_t glyphs;
+	size_t bytes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+};
+
+void TTF_CacheStats(TTF_Font* font, struct ttf_cache_stats* out);
+
 /*
  * Same as TTF_RenderUNICODEglyph above, but 'ch' references the glyph index in
  * the font-chain, not the unicode codepoint.  This is only for special/trusted
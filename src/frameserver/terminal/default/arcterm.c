@@ -8,12 +8,34 @@
 #include <ctype.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
 #include <poll.h>
 #include <unistd.h>
 #include "tsm/libtsm.h"
 #include "tsm/libtsm_int.h"
 #include "tsm/shl-pty.h"
 
+/*
+ * Output from the pty goes through a single producer / single consumer ring:
+ * pump_pty only reads into it, parse_pty feeds it to the state machine in as
+ * large chunks as are available. The two only meet on the wait lock when the
+ * ring runs empty or full.
+ */
+#define RING_SIZE (1024 * 1024)
+#define PARSE_CHUNK (64 * 1024)
+
+struct ring {
+	uint8_t* buf;
+	_Atomic size_t head;
+	_Atomic size_t tail;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	atomic_bool reader_wait;
+	atomic_bool parser_wait;
+	atomic_bool eof;
+};
+
 static struct {
 	struct tui_context* screen;
 	struct tsm_vte* vte;
@@ -27,9 +49,17 @@ static struct {
 	long last_input;
 	int dirtyfd;
 
+/* set when the render thread has been signalled but not yet refreshed */
+	atomic_bool wake_pending;
+	struct ring ring;
+
 } term = {
 	.die_on_term = true,
-	.synch = PTHREAD_MUTEX_INITIALIZER
+	.synch = PTHREAD_MUTEX_INITIALIZER,
+	.ring = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER
+	}
 };
 
 static inline void trace(const char* msg, ...)
@@ -45,34 +75,140 @@ static inline void trace(const char* msg, ...)
 
 extern int arcan_tuiint_dirty(struct tui_context* tui);
 
+/*
+ * Sleep until [cond] no longer holds. The flag is raised before checking again
+ * under the lock so that the other side either sees it and signals, or has
+ * already made the change that ends the wait.
+ */
+static void ring_wait(struct ring* r, atomic_bool* flag, bool (*cond)(struct ring*))
+{
+	pthread_mutex_lock(&r->lock);
+	atomic_store(flag, true);
+	while (cond(r) && !atomic_load(&r->eof))
+		pthread_cond_wait(&r->cond, &r->lock);
+	atomic_store(flag, false);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static void ring_wake(struct ring* r, atomic_bool* flag)
+{
+	if (!atomic_load(flag))
+		return;
+
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+/* no more data will arrive, release anyone waiting for it */
+static void ring_close(struct ring* r)
+{
+	atomic_store(&r->eof, true);
+	pthread_mutex_lock(&r->lock);
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+}
+
+static bool ring_full(struct ring* r)
+{
+	return atomic_load(&r->head) - atomic_load(&r->tail) == RING_SIZE;
+}
+
+static bool ring_empty(struct ring* r)
+{
+	return atomic_load(&r->head) == atomic_load(&r->tail);
+}
+
+/* at most one wakeup is outstanding, the render thread re-arms it */
+static void wake_render()
+{
+	if (arcan_tuiint_dirty(term.screen) &&
+		!atomic_exchange(&term.wake_pending, true))
+		write(term.dirtyfd, &(char){'1'}, 1);
+}
+
+/*
+ * Read as much as there is contiguous room for, so interactive use gets small
+ * reads and floods get large ones without any tuning.
+ */
 void* pump_pty()
 {
+	struct ring* r = &term.ring;
 	int fd = shl_pty_get_fd(term.pty);
 
 	while (term.alive){
-		char buf[4096];
-		ssize_t nr = read(fd, buf, 4096);
+		if (ring_full(r)){
+			ring_wait(r, &r->reader_wait, ring_full);
+			continue;
+		}
+
+		size_t head = atomic_load(&r->head);
+		size_t ofs = head % RING_SIZE;
+		size_t room = RING_SIZE - (head - atomic_load(&r->tail));
+		if (room > RING_SIZE - ofs)
+			room = RING_SIZE - ofs;
+
+		ssize_t nr = read(fd, &r->buf[ofs], room);
 		if (-1 == nr){
 			if (errno == EAGAIN || errno == EINTR)
 				continue;
-			term.alive = false;
-			arcan_tui_set_flags(term.screen, TUI_HIDE_CURSOR);
 			break;
 		}
+		if (0 == nr)
+			break;
+
+		atomic_store(&r->head, head + nr);
+		ring_wake(r, &r->parser_wait);
+	}
+
+	ring_close(r);
+	return NULL;
+}
+
+/*
+ * Parse whatever has been read in chunks of up to PARSE_CHUNK, the synch lock
+ * is only held per chunk so that the render thread can get in between.
+ */
+static void* parse_pty(void* tag)
+{
+	struct ring* r = &term.ring;
+
+	for (;;){
+		if (ring_empty(r)){
+			if (atomic_load(&r->eof))
+				break;
+			ring_wait(r, &r->parser_wait, ring_empty);
+			continue;
+		}
+
+		size_t tail = atomic_load(&r->tail);
+		size_t ofs = tail % RING_SIZE;
+		size_t nb = atomic_load(&r->head) - tail;
+		if (nb > RING_SIZE - ofs)
+			nb = RING_SIZE - ofs;
+		if (nb > PARSE_CHUNK)
+			nb = PARSE_CHUNK;
 
 /* shl_pty_write calls are mutex- protected,
  * so vte_input -> write- callback -> mutex
  */
 		pthread_mutex_lock(&term.synch);
-		tsm_vte_input(term.vte, buf, nr);
+		tsm_vte_input(term.vte, (char*) &r->buf[ofs], nb);
 		tsm_vte_update_debug(term.vte);
 		pthread_mutex_unlock(&term.synch);
 
-/* wake the other thread */
-		if (arcan_tuiint_dirty(term.screen)){
-			write(term.dirtyfd, &(char){'1'}, 1);
-		}
+		atomic_store(&r->tail, tail + nb);
+		ring_wake(r, &r->reader_wait);
+		wake_render();
+
+/* give a render thread that is waiting for the lock a chance to get it */
+		if (atomic_load(&term.wake_pending))
+			sched_yield();
 	}
+
+	term.alive = false;
+	arcan_tui_set_flags(term.screen, TUI_HIDE_CURSOR);
+	write(term.dirtyfd, &(char){'1'}, 1);
 	return NULL;
 }
 
@@ -555,8 +691,16 @@ int afsrv_terminal(struct arcan_shmif_cont* con, struct arg_arr* args)
 
 	term.dirtyfd = pair[1];
 
-	if (-1 == pthread_create(&pth, &pthattr, pump_pty, NULL))
+	term.ring.buf = malloc(RING_SIZE);
+	if (!term.ring.buf)
+		return EXIT_FAILURE;
+
+/* if only the parser got started, it would otherwise wait for data forever */
+	if (0 != pthread_create(&pth, &pthattr, parse_pty, NULL) ||
+		0 != pthread_create(&pth, &pthattr, pump_pty, NULL)){
 		term.alive = false;
+		ring_close(&term.ring);
+	}
 
 	while(term.alive || !term.die_on_term){
 		struct tui_process_res res =
@@ -565,10 +709,12 @@ int afsrv_terminal(struct arcan_shmif_cont* con, struct arg_arr* args)
 		if (res.errc < TUI_ERRC_OK)
 			break;
 
-	/* flush out the signal pipe, don't care about contents */
+	/* flush out the signal pipe, don't care about contents, and re-arm so
+	 * that anything parsed from here on causes another wakeup */
 		if (res.ok){
 			char buf[256];
 			read(pair[0], buf, 256);
+			atomic_store(&term.wake_pending, false);
 		}
 
 		int rc = arcan_tui_refresh(term.screen);
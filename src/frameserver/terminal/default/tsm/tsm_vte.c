@@ -49,8 +49,14 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <inttypes.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "libtsm_int.h"
 
+/* tui internal, see tui.c */
+extern void arcan_tuiint_set_frametime(struct tui_context*, unsigned ms);
+
 /* Input parser states */
 enum parser_state {
 	STATE_NONE,		/* placeholder */
@@ -2662,6 +2668,60 @@ static void parse_data(struct tsm_vte *vte, uint32_t raw)
 	DEBUG_LOG(vte, "unhandled input %u in state %d", raw, vte->state);
 }
 
+/*
+ * Length of the run of printable ASCII (0x20..0x7e) at the start of u8, the
+ * bulk of what a 'cat' of a log or source file looks like. Sixteen bytes are
+ * checked at a time where SSE2 is available.
+ */
+static size_t ascii_run(const char *u8, size_t len)
+{
+	size_t i = 0;
+
+#ifdef __SSE2__
+	const __m128i lo = _mm_set1_epi8(0x1f);
+	const __m128i hi = _mm_set1_epi8(0x7f);
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&u8[i]);
+
+/* signed compare, so anything >= 0x80 also fails the lower bound */
+		__m128i ok = _mm_and_si128(
+			_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+		unsigned int mask = ~_mm_movemask_epi8(ok) & 0xffff;
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+
+	for (; i < len; ++i) {
+		if ((uint8_t)u8[i] < 0x20 || (uint8_t)u8[i] > 0x7e)
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * In the ground state and with an identity mapped GL, printable ASCII would
+ * go through the state machine only to be written out unmodified. Once such
+ * a character has been parsed (so any pending utf-8 sequence, single shift or
+ * escape has been resolved) the rest of the run is forwarded in one write.
+ */
+static size_t print_run(struct tsm_vte *vte, const char *u8, size_t len)
+{
+	if (vte->state != STATE_GROUND ||
+	    vte->glt || *vte->gl != &tsm_vte_unicode_lower)
+		return 0;
+
+	size_t n = ascii_run(u8, len);
+	if (n) {
+		to_rgb(vte, false);
+		arcan_tui_writeu8(vte->con, (const uint8_t *)u8, n, &vte->cattr);
+	}
+
+	return n;
+}
+
 SHL_EXPORT
 void tsm_vte_input(struct tsm_vte *vte, const char *u8, size_t len)
 {
@@ -2679,16 +2739,22 @@ void tsm_vte_input(struct tsm_vte *vte, const char *u8, size_t len)
 				DEBUG_LOG(vte, "receiving 8bit character U+%d from pty while in 7bit mode",
 					   (int)u8[i]);
 			parse_data(vte, u8[i] & 0x7f);
+			ucs4 = u8[i];
 		} else if (vte->flags & FLAG_8BIT_MODE) {
 			parse_data(vte, u8[i]);
+			ucs4 = u8[i];
 		} else {
 			state = tsm_utf8_mach_feed(vte->mach, u8[i]);
-			if (state == TSM_UTF8_ACCEPT ||
-			    state == TSM_UTF8_REJECT) {
-				ucs4 = tsm_utf8_mach_get(vte->mach);
-				parse_data(vte, ucs4);
-			}
+			if (state != TSM_UTF8_ACCEPT &&
+			    state != TSM_UTF8_REJECT)
+				continue;
+
+			ucs4 = tsm_utf8_mach_get(vte->mach);
+			parse_data(vte, ucs4);
 		}
+
+		if (ucs4 >= 0x20 && ucs4 < 0x7f)
+			i += print_run(vte, &u8[i + 1], len - i - 1);
 	}
 }
 
@@ -2742,6 +2808,10 @@ SHL_EXPORT bool tsm_vte_debug(struct tsm_vte* in,
 	in->debug = newctx;
 	arcan_tui_set_flags(in->debug, TUI_ALTERNATE | TUI_HIDE_CURSOR);
 
+/* only ever refreshed from update_debug, a held back update would linger
+ * until the next thing is parsed */
+	arcan_tuiint_set_frametime(in->debug, 0);
+
 	tsm_vte_update_debug(in);
 	return true;
 }
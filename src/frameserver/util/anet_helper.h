@@ -13,9 +13,12 @@ struct anet_options {
 	const char* port;
 	int sockfd;
 	int mt_mode;
+	size_t mt_workers;
 	int mode;
 	const char* redirect_exit;
 	const char* devicehint_cp;
+	const char* record;
+	const char* cache_dir;
 	struct a12_context_options* opts;
 };
 
@@ -87,6 +87,58 @@ const char * defcvprg =
 " gl_Position = (projection * modelview) * vertex;\n"
 "}";
 
+/* text cells, drawn instanced with the per-cell attributes in
+ * texcoord (col, row), texcoord1 (glyph, flags), color (fg), tangent (bg) */
+static const char* defcellvprg =
+"#version 100\n"
+"precision mediump float;\n"
+"uniform vec2 cell_sz;\n"
+"uniform vec2 target_sz;\n"
+"uniform vec2 atlas_sz;\n"
+"attribute vec2 vertex;\n"
+"attribute vec2 texcoord;\n"
+"attribute vec2 texcoord1;\n"
+"attribute vec4 color;\n"
+"attribute vec4 tangent;\n"
+"varying vec2 texco;\n"
+"varying vec2 cellco;\n"
+"varying vec4 fgc;\n"
+"varying vec4 bgc;\n"
+"varying vec3 marks;\n"
+"void main(){\n"
+"	vec2 pos = (texcoord + vertex) * cell_sz;\n"
+"	gl_Position = vec4(pos / target_sz * 2.0 - 1.0, 0.0, 1.0);\n"
+"	float tiles = floor(atlas_sz.x / cell_sz.x + 0.5);\n"
+"	vec2 tile = vec2(mod(texcoord1.x, tiles), floor(texcoord1.x / tiles));\n"
+"	texco = (tile + vertex) * cell_sz / atlas_sz;\n"
+"	cellco = vertex * cell_sz;\n"
+"	fgc = color;\n"
+"	bgc = tangent;\n"
+"	marks = mod(floor(texcoord1.yyy / vec3(1.0, 2.0, 4.0)), 2.0);\n"
+"}";
+
+static const char* defcellfprg =
+"#version 100\n"
+"precision mediump float;\n"
+"uniform sampler2D map_diffuse;\n"
+"uniform vec2 cell_sz;\n"
+"varying vec2 texco;\n"
+"varying vec2 cellco;\n"
+"varying vec4 fgc;\n"
+"varying vec4 bgc;\n"
+"varying vec3 marks;\n"
+"void main(){\n"
+"	float a = marks.x * texture2D(map_diffuse, texco).r;\n"
+"	float lw = floor(cell_sz.y * 0.05);\n"
+"	lw += 1.0 - mod(lw, 2.0);\n"
+"	float mid = floor(cell_sz.y * 0.5) - floor(lw * 0.5);\n"
+"	if (marks.y > 0.5 && cellco.y >= cell_sz.y - lw)\n"
+"		a = 1.0;\n"
+"	if (marks.z > 0.5 && cellco.y >= mid && cellco.y < mid + lw)\n"
+"		a = 1.0;\n"
+"	gl_FragColor = vec4(mix(bgc.rgb, fgc.rgb, a), max(bgc.a, a));\n"
+"}";
+
 agp_shader_id agp_default_shader(enum SHADER_TYPES type)
 {
 	static agp_shader_id shids[SHADER_TYPE_ENDM];
@@ -99,6 +151,8 @@ agp_shader_id agp_default_shader(enum SHADER_TYPES type)
 		shids[COLOR_2D] = agp_shader_build(
 			"DEFAULT_COLOR", NULL, defcvprg, defcfprg);
 		shids[BASIC_3D] = shids[BASIC_2D];
+		shids[CELL_2D] = agp_shader_build(
+			"DEFAULT_CELL", NULL, defcellvprg, defcellfprg);
 		defshdr_build = true;
 	}
 
@@ -142,6 +196,11 @@ void agp_shader_source(enum SHADER_TYPES type,
 		*frag = defcfprg;
 	break;
 
+	case CELL_2D:
+		*vert = defcellvprg;
+		*frag = defcellfprg;
+	break;
+
 	default:
 		*vert = NULL;
 		*frag = NULL;
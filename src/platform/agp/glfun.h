@@ -74,6 +74,7 @@ struct agp_fenv {
 	void (*vertex_iattrpointer) (GLuint, GLint, GLenum, GLsizei, const GLvoid*);
 
 	void (*disable_vertex_attrarray) (GLuint);
+	void (*vertex_attrdivisor) (GLuint, GLuint);
 
 /* Shader Uniforms */
 	void (*unif_1i)(GLint, GLint);
@@ -139,6 +140,7 @@ struct agp_fenv {
 	void (*stencil_func) (GLenum, GLint, GLuint);
 	void (*stencil_op) (GLenum, GLenum, GLenum);
 	void (*draw_arrays) (GLenum, GLint, GLsizei);
+	void (*draw_arrays_instanced) (GLenum, GLint, GLsizei, GLsizei);
 	void (*draw_elements) (GLenum, GLsizei, GLenum, const GLvoid*);
 	void (*depth_mask) (GLboolean);
 	void (*depth_func) (GLenum);
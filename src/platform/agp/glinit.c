@@ -113,6 +113,15 @@ void agp_glinit_fenv(struct agp_fenv* dst,
 		(void (*)(GLuint))
 			lookup(tag, "glDisableVertexAttribArray");
 
+/* instancing is core in 3.3 / ES3, otherwise through the ARB extensions */
+	dst->vertex_attrdivisor =
+		(void (*)(GLuint, GLuint))
+			lookup_opt(tag, "glVertexAttribDivisor");
+	if (!dst->vertex_attrdivisor)
+		dst->vertex_attrdivisor =
+			(void (*)(GLuint, GLuint))
+				lookup_opt(tag, "glVertexAttribDivisorARB");
+
 /* Shader Uniforms */
 	dst->unif_1i =
 		(void (*)(GLint, GLint))
@@ -282,6 +291,13 @@ void agp_glinit_fenv(struct agp_fenv* dst,
 	dst->draw_arrays =
 		(void(*)(GLenum, GLint, GLsizei))
 			lookup(tag, "glDrawArrays");
+	dst->draw_arrays_instanced =
+		(void(*)(GLenum, GLint, GLsizei, GLsizei))
+			lookup_opt(tag, "glDrawArraysInstanced");
+	if (!dst->draw_arrays_instanced)
+		dst->draw_arrays_instanced =
+			(void(*)(GLenum, GLint, GLsizei, GLsizei))
+				lookup_opt(tag, "glDrawArraysInstancedARB");
 	dst->draw_elements =
 		(void(*)(GLenum, GLsizei, GLenum, const GLvoid*))
 			lookup(tag, "glDrawElements");
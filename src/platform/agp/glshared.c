@@ -1349,6 +1349,84 @@ void agp_draw_vobj(
 	agp_rendertarget_dirty(active_rendertarget, &(struct agp_region){});
 }
 
+bool agp_draw_cells(struct agp_rendertarget* dst, struct agp_vstore* atlas,
+	size_t cell_w, size_t cell_h, const struct agp_cell* cells, size_t n)
+{
+	struct agp_fenv* env = agp_env();
+	agp_shader_id shid = agp_default_shader(CELL_2D);
+
+	if (!env->draw_arrays_instanced || !env->vertex_attrdivisor ||
+		!dst || !atlas || !n || !agp_shader_valid(shid))
+		return false;
+
+	verbose_print("draw-cells(%zu)", n);
+	struct agp_rendertarget* prev = active_rendertarget;
+	agp_activate_rendertarget(dst);
+	agp_blendstate(BLEND_NONE);
+	agp_shader_activate(shid);
+	agp_activate_vstore(atlas);
+
+	agp_shader_forceunif("cell_sz", shdrvec2,
+		(float[]){cell_w, cell_h});
+	agp_shader_forceunif("target_sz", shdrvec2,
+		(float[]){dst->store->w, dst->store->h});
+	agp_shader_forceunif("atlas_sz", shdrvec2,
+		(float[]){atlas->w, atlas->h});
+
+/* the corners of the cell are the only per-vertex data, everything else is
+ * sourced per cell straight from the array */
+	static const GLfloat corners[] = {0, 0, 1, 0, 0, 1, 1, 1};
+	struct {
+		enum shader_vertex_attributes attr;
+		GLint size;
+		GLenum type;
+		GLboolean norm;
+		const void* ptr;
+	} attrs[] = {
+		{ATTRIBUTE_TEXCORD0, 2, GL_UNSIGNED_SHORT, GL_FALSE, &cells->col},
+		{ATTRIBUTE_TEXCORD1, 2, GL_UNSIGNED_SHORT, GL_FALSE, &cells->glyph},
+		{ATTRIBUTE_COLOR, 4, GL_UNSIGNED_BYTE, GL_TRUE, cells->fg},
+		{ATTRIBUTE_TANGENT, 4, GL_UNSIGNED_BYTE, GL_TRUE, cells->bg}
+	};
+	GLint locs[COUNT_OF(attrs)];
+
+	GLint attrindv = agp_shader_vattribute_loc(ATTRIBUTE_VERTEX);
+	if (attrindv != -1){
+		env->enable_vertex_attrarray(attrindv);
+		env->vertex_attrpointer(attrindv, 2, GL_FLOAT, GL_FALSE, 0, corners);
+	}
+
+	for (size_t i = 0; i < COUNT_OF(attrs); i++){
+		locs[i] = agp_shader_vattribute_loc(attrs[i].attr);
+		if (locs[i] == -1)
+			continue;
+
+		env->enable_vertex_attrarray(locs[i]);
+		env->vertex_attrpointer(locs[i], attrs[i].size, attrs[i].type,
+			attrs[i].norm, sizeof(struct agp_cell), attrs[i].ptr);
+		env->vertex_attrdivisor(locs[i], 1);
+	}
+
+	env->draw_arrays_instanced(GL_TRIANGLE_STRIP, 0, 4, n);
+
+	for (size_t i = 0; i < COUNT_OF(attrs); i++){
+		if (locs[i] == -1)
+			continue;
+
+		env->vertex_attrdivisor(locs[i], 0);
+		env->disable_vertex_attrarray(locs[i]);
+	}
+
+	if (attrindv != -1)
+		env->disable_vertex_attrarray(attrindv);
+
+	agp_deactivate_vstore();
+	agp_rendertarget_dirty(dst, &(struct agp_region){});
+	agp_activate_rendertarget(prev);
+
+	return true;
+}
+
 static void toggle_debugstates(float* modelview)
 {
 	struct agp_fenv* env = agp_env();
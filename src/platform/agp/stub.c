@@ -163,6 +163,12 @@ void agp_draw_vobj(float x1, float y1,
 {
 }
 
+bool agp_draw_cells(struct agp_rendertarget* dst, struct agp_vstore* atlas,
+	size_t cell_w, size_t cell_h, const struct agp_cell* cells, size_t n)
+{
+	return false;
+}
+
 void agp_submit_mesh(struct agp_mesh_store* base, enum agp_mesh_flags fl)
 {
 }
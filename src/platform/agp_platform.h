@@ -48,6 +48,7 @@ enum SHADER_TYPES {
 	BASIC_2D = 0,
 	COLOR_2D,
 	BASIC_3D,
+	CELL_2D,
 	SHADER_TYPE_ENDM
 };
 agp_shader_id agp_default_shader(enum SHADER_TYPES);
@@ -305,6 +306,27 @@ void agp_blendstate(enum arcan_blendfunc);
 void agp_draw_vobj(float x1, float y1, float x2, float y2,
 	const float* txcos, const float* modelview);
 
+/*
+ * Draw a grid of text cells into [dst] as one instanced draw call, each
+ * cell covers [cell_w, cell_h] pixels at (col, row) and is filled with the
+ * background color and the foreground color by the coverage of the [atlas]
+ * tile (glyph % (atlas->w / cell_w), glyph / (atlas->w / cell_w)). [flags]
+ * bit 0: use the glyph, bit 1: underline, bit 2: strikethrough.
+ *
+ * Returns false if the platform lacks instancing, the cells then have to be
+ * drawn some other way.
+ */
+struct agp_rendertarget;
+struct agp_cell {
+	uint16_t col, row;
+	uint16_t glyph, flags;
+	uint8_t fg[4];
+	uint8_t bg[4];
+};
+
+bool agp_draw_cells(struct agp_rendertarget* dst, struct agp_vstore* atlas,
+	size_t cell_w, size_t cell_h, const struct agp_cell* cells, size_t n);
+
 /*
  * Destination format for rendertargets. Note that we do not currently suport
  * floating point targets and that for some platforms, COLOR_DEPTH will map to
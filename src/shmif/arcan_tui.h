@@ -618,10 +618,18 @@ size_t arcan_tui_get_handles(
 
 /*
  * Update and synch the specified context.
+ *
+ * Updates are coalesced: if the last synch was less than a frame ago (or it
+ * has not been consumed yet) the update is held back and merged with the next
+ * one, for at most a latency cap. Right after a key press nothing is held
+ * back. The timeout in arcan_tui_process is reduced to when it is due, and
+ * the frametime=ms and latency=ms arguments control the behavior.
+ *
  * Returns:
  *  1 on success
  *  0 on state-ok but no need to sync
- * -1 and errno (:EAGAIN) if the connection is already busy synching
+ * -1 and errno (:EAGAIN) if the connection is already busy synching or
+ *    the update was held back
  * -1 and errno (:EINVAL) if the connection is broken
  */
 int arcan_tui_refresh(struct tui_context*);
@@ -1025,6 +1033,22 @@ void arcan_tui_tab_left(struct tui_context*, size_t);
 void arcan_tui_scroll_up(struct tui_context*, size_t);
 void arcan_tui_scroll_down(struct tui_context*, size_t);
 
+/*
+ * Search the scrollback buffer for lines that contain the utf-8 string
+ * [needle]. Up to [n] matches are written to [out], newest first, as the
+ * number of lines up from the end of the scrollback. That is the amount to
+ * arcan_tui_scroll_up from the bottom to get the line at the top of the
+ * screen. Only offsets larger than [after] are considered, so a search can
+ * continue from the last match.
+ *
+ * The scrollback is indexed as lines are added, so this stays fast even for
+ * very large scrollbacks as long as the needle is 3 characters or longer.
+ *
+ * Returns the number of matches written to [out].
+ */
+size_t arcan_tui_search_sb(struct tui_context*,
+	const char* needle, size_t after, size_t* out, size_t n);
+
 /*
  * [DEPRECATE -> widget]
  * remove the tabstop at the current position
@@ -1100,6 +1124,8 @@ typedef void (* PTUITABRIGHT)(struct tui_context*, size_t);
 typedef void (* PTUITABLEFT)(struct tui_context*, size_t);
 typedef void (* PTUISCROLLUP)(struct tui_context*, size_t);
 typedef void (* PTUISCROLLDOWN)(struct tui_context*, size_t);
+typedef size_t (* PTUISEARCHSB)(struct tui_context*,
+	const char*, size_t, size_t*, size_t);
 typedef void (* PTUIRESETTABSTOP)(struct tui_context*);
 typedef void (* PTUIRESETALLTABSTOPS)(struct tui_context*);
 typedef void (* PTUISCROLLHINT)(struct tui_context*, size_t, struct tui_region*);
@@ -1177,6 +1203,7 @@ static PTUITABRIGHT arcan_tui_tab_right;
 static PTUITABLEFT arcan_tui_tab_left;
 static PTUISCROLLUP arcan_tui_scroll_up;
 static PTUISCROLLDOWN arcan_tui_scroll_down;
+static PTUISEARCHSB arcan_tui_search_sb;
 static PTUIRESETTABSTOP arcan_tui_reset_tabstop;
 static PTUIRESETALLTABSTOPS arcan_tui_reset_all_tabstops;
 static PTUISCROLLHINT arcan_tui_scrollhint;
@@ -1253,6 +1280,7 @@ M(PTUITABRIGHT,arcan_tui_tab_right);
 M(PTUITABLEFT,arcan_tui_tab_left);
 M(PTUISCROLLUP,arcan_tui_scroll_up);
 M(PTUISCROLLDOWN,arcan_tui_scroll_down);
+M(PTUISEARCHSB,arcan_tui_search_sb);
 M(PTUIRESETTABSTOP,arcan_tui_reset_tabstop);
 M(PTUIRESETALLTABSTOPS,arcan_tui_reset_all_tabstops);
 M(PTUISCROLLHINT,arcan_tui_scrollhint);
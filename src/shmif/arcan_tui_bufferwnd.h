@@ -96,6 +96,21 @@ void arcan_tui_bufferwnd_setup(
 	struct tui_bufferwnd_opts*, size_t opts_sz
 );
 
+/*
+ * Same as arcan_tui_bufferwnd_setup, but the contents are taken from the
+ * regular file behind [fd] rather than from memory. The file is read in
+ * windows as they become visible, so it can be far larger than what would
+ * fit in memory. Edits are held back and written to the file on commit (see
+ * [allow_exit] and bufferwnd_status), a cancel, synch or release discards
+ * them. If [fd] was opened read-only the window will be as well.
+ *
+ * The descriptor is duplicated, the caller retains ownership of [fd].
+ * Returns false if the descriptor can't be used, the context is then left
+ * untouched.
+ */
+bool arcan_tui_bufferwnd_setup_fd(struct tui_context* ctx,
+	int fd, struct tui_bufferwnd_opts*, size_t opts_sz);
+
 /*
  * Return 1 if OK, 0 if commit-exit is requested, -1 if cancel-exit is requested,
  * this is only useful / valid if the [allow_exit] option has been set.
@@ -105,14 +120,16 @@ int arcan_tui_bufferwnd_status(struct tui_context*);
 
 /*
  * Replace the active buffer with another. This may cause delta writes to
- * be synched if the commit write function has been provided.
+ * be synched if the commit write function has been provided. A descriptor
+ * from _setup_fd is closed.
  */
 void arcan_tui_bufferwnd_synch(
 	struct tui_context* T, uint8_t* buf, size_t buf_sz, size_t prefix_ofs);
 
 /*
  * Move the cursor to point at a specific offset in the buffer (ofs < buf_sz),
- * this may cause a repagination.
+ * this may cause a repagination. This is constant time, nothing outside of
+ * the new page is touched.
  */
 void arcan_tui_bufferwnd_seek(struct tui_context* T, size_t buf_ofs);
 
@@ -134,6 +151,8 @@ void arcan_tui_bufferwnd_release(struct tui_context* T);
 #else
 typedef bool(* PTUIBUFFERWND_SETUP)(
 	struct tui_context*, uint8_t*, size_t, struct tui_bufferwnd_opts*, size_t);
+typedef bool(* PTUIBUFFERWND_SETUP_FD)(
+	struct tui_context*, int, struct tui_bufferwnd_opts*, size_t);
 typedef void(* PTUIBUFFERWND_RELEASE)(struct tui_context*);
 typedef void(* PTUIBUFFERWND_SYNCH)(
 	struct tui_context*, uint8_t* buf, size_t, size_t);
@@ -142,6 +161,7 @@ typedef int(* PTUIBUFFERWND_STATUS)(struct tui_context*);
 typedef size_t(* PTUIBUFFERWND_TELL)(struct tui_context*, struct tui_bufferwnd_opts*);
 
 static PTUIBUFFERWND_SETUP arcan_tui_bufferwnd_setup;
+static PTUIBUFFERWND_SETUP_FD arcan_tui_bufferwnd_setup_fd;
 static PTUIBUFFERWND_RELEASE arcan_tui_bufferwnd_release;
 static PTUIBUFFERWND_SYNCH arcan_tui_bufferwnd_synch;
 static PTUIBUFFERWND_SEEK arcan_tui_bufferwnd_seek;
@@ -153,6 +173,7 @@ static bool arcan_tui_bufferwnd_dynload(
 {
 #define M(TYPE, SYM) if (! (SYM = (TYPE) lookup(tag, #SYM)) ) return false
 M(PTUIBUFFERWND_SETUP, arcan_tui_bufferwnd_setup);
+M(PTUIBUFFERWND_SETUP_FD, arcan_tui_bufferwnd_setup_fd);
 M(PTUIBUFFERWND_RELEASE, arcan_tui_bufferwnd_release);
 M(PTUIBUFFERWND_SYNCH, arcan_tui_bufferwnd_synch);
 M(PTUIBUFFERWND_SEEK, arcan_tui_bufferwnd_seek);
@@ -29,6 +29,22 @@ struct tui_list_entry {
 	uintptr_t tag;        /* index or other reference to pair trigger */
 };
 
+/*
+ * Data source for lists that are too large, or too expensive to produce, to
+ * be provided up front, see arcan_tui_listwnd_setup_source.
+ *
+ * [count] returns the current number of entries.
+ *
+ * [fetch] fills out [dst] with up to [n] entries starting at [ofs] and
+ * returns the number that were filled. The strings referenced by the entries
+ * need to remain valid until the next fetch call.
+ */
+struct tui_list_source {
+	size_t (*count)(void* tag);
+	size_t (*fetch)(void* tag, size_t ofs, size_t n, struct tui_list_entry* dst);
+	void* tag;
+};
+
 /*
  * Description:
  * This function partially assumes control over a provided window and uses
@@ -73,6 +89,27 @@ struct tui_list_entry {
 bool arcan_tui_listwnd_setup(
 	struct tui_context*, struct tui_list_entry*, size_t n_entries);
 
+/*
+ * Same as arcan_tui_listwnd_setup, but the entries are retrieved through
+ * [source] as they are needed, so the cost of opening and presenting the list
+ * does not depend on its length. [source_sz] is sizeof(struct tui_list_source)
+ * and the source is copied.
+ *
+ * Only the visible range (and a few entries around it) are fetched, and the
+ * count is re-read on each redraw so the source may grow between dirty calls.
+ *
+ * Typing filters the list to entries with labels that contain the typed
+ * string (case insensitive for ASCII). The source is scanned incrementally on
+ * ticks and matches are presented as they are found. Backspace edits and
+ * cancel clears the filter. Shortcuts are not used in this mode.
+ *
+ * The entry returned from _status is a copy that is valid until the next call
+ * into the list, _tell and _setpos use indices into the source, not into the
+ * filtered view.
+ */
+bool arcan_tui_listwnd_setup_source(
+	struct tui_context*, struct tui_list_source* source, size_t source_sz);
+
 /*
  * Query and flush the active window selection status, returns true if
  * somthing has been activated, and sets a pointer to the item [or NULL
@@ -110,6 +147,8 @@ void arcan_tui_listwnd_release(struct tui_context*);
 #else
 typedef bool(* PTUILISTWND_SETUP)(
 	struct tui_context*, struct tui_list_entry*, size_t n_entries);
+typedef bool(* PTUILISTWND_SETUP_SOURCE)(
+	struct tui_context*, struct tui_list_source*, size_t);
 typedef bool(* PTUILISTWND_STATUS)(
 	struct tui_context*, struct tui_list_entry** out);
 typedef void(* PTUILISTWND_DIRTY)(struct tui_context*);
@@ -118,6 +157,7 @@ typedef void(* PTUILISTWND_SETPOS)(struct tui_context*, size_t);
 typedef ssize_t(* PTUILISTWND_TELL)(struct tui_context*);
 
 static PTUILISTWND_SETUP arcan_tui_listwnd_setup;
+static PTUILISTWND_SETUP_SOURCE arcan_tui_listwnd_setup_source;
 static PTUILISTWND_STATUS arcan_tui_listwnd_status;
 static PTUILISTWND_DIRTY arcan_tui_listwnd_dirty;
 static PTUILISTWND_RELEASE arcan_tui_listwnd_release;
@@ -129,6 +169,7 @@ static bool arcan_tui_listwnd_dynload(
 {
 #define M(TYPE, SYM) if (! (SYM = (TYPE) lookup(tag, #SYM)) ) return false
 M(PTUILISTWND_SETUP, arcan_tui_listwnd_setup);
+M(PTUILISTWND_SETUP_SOURCE, arcan_tui_listwnd_setup_source);
 M(PTUILISTWND_STATUS, arcan_tui_listwnd_status);
 M(PTUILISTWND_DIRTY, arcan_tui_listwnd_dirty);
 M(PTUILISTWND_RELEASE, arcan_tui_listwnd_release);
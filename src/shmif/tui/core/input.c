@@ -428,6 +428,7 @@ void tui_input_event(
 			tsm_screen_selection_reset(tui->screen);
 		}
 		tui->inact_timer = -4;
+		tui->coalesce.input = arcan_timemillis();
 		if (label[0] && consume_label(tui, ioev, label))
 			return;
 
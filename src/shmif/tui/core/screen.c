@@ -30,11 +30,23 @@ static int tsm_draw_callback(struct tsm_screen* screen, uint32_t id,
 		tui->front[pos].attr = *attr;
 		tui->front[pos].fstamp = tui->fstamp;
 		tui->dirty |= DIRTY_PARTIAL;
+
+		struct tui_span* span = &tui->spans[y];
+		if (x < span->x1)
+			span->x1 = x;
+		if (x > span->x2)
+			span->x2 = x;
 	}
 
 	return 0;
 }
 
+static void reset_spans(struct tui_context* tui)
+{
+	for (size_t i = 0; i < tui->rows; i++)
+		tui->spans[i] = (struct tui_span){.x1 = UINT16_MAX};
+}
+
 static void resize_cellbuffer(struct tui_context* tui)
 {
 	if (tui->base){
@@ -44,10 +56,12 @@ static void resize_cellbuffer(struct tui_context* tui)
 	}
 
 	tui->base = NULL;
+	tui->spans = NULL;
 
-	size_t buffer_sz = 2 * tui->rows * tui->cols * sizeof(struct tui_cell);
+	size_t buffer_sz = 2 * tui->rows * tui->cols * sizeof(struct tui_cell) +
+		tui->rows * sizeof(struct tui_span);
 	size_t rbuf_sz =
-		sizeof(struct tui_raster_header) + /* always there */
+		raster_hdr_sz + raster_hdr_scroll_sz + /* always there, worst case */
 		((tui->rows * tui->cols + 2) * raster_cell_sz) + /* worst case, includes cursor */
 		((tui->rows+2) * sizeof(struct tui_raster_line))
 	;
@@ -74,19 +88,24 @@ static void resize_cellbuffer(struct tui_context* tui)
 
 	tui->front = tui->base;
 	tui->back = &tui->base[tui->rows * tui->cols];
+	tui->spans = (struct tui_span*) &tui->base[2 * tui->rows * tui->cols];
+	reset_spans(tui);
+
+/* the front buffer is empty so everything has to be drawn again */
+	tui->age = 0;
 	tui->dirty |= DIRTY_FULL;
 }
 
 /* sweep a row from a start offset until the first deviation
- * between front and back offset */
+ * between front and back offset, up to and including [end] */
 static ssize_t find_row_ofs(
-	struct tui_context* tui, size_t row, size_t ofs)
+	struct tui_context* tui, size_t row, size_t ofs, size_t end)
 {
 	size_t pos = row * tui->cols;
 	struct tui_cell* front = &tui->front[pos];
 	struct tui_cell* back = &tui->back[pos];
 
-	for (pos = ofs; pos < tui->cols; pos++){
+	for (pos = ofs; pos <= end && pos < tui->cols; pos++){
 		if (!tui_attr_equal(front[pos].attr,
 			back[pos].attr) || front[pos].ch != back[pos].ch){
 			return pos;
@@ -152,6 +171,53 @@ struct tui_cell* tcell, uint8_t* outb, uint8_t has_cursor)
 	return raster_cell_sz;
 }
 
+/*
+ * Apply a scroll of the screen to the front and back buffers before drawing,
+ * tsm doesn't age the lines that moved. The back buffer then matches what the
+ * rasterizer will have after moving the pixels, with the exposed rows set to a
+ * codepoint that can't match so they are always redrawn.
+ */
+static bool scroll_cells(
+	struct tui_context* tui, int delta, unsigned top, unsigned bottom)
+{
+	size_t step = abs(delta);
+	if (!tui->front || top > bottom || bottom >= tui->rows || step > bottom - top)
+		return false;
+
+	size_t row_sz = tui->cols * sizeof(struct tui_cell);
+	size_t n_rows = bottom - top + 1 - step;
+	size_t exposed = delta > 0 ? top + n_rows : top;
+	struct tui_cell* bufs[] = {tui->front, tui->back};
+
+	for (size_t i = 0; i < 2; i++){
+		struct tui_cell* base = &bufs[i][top * tui->cols];
+		if (delta > 0)
+			memmove(base, &base[step * tui->cols], n_rows * row_sz);
+		else
+			memmove(&base[step * tui->cols], base, n_rows * row_sz);
+	}
+
+	for (size_t i = exposed * tui->cols; i < (exposed + step) * tui->cols; i++)
+		tui->back[i].ch = UINT32_MAX;
+
+/* the drawn cursor moves with the contents */
+	if (tui->last_cursor.active &&
+		tui->last_cursor.row >= top && tui->last_cursor.row <= bottom){
+		ssize_t row = (ssize_t) tui->last_cursor.row - delta;
+		if (row < (ssize_t) top || row > (ssize_t) bottom)
+			tui->last_cursor.active = false;
+		else
+			tui->last_cursor.row = row;
+	}
+
+/* the pixels need to move even if nothing else would change */
+	tui->scroll.delta = delta;
+	tui->scroll.top = top;
+	tui->scroll.bottom = bottom;
+	tui->dirty |= DIRTY_PARTIAL;
+	return true;
+}
+
 static int build_raster_buffer(
 	struct tui_context* tui, uint8_t** rbuf, size_t* rbuf_sz)
 {
@@ -166,7 +232,8 @@ static int build_raster_buffer(
 	hdr.bgc[3] = tui->alpha;
 
 	uint8_t* out = tui->rbuf;
-	size_t outsz = sizeof(hdr);
+	size_t hdr_sz = raster_hdr_sz;
+	size_t outsz = hdr_sz;
 
 /* this is set on a manual invalidate, or a screen or cell resize */
 	if (tui->dirty & DIRTY_FULL){
@@ -205,8 +272,22 @@ static int build_raster_buffer(
 
 /* delta update, find_row_ofs gives the next mismatch on the row */
 	else if (tui->dirty & DIRTY_PARTIAL){
+		if (tui->scroll.delta){
+			hdr.flags |= RPACK_SCROLL;
+			hdr.scroll = tui->scroll.delta;
+			hdr.scroll_top = tui->scroll.top;
+			hdr.scroll_bottom = tui->scroll.bottom;
+			hdr_sz += raster_hdr_scroll_sz;
+			outsz = hdr_sz;
+		}
+
+/* only the rows and columns that have been drawn to can differ */
 		for (size_t row = 0; row < tui->rows; row++){
-			ssize_t ofs = find_row_ofs(tui, row, 0);
+			struct tui_span span = tui->spans[row];
+			if (span.x1 > span.x2)
+				continue;
+
+			ssize_t ofs = find_row_ofs(tui, row, span.x1, span.x2);
 			if (-1 == ofs)
 				continue;
 
@@ -237,7 +318,7 @@ static int build_raster_buffer(
 				outsz += cell_to_rcell(attr, &out[outsz], 0);
 /* iterate forward */
 				ssize_t last_ofs = ofs;
-				ofs = find_row_ofs(tui, row, ofs+1);
+				ofs = find_row_ofs(tui, row, ofs+1, span.x2);
 				if (-1 == ofs)
 					break;
 
@@ -255,7 +336,7 @@ static int build_raster_buffer(
 			memcpy(&out[line_dst], &line, sizeof(struct tui_raster_line));
 			hdr.cells += line.ncells;
 			hdr.lines++;
-			assert(outsz == raster_hdr_sz + raster_line_sz * hdr.lines + raster_cell_sz * hdr.cells);
+			assert(outsz == hdr_sz + raster_line_sz * hdr.lines + raster_cell_sz * hdr.cells);
 		}
 
 		hdr.flags |= RPACK_DFRAME;
@@ -317,16 +398,16 @@ static int build_raster_buffer(
 			hdr.cursor_state = tui->defocus ? CURSOR_INACTIVE : CURSOR_ACTIVE;
 		}
 
-		assert(outsz == raster_hdr_sz + raster_line_sz * hdr.lines + raster_cell_sz * hdr.cells);
+		assert(outsz == hdr_sz + raster_line_sz * hdr.lines + raster_cell_sz * hdr.cells);
 		tui->last_cursor.active = true;
 	}
 
 	hdr.data_sz = hdr.lines * raster_line_sz +
-		hdr.cells * raster_cell_sz + raster_hdr_sz;
+		hdr.cells * raster_cell_sz + hdr_sz;
 
 /* write the header and return */
 /* NOTE: REPLACE WITH PROPER PACKING */
-	memcpy(tui->rbuf, &hdr, sizeof(hdr));
+	memcpy(tui->rbuf, &hdr, hdr_sz);
 	*rbuf_sz = outsz;
 	*rbuf = tui->rbuf;
 	return rv;
@@ -411,14 +492,29 @@ int tui_screen_refresh(struct tui_context* tui)
 	if (tui->vsynch)
 		pthread_mutex_lock(tui->vsynch);
 
+/* scrolling has to be applied before drawing, after that either everything
+ * has changed and a full frame is cheaper, or only the cells that tsm has aged
+ * since the last draw need to be considered */
+	int scroll;
+	unsigned scroll_top, scroll_bottom;
+	if (tsm_screen_scroll_consume(
+		tui->screen, &scroll, &scroll_top, &scroll_bottom))
+		scroll_cells(tui, scroll, scroll_top, scroll_bottom);
+
+	if (tsm_screen_aged(tui->screen, tui->age))
+		tui->dirty |= DIRTY_FULL;
+
 /* this will repeatedly call tsm_draw_callback which, in turn, will update
  * the front buffer with new glyphs. */
-	tui->age = tsm_screen_draw(tui->screen, tsm_draw_callback, tui);
+	tui->age = tsm_screen_draw(tui->screen, tui->age, tsm_draw_callback, tui);
 
 	uint8_t* rbuf;
 	size_t rbuf_sz;
 	int rv = build_raster_buffer(tui, &rbuf, &rbuf_sz);
 	tui->dirty = DIRTY_NONE;
+	tui->scroll.delta = 0;
+	if (tui->spans)
+		reset_spans(tui);
 
 /* Release the update lock so other threads may continue to update /
  * process while we are busy forwarding and synching. */
@@ -97,6 +97,13 @@ static void apply_arg(struct tui_context* src, struct arg_arr* args)
 
 	if (arg_lookup(args, "bgalpha", 0, &val) && val)
 		src->alpha = strtoul(val, NULL, 10);
+
+/* frametime=0 disables refresh coalescing */
+	if (arg_lookup(args, "frametime", 0, &val) && val)
+		src->coalesce.interval = strtoul(val, NULL, 10);
+
+	if (arg_lookup(args, "latency", 0, &val) && val)
+		src->coalesce.latency = strtoul(val, NULL, 10);
 }
 
 arcan_tui_conn* arcan_tui_open_display(const char* title, const char* ident)
@@ -192,7 +199,11 @@ struct tui_context* arcan_tui_setup(
 		.font_sz = 0.0416,
 		.flags = TUI_ALTERNATE,
 		.cell_w = 8,
-		.cell_h = 8
+		.cell_h = 8,
+		.coalesce = {
+			.interval = 16,
+			.latency = 50
+		}
 	};
 
 /*
@@ -254,6 +265,8 @@ struct tui_context* arcan_tui_setup(
 		res->alpha = parent->alpha;
 		res->cursor = parent->cursor;
 		res->ppcm = parent->ppcm;
+		res->coalesce.interval = parent->coalesce.interval;
+		res->coalesce.latency = parent->coalesce.latency;
 
 		tui_fontmgmt_setup(res, &(struct arcan_shmif_initial){
 			.fonts = {
@@ -20,19 +20,81 @@
 #include "../screen/utf8.c"
 #include "uthash.h"
 
+/*
+ * Glyphs are expanded at load time to one 32-bit mask per pixel row with the
+ * leftmost pixel in the most significant bit, so drawing never has to deal
+ * with the byte padding of the PSF2 bitmaps.
+ */
+#define MAX_GLYPH_W 32
+
 struct glyph_ent {
 	uint32_t codepoint;
-	uint8_t* data;
+	uint32_t* rows;
 	UT_hash_handle hh;
 };
 
 struct bitmap_font {
-	uint8_t* fontdata;
-	size_t chsz, w, h;
+	uint32_t* rows;
+	size_t w, h;
 	size_t n_glyphs;
 	struct glyph_ent glyphs[0];
 };
 
+/*
+ * Codepoint to glyph lookup. The BMP is direct mapped through pages of 256
+ * entries that are allocated on first use (a latin font only touches a few),
+ * anything above that goes through the hash table.
+ */
+struct glyph_index {
+	uint32_t** pages[256];
+	struct glyph_ent* ht;
+};
+
+static uint32_t* glyph_find(struct glyph_index* ind, uint32_t cp)
+{
+	if (!ind)
+		return NULL;
+
+	if (cp < 0x10000){
+		uint32_t** page = ind->pages[cp >> 8];
+		return page ? page[cp & 0xff] : NULL;
+	}
+
+	struct glyph_ent* gent;
+	HASH_FIND_INT(ind->ht, &cp, gent);
+	return gent ? gent->rows : NULL;
+}
+
+static bool glyph_insert(struct glyph_index* ind, struct glyph_ent* ent)
+{
+	if (ent->codepoint < 0x10000){
+		uint32_t*** page = &ind->pages[ent->codepoint >> 8];
+		if (!*page){
+			*page = calloc(256, sizeof(uint32_t*));
+			if (!*page)
+				return false;
+		}
+		(*page)[ent->codepoint & 0xff] = ent->rows;
+		return true;
+	}
+
+	struct glyph_ent* repl;
+	HASH_REPLACE_INT(ind->ht, codepoint, ent, repl);
+	return true;
+}
+
+static void glyph_index_free(struct glyph_index* ind)
+{
+	if (!ind)
+		return;
+
+	for (size_t i = 0; i < 256; i++)
+		free(ind->pages[i]);
+
+	HASH_CLEAR(hh, ind->ht);
+	free(ind);
+}
+
 static bool psf2_decode_header(
 	const uint8_t* const buf, size_t buf_sz,
 	size_t* glyph_count, size_t* glyph_bytes, size_t* w, size_t* h, size_t* ofs)
@@ -65,35 +127,55 @@ static bool psf2_decode_header(
 }
 
 /*
- * support a subset of PSF(v2), no ranges in the unicode- table
+ * support a subset of PSF(v2), no ranges in the unicode- table and no glyphs
+ * wider than MAX_GLYPH_W
  */
 static struct bitmap_font* open_psf2(
-	const uint8_t* const buf, size_t buf_sz, struct glyph_ent** ht)
+	const uint8_t* const buf, size_t buf_sz, struct glyph_index* index)
 {
 	size_t glyph_count, glyph_bytes, w, h, ofs;
 
 	if (!psf2_decode_header(buf, buf_sz, &glyph_count, &glyph_bytes, &w,&h,&ofs))
 		return NULL;
 
+	size_t bpr = (w + 7) / 8;
+	if (!w || !h || w > MAX_GLYPH_W || glyph_bytes < bpr * h){
+		fprintf(stderr, "open_psf2() unsupported glyph dimensions\n");
+		return NULL;
+	}
+
 	size_t pos = ofs;
 	size_t glyphbuf_sz = glyph_count * glyph_bytes;
+	if (ofs > buf_sz || buf_sz - ofs < glyphbuf_sz)
+		return NULL;
 	size_t unicodecount = buf_sz - pos - glyphbuf_sz;
 
 /* we overallocate as we need to support aliases and it's not many bytes */
 	struct bitmap_font* res = malloc(
 		sizeof(struct bitmap_font) +
 		sizeof(struct glyph_ent) * unicodecount +
-		glyphbuf_sz
+		sizeof(uint32_t) * glyph_count * h
 	);
+	if (!res)
+		return NULL;
 
-/* read in the raw font-data */
-	res->chsz = glyph_bytes;
 	res->w = w;
 	res->h = h;
 	res->n_glyphs = 0;
 
-	res->fontdata = (uint8_t*) &res->glyphs[unicodecount];
-	memcpy(res->fontdata, &buf[pos], glyphbuf_sz);
+/* expand the raw font-data to row masks, padding bits should be 0 but mask
+ * them off regardless so the draw loop can trust them */
+	res->rows = (uint32_t*) &res->glyphs[unicodecount];
+	uint32_t pad = ~(uint32_t)0 << (MAX_GLYPH_W - w);
+	for (size_t i = 0; i < glyph_count; i++){
+		const uint8_t* src = &buf[pos + i * glyph_bytes];
+		for (size_t row = 0; row < h; row++, src += bpr){
+			uint32_t mask = 0;
+			for (size_t j = 0; j < bpr; j++)
+				mask |= (uint32_t) src[j] << (24 - j * 8);
+			res->rows[i * h + row] = mask & pad;
+		}
+	}
 	pos = ofs + glyphbuf_sz;
 
 /* the rest is UTF-8 sequences, build glyph_ent for these */
@@ -117,13 +199,14 @@ static struct bitmap_font* open_psf2(
 			return res;
 		}
 		else if (state == UTF8_ACCEPT){
-			res->glyphs[res->n_glyphs].hh = (struct UT_hash_handle){};
-			res->glyphs[res->n_glyphs].codepoint = codepoint;
-			res->glyphs[res->n_glyphs].data = &res->fontdata[glyph_bytes*ind];
-
-			struct glyph_ent* repl;
-			HASH_REPLACE_INT(*ht, codepoint, &res->glyphs[res->n_glyphs], repl);
-			res->n_glyphs++;
+			struct glyph_ent* ent = &res->glyphs[res->n_glyphs];
+			*ent = (struct glyph_ent){
+				.codepoint = codepoint,
+				.rows = &res->rows[h * ind]
+			};
+
+			if (glyph_insert(index, ent))
+				res->n_glyphs++;
 			state = 0;
 			codepoint = 0;
 		}
@@ -141,7 +224,7 @@ struct font_entry {
 	size_t sz;
 	struct bitmap_font* font;
 	bool shared_ht;
-	struct glyph_ent* ht;
+	struct glyph_index* index;
 };
 
 struct tui_pixelfont {
@@ -164,8 +247,6 @@ bool tui_pixelfont_valid(uint8_t* buf, size_t buf_sz)
 bool tui_pixelfont_load(struct tui_pixelfont* ctx,
 	uint8_t* buf, size_t buf_sz, size_t px_sz, bool merge)
 {
-	struct glyph_ent** ht = NULL;
-
 /* don't waste time with a font we can't decode */
 	if (!psf2_decode_header(buf, buf_sz, NULL, NULL, NULL, NULL, NULL))
 		return false;
@@ -175,9 +256,10 @@ bool tui_pixelfont_load(struct tui_pixelfont* ctx,
 		for (size_t i = 0; i < ctx->n_fonts; i++){
 			if (ctx->fonts[i].font && ctx->fonts[i].sz == px_sz){
 				if (!ctx->fonts[i].shared_ht)
-					HASH_CLEAR(hh, ctx->fonts[i].ht);
+					glyph_index_free(ctx->fonts[i].index);
 				free(ctx->fonts[i].font);
 				ctx->fonts[i].font = NULL;
+				ctx->fonts[i].index = NULL;
 				ctx->fonts[i].sz = 0;
 				ctx->fonts[i].shared_ht = false;
 			}
@@ -200,17 +282,25 @@ bool tui_pixelfont_load(struct tui_pixelfont* ctx,
 		for (size_t i = 0; i < ctx->n_fonts; i++){
 			if (ctx->fonts[i].font && ctx->fonts[i].sz == px_sz){
 				dst->shared_ht = true;
-				dst->ht = ctx->fonts[i].ht;
+				dst->index = ctx->fonts[i].index;
 				break;
 			}
 		}
 	}
 
+	if (!dst->shared_ht){
+		dst->index = calloc(1, sizeof(struct glyph_index));
+		if (!dst->index)
+			return false;
+	}
+
 /* load it */
-	dst->font = open_psf2(buf, buf_sz, &dst->ht);
+	dst->font = open_psf2(buf, buf_sz, dst->index);
 	if (!dst->font){
+		if (!dst->shared_ht)
+			glyph_index_free(dst->index);
 		dst->shared_ht = false;
-		dst->ht = NULL;
+		dst->index = NULL;
 		return false;
 	}
 	dst->sz = px_sz;
@@ -230,10 +320,11 @@ static void drop_font_context (struct tui_pixelfont* ctx)
 /* some font slots share hash table with others, don't free those,
  * the real table slot won't be marked as shared */
 		if (!ctx->fonts[i].shared_ht)
-			HASH_CLEAR(hh, ctx->fonts[i].ht);
+			glyph_index_free(ctx->fonts[i].index);
 
 		free(ctx->fonts[i].font);
 		ctx->fonts[i].font = NULL;
+		ctx->fonts[i].index = NULL;
 		ctx->fonts[i].sz = 0;
 		ctx->fonts[i].shared_ht = false;
 	}
@@ -272,11 +363,13 @@ void tui_pixelfont_close(struct tui_pixelfont* ctx)
 			continue;
 
 		if (!ctx->fonts[i].shared_ht)
-			HASH_CLEAR(hh, ctx->fonts[i].ht);
+			glyph_index_free(ctx->fonts[i].index);
 
-			free(ctx->fonts[i].font);ctx->fonts[i].font = NULL;
-			ctx->fonts[i].sz = 0;
-			ctx->fonts[i].shared_ht = false;
+		free(ctx->fonts[i].font);
+		ctx->fonts[i].font = NULL;
+		ctx->fonts[i].index = NULL;
+		ctx->fonts[i].sz = 0;
+		ctx->fonts[i].shared_ht = false;
 	}
 	free(ctx);
 }
@@ -320,9 +413,38 @@ bool tui_pixelfont_hascp(struct tui_pixelfont* ctx, uint32_t cp)
 	if (!ctx->active_font)
 		return false;
 
-	struct glyph_ent* gent;
-	HASH_FIND_INT(ctx->active_font->ht, &cp, gent);
-	return gent != NULL;
+	return glyph_find(ctx->active_font->index, cp) != NULL;
+}
+
+/*
+ * Branch-free per column so that the compiler can turn it into vector selects:
+ * the column bit is tested against a constant table rather than a variable
+ * shift and the result is widened to a full pixel which picks between the
+ * foreground and the background (or what is already there).
+ */
+static const uint32_t column_bit[MAX_GLYPH_W] = {
+	1u << 31, 1u << 30, 1u << 29, 1u << 28, 1u << 27, 1u << 26, 1u << 25,
+	1u << 24, 1u << 23, 1u << 22, 1u << 21, 1u << 20, 1u << 19, 1u << 18,
+	1u << 17, 1u << 16, 1u << 15, 1u << 14, 1u << 13, 1u << 12, 1u << 11,
+	1u << 10, 1u << 9, 1u << 8, 1u << 7, 1u << 6, 1u << 5, 1u << 4,
+	1u << 3, 1u << 2, 1u << 1, 1u << 0
+};
+
+static inline void expand_row(shmif_pixel* restrict dst,
+	uint32_t mask, size_t n, shmif_pixel fg, shmif_pixel bg, bool bgign)
+{
+	if (bgign){
+		for (size_t i = 0; i < n; i++){
+			shmif_pixel sel = -(shmif_pixel)((mask & column_bit[i]) != 0);
+			dst[i] = (fg & sel) | (dst[i] & ~sel);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++){
+		shmif_pixel sel = -(shmif_pixel)((mask & column_bit[i]) != 0);
+		dst[i] = (fg & sel) | (bg & ~sel);
+	}
 }
 
 void tui_pixelfont_draw(
@@ -331,16 +453,14 @@ void tui_pixelfont_draw(
 	int maxx, int maxy, bool bgign)
 {
 	struct font_entry* font = ctx->active_font;
-	struct glyph_ent* gent;
-	if (font)
-		HASH_FIND_INT(font->ht, &cp, gent);
-
-	if (x >= maxx || y >= maxy)
+	if (!font || !font->font || x >= maxx || y >= maxy)
 		return;
 
-	if (!font || !gent){
-		size_t w = font->font->w;
-		size_t h = font->font->h;
+	int w = font->font->w;
+	int h = font->font->h;
+	uint32_t* rows = glyph_find(font->index, cp);
+
+	if (!rows){
 		if (w + x >= maxx)
 			w = maxx - x;
 		if (h + y >= maxy)
@@ -353,43 +473,31 @@ void tui_pixelfont_draw(
 /*
  * handle partial- clipping against screen regions
  */
-	uint8_t bind = 0;
 	int row = 0;
 	if (y < 0){
-		row -= y;
-		uint8_t bpr = font->font->w / 8;
-		if (font->font->w % 8 != 0 || bpr == 0)
-			bpr++;
-		bind += -y * bpr;
+		row = -y;
 		y = 0;
 	}
 
 	int colst = 0;
 	if (x < 0){
-		colst =-1*x;
+		colst = -x;
 		x = 0;
 	}
 
-	if (font->font->w + x > maxx || font->font->h + y > maxy)
+	if (colst >= w || w - colst + x > maxx || h - row + y > maxy)
 		return;
 
-	for (; row < font->font->h && y < maxy; row++, y++){
+	size_t n = w - colst;
+	for (; row < h; row++, y++){
 		shmif_pixel* pos = &c[y * pitch + x];
-		for (int col = colst; col < font->font->w; bind++){
-/* padding bits will just be 0 */
-			int lx = x;
-			for (
-				int bit = 7;
-				bit >= 0 && col < font->font->w && lx < maxx;
-				bit--, col++, lx++)
-			{
-				if ((1 << bit) & gent->data[bind]){
-					pos[col] = fg;
-				}
-				else if (!bgign){
-					pos[col] = bg;
-				}
-			}
+		uint32_t mask = rows[row] << colst;
+
+		if (mask)
+			expand_row(pos, mask, n, fg, bg, bgign);
+		else if (!bgign){
+			for (size_t i = 0; i < n; i++)
+				pos[i] = bg;
 		}
 	}
 }
@@ -1,4 +1,5 @@
 #include <inttypes.h>
+#include <pthread.h>
 #include "../../arcan_shmif.h"
 #include "../../arcan_tui.h"
 #define SHMIF_TTF
@@ -22,10 +23,174 @@ struct cell {
 	uint8_t attr;
 };
 
+/*
+ * Glyphs from vector fonts are kept as coverage masks (one byte per pixel at
+ * the cell size) in an atlas shared by all styles, with a separate lookup
+ * table per style so that mixing bold / italic / normal cells does not cause
+ * any font state changes once the glyphs have been seen. Colors are applied
+ * when the mask is blitted so they are not part of the key. Slots are shared
+ * between the styles and recycled in LRU order.
+ */
+#define GLYPH_SLOTS 1024
+#define GLYPH_BUCKETS 256
+#define GLYPH_NIL 0xffff
+
+/* slots per row when the atlas is used as a texture by the cell grid */
+#define GLYPH_ATLAS_COLS 32
+
+enum glyph_flags {
+/* nothing to draw, just fill with background */
+	GLYPH_EMPTY = 1,
+
+/* colored or subpixel glyph that can't be expressed as coverage */
+	GLYPH_DIRECT = 2
+};
+
+struct glyph_slot {
+	uint32_t ucs4;
+	uint8_t style;
+	uint8_t flags;
+	uint16_t hnext;
+	uint16_t lprev, lnext;
+};
+
+struct glyph_cache {
+	uint8_t* atlas;
+	shmif_pixel* scratch;
+	size_t used;
+
+/* bumped whenever a slot changes glyph, and the range of slots that have
+ * been rendered since the atlas was last sent to a texture */
+	uint64_t gen, epoch;
+	uint16_t dirty_lo, dirty_hi;
+	uint16_t lru_head, lru_tail;
+	uint16_t buckets[4][GLYPH_BUCKETS];
+	struct glyph_slot slots[GLYPH_SLOTS];
+
+/* slots used by the raster threads, moved to the LRU front afterwards */
+	_Atomic uint8_t hit[GLYPH_SLOTS];
+};
+
+/*
+ * Frames with enough cells are split into bands of consecutive lines that
+ * are rasterized in parallel, each band only writes to the pixel rows of its
+ * own lines. The threads only read the glyph cache: cells that would need
+ * the font renderer (misses, colored glyphs) are deferred and drawn by the
+ * calling thread once the bands are done.
+ */
+#define RASTER_MAX_THREADS 8
+#define RASTER_MAX_BANDS 32
+#define RASTER_BAND_CELLS 2048
+
+/* one packed line, resolved before the bands are split */
+struct raster_line {
+	uint8_t* cells;
+	size_t n_cells;
+	size_t row;
+	size_t offset;
+
+/* row to fill with background from on a full frame, -1 for none */
+	ssize_t gap;
+};
+
+struct deferred_cell {
+	struct cell cell;
+	int x, y;
+};
+
+struct raster_band {
+	size_t first, count;
+	uint16_t x1, y1, x2;
+	size_t last_line;
+
+	struct deferred_cell* deferred;
+	size_t n_deferred, deferred_sz;
+	bool failed;
+	uint64_t hits;
+};
+
+struct raster_pool {
+	pthread_t threads[RASTER_MAX_THREADS];
+	size_t n_threads;
+
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	unsigned gen;
+	size_t active;
+	bool shutdown;
+
+	_Atomic size_t next_band;
+};
+
+/*
+ * Hash of the line that was last drawn at each row of a destination, a line
+ * that matches is already there and is skipped. The hash is seeded with
+ * everything that changes how the cells of a line would be drawn.
+ */
+struct tui_raster_rows {
+	uint64_t* hash;
+	size_t n;
+};
+
+/*
+ * The cell grid keeps the whole screen as one instance per cell, to be drawn
+ * with the glyph atlas as texture instead of being rasterized. The codepoint
+ * and attributes are kept on the side so that the glyphs can be resolved
+ * again when the atlas has recycled slots, and so that the CPU fallback can
+ * draw from the same state.
+ */
+struct grid_key {
+	uint32_t ucs4;
+	uint8_t attr;
+	uint8_t bg[3];
+};
+
+struct tui_raster_grid {
+	size_t cols, rows;
+	size_t cell_w, cell_h;
+	struct tui_raster_instance* cells;
+	struct grid_key* keys;
+
+	uint64_t gen, epoch;
+	uint8_t cursor_state;
+	uint8_t alpha;
+	bool invalid;
+
+#ifndef NO_ARCAN_AGP
+	struct agp_vstore* dst;
+	struct agp_rendertarget* rtgt;
+#endif
+};
+
+/* the frame currently being rasterized */
+struct raster_job {
+	shmif_pixel* vidp;
+	size_t pitch;
+	size_t max_w, max_h;
+	shmif_pixel bgc;
+	uint8_t alpha;
+	bool update;
+
+	struct tui_raster_rows* rows;
+	uint64_t seed;
+	size_t drawn;
+};
+
 struct tui_raster_context {
 	struct tui_font* fonts[4];
 	int last_style;
 	int cursor_state;
+	struct glyph_cache glyphs;
+
+	struct raster_job job;
+	struct raster_line* lines;
+	size_t lines_sz;
+	struct raster_band bands[RASTER_MAX_BANDS];
+	size_t n_bands;
+
+	struct raster_pool* pool;
+	bool no_pool;
 
 	shmif_pixel cc;
 
@@ -34,14 +199,46 @@ struct tui_raster_context {
 
 	size_t min_x, min_y;
 	size_t max_x, max_y;
+
+	struct tui_raster_stats stats;
+
+#ifndef NO_ARCAN_AGP
+/* the atlas as a texture for the cell grid, expanded to the pixel format */
+	struct agp_vstore* atlas_store;
+	shmif_pixel* atlas_buf;
+	size_t atlas_w, atlas_h;
+#endif
 };
 
+/*
+ * Forget all cached glyphs, the atlas itself is sized after the cell and is
+ * rebuilt on the next miss. The epoch is unique across contexts so that a
+ * cell grid can tell if it was resolved against the same glyphs.
+ */
+static void glyph_flush(struct glyph_cache* C)
+{
+	static _Atomic uint64_t epoch;
+
+	free(C->atlas);
+	free(C->scratch);
+	C->atlas = NULL;
+	C->scratch = NULL;
+	C->used = 0;
+	C->gen++;
+	C->epoch = atomic_fetch_add(&epoch, 1) + 1;
+	C->dirty_lo = GLYPH_SLOTS;
+	C->dirty_hi = 0;
+	C->lru_head = C->lru_tail = GLYPH_NIL;
+	memset(C->buckets, 0xff, sizeof(C->buckets));
+}
+
 void tui_raster_setfont(
 	struct tui_raster_context* ctx, struct tui_font** src, size_t n_fonts)
 {
 	for (size_t i = 0; i < 4; i++)
 		ctx->fonts[i] = i < n_fonts ? src[i] : NULL;
 	ctx->last_style = -1;
+	glyph_flush(&ctx->glyphs);
 }
 
 struct tui_raster_context* tui_raster_setup(size_t cell_w, size_t cell_h)
@@ -56,14 +253,18 @@ struct tui_raster_context* tui_raster_setup(size_t cell_w, size_t cell_h)
 		.cc = SHMIF_RGBA(0x00, 0xaa, 0x00, 0xff),
 		.last_style = -1
 	};
+	glyph_flush(&res->glyphs);
 
 	return res;
 }
 
+/* this is also the signal that the fonts have been changed in place */
 void tui_raster_cell_size(struct tui_raster_context* ctx, size_t w, size_t h)
 {
 	ctx->cell_w = w;
 	ctx->cell_h = h;
+	ctx->last_style = -1;
+	glyph_flush(&ctx->glyphs);
 }
 
 void unpack_u32(uint32_t* dst, uint8_t* inbuf)
@@ -101,7 +302,343 @@ static void linehint(struct tui_raster_context* ctx, struct cell* cell,
 	}
 }
 
-static size_t drawglyph(struct tui_raster_context* ctx, struct cell* cell,
+static void lru_unlink(struct glyph_cache* C, uint16_t i)
+{
+	struct glyph_slot* g = &C->slots[i];
+	if (g->lprev != GLYPH_NIL)
+		C->slots[g->lprev].lnext = g->lnext;
+	else
+		C->lru_head = g->lnext;
+
+	if (g->lnext != GLYPH_NIL)
+		C->slots[g->lnext].lprev = g->lprev;
+	else
+		C->lru_tail = g->lprev;
+}
+
+static void lru_front(struct glyph_cache* C, uint16_t i)
+{
+	struct glyph_slot* g = &C->slots[i];
+	g->lprev = GLYPH_NIL;
+	g->lnext = C->lru_head;
+
+	if (C->lru_head != GLYPH_NIL)
+		C->slots[C->lru_head].lprev = i;
+	else
+		C->lru_tail = i;
+
+	C->lru_head = i;
+}
+
+static uint16_t* glyph_bucket(struct glyph_cache* C, uint32_t ucs4, int style)
+{
+	return &C->buckets[style][(ucs4 * 2654435761u) >> 24];
+}
+
+/* lookup without touching the LRU, safe as long as nothing is inserted */
+static uint16_t glyph_find(struct glyph_cache* C, uint32_t ucs4, int style)
+{
+	for (uint16_t i = *glyph_bucket(C, ucs4, style);
+		i != GLYPH_NIL; i = C->slots[i].hnext){
+		if (C->slots[i].ucs4 == ucs4){
+			atomic_store_explicit(&C->hit[i], 1, memory_order_relaxed);
+			return i;
+		}
+	}
+
+	return GLYPH_NIL;
+}
+
+static uint16_t glyph_lookup(struct glyph_cache* C, uint32_t ucs4, int style)
+{
+	for (uint16_t i = *glyph_bucket(C, ucs4, style);
+		i != GLYPH_NIL; i = C->slots[i].hnext){
+		if (C->slots[i].ucs4 == ucs4){
+			if (C->lru_head != i){
+				lru_unlink(C, i);
+				lru_front(C, i);
+			}
+			return i;
+		}
+	}
+
+	return GLYPH_NIL;
+}
+
+/* grab a free slot or recycle the least recently used one */
+static uint16_t glyph_alloc(struct glyph_cache* C)
+{
+	if (C->used < GLYPH_SLOTS)
+		return C->used++;
+
+	uint16_t i = C->lru_tail;
+	struct glyph_slot* g = &C->slots[i];
+	lru_unlink(C, i);
+	C->gen++;
+
+	uint16_t* cur = glyph_bucket(C, g->ucs4, g->style);
+	while (*cur != i)
+		cur = &C->slots[*cur].hnext;
+	*cur = g->hnext;
+
+	return i;
+}
+
+static void set_style(struct tui_raster_context* ctx,
+	TTF_Font* fonts[static 2], int style)
+{
+/* seriously expensive so only perform if we actually need to as it can cause a
+ * glyph cache flush (bold / italic / ...), with the atlas this only happens on
+ * misses */
+	if (style != ctx->last_style){
+		ctx->last_style = style;
+		TTF_SetFontStyle(fonts[0], style);
+		if (fonts[1])
+			TTF_SetFontStyle(fonts[1], style);
+	}
+}
+
+static bool glyph_atlas(struct tui_raster_context* ctx)
+{
+	struct glyph_cache* C = &ctx->glyphs;
+	if (C->atlas)
+		return true;
+
+	C->atlas = malloc(ctx->cell_w * ctx->cell_h * GLYPH_SLOTS);
+	C->scratch = malloc(ctx->cell_w * 3 * ctx->cell_h * sizeof(shmif_pixel) * 2);
+	if (!C->atlas || !C->scratch){
+		glyph_flush(C);
+		return false;
+	}
+
+	return true;
+}
+
+/* add a freshly rendered slot to the lookup and the front of the LRU */
+static void glyph_link(
+	struct glyph_cache* C, uint16_t i, uint32_t ucs4, int style)
+{
+	uint16_t* bucket = glyph_bucket(C, ucs4, style);
+	C->slots[i].hnext = *bucket;
+	*bucket = i;
+	lru_front(C, i);
+
+	if (i < C->dirty_lo)
+		C->dirty_lo = i;
+	if (i >= C->dirty_hi)
+		C->dirty_hi = i + 1;
+}
+
+/*
+ * Render the glyph once white on black and once black on white, for anything
+ * that can be expressed as coverage the two are each others complement and
+ * any channel of the first is the mask. The scratch rows are padded by a cell
+ * on each side so that glyphs which extend outside the cell (italic) don't
+ * wrap around into the next row, that part would otherwise be overdrawn by
+ * the neighbouring cell anyhow.
+ */
+static uint16_t glyph_render(struct tui_raster_context* ctx,
+	TTF_Font* fonts[static 2], size_t nfonts, uint32_t ucs4, int style)
+{
+	struct glyph_cache* C = &ctx->glyphs;
+	size_t cell_sz = ctx->cell_w * ctx->cell_h;
+
+	size_t stride = ctx->cell_w * 3;
+	size_t scratch_sz = stride * ctx->cell_h;
+
+	if (!glyph_atlas(ctx))
+		return GLYPH_NIL;
+
+	set_style(ctx, fonts, style);
+
+	uint8_t white[4] = {0xff, 0xff, 0xff, 0xff};
+	uint8_t black[4] = {0x00, 0x00, 0x00, 0xff};
+	shmif_pixel* pos = C->scratch;
+	shmif_pixel* neg = &C->scratch[scratch_sz];
+
+	for (size_t i = 0; i < scratch_sz; i++){
+		pos[i] = SHMIF_RGBA(0x00, 0x00, 0x00, 0xff);
+		neg[i] = SHMIF_RGBA(0xff, 0xff, 0xff, 0xff);
+	}
+
+	int adv = 0;
+	unsigned xs = 0, ind = 0;
+	TTF_RenderUNICODEglyph(&pos[ctx->cell_w], ctx->cell_w, ctx->cell_h, stride,
+		fonts, nfonts, ucs4, &xs, white, black, true, true, style, &adv, &ind);
+
+	adv = 0;
+	xs = ind = 0;
+	TTF_RenderUNICODEglyph(&neg[ctx->cell_w], ctx->cell_w, ctx->cell_h, stride,
+		fonts, nfonts, ucs4, &xs, black, white, true, true, style, &adv, &ind);
+
+	uint16_t i = glyph_alloc(C);
+	struct glyph_slot* g = &C->slots[i];
+	uint8_t* mask = &C->atlas[i * cell_sz];
+	*g = (struct glyph_slot){
+		.ucs4 = ucs4,
+		.style = style,
+		.flags = GLYPH_EMPTY
+	};
+
+	for (size_t px = 0; px < cell_sz && !(g->flags & GLYPH_DIRECT); px++){
+		size_t ofs = (px / ctx->cell_w) * stride + ctx->cell_w + (px % ctx->cell_w);
+		uint8_t r, g1, b, a, nr, ng, nb, na;
+		SHMIF_RGBA_DECOMP(pos[ofs], &r, &g1, &b, &a);
+		SHMIF_RGBA_DECOMP(neg[ofs], &nr, &ng, &nb, &na);
+
+		if (r != g1 || r != b || r + nr != 0xff){
+			g->flags = GLYPH_DIRECT;
+			break;
+		}
+
+		if (r)
+			g->flags = 0;
+		mask[px] = r;
+	}
+
+/* these are drawn directly when rasterizing, the mask is only used by the
+ * cell grid where the brightest channel is the best coverage there is */
+	if (g->flags & GLYPH_DIRECT){
+		for (size_t px = 0; px < cell_sz; px++){
+			size_t ofs = (px / ctx->cell_w) * stride + ctx->cell_w + (px % ctx->cell_w);
+			uint8_t r, g1, b, a;
+			SHMIF_RGBA_DECOMP(pos[ofs], &r, &g1, &b, &a);
+			mask[px] = r > g1 ? (r > b ? r : b) : (g1 > b ? g1 : b);
+		}
+	}
+
+	glyph_link(C, i, ucs4, style);
+	return i;
+}
+
+/*
+ * Bitmap fonts are drawn straight from the font when rasterizing, they only
+ * go into the atlas when it is used as a texture by the cell grid
+ */
+static uint16_t glyph_render_bitmap(
+	struct tui_raster_context* ctx, uint32_t ucs4)
+{
+	struct glyph_cache* C = &ctx->glyphs;
+	size_t stride = ctx->cell_w * 3;
+
+	if (!glyph_atlas(ctx))
+		return GLYPH_NIL;
+
+	for (size_t i = 0; i < stride * ctx->cell_h; i++)
+		C->scratch[i] = SHMIF_RGBA(0x00, 0x00, 0x00, 0xff);
+
+	tui_pixelfont_draw(ctx->fonts[0]->bitmap, C->scratch, stride, ucs4, 0, 0,
+		SHMIF_RGBA(0xff, 0xff, 0xff, 0xff), SHMIF_RGBA(0x00, 0x00, 0x00, 0xff),
+		stride, ctx->cell_h, false
+	);
+
+	uint16_t i = glyph_alloc(C);
+	uint8_t* mask = &C->atlas[i * ctx->cell_w * ctx->cell_h];
+	C->slots[i] = (struct glyph_slot){
+		.ucs4 = ucs4,
+		.flags = GLYPH_EMPTY
+	};
+
+	for (size_t y = 0; y < ctx->cell_h; y++)
+		for (size_t x = 0; x < ctx->cell_w; x++){
+			uint8_t r, g, b, a;
+			SHMIF_RGBA_DECOMP(C->scratch[y * stride + x], &r, &g, &b, &a);
+			if (r)
+				C->slots[i].flags = 0;
+			*mask++ = r;
+		}
+
+	glyph_link(C, i, ucs4, 0);
+	return i;
+}
+
+static inline shmif_pixel blend(
+	uint8_t fg[static 4], uint8_t bg[static 4], uint8_t a)
+{
+	uint32_t r = 0x80 + (a * fg[0] + bg[0] * (255 - a));
+	r = (r + (r >> 8)) >> 8;
+	uint32_t g = 0x80 + (a * fg[1] + bg[1] * (255 - a));
+	g = (g + (g >> 8)) >> 8;
+	uint32_t b = 0x80 + (a * fg[2] + bg[2] * (255 - a));
+	b = (b + (b >> 8)) >> 8;
+	uint8_t av = (a < bg[3] || a - bg[3] < bg[3]) ? bg[3] : a;
+	return SHMIF_RGBA(r, g, b, av);
+}
+
+/* same blending as the font renderer does against a background */
+static void blit_mask(struct tui_raster_context* ctx, uint8_t* mask,
+	shmif_pixel* vidp, size_t pitch, int x, int y, shmif_pixel fc, shmif_pixel bc)
+{
+	uint8_t fg[4], bg[4];
+	SHMIF_RGBA_DECOMP(fc, &fg[0], &fg[1], &fg[2], &fg[3]);
+	SHMIF_RGBA_DECOMP(bc, &bg[0], &bg[1], &bg[2], &bg[3]);
+	fc = SHMIF_RGBA(fg[0], fg[1], fg[2], 0xff);
+
+	for (size_t row = 0; row < ctx->cell_h; row++){
+		shmif_pixel* out = &vidp[(y + row) * pitch + x];
+		for (size_t col = 0; col < ctx->cell_w; col++){
+			uint8_t a = *mask++;
+			if (a == 0)
+				out[col] = bc;
+			else if (a == 0xff)
+				out[col] = fc;
+			else
+				out[col] = blend(fg, bg, a);
+		}
+	}
+}
+
+static void defer_cell(
+	struct raster_band* band, struct cell* cell, int x, int y)
+{
+	if (band->n_deferred == band->deferred_sz){
+		size_t nsz = band->deferred_sz ? band->deferred_sz * 2 : 64;
+		struct deferred_cell* cells =
+			realloc(band->deferred, nsz * sizeof(struct deferred_cell));
+		if (!cells){
+			band->failed = true;
+			return;
+		}
+		band->deferred = cells;
+		band->deferred_sz = nsz;
+	}
+
+	band->deferred[band->n_deferred++] = (struct deferred_cell){
+		.cell = *cell,
+		.x = x,
+		.y = y
+	};
+}
+
+/* primary and fallback font */
+static size_t vector_fonts(
+	struct tui_raster_context* ctx, TTF_Font* fonts[static 2])
+{
+	fonts[0] = ctx->fonts[0]->truetype;
+	fonts[1] = NULL;
+
+	if (ctx->fonts[1]->vector && ctx->fonts[1]->truetype){
+		fonts[1] = ctx->fonts[1]->truetype;
+		return 2;
+	}
+
+	return 1;
+}
+
+static int cell_style(uint8_t attr)
+{
+	int style = TTF_STYLE_NORMAL;
+	style |= TTF_STYLE_ITALIC * !!(attr & (1 << CATTR_ITALIC));
+	style |= TTF_STYLE_BOLD * !!(attr & (1 << CATTR_BOLD));
+	return style;
+}
+
+/*
+ * [band] is set when called from a raster thread, the glyph cache is then
+ * only read and anything else is deferred to the calling thread
+ */
+static size_t drawglyph(struct tui_raster_context* ctx,
+	struct raster_band* band, struct cell* cell,
 	shmif_pixel* vidp, size_t pitch, int x, int y, size_t maxx, size_t maxy)
 {
 /* draw glyph based on font state */
@@ -114,7 +651,7 @@ static size_t drawglyph(struct tui_raster_context* ctx, struct cell* cell,
 			}
 		}
 
-/* linear search for cp, on fail, fill with background */
+/* indexed lookup for cp, on fail, fill with background */
 		tui_pixelfont_draw(ctx->fonts[0]->bitmap,
 			vidp, pitch, cell->ucs4, x, y, cell->fc, cell->bc, maxx, maxy, false);
 
@@ -130,12 +667,8 @@ static size_t drawglyph(struct tui_raster_context* ctx, struct cell* cell,
 	}
 
 /* vector font drawing */
-	size_t nfonts = 1;
-	TTF_Font* fonts[2] = {ctx->fonts[0]->truetype, NULL};
-	if (ctx->fonts[1]->vector && ctx->fonts[1]->truetype){
-		nfonts = 2;
-		fonts[1] = ctx->fonts[1]->truetype;
-	}
+	TTF_Font* fonts[2];
+	size_t nfonts = vector_fonts(ctx, fonts);
 
 /* Clear to bg-color as the glyph drawing with background won't pad,
  * except if it is the cursor color, then use that. We can't do the
@@ -145,42 +678,64 @@ static size_t drawglyph(struct tui_raster_context* ctx, struct cell* cell,
 	if ((cell->attr & (1 << CATTR_CURSOR)) && ctx->cursor_state == CURSOR_ACTIVE)
 		bc = ctx->cc;
 
-	draw_box_px(vidp,
-		pitch, maxx, maxy, x, y, ctx->cell_w, ctx->cell_h, bc);
-
 /* fast-path, just clear to background */
 	if (!cell->ucs4){
+		draw_box_px(vidp,
+			pitch, maxx, maxy, x, y, ctx->cell_w, ctx->cell_h, bc);
 		return ctx->cell_w;
 	}
 
-	int prem = TTF_STYLE_NORMAL;
-	prem |= TTF_STYLE_ITALIC * !!(cell->attr & (1 << CATTR_ITALIC));
-	prem |= TTF_STYLE_BOLD * !!(cell->attr & (1 << CATTR_BOLD));
+	int prem = cell_style(cell->attr);
 
-/* seriously expensive so only perform if we actually need to as it can cause a
- * glyph cache flush (bold / italic / ...), other option would be to run
- * separate glyph caches on the different style options.. */
-	if (prem != ctx->last_style){
-		ctx->last_style = prem;
-		TTF_SetFontStyle(fonts[0], prem);
-		if (fonts[1])
-			TTF_SetFontStyle(fonts[1], prem);
+/* the common case is a blit from the atlas, mask and background in one go */
+	uint16_t slot;
+	if (band){
+		slot = glyph_find(&ctx->glyphs, cell->ucs4, prem);
+		if (slot == GLYPH_NIL || (ctx->glyphs.slots[slot].flags & GLYPH_DIRECT)){
+			defer_cell(band, cell, x, y);
+			return ctx->cell_w;
+		}
+		band->hits++;
+	}
+	else {
+		slot = glyph_lookup(&ctx->glyphs, cell->ucs4, prem);
+		if (slot == GLYPH_NIL){
+			slot = glyph_render(ctx, fonts, nfonts, cell->ucs4, prem);
+			ctx->stats.glyph_misses++;
+		}
+		else
+			ctx->stats.glyph_hits++;
 	}
 
-	uint8_t fg[4], bg[4];
-	SHMIF_RGBA_DECOMP(cell->fc, &fg[0], &fg[1], &fg[2], &fg[3]);
-	SHMIF_RGBA_DECOMP(bc, &bg[0], &bg[1], &bg[2], &bg[3]);
+	uint8_t flags = slot != GLYPH_NIL ? ctx->glyphs.slots[slot].flags : GLYPH_DIRECT;
+	if (flags & GLYPH_EMPTY){
+		draw_box_px(vidp,
+			pitch, maxx, maxy, x, y, ctx->cell_w, ctx->cell_h, bc);
+	}
+	else if (!(flags & GLYPH_DIRECT)){
+		blit_mask(ctx, &ctx->glyphs.atlas[slot * ctx->cell_w * ctx->cell_h],
+			vidp, pitch, x, y, cell->fc, bc);
+	}
+	else {
+		draw_box_px(vidp,
+			pitch, maxx, maxy, x, y, ctx->cell_w, ctx->cell_h, bc);
+		set_style(ctx, fonts, prem);
+
+		uint8_t fg[4], bg[4];
+		SHMIF_RGBA_DECOMP(cell->fc, &fg[0], &fg[1], &fg[2], &fg[3]);
+		SHMIF_RGBA_DECOMP(bc, &bg[0], &bg[1], &bg[2], &bg[3]);
 
 	/* these are mainly used as state machine for kernel / shaping,
 	 * we need the 'x-start' position from the previous glyph and commit
 	 * that to the line-offset table for coordinate translation */
-	int adv = 0;
-	unsigned xs = 0;
-	unsigned ind = 0;
-	TTF_RenderUNICODEglyph(&vidp[y * pitch + x],
-		ctx->cell_w, ctx->cell_h, pitch, fonts, nfonts, cell->ucs4, &xs,
-		fg, bg, true, true, ctx->last_style, &adv, &ind
-	);
+		int adv = 0;
+		unsigned xs = 0;
+		unsigned ind = 0;
+		TTF_RenderUNICODEglyph(&vidp[y * pitch + x],
+			ctx->cell_w, ctx->cell_h, pitch, fonts, nfonts, cell->ucs4, &xs,
+			fg, bg, true, true, ctx->last_style, &adv, &ind
+		);
+	}
 
 /* add line-marks, this actually does not belong here, it should be part
  * of the style marker to the TTF_RenderUNICODEglyph - the code should be
@@ -195,108 +750,226 @@ static size_t drawglyph(struct tui_raster_context* ctx, struct cell* cell,
 	return ctx->cell_w;
 }
 
-static int raster_tobuf(
-	struct tui_raster_context* ctx, shmif_pixel* vidp, size_t pitch,
-	size_t max_w, size_t max_h,
-	uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2,
-	uint8_t* buf, size_t buf_sz)
+/*
+ * Move the pixel rows of the scroll region, rows exposed by the scroll keep
+ * their old contents as the packing side has to include them in the update.
+ * The region is clamped to the buffer, if nothing is left to move the scroll
+ * is dropped and the lines are drawn as they are.
+ */
+static bool raster_scroll(struct tui_raster_context* ctx, shmif_pixel* vidp,
+	size_t pitch, size_t max_h, struct tui_raster_header* hdr)
 {
-	struct tui_raster_header hdr;
-	if (!buf_sz || buf_sz < sizeof(struct tui_raster_header))
-		return -1;
+	size_t first = hdr->scroll_top;
+	size_t last = (size_t) hdr->scroll_bottom + 1;
+	size_t step = abs(hdr->scroll);
 
-	bool update = false;
-	memcpy(&hdr, buf, sizeof(struct tui_raster_header));
+	if (last > max_h / ctx->cell_h)
+		last = max_h / ctx->cell_h;
 
-/* the caller might provide a larger input buffer than what the header sets,
- * and that will still clamp/drop-out etc. but mismatch between the header
- * fields is, of course, not permitted. */
-	size_t hdr_ver_sz = hdr.lines * raster_line_sz +
-		hdr.cells * raster_cell_sz + raster_hdr_sz;
+	if (first >= last || step >= last - first)
+		return false;
 
-	if (hdr.data_sz > buf_sz || hdr.data_sz != hdr_ver_sz){
-		return -1;
+	hdr->scroll_bottom = last - 1;
+	size_t top = first * ctx->cell_h;
+	size_t bottom = last * ctx->cell_h;
+	size_t px_step = step * ctx->cell_h;
+
+	size_t nb = (bottom - top - px_step) * pitch * sizeof(shmif_pixel);
+	if (hdr->scroll > 0)
+		memmove(&vidp[top * pitch], &vidp[(top + px_step) * pitch], nb);
+	else
+		memmove(&vidp[(top + px_step) * pitch], &vidp[top * pitch], nb);
+
+/* the row hashes move along with the pixels */
+	struct tui_raster_rows* rows = ctx->job.rows;
+	if (rows){
+		if (last > rows->n)
+			last = rows->n;
+
+		if (first + step < last){
+			nb = (last - first - step) * sizeof(uint64_t);
+			if (hdr->scroll > 0)
+				memmove(&rows->hash[first], &rows->hash[first + step], nb);
+			else
+				memmove(&rows->hash[first + step], &rows->hash[first], nb);
+		}
 	}
 
-	buf_sz -= sizeof(struct tui_raster_header);
-	buf += sizeof(struct tui_raster_header);
-	shmif_pixel bgc = SHMIF_RGBA(hdr.bgc[0], hdr.bgc[1], hdr.bgc[2], hdr.bgc[3]);
+	return true;
+}
 
-	if (hdr.flags & RPACK_DFRAME){
-		*x1 = max_w;
-		*y1 = max_h;
-		*x2 = *y2 = 0;
-		update = true;
-	}
-	else {
-		*x1 = *y1 = 0;
-		*x2 = max_w;
-		*y2 = max_h;
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+	h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+	return h ^ (h >> 29);
+}
+
+static uint64_t line_hash(uint64_t seed,
+	struct tui_raster_line* line, uint8_t* buf, size_t n)
+{
+	uint64_t h = hash_mix(seed, (uint64_t)line->offset << 32 | n);
+	size_t nb = n * raster_cell_sz;
+
+	for (; nb >= 8; nb -= 8, buf += 8){
+		uint64_t v;
+		memcpy(&v, buf, 8);
+		h = hash_mix(h, v);
 	}
 
-	ctx->cursor_state = hdr.cursor_state;
+	uint64_t v = 0;
+	memcpy(&v, buf, nb);
+	h = hash_mix(h, v);
 
-	ssize_t cur_y = -1;
-	size_t last_line = 0;
-	size_t draw_y = 0;
+/* 0 is reserved for rows with unknown contents */
+	return h ? h : 1;
+}
 
-	for (size_t i = 0; i < hdr.lines && buf_sz; i++){
-		if (buf_sz < sizeof(struct tui_raster_line))
-			return -1;
+static void rows_invalidate(struct tui_raster_rows* rows, size_t first, size_t last)
+{
+	for (size_t i = first; i < last && i < rows->n; i++)
+		rows->hash[i] = 0;
+}
 
-/* read / unpack line metadata */
-		struct tui_raster_line line;
+/*
+ * Check [line] against the row cache and update it, returns true if the line
+ * is already drawn at that row
+ */
+static bool rows_match(struct tui_raster_context* ctx,
+	struct tui_raster_line* line, uint8_t* buf, size_t n)
+{
+	struct tui_raster_rows* rows = ctx->job.rows;
+	if (line->start_line >= rows->n)
+		return false;
+
+	uint64_t h = line_hash(ctx->job.seed, line, buf, n);
+	if (rows->hash[line->start_line] == h)
+		return true;
+
+	rows->hash[line->start_line] = h;
+	return false;
+}
+
+/*
+ * Validate and index the packed lines so that they can be split into bands,
+ * [ordered] is set if every line starts below the previous one, which is what
+ * guarantees that the bands write to disjoint rows.
+ */
+static bool resolve_lines(struct tui_raster_context* ctx,
+	struct tui_raster_header* hdr, uint8_t* buf, size_t buf_sz,
+	size_t* n_lines, size_t* n_cells, bool* ordered)
+{
+	if (hdr->lines > ctx->lines_sz){
+		struct raster_line* lines =
+			realloc(ctx->lines, hdr->lines * sizeof(struct raster_line));
+		if (!lines)
+			return false;
+		ctx->lines = lines;
+		ctx->lines_sz = hdr->lines;
+	}
+
+	ssize_t cur_y = -1;
+	*n_lines = *n_cells = 0;
+	*ordered = true;
+
+	for (size_t i = 0; i < hdr->lines && buf_sz; i++){
+/* the row cache has already been updated for the lines before this one, but
+ * none of them will be drawn, so forget all of it rather than track which */
+		if (buf_sz < sizeof(struct tui_raster_line)){
+			if (ctx->job.rows)
+				rows_invalidate(ctx->job.rows, 0, ctx->job.rows->n);
+			return false;
+		}
 
+		struct tui_raster_line line;
 		memcpy(&line, buf, sizeof(struct tui_raster_line));
 		buf += sizeof(line);
+		buf_sz -= sizeof(line);
 
-/* remember the lower line we were at, these are not always ordered */
-		if (line.start_line > last_line)
-			last_line = line.start_line;
-
-/* respecting scrolling will need another drawing routine, as we need clipping
- * etc. and multiple lines can be scrolled, and that's better fixed when we
- * have an atlas to work from */
-		if (update && cur_y == -1){
-			*y1 = line.start_line * ctx->cell_h;
-		}
+		size_t n = line.ncells;
+		if (n > buf_sz / raster_cell_sz)
+			n = buf_sz / raster_cell_sz;
 
-/* skip omitted lines */
-		if (cur_y != line.start_line){
-/* for full draw we fill in the skipped space with the background color */
-			if (!update && cur_y != -1){
-				draw_box_px(vidp, pitch, max_w, max_h,
-					0, cur_y * ctx->cell_h,
-					ctx->cell_w, ctx->cell_h * (line.start_line - cur_y), bgc
-				);
+		if (cur_y != -1 && line.start_line < cur_y)
+			*ordered = false;
+
+		ssize_t gap = !ctx->job.update &&
+			cur_y != -1 && cur_y != line.start_line ? cur_y : -1;
+
+/* lines that are already drawn are dropped, but the gap before still needs
+ * to be filled so those are kept without any cells */
+		size_t draw_n = n;
+		if (ctx->job.rows){
+			if (gap != -1)
+				rows_invalidate(ctx->job.rows, gap, line.start_line);
+
+			ctx->stats.lines++;
+			if (rows_match(ctx, &line, buf, n)){
+				ctx->stats.lines_reused++;
+				draw_n = 0;
 			}
-			cur_y = line.start_line;
-		}
-		draw_y = cur_y * ctx->cell_h;
-
-/* the line- raster routine isn't right, we actually need to unpack each line
- * into a local buffer, make note of actual offsets and width, and then two-pass
- * with bg first and then blend the glyphs on top of that - otherwise kerning,
- * shapes etc. looks bad. */
-		if (draw_y < *y1){
-			*y1 = draw_y;
 		}
 
-/* Shaping, BiDi, ... missing here now while we get the rest in place */
-		size_t draw_x = line.offset * ctx->cell_w;
-
-		if (draw_x < *x1){
-			*x1 = draw_x;
+		if (draw_n || gap != -1){
+			ctx->lines[(*n_lines)++] = (struct raster_line){
+				.cells = buf,
+				.n_cells = draw_n,
+				.row = line.start_line,
+				.offset = line.offset,
+				.gap = gap
+			};
+			ctx->job.drawn += draw_n || gap != -1;
 		}
 
-		for (size_t i = line.offset; line.ncells && buf_sz >= raster_cell_sz; i++){
-			line.ncells--;
+		buf += n * raster_cell_sz;
+		buf_sz -= n * raster_cell_sz;
+		*n_cells += draw_n;
+		cur_y = line.start_line + 1;
+	}
+
+	return true;
+}
+
+static void raster_band(
+	struct tui_raster_context* ctx, struct raster_band* band, bool shared)
+{
+	struct raster_job* job = &ctx->job;
 
-/* extract each cell */
+	band->x1 = job->max_w;
+	band->y1 = job->max_h;
+	band->x2 = 0;
+	band->last_line = 0;
+	band->n_deferred = 0;
+	band->failed = false;
+	band->hits = 0;
+
+	for (size_t i = band->first; i < band->first + band->count; i++){
+		struct raster_line* line = &ctx->lines[i];
+
+/* remember the lower line we were at, these are not always ordered */
+		if (line->row > band->last_line)
+			band->last_line = line->row;
+
+/* for full draw we fill in the skipped space with the background color */
+		if (line->gap != -1){
+			draw_box_px(job->vidp, job->pitch, job->max_w, job->max_h,
+				0, line->gap * ctx->cell_h,
+				ctx->cell_w, ctx->cell_h * (line->row - line->gap), job->bgc
+			);
+		}
+
+		size_t draw_y = line->row * ctx->cell_h;
+		if (draw_y < band->y1)
+			band->y1 = draw_y;
+
+/* Shaping, BiDi, ... missing here now while we get the rest in place */
+		size_t draw_x = line->offset * ctx->cell_w;
+		if (draw_x < band->x1)
+			band->x1 = draw_x;
+
+		uint8_t* buf = line->cells;
+		for (size_t j = 0; j < line->n_cells; j++, buf += raster_cell_sz){
 			struct cell cell;
-			unpack_cell(buf, &cell, hdr.bgc[3]);
-			buf += raster_cell_sz;
-			buf_sz -= raster_cell_sz;
+			unpack_cell(buf, &cell, job->alpha);
 
 /* skip bit is set, note that for a shaped line, this means that
  * we need to have an offset- map to advance correctly */
@@ -306,33 +979,366 @@ static int raster_tobuf(
 			}
 
 /* blit or discard if OOB */
-			if (draw_x + ctx->cell_w < max_w && draw_y + ctx->cell_h < max_h){
-				draw_x += drawglyph(ctx, &cell, vidp, pitch, draw_x, draw_y, max_w, max_h);
+			if (draw_x + ctx->cell_w < job->max_w &&
+				draw_y + ctx->cell_h < job->max_h){
+				draw_x += drawglyph(ctx, shared ? band : NULL, &cell,
+					job->vidp, job->pitch, draw_x, draw_y, job->max_w, job->max_h);
 			}
 			else
 				continue;
 
 			uint16_t next_x = draw_x + ctx->cell_w;
-			if (*x2 < next_x && next_x <= max_w){
-				*x2 = next_x;
+			if (band->x2 < next_x && next_x <= job->max_w){
+				band->x2 = next_x;
 			}
 		}
+	}
+}
+
+static void raster_bands(struct tui_raster_context* ctx)
+{
+	struct raster_pool* pool = ctx->pool;
+	size_t i;
+
+	while ((i = atomic_fetch_add(&pool->next_band, 1)) < ctx->n_bands)
+		raster_band(ctx, &ctx->bands[i], true);
+}
+
+static void* raster_worker(void* tag)
+{
+	struct tui_raster_context* ctx = tag;
+	struct raster_pool* pool = ctx->pool;
+	unsigned gen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	for(;;){
+		while (pool->gen == gen && !pool->shutdown)
+			pthread_cond_wait(&pool->work, &pool->lock);
+
+		if (pool->shutdown)
+			break;
+
+		gen = pool->gen;
+		pthread_mutex_unlock(&pool->lock);
+
+		raster_bands(ctx);
+
+		pthread_mutex_lock(&pool->lock);
+		if (0 == --pool->active)
+			pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+static void pool_free(struct tui_raster_context* ctx)
+{
+	struct raster_pool* pool = ctx->pool;
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->n_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool);
+	ctx->pool = NULL;
+}
+
+/*
+ * Spawn the raster threads on the first frame that is large enough, one less
+ * than there are cores as the calling thread takes bands as well. The count
+ * can be forced with TUI_RASTER_THREADS, 0 disables.
+ */
+static bool pool_setup(struct tui_raster_context* ctx)
+{
+	if (ctx->pool)
+		return true;
+
+	if (ctx->no_pool)
+		return false;
+
+	ctx->no_pool = true;
+	long n = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	const char* env = getenv("TUI_RASTER_THREADS");
+	if (env)
+		n = strtol(env, NULL, 10);
+
+	if (n <= 0)
+		return false;
+
+	if (n > RASTER_MAX_THREADS)
+		n = RASTER_MAX_THREADS;
+
+	struct raster_pool* pool = malloc(sizeof(struct raster_pool));
+	if (!pool)
+		return false;
+
+	*pool = (struct raster_pool){0};
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	ctx->pool = pool;
+
+	for (size_t i = 0; i < n; i++){
+		if (0 != pthread_create(&pool->threads[i], NULL, raster_worker, ctx))
+			break;
+		pool->n_threads++;
+	}
+
+	if (!pool->n_threads){
+		pool_free(ctx);
+		return false;
+	}
+
+	ctx->no_pool = false;
+	return true;
+}
+
+/* cut the lines into bands of about the same number of cells */
+static void split_bands(
+	struct tui_raster_context* ctx, size_t n_lines, size_t n_cells)
+{
+	ctx->n_bands = 0;
+
+	size_t n = n_cells / RASTER_BAND_CELLS;
+	if (n < 2 || n_lines < 2 || !pool_setup(ctx))
+		return;
+
+	if (n > (ctx->pool->n_threads + 1) * 4)
+		n = (ctx->pool->n_threads + 1) * 4;
+	if (n > RASTER_MAX_BANDS)
+		n = RASTER_MAX_BANDS;
+
+	size_t step = n_cells / n;
+	size_t acc = 0;
+	struct raster_band* band = NULL;
+
+	for (size_t i = 0; i < n_lines; i++){
+		if (!band || (acc >= step && ctx->n_bands < n)){
+			band = &ctx->bands[ctx->n_bands++];
+			band->first = i;
+			band->count = 0;
+			acc = 0;
+		}
+		band->count++;
+		acc += ctx->lines[i].n_cells;
+	}
+}
+
+static void raster_parallel(struct tui_raster_context* ctx)
+{
+	struct raster_pool* pool = ctx->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	atomic_store(&pool->next_band, 0);
+	pool->active = pool->n_threads;
+	pool->gen++;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	raster_bands(ctx);
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+/* now the cache can be modified again, draw what the threads couldn't and
+ * bring the glyphs they used to the front of the LRU */
+	struct raster_job* job = &ctx->job;
+	for (size_t i = 0; i < ctx->n_bands; i++){
+		struct raster_band* band = &ctx->bands[i];
+		if (band->failed){
+			raster_band(ctx, band, false);
+			continue;
+		}
+
+		ctx->stats.glyph_hits += band->hits;
+		for (size_t j = 0; j < band->n_deferred; j++){
+			struct deferred_cell* def = &band->deferred[j];
+			drawglyph(ctx, NULL, &def->cell, job->vidp,
+				job->pitch, def->x, def->y, job->max_w, job->max_h);
+		}
+	}
 
-		cur_y++;
+	struct glyph_cache* C = &ctx->glyphs;
+	for (size_t i = 0; i < C->used; i++){
+		if (atomic_exchange_explicit(&C->hit[i], 0, memory_order_relaxed) &&
+			C->lru_head != i){
+			lru_unlink(C, i);
+			lru_front(C, i);
+		}
 	}
+}
+
+static bool rows_resize(struct tui_raster_rows* rows, size_t n)
+{
+	if (n <= rows->n)
+		return true;
+
+	uint64_t* hash = realloc(rows->hash, n * sizeof(uint64_t));
+	if (!hash)
+		return false;
+
+	memset(&hash[rows->n], '\0', (n - rows->n) * sizeof(uint64_t));
+	rows->hash = hash;
+	rows->n = n;
+	return true;
+}
+
+/*
+ * the caller might provide a larger input buffer than what the header sets,
+ * and that will still clamp/drop-out etc. but mismatch between the header
+ * fields is, of course, not permitted. Returns the size of the header (which
+ * depends on the flags) or 0 if it is invalid.
+ */
+static size_t unpack_header(
+	uint8_t* buf, size_t buf_sz, struct tui_raster_header* hdr)
+{
+	if (!buf_sz || buf_sz < raster_hdr_sz)
+		return 0;
+
+	*hdr = (struct tui_raster_header){0};
+	memcpy(hdr, buf, raster_hdr_sz);
+
+	size_t hdr_sz = raster_hdr_sz;
+	if (hdr->flags & RPACK_SCROLL){
+		hdr_sz += raster_hdr_scroll_sz;
+		if (buf_sz < hdr_sz)
+			return 0;
+		memcpy(hdr, buf, hdr_sz);
+	}
+
+	size_t hdr_ver_sz = hdr->lines * raster_line_sz +
+		hdr->cells * raster_cell_sz + hdr_sz;
 
+	if (hdr->data_sz > buf_sz || hdr->data_sz != hdr_ver_sz)
+		return 0;
+
+	return hdr_sz;
+}
+
+/*
+ * Returns 1 if something was drawn, 0 if every line was already in place
+ * (only when a row cache is used) and -1 on invalid input.
+ */
+static int raster_tobuf(
+	struct tui_raster_context* ctx, shmif_pixel* vidp, size_t pitch,
+	size_t max_w, size_t max_h,
+	uint16_t* x1, uint16_t* y1, uint16_t* x2, uint16_t* y2,
+	uint8_t* buf, size_t buf_sz, struct tui_raster_rows* rows)
+{
+	struct tui_raster_header hdr;
+	size_t hdr_sz = unpack_header(buf, buf_sz, &hdr);
+	if (!hdr_sz)
+		return -1;
+
+	bool update = false;
+
+	buf_sz -= hdr_sz;
+	buf += hdr_sz;
+	shmif_pixel bgc = SHMIF_RGBA(hdr.bgc[0], hdr.bgc[1], hdr.bgc[2], hdr.bgc[3]);
+
+	if (hdr.flags & RPACK_DFRAME){
+		*x1 = max_w;
+		*y1 = max_h;
+		*x2 = *y2 = 0;
+		update = true;
+	}
+	else {
+		*x1 = *y1 = 0;
+		*x2 = max_w;
+		*y2 = max_h;
+	}
+
+	ctx->cursor_state = hdr.cursor_state;
+
+	if (rows && !rows_resize(rows, max_h / ctx->cell_h + 1))
+		rows = NULL;
+
+	ctx->job = (struct raster_job){
+		.vidp = vidp,
+		.pitch = pitch,
+		.max_w = max_w,
+		.max_h = max_h,
+		.bgc = bgc,
+		.alpha = hdr.bgc[3],
+		.update = update,
+		.rows = rows,
+		.seed = hash_mix(hash_mix((uintptr_t) ctx,
+			ctx->cell_w << 16 | ctx->cell_h), hdr.cursor_state << 8 | hdr.bgc[3])
+	};
+
+	bool scroll = update && hdr.scroll &&
+		raster_scroll(ctx, vidp, pitch, max_h, &hdr);
+
+	size_t n_lines, n_cells;
+	bool ordered;
+	if (!resolve_lines(ctx, &hdr, buf, buf_sz, &n_lines, &n_cells, &ordered))
+		return -1;
+
+	if (ordered)
+		split_bands(ctx, n_lines, n_cells);
+	else
+		ctx->n_bands = 0;
+
+	if (ctx->n_bands > 1)
+		raster_parallel(ctx);
+	else {
+		ctx->n_bands = 1;
+		ctx->bands[0].first = 0;
+		ctx->bands[0].count = n_lines;
+		raster_band(ctx, &ctx->bands[0], false);
+	}
+
+/* merge the bounds of the bands */
 	if (update){
+		size_t last_line = 0;
+		for (size_t i = 0; i < ctx->n_bands; i++){
+			struct raster_band* band = &ctx->bands[i];
+			if (band->x1 < *x1)
+				*x1 = band->x1;
+			if (band->y1 < *y1)
+				*y1 = band->y1;
+			if (band->x2 > *x2)
+				*x2 = band->x2;
+			if (band->last_line > last_line)
+				last_line = band->last_line;
+		}
 		*y2 = (last_line + 1) * ctx->cell_h;
 	}
 
-/* sweep through the context struct and blit the glyphs */
+/* the scroll region has changed in full */
+	if (scroll){
+		uint16_t top = hdr.scroll_top * ctx->cell_h;
+		uint16_t bottom = (hdr.scroll_bottom + 1) * ctx->cell_h;
+		*x1 = 0;
+		*x2 = max_w;
+		if (top < *y1)
+			*y1 = top;
+		if (bottom > *y2)
+			*y2 = bottom;
+	}
+
+	if (rows && !ctx->job.drawn && !scroll)
+		return 0;
+
 	return 1;
 }
 
 int tui_raster_render(struct tui_raster_context* ctx,
 	struct arcan_shmif_cont* dst, uint8_t* buf, size_t buf_sz)
 {
-	if (!ctx || !dst || !ctx->fonts[0] || buf_sz < sizeof(struct tui_raster_header))
+	if (!ctx || !dst || !ctx->fonts[0] || buf_sz < raster_hdr_sz)
 		return -1;
 
 /* pixel- rasterization over shmif should work with one big BB until we have
@@ -340,7 +1346,7 @@ int tui_raster_render(struct tui_raster_context* ctx,
  * much to care about there */
 	uint16_t x1, y1, x2, y2;
 	if (-1 == raster_tobuf(ctx, dst->vidp, dst->pitch,
-		dst->w, dst->h, &x1, &y1, &x2, &y2, buf, buf_sz))
+		dst->w, dst->h, &x1, &y1, &x2, &y2, buf, buf_sz, NULL))
 	return -1;
 
 	if (x2 > dst->w)
@@ -371,15 +1377,19 @@ void tui_raster_offset(
  */
 #ifndef NO_ARCAN_AGP
 void tui_raster_renderagp(struct tui_raster_context* ctx,
-	struct agp_vstore* dst, uint8_t* buf, size_t buf_sz)
+	struct agp_vstore* dst, struct tui_raster_rows** rows,
+	uint8_t* buf, size_t buf_sz)
 {
-	if (!ctx || !dst || buf_sz < sizeof(struct tui_raster_header))
+	if (!ctx || !dst || buf_sz < raster_hdr_sz)
 		return;
 
+	if (rows && !*rows)
+		*rows = calloc(1, sizeof(struct tui_raster_rows));
+
 	uint16_t x1, y1, x2, y2;
 
-	if (-1 == raster_tobuf(ctx, dst->vinf.text.raw, dst->w,
-		dst->w, dst->h, &x1, &y1, &x2, &y2, buf, buf_sz))
+	if (1 != raster_tobuf(ctx, dst->vinf.text.raw, dst->w,
+		dst->w, dst->h, &x1, &y1, &x2, &y2, buf, buf_sz, rows ? *rows : NULL))
 		return;
 
 	struct stream_meta stream = {
@@ -393,6 +1403,502 @@ void tui_raster_renderagp(struct tui_raster_context* ctx,
 }
 #endif
 
+/* the atlas only has one style for bitmap fonts */
+static int grid_style(struct tui_raster_context* ctx, uint8_t attr)
+{
+	return ctx->fonts[0]->vector ? cell_style(attr) : TTF_STYLE_NORMAL;
+}
+
+/* unlike drawglyph this always goes through the atlas, bitmap fonts included */
+static uint16_t grid_glyph(
+	struct tui_raster_context* ctx, uint32_t ucs4, uint8_t attr)
+{
+	int style = grid_style(ctx, attr);
+	uint16_t slot = glyph_lookup(&ctx->glyphs, ucs4, style);
+	if (slot != GLYPH_NIL){
+		ctx->stats.glyph_hits++;
+		return slot;
+	}
+
+	ctx->stats.glyph_misses++;
+	if (!ctx->fonts[0]->vector)
+		return glyph_render_bitmap(ctx, ucs4);
+
+	TTF_Font* fonts[2];
+	size_t nfonts = vector_fonts(ctx, fonts);
+	return glyph_render(ctx, fonts, nfonts, ucs4, style);
+}
+
+/* derive the instance at [ofs] from the key and the current states */
+static void grid_cell(struct tui_raster_context* ctx,
+	struct tui_raster_grid* grid, size_t ofs)
+{
+	struct grid_key* key = &grid->keys[ofs];
+	struct tui_raster_instance* cell = &grid->cells[ofs];
+
+	cell->glyph = 0;
+	cell->flags = 0;
+	memcpy(cell->bg, key->bg, 3);
+	cell->bg[3] = grid->alpha;
+
+	if ((key->attr & (1 << CATTR_CURSOR)) && grid->cursor_state == CURSOR_ACTIVE)
+		SHMIF_RGBA_DECOMP(ctx->cc,
+			&cell->bg[0], &cell->bg[1], &cell->bg[2], &cell->bg[3]);
+
+	if (!key->ucs4)
+		return;
+
+	uint16_t slot = grid_glyph(ctx, key->ucs4, key->attr);
+	if (slot != GLYPH_NIL && !(ctx->glyphs.slots[slot].flags & GLYPH_EMPTY)){
+		cell->glyph = slot;
+		cell->flags |= RINST_GLYPH;
+	}
+
+	if (key->attr & (1 << CATTR_UNDERLINE))
+		cell->flags |= RINST_UNDERLINE;
+	if (key->attr & (1 << CATTR_STRIKETHROUGH))
+		cell->flags |= RINST_STRIKETHROUGH;
+}
+
+/* does the slot referenced by the instance at [ofs] still hold its glyph */
+static bool grid_valid(struct tui_raster_context* ctx,
+	struct tui_raster_grid* grid, size_t ofs)
+{
+	struct tui_raster_instance* cell = &grid->cells[ofs];
+	if (!(cell->flags & RINST_GLYPH))
+		return true;
+
+	struct glyph_slot* slot = &ctx->glyphs.slots[cell->glyph];
+	return cell->glyph < ctx->glyphs.used &&
+		slot->ucs4 == grid->keys[ofs].ucs4 &&
+		slot->style == grid_style(ctx, grid->keys[ofs].attr);
+}
+
+static void grid_place(struct tui_raster_grid* grid, size_t first, size_t last)
+{
+	for (size_t row = first; row < last; row++)
+		for (size_t col = 0; col < grid->cols; col++){
+			grid->cells[row * grid->cols + col].row = row;
+			grid->cells[row * grid->cols + col].col = col;
+		}
+}
+
+static struct tui_raster_grid* grid_setup(struct tui_raster_context* ctx,
+	struct tui_raster_grid** grid, size_t cols, size_t rows)
+{
+	struct tui_raster_grid* G = *grid;
+	if (G && G->cols == cols && G->rows == rows &&
+		G->cell_w == ctx->cell_w && G->cell_h == ctx->cell_h)
+		return G;
+
+	if (!G){
+		G = *grid = calloc(1, sizeof(struct tui_raster_grid));
+		if (!G)
+			return NULL;
+	}
+
+	free(G->cells);
+	free(G->keys);
+	G->cells = calloc(cols * rows + 1, sizeof(struct tui_raster_instance));
+	G->keys = calloc(cols * rows + 1, sizeof(struct grid_key));
+	G->cols = G->rows = 0;
+	if (!G->cells || !G->keys)
+		return NULL;
+
+	G->cols = cols;
+	G->rows = rows;
+	G->cell_w = ctx->cell_w;
+	G->cell_h = ctx->cell_h;
+	G->invalid = true;
+	grid_place(G, 0, rows);
+
+	return G;
+}
+
+static inline void grid_mark(size_t* lo, size_t* hi, size_t first, size_t last)
+{
+	if (first < *lo)
+		*lo = first;
+	if (last > *hi)
+		*hi = last;
+}
+
+/* same clamping as raster_scroll, a region that doesn't fit is dropped */
+static void grid_scroll(struct tui_raster_grid* grid,
+	struct tui_raster_header* hdr, size_t* lo, size_t* hi)
+{
+	size_t top = hdr->scroll_top;
+	size_t bottom = (size_t) hdr->scroll_bottom + 1;
+	size_t step = abs(hdr->scroll);
+
+/* the part of the region below the last full row isn't part of the grid */
+	if (bottom > grid->rows)
+		bottom = grid->rows;
+	if (top >= bottom || step >= bottom - top)
+		return;
+
+	size_t n = (bottom - top - step) * grid->cols;
+	size_t src = (hdr->scroll > 0 ? top + step : top) * grid->cols;
+	size_t dst = (hdr->scroll > 0 ? top : top + step) * grid->cols;
+
+	memmove(&grid->keys[dst], &grid->keys[src], n * sizeof(struct grid_key));
+	memmove(&grid->cells[dst],
+		&grid->cells[src], n * sizeof(struct tui_raster_instance));
+	grid_place(grid, top, bottom);
+	grid_mark(lo, hi, top, bottom);
+}
+
+int tui_raster_grid_update(struct tui_raster_context* ctx,
+	struct tui_raster_grid** grid, size_t cols, size_t rows,
+	uint8_t* buf, size_t buf_sz, size_t* first, size_t* count)
+{
+	struct tui_raster_header hdr;
+	size_t hdr_sz;
+	if (!ctx || !grid || !ctx->fonts[0] ||
+		!(hdr_sz = unpack_header(buf, buf_sz, &hdr)))
+		return -1;
+
+	struct tui_raster_grid* G = grid_setup(ctx, grid, cols, rows);
+	if (!G)
+		return -1;
+
+	buf += hdr_sz;
+	buf_sz -= hdr_sz;
+	size_t lo = G->rows, hi = 0;
+
+	if (G->epoch != ctx->glyphs.epoch || G->alpha != hdr.bgc[3]){
+		G->epoch = ctx->glyphs.epoch;
+		G->alpha = hdr.bgc[3];
+		G->invalid = true;
+	}
+
+/* a full frame starts over from an empty screen */
+	if (!(hdr.flags & RPACK_DFRAME)){
+		for (size_t i = 0; i < G->cols * G->rows; i++){
+			G->keys[i] = (struct grid_key){
+				.bg = {hdr.bgc[0], hdr.bgc[1], hdr.bgc[2]}
+			};
+			memset(G->cells[i].fg, '\0', 4);
+		}
+		G->invalid = true;
+	}
+	else if (hdr.scroll)
+		grid_scroll(G, &hdr, &lo, &hi);
+
+	if (G->cursor_state != hdr.cursor_state){
+		G->cursor_state = hdr.cursor_state;
+		for (size_t i = 0; i < G->cols * G->rows && !G->invalid; i++)
+			if (G->keys[i].attr & (1 << CATTR_CURSOR)){
+				grid_cell(ctx, G, i);
+				grid_mark(&lo, &hi, i / G->cols, i / G->cols + 1);
+			}
+	}
+
+	for (size_t i = 0; i < hdr.lines; i++){
+		if (buf_sz < sizeof(struct tui_raster_line))
+			break;
+
+		struct tui_raster_line line;
+		memcpy(&line, buf, sizeof(struct tui_raster_line));
+		buf += sizeof(struct tui_raster_line);
+		buf_sz -= sizeof(struct tui_raster_line);
+
+		size_t n = line.ncells;
+		if (n > buf_sz / raster_cell_sz)
+			n = buf_sz / raster_cell_sz;
+
+		uint8_t* cells = buf;
+		buf += n * raster_cell_sz;
+		buf_sz -= n * raster_cell_sz;
+
+		size_t row = line.start_line;
+		if (row >= G->rows)
+			continue;
+
+		bool changed = false;
+		size_t col = line.offset;
+
+		for (size_t j = 0; j < n && col < G->cols;
+			j++, col++, cells += raster_cell_sz){
+			if (cells[6] & (1 << CATTR_SKIP))
+				continue;
+
+			size_t ofs = row * G->cols + col;
+			struct tui_raster_instance* cell = &G->cells[ofs];
+			struct grid_key key = {
+				.attr = cells[6],
+				.bg = {cells[3], cells[4], cells[5]}
+			};
+			unpack_u32(&key.ucs4, &cells[8]);
+
+			if (!G->invalid && memcmp(cell->fg, cells, 3) == 0 &&
+				memcmp(&G->keys[ofs], &key, sizeof(struct grid_key)) == 0)
+				continue;
+
+			G->keys[ofs] = key;
+			memcpy(cell->fg, cells, 3);
+			cell->fg[3] = 0xff;
+			changed = true;
+
+			if (!G->invalid)
+				grid_cell(ctx, G, ofs);
+		}
+
+		if (changed)
+			grid_mark(&lo, &hi, row, row + 1);
+	}
+
+	if (G->invalid){
+		G->gen = ctx->glyphs.gen;
+		G->invalid = false;
+		for (size_t i = 0; i < G->cols * G->rows; i++)
+			grid_cell(ctx, G, i);
+		grid_mark(&lo, &hi, 0, G->rows);
+	}
+
+/* Slots might have been recycled by the glyphs just resolved or by other
+ * users of the context, then the cells that used them are resolved again.
+ * If that still doesn't settle there are more distinct glyphs on screen than
+ * the atlas can hold, the next update will try again. */
+	for (size_t pass = 0; pass < 2 && G->gen != ctx->glyphs.gen; pass++){
+		G->gen = ctx->glyphs.gen;
+		for (size_t i = 0; i < G->cols * G->rows; i++)
+			if (!grid_valid(ctx, G, i)){
+				grid_cell(ctx, G, i);
+				grid_mark(&lo, &hi, i / G->cols, i / G->cols + 1);
+			}
+	}
+
+	if (lo >= hi)
+		return 0;
+
+	*first = lo;
+	*count = hi - lo;
+	return 1;
+}
+
+struct tui_raster_instance* tui_raster_grid_cells(
+	struct tui_raster_grid* grid, size_t* cols, size_t* rows)
+{
+	if (!grid){
+		*cols = *rows = 0;
+		return NULL;
+	}
+
+	*cols = grid->cols;
+	*rows = grid->rows;
+	return grid->cells;
+}
+
+void tui_raster_grid_draw(
+	struct tui_raster_context* ctx, struct tui_raster_grid* grid,
+	shmif_pixel* vidp, size_t pitch, size_t max_w, size_t max_h,
+	size_t first, size_t count)
+{
+	if (!ctx || !grid || !ctx->fonts[0])
+		return;
+
+	ctx->cursor_state = grid->cursor_state;
+
+	for (size_t row = first; row < first + count && row < grid->rows; row++){
+		size_t y = row * ctx->cell_h;
+		if (y + ctx->cell_h >= max_h)
+			break;
+
+		for (size_t col = 0; col < grid->cols; col++){
+			size_t x = col * ctx->cell_w;
+			if (x + ctx->cell_w >= max_w)
+				break;
+
+			struct tui_raster_instance* inst = &grid->cells[row * grid->cols + col];
+			struct grid_key* key = &grid->keys[row * grid->cols + col];
+			struct cell cell = {
+				.fc = SHMIF_RGBA(inst->fg[0], inst->fg[1], inst->fg[2], 0xff),
+				.bc = SHMIF_RGBA(key->bg[0], key->bg[1], key->bg[2], grid->alpha),
+				.ucs4 = key->ucs4,
+				.attr = key->attr
+			};
+			drawglyph(ctx, NULL, &cell, vidp, pitch, x, y, max_w, max_h);
+		}
+	}
+}
+
+#ifndef NO_ARCAN_AGP
+_Static_assert(sizeof(struct tui_raster_instance) == sizeof(struct agp_cell),
+	"raster instance and agp cell layout mismatch");
+
+static void atlas_drop(struct tui_raster_context* ctx)
+{
+	if (ctx->atlas_store){
+		agp_drop_vstore(ctx->atlas_store);
+		free(ctx->atlas_store);
+	}
+
+	free(ctx->atlas_buf);
+	ctx->atlas_store = NULL;
+	ctx->atlas_buf = NULL;
+}
+
+/*
+ * Send the slots rendered since the last call to the atlas texture, where
+ * the slots are laid out in rows of GLYPH_ATLAS_COLS
+ */
+static struct agp_vstore* atlas_synch(struct tui_raster_context* ctx)
+{
+	struct glyph_cache* C = &ctx->glyphs;
+	size_t w = ctx->cell_w * GLYPH_ATLAS_COLS;
+	size_t h = ctx->cell_h * (GLYPH_SLOTS / GLYPH_ATLAS_COLS);
+
+	if (!glyph_atlas(ctx))
+		return NULL;
+
+	if (!ctx->atlas_store || ctx->atlas_w != w || ctx->atlas_h != h){
+		atlas_drop(ctx);
+		ctx->atlas_store = calloc(1, sizeof(struct agp_vstore));
+		ctx->atlas_buf = malloc(w * h * sizeof(shmif_pixel));
+		if (!ctx->atlas_store || !ctx->atlas_buf){
+			atlas_drop(ctx);
+			return NULL;
+		}
+
+		agp_empty_vstore(ctx->atlas_store, w, h);
+		ctx->atlas_w = w;
+		ctx->atlas_h = h;
+		C->dirty_lo = 0;
+		C->dirty_hi = C->used;
+	}
+
+	if (C->dirty_lo >= C->dirty_hi)
+		return ctx->atlas_store;
+
+	size_t r1 = C->dirty_lo / GLYPH_ATLAS_COLS;
+	size_t r2 = (C->dirty_hi - 1) / GLYPH_ATLAS_COLS + 1;
+
+	for (size_t i = r1 * GLYPH_ATLAS_COLS; i < C->used &&
+		i < r2 * GLYPH_ATLAS_COLS; i++){
+		uint8_t* mask = &C->atlas[i * ctx->cell_w * ctx->cell_h];
+		size_t x = (i % GLYPH_ATLAS_COLS) * ctx->cell_w;
+		size_t y = (i / GLYPH_ATLAS_COLS) * ctx->cell_h;
+
+		for (size_t row = 0; row < ctx->cell_h; row++){
+			shmif_pixel* out = &ctx->atlas_buf[(y + row) * w + x];
+			for (size_t col = 0; col < ctx->cell_w; col++, mask++)
+				out[col] = SHMIF_RGBA(*mask, *mask, *mask, 0xff);
+		}
+	}
+
+	struct stream_meta stream = {
+		.buf = ctx->atlas_buf,
+		.x1 = 0, .y1 = r1 * ctx->cell_h,
+		.w = w, .h = (r2 - r1) * ctx->cell_h,
+		.dirty = true
+	};
+	agp_stream_prepare(ctx->atlas_store, stream, STREAM_RAW_DIRECT_SYNCHRONOUS);
+
+	C->dirty_lo = GLYPH_SLOTS;
+	C->dirty_hi = 0;
+	return ctx->atlas_store;
+}
+
+/*
+ * Synch the raster state into the agp_store as a cell grid, the rows that
+ * changed are drawn as instances sampling from the atlas texture, and only
+ * the atlas slots that are new are uploaded. If the cells can't be drawn
+ * that way, the same rows are rasterized and uploaded instead.
+ */
+void tui_raster_gridagp(struct tui_raster_context* ctx,
+	struct agp_vstore* dst, struct tui_raster_grid** grid,
+	uint8_t* buf, size_t buf_sz)
+{
+	if (!ctx || !dst || !grid ||
+		dst->w <= ctx->cell_w || dst->h <= ctx->cell_h)
+		return;
+
+	size_t first, count;
+	if (1 != tui_raster_grid_update(ctx, grid, (dst->w - 1) / ctx->cell_w,
+		(dst->h - 1) / ctx->cell_h, buf, buf_sz, &first, &count))
+		return;
+
+	struct tui_raster_grid* G = *grid;
+	if (G->dst != dst){
+		if (G->rtgt)
+			agp_drop_rendertarget(G->rtgt);
+		G->rtgt = NULL;
+		G->dst = dst;
+	}
+
+	struct agp_vstore* atlas = atlas_synch(ctx);
+	if (atlas && !G->rtgt)
+		G->rtgt = agp_setup_rendertarget(dst, RENDERTARGET_COLOR);
+
+	if (atlas && G->rtgt && agp_draw_cells(G->rtgt, atlas,
+		ctx->cell_w, ctx->cell_h, (struct agp_cell*) &G->cells[first * G->cols],
+		count * G->cols))
+		return;
+
+	if (!dst->vinf.text.raw)
+		return;
+
+	tui_raster_grid_draw(ctx, G,
+		dst->vinf.text.raw, dst->w, dst->w, dst->h, first, count);
+
+	size_t y2 = (first + count) * ctx->cell_h;
+	struct stream_meta stream = {
+		.buf = dst->vinf.text.raw,
+		.x1 = 0, .y1 = first * ctx->cell_h,
+		.w = dst->w, .h = (y2 > dst->h ? dst->h : y2) - first * ctx->cell_h,
+		.dirty = true
+	};
+
+	stream = agp_stream_prepare(dst, stream, STREAM_RAW_DIRECT);
+	agp_stream_commit(dst, stream);
+}
+#endif
+
+void tui_raster_grid_free(struct tui_raster_grid* grid)
+{
+	if (!grid)
+		return;
+
+#ifndef NO_ARCAN_AGP
+	if (grid->rtgt)
+		agp_drop_rendertarget(grid->rtgt);
+#endif
+
+	free(grid->cells);
+	free(grid->keys);
+	free(grid);
+}
+
+void tui_raster_rows_reset(struct tui_raster_rows* rows)
+{
+	if (rows && rows->hash)
+		memset(rows->hash, '\0', rows->n * sizeof(uint64_t));
+}
+
+void tui_raster_rows_free(struct tui_raster_rows* rows)
+{
+	if (!rows)
+		return;
+
+	free(rows->hash);
+	free(rows);
+}
+
+void tui_raster_stats(
+	struct tui_raster_context* ctx, struct tui_raster_stats* out)
+{
+	if (!ctx || !out)
+		return;
+
+	out->glyphs += ctx->glyphs.used;
+	out->glyph_slots += GLYPH_SLOTS;
+	out->glyph_hits += ctx->stats.glyph_hits;
+	out->glyph_misses += ctx->stats.glyph_misses;
+	out->lines += ctx->stats.lines;
+	out->lines_reused += ctx->stats.lines_reused;
+}
+
 /*
  * Free any buffers and resources bound to the raster
  */
@@ -401,5 +1907,14 @@ void tui_raster_free(struct tui_raster_context* ctx)
 	if (!ctx)
 		return;
 
+	pool_free(ctx);
+	for (size_t i = 0; i < RASTER_MAX_BANDS; i++)
+		free(ctx->bands[i].deferred);
+	free(ctx->lines);
+
+	glyph_flush(&ctx->glyphs);
+#ifndef NO_ARCAN_AGP
+	atlas_drop(ctx);
+#endif
 	free(ctx);
 }
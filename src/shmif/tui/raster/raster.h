@@ -25,9 +25,10 @@
  * verified against the fonts so that the codepoints exist, otherwise swapped
  * for a valid replacement.
  *
- * 5. Scrolling need to update all relevant lines in the region to scroll,
- *    only the step and direction of the first scroll- marked line will be
- *    respected (and applies to all subseqent scroll- tagged lines).
+ * 5. Scrolling is carried in the header of a delta frame, the rows of the
+ *    scroll region are moved before any of the lines are drawn. Rows that
+ *    are exposed by the scroll are left as they were and need to be part of
+ *    the update.
  */
 
 /* the raster cell is 12 byte:
@@ -108,11 +109,6 @@ struct tui_font {
 	int hint;
 };
 
-enum raster_flags {
-	RPACK_IFRAME = 1,
-	RPACK_DFRAME = 2
-};
-
 /*
  * lines and cells must match the actual provided contents and contents
  * size or there will be a validation fault when submitting the buffer.
@@ -128,6 +124,13 @@ struct __attribute__((packed)) tui_raster_header {
 /* cursor state will be applied to cells with a cursor- bit set,
  * color, shape etc. may be overridden and drawn in a user- configured way */
 	uint8_t cursor_state;
+
+/* only present with RPACK_SCROLL (zero otherwise): for RPACK_DFRAME, move the
+ * rows [scroll_top, scroll_bottom] this number of rows up (or down if
+ * negative) before applying the lines */
+	int16_t scroll;
+	uint16_t scroll_top;
+	uint16_t scroll_bottom;
 };
 
 /* Build a new raster context based on the provided set of fonts,
@@ -161,12 +164,102 @@ void tui_raster_cell_size(struct tui_raster_context* ctx, size_t w, size_t h);
 
 /*
  * Synch the raster state into the agp_store
+ *
+ * [rows] (optional) tracks what has been drawn into [dst] so that lines which
+ * are identical to what is already there are skipped, even in full frames. It
+ * is allocated on first use and is specific to [dst], reset it whenever the
+ * store contents is replaced by other means (e.g. resize) and free it along
+ * with the store.
  */
+struct tui_raster_rows;
+
 #ifndef NO_ARCAN_AGP
 void tui_raster_renderagp(struct tui_raster_context* ctx,
-	struct agp_vstore* dst, uint8_t* buf, size_t buf_sz);
+	struct agp_vstore* dst, struct tui_raster_rows** rows,
+	uint8_t* buf, size_t buf_sz);
+#endif
+
+void tui_raster_rows_reset(struct tui_raster_rows*);
+void tui_raster_rows_free(struct tui_raster_rows*);
+
+/*
+ * Cell grid, the alternative to rasterizing: the screen is kept as one
+ * instance per cell (row-major) that refers to a slot in the glyph atlas,
+ * so that it can be drawn by the GPU with the atlas as a texture.
+ *
+ * The glyph is the atlas slot, which is at tile (glyph % 32, glyph / 32) of
+ * the atlas texture. Colors are RGBA, the cursor color and the alpha of the
+ * frame are already applied to the background. Colored glyphs (emoji) can
+ * only be tinted by the foreground color in this form.
+ */
+enum tui_raster_instance_flags {
+	RINST_GLYPH = 1,
+	RINST_UNDERLINE = 2,
+	RINST_STRIKETHROUGH = 4
+};
+
+struct tui_raster_instance {
+	uint16_t col, row;
+	uint16_t glyph, flags;
+	uint8_t fg[4];
+	uint8_t bg[4];
+};
+
+struct tui_raster_grid;
+
+/*
+ * Apply a packed buffer to [grid], which is allocated on first use and
+ * reset whenever [cols], [rows] or the cell size changes. Returns -1 on
+ * invalid input, 0 if no cell changed and 1 with [first, count] set to the
+ * range of rows that has to be drawn again.
+ */
+int tui_raster_grid_update(struct tui_raster_context* ctx,
+	struct tui_raster_grid** grid, size_t cols, size_t rows,
+	uint8_t* buf, size_t buf_sz, size_t* first, size_t* count);
+
+struct tui_raster_instance* tui_raster_grid_cells(
+	struct tui_raster_grid* grid, size_t* cols, size_t* rows);
+
+/*
+ * CPU fallback, rasterize the rows [first, first+count) of the grid
+ */
+void tui_raster_grid_draw(
+	struct tui_raster_context* ctx, struct tui_raster_grid* grid,
+	shmif_pixel* vidp, size_t pitch, size_t max_w, size_t max_h,
+	size_t first, size_t count);
+
+/*
+ * Same as tui_raster_renderagp but through the grid, the rows that change
+ * are drawn into [dst] as instanced cells and only new glyphs are uploaded.
+ * This falls back to tui_raster_grid_draw if the platform can't draw cells,
+ * the raw buffer of [dst] is not kept in synch otherwise. [grid] is bound to
+ * [dst] and should be freed along with it, or when it is resized.
+ */
+#ifndef NO_ARCAN_AGP
+void tui_raster_gridagp(struct tui_raster_context* ctx,
+	struct agp_vstore* dst, struct tui_raster_grid** grid,
+	uint8_t* buf, size_t buf_sz);
 #endif
 
+void tui_raster_grid_free(struct tui_raster_grid*);
+
+/*
+ * Counters for the glyph cache and line reuse, these accumulate over the
+ * lifetime of the context. tui_raster_stats adds the values of [ctx] to
+ * those already in [out] so that several contexts can be summed up.
+ */
+struct tui_raster_stats {
+	size_t glyphs;
+	size_t glyph_slots;
+	uint64_t glyph_hits;
+	uint64_t glyph_misses;
+	uint64_t lines;
+	uint64_t lines_reused;
+};
+
+void tui_raster_stats(
+	struct tui_raster_context* ctx, struct tui_raster_stats* out);
+
 /*
  * Free any buffers and resources bound to the raster.
  */
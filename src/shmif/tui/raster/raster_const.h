@@ -1,3 +1,13 @@
 static const size_t raster_cell_sz = 12;
 static const size_t raster_hdr_sz = 16;
+static const size_t raster_hdr_scroll_sz = 6;
 static const size_t raster_line_sz = 9;
+
+enum raster_flags {
+	RPACK_IFRAME = 1,
+	RPACK_DFRAME = 2,
+
+/* the header is followed by the scroll fields, packers that predate them
+ * never set this and send the shorter header */
+	RPACK_SCROLL = 4
+};
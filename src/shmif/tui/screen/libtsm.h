@@ -192,6 +192,16 @@ int tsm_screen_sb_page_up(struct tsm_screen *con, unsigned int num);
 int tsm_screen_sb_page_down(struct tsm_screen *con, unsigned int num);
 void tsm_screen_sb_reset(struct tsm_screen *con);
 
+/*
+ * Find scrollback lines that contain [needle], newest first. Matches are
+ * written to [out] as the line offset from the end of the scrollback (1 is
+ * the most recent line), only offsets larger than [after] are considered so
+ * a search can continue where the last one stopped. Returns the number of
+ * matches, at most [n].
+ */
+size_t tsm_screen_sb_search(struct tsm_screen *con, const uint32_t *needle,
+		size_t len, size_t after, size_t *out, size_t n);
+
 struct tui_screen_attr tsm_screen_get_def_attr(struct tsm_screen* con);
 
 void tsm_screen_set_def_attr(struct tsm_screen *con,
@@ -210,6 +220,10 @@ void tsm_screen_reset_all_tabstops(struct tsm_screen *con);
 
 int tsm_screen_write(struct tsm_screen *con, tsm_symbol_t ch,
 		const struct tui_screen_attr *attr);
+
+/* bulk version of _write for a run of printable (0x20..0x7e) ASCII */
+int tsm_screen_write_ascii(struct tsm_screen *con, const uint8_t *u8,
+		size_t len, const struct tui_screen_attr *attr);
 int tsm_screen_newline(struct tsm_screen *con);
 int tsm_screen_scroll_up(struct tsm_screen *con, unsigned int num);
 int tsm_screen_scroll_down(struct tsm_screen *con, unsigned int num);
@@ -298,8 +312,24 @@ int tsm_screen_get_word(struct tsm_screen *con,
 /* returns: !0 if cell is empty */
 int tsm_screen_empty(struct tsm_screen *con, unsigned x, unsigned y);
 
-tsm_age_t tsm_screen_draw(
-	struct tsm_screen *con, tsm_screen_draw_cb draw_cb, void *data);
+/* Invoke [draw_cb] for the cells of the screen, the age of the last call is
+ * returned and if it is passed as [since] on the next one, lines that have not
+ * changed are skipped. */
+tsm_age_t tsm_screen_draw(struct tsm_screen *con,
+	tsm_age_t since, tsm_screen_draw_cb draw_cb, void *data);
+
+/* returns: true if everything on the screen has changed since [since], i.e.
+ * the next draw will cover all cells */
+bool tsm_screen_aged(struct tsm_screen *con, tsm_age_t since);
+
+/* returns: true if the lines [top, bottom] have been scrolled since the last
+ * call, with the net number of lines in [delta] (positive if the contents
+ * moved up). Scrolling in different regions or while the scrollback is being
+ * viewed returns false. The state is reset on every call. Moved lines are not
+ * aged, so this needs to be called before drawing and if true the consumer is
+ * expected to move what it has from the previous draw. */
+bool tsm_screen_scroll_consume(struct tsm_screen *con,
+	int *delta, unsigned *top, unsigned *bottom);
 
 #ifdef __cplusplus
 }
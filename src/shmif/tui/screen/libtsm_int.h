@@ -93,6 +93,12 @@ struct cell {
 	tsm_age_t age;
 };
 
+/* attribute run in a packed scrollback line */
+struct sb_run {
+	struct tui_screen_attr attr;
+	uint16_t len;
+};
+
 struct line {
 	struct line *next;
 	struct line *prev;
@@ -101,6 +107,63 @@ struct line {
 	struct cell *cells;
 	uint64_t sb_id;
 	tsm_age_t age;
+	tsm_age_t cell_age; /* newest of the cells, lets draw skip the line */
+
+	/* Lines in the scrollback are packed into an arena and have no cells. The
+	 * attribute runs cover all [size] cells and are followed by [n_chars]
+	 * characters, as bytes if [ascii] or as u32 + width byte otherwise. Cells
+	 * past n_chars are blank. */
+	unsigned int n_runs;
+	unsigned int n_chars;
+	bool ascii;
+	struct sb_run runs[];
+};
+
+/* character [i] of a packed scrollback line, width 0 for the cells covered
+ * by the wide character before them */
+static inline tsm_symbol_t sb_line_ch(const struct line *line,
+				      unsigned int i, unsigned int *width)
+{
+	const uint8_t *chars = (const uint8_t *)&line->runs[line->n_runs];
+
+	*width = 1;
+	if (i >= line->n_chars)
+		return 0;
+	if (line->ascii)
+		return chars[i];
+
+	*width = chars[line->n_chars * sizeof(uint32_t) + i];
+	return ((const uint32_t *)chars)[i];
+}
+
+/* scrollback search index, see tsm_search.c */
+#define SB_INDEX_BLOCK 64
+#define SB_INDEX_BUCKETS (1 << 14)
+
+struct sb_posting {
+	uint32_t *blocks;
+	uint32_t first;
+	uint32_t count;
+	uint32_t size;
+};
+
+struct sb_index {
+	struct sb_posting buckets[SB_INDEX_BUCKETS];
+	struct line **block_lines;	/* first indexed line of each block */
+	uint32_t block_base;		/* block of block_lines[0] */
+	uint32_t n_blocks;
+	uint32_t size;
+	uint64_t valid_from;		/* lines before this are not indexed */
+};
+
+/* scrollback storage, lines are only ever added at the end and evicted from
+ * the start so an arena is released as soon as its last line goes */
+struct sb_arena {
+	struct sb_arena *next;
+	size_t size;
+	size_t used;
+	size_t live;
+	uint8_t data[];
 };
 
 #define SELECTION_TOP -1
@@ -133,6 +196,12 @@ struct tsm_screen {
 	struct line **alt_lines;
 	tsm_age_t age;
 
+	/* net line scroll since the last tsm_screen_scroll_consume */
+	int scroll_delta;
+	unsigned int scroll_top;
+	unsigned int scroll_bottom;
+	bool scroll_mixed;
+
 	/* scroll-back buffer */
 	unsigned int sb_count;		/* number of lines in sb */
 	struct line *sb_first;		/* first line; was moved first */
@@ -140,6 +209,12 @@ struct tsm_screen {
 	unsigned int sb_max;		/* max-limit of lines in sb */
 	struct line *sb_pos;		/* current position in sb or NULL */
 	uint64_t sb_last_id;		/* last id given to sb-line */
+	struct sb_arena *sb_arena;	/* oldest arena, holds sb_first */
+	struct sb_arena *sb_arena_last;	/* arena new lines are packed into */
+	struct sb_arena *sb_arena_spare;	/* released arena kept for reuse */
+	struct cell *sb_cells;		/* packed line expanded for drawing */
+	unsigned int sb_cells_sz;
+	struct sb_index *sb_index;	/* trigram index for sb_search */
 
 	/* cursor */
 	unsigned int cursor_x;
@@ -154,5 +229,8 @@ struct tsm_screen {
 	struct selection_pos sel_end;
 };
 
+/* maintained from link_to_scrollback, and dropped with the scrollback */
+void tsm_sbindex_add(struct tsm_screen *con, struct line *line);
+void tsm_sbindex_free(struct tsm_screen *con);
 
 #endif /* TSM_LIBTSM_INT_H */
@@ -125,16 +125,17 @@ static void move_cursor(struct tsm_screen *con, unsigned int x, unsigned int y)
  * this is to not age cells where there isn't a difference, saves some poor
  * use of _clear screen + refresh even when a small portion has changed
  */
-static void cell_init_chg(struct tsm_screen *con, struct cell *cell)
+static bool cell_init_chg(struct tsm_screen *con, struct cell *cell)
 {
 	if (cell->ch == 0 && tui_attr_equal(cell->attr, con->def_attr)){
-		return;
+		return false;
 	}
 
 	cell->ch = 0;
 	cell->width = 1;
 	cell->age = con->age_cnt;
 	memcpy(&cell->attr, &con->def_attr, sizeof(cell->attr));
+	return true;
 }
 
 static void cell_init(struct tsm_screen *con, struct cell *cell)
@@ -161,6 +162,7 @@ static int line_new(struct tsm_screen *con, struct line **out,
 	line->prev = NULL;
 	line->size = width;
 	line->age = con->age_cnt;
+	line->cell_age = con->age_cnt;
 
 	line->cells = malloc(sizeof(struct cell) * width);
 	if (!line->cells) {
@@ -195,6 +197,7 @@ static int line_resize(struct tsm_screen *con, struct line *line,
 			return -ENOMEM;
 
 		line->cells = tmp;
+		line->cell_age = con->age_cnt;
 
 		while (line->size < width) {
 			cell_init(con, &line->cells[line->size]);
@@ -205,28 +208,275 @@ static int line_resize(struct tsm_screen *con, struct line *line,
 	return 0;
 }
 
-/* This links the given line into the scrollback-buffer */
-static void link_to_scrollback(struct tsm_screen *con, struct line *line)
+/* Scrollback lines are packed back to back into arenas of this size, lines
+ * that would not fit in an empty one get an arena of their own */
+#define SB_ARENA_SIZE (256 * 1024)
+
+static void *sb_alloc(struct tsm_screen *con, size_t sz)
 {
-	struct line *tmp;
+	struct sb_arena *arena = con->sb_arena_last;
+	size_t asz;
+	void *res;
 
-	con->age = con->age_cnt;
+	sz = (sz + 7) & ~(size_t)7;
 
-	if (con->sb_max == 0) {
-		if (con->sel_active) {
-			if (con->sel_start.line == line) {
-				con->sel_start.line = NULL;
-				con->sel_start.y = SELECTION_TOP;
-			}
-			if (con->sel_end.line == line) {
-				con->sel_end.line = NULL;
-				con->sel_end.y = SELECTION_TOP;
+	if (!arena || arena->size - arena->used < sz) {
+		asz = sz > SB_ARENA_SIZE ? sz : SB_ARENA_SIZE;
+
+		if (con->sb_arena_spare && con->sb_arena_spare->size >= asz) {
+			arena = con->sb_arena_spare;
+			con->sb_arena_spare = NULL;
+		} else {
+			arena = malloc(sizeof(*arena) + asz);
+			if (!arena)
+				return NULL;
+			arena->size = asz;
+		}
+
+		arena->next = NULL;
+		arena->used = 0;
+		arena->live = 0;
+
+		if (con->sb_arena_last)
+			con->sb_arena_last->next = arena;
+		else
+			con->sb_arena = arena;
+		con->sb_arena_last = arena;
+	}
+
+	res = &arena->data[arena->used];
+	arena->used += sz;
+	++arena->live;
+	return res;
+}
+
+/* Called when sb_first is evicted, as lines leave in the order they were
+ * added that line always lives in the oldest arena. The steady state of a
+ * full scrollback cycles between two arenas without touching the heap. */
+static void sb_release(struct tsm_screen *con)
+{
+	struct sb_arena *arena = con->sb_arena;
+
+	if (!arena || --arena->live)
+		return;
+
+	if (arena == con->sb_arena_last) {
+		arena->used = 0;
+		return;
+	}
+
+	con->sb_arena = arena->next;
+	if (!con->sb_arena_spare && arena->size == SB_ARENA_SIZE)
+		con->sb_arena_spare = arena;
+	else
+		free(arena);
+}
+
+static void sb_release_all(struct tsm_screen *con)
+{
+	struct sb_arena *arena, *tmp;
+
+	for (arena = con->sb_arena; arena; ) {
+		tmp = arena;
+		arena = arena->next;
+		free(tmp);
+	}
+
+	free(con->sb_arena_spare);
+	con->sb_arena = NULL;
+	con->sb_arena_last = NULL;
+	con->sb_arena_spare = NULL;
+}
+
+/* Build the packed scrollback copy of [src], see struct line */
+static struct line *sb_pack(struct tsm_screen *con, struct line *src)
+{
+	struct cell *cells = src->cells;
+	struct line *line;
+	unsigned int i, n, runs, run_len;
+	bool ascii = true;
+	uint8_t *chars;
+	uint32_t *wide;
+
+	/* trailing blanks are covered by the attribute runs alone */
+	n = src->size;
+	while (n && !cells[n - 1].ch && cells[n - 1].width == 1 &&
+	       tui_attr_equal(cells[n - 1].attr, cells[src->size - 1].attr))
+		--n;
+
+	for (i = 0; i < n; ++i) {
+		if (cells[i].ch > 0x7f || cells[i].width != 1) {
+			ascii = false;
+			break;
+		}
+	}
+
+	runs = 0;
+	run_len = 0;
+	for (i = 0; i < src->size; ++i) {
+		if (!i || run_len == UINT16_MAX ||
+		    !tui_attr_equal(cells[i].attr, cells[i - 1].attr)) {
+			++runs;
+			run_len = 0;
+		}
+		++run_len;
+	}
+
+	line = sb_alloc(con, sizeof(*line) + runs * sizeof(struct sb_run) +
+			(ascii ? n : n * (sizeof(uint32_t) + 1)));
+	if (!line)
+		return NULL;
+
+	line->next = NULL;
+	line->prev = NULL;
+	line->size = src->size;
+	line->cells = NULL;
+	line->age = src->age;
+	line->cell_age = src->cell_age;
+	line->n_runs = runs;
+	line->n_chars = n;
+	line->ascii = ascii;
+
+	runs = 0;
+	for (i = 0; i < src->size; ++i) {
+		if (i && line->runs[runs].len < UINT16_MAX &&
+		    tui_attr_equal(cells[i].attr, line->runs[runs].attr)) {
+			++line->runs[runs].len;
+			continue;
+		}
+		if (i)
+			++runs;
+		line->runs[runs].attr = cells[i].attr;
+		line->runs[runs].len = 1;
+	}
+
+	chars = (uint8_t *)&line->runs[line->n_runs];
+	if (ascii) {
+		for (i = 0; i < n; ++i)
+			chars[i] = cells[i].ch;
+	} else {
+		wide = (uint32_t *)chars;
+		chars = &chars[n * sizeof(uint32_t)];
+		for (i = 0; i < n; ++i) {
+			wide[i] = cells[i].ch;
+			chars[i] = cells[i].width;
+		}
+	}
+
+	return line;
+}
+
+/* Cells of a line, packed scrollback lines are expanded into a buffer that is
+ * only valid until the next call */
+static struct cell *line_cells(struct tsm_screen *con, struct line *line)
+{
+	const uint8_t *chars, *width;
+	const uint32_t *wide;
+	struct cell *cell;
+	unsigned int i, r, k;
+
+	if (line->cells)
+		return line->cells;
+
+	if (con->sb_cells_sz < line->size) {
+		cell = realloc(con->sb_cells, line->size * sizeof(struct cell));
+		if (!cell)
+			return NULL;
+		con->sb_cells = cell;
+		con->sb_cells_sz = line->size;
+	}
+
+	chars = (const uint8_t *)&line->runs[line->n_runs];
+	wide = (const uint32_t *)chars;
+	width = &chars[line->n_chars * sizeof(uint32_t)];
+
+	cell = con->sb_cells;
+	for (i = 0, r = 0; r < line->n_runs; ++r) {
+		for (k = 0; k < line->runs[r].len; ++k, ++i, ++cell) {
+			cell->attr = line->runs[r].attr;
+			cell->age = line->cell_age;
+			if (i >= line->n_chars) {
+				cell->ch = 0;
+				cell->width = 1;
+			} else if (line->ascii) {
+				cell->ch = chars[i];
+				cell->width = 1;
+			} else {
+				cell->ch = wide[i];
+				cell->width = width[i];
 			}
 		}
-		line_free(line);
+	}
+
+	return con->sb_cells;
+}
+
+/* Track scrolling so that the renderer can move the already drawn contents
+ * rather than redraw all the lines, only the net scroll of a single region
+ * can be expressed */
+static void scroll_note(struct tsm_screen *con,
+	unsigned int top, unsigned int bottom, int delta)
+{
+	if (con->scroll_mixed)
+		return;
+
+	if (!con->scroll_delta) {
+		con->scroll_top = top;
+		con->scroll_bottom = bottom;
+	}
+	else if (con->scroll_top != top || con->scroll_bottom != bottom) {
+		con->scroll_mixed = true;
 		return;
 	}
 
+	con->scroll_delta += delta;
+}
+
+/* Scrolling does not age the lines that have moved, so if the consumer can't
+ * move what it has drawn in the same way, everything has to be redrawn */
+SHL_EXPORT
+bool tsm_screen_scroll_consume(struct tsm_screen *con,
+	int *delta, unsigned *top, unsigned *bottom)
+{
+	bool rv = !con->scroll_mixed && con->scroll_delta && !con->sb_pos &&
+		abs(con->scroll_delta) <= con->scroll_bottom - con->scroll_top;
+
+	*delta = con->scroll_delta;
+	*top = con->scroll_top;
+	*bottom = con->scroll_bottom;
+
+	if (!rv && (con->scroll_delta || con->scroll_mixed)) {
+		inc_age(con);
+		con->age = con->age_cnt;
+	}
+
+	con->scroll_delta = 0;
+	con->scroll_mixed = false;
+	return rv;
+}
+
+SHL_EXPORT
+bool tsm_screen_aged(struct tsm_screen *con, tsm_age_t since)
+{
+	return !since || con->age_reset || con->age > since ||
+		con->scroll_delta || con->scroll_mixed;
+}
+
+/* This packs a copy of the given line into the scrollback-buffer, the
+ * caller keeps the line itself */
+static void link_to_scrollback(struct tsm_screen *con, struct line *src)
+{
+	struct line *tmp, *line;
+
+	if (con->sb_max == 0)
+		return;
+
+	/* on allocation failure the line is lost to the scrollback, same as if
+	 * it had been evicted right away */
+	line = sb_pack(con, src);
+	if (!line)
+		return;
+
 	/* Remove a line from the scrollback buffer if it reaches its maximum.
 	 * We must take care to correctly keep the current position as the new
 	 * line is linked in after we remove the top-most line here.
@@ -267,7 +517,7 @@ static void link_to_scrollback(struct tsm_screen *con, struct line *line)
 				con->sel_end.y = SELECTION_TOP;
 			}
 		}
-		line_free(tmp);
+		sb_release(con);
 	}
 
 	line->sb_id = ++con->sb_last_id;
@@ -279,18 +529,17 @@ static void link_to_scrollback(struct tsm_screen *con, struct line *line)
 		con->sb_first = line;
 	con->sb_last = line;
 	++con->sb_count;
+
+	tsm_sbindex_add(con, line);
 }
 
 static int screen_scroll_up(struct tsm_screen *con, unsigned int num)
 {
 	unsigned int i, j, max, pos;
-	int ret;
 
 	if (!num)
 		return 0;
 
-	con->age = con->age_cnt;
-
 	max = con->margin_bottom + 1 - con->margin_top;
 	if (num > max)
 		num = max;
@@ -309,18 +558,13 @@ static int screen_scroll_up(struct tsm_screen *con, unsigned int num)
 
 	for (i = 0; i < num; ++i) {
 		pos = con->margin_top + i;
+		cache[i] = con->lines[pos];
 		if (!(con->flags & TSM_SCREEN_ALTERNATE))
-			ret = line_new(con, &cache[i], con->size_x);
-		else
-			ret = -EAGAIN;
+			link_to_scrollback(con, cache[i]);
 
-		if (!ret) {
-			link_to_scrollback(con, con->lines[pos]);
-		} else {
-			cache[i] = con->lines[pos];
-			for (j = 0; j < con->size_x; ++j)
-				cell_init(con, &cache[i]->cells[j]);
-		}
+		cache[i]->age = con->age_cnt;
+		for (j = 0; j < cache[i]->size; ++j)
+			cell_init(con, &cache[i]->cells[j]);
 	}
 
 	if (num < max) {
@@ -331,6 +575,7 @@ static int screen_scroll_up(struct tsm_screen *con, unsigned int num)
 
 	memcpy(&con->lines[con->margin_top + (max - num)],
 	       cache, num * sizeof(struct line*));
+	scroll_note(con, con->margin_top, con->margin_bottom, num);
 
 	if (con->sel_active) {
 		if (!con->sel_start.line && con->sel_start.y >= 0) {
@@ -362,8 +607,6 @@ static int screen_scroll_down(struct tsm_screen *con, unsigned int num)
 	if (!num)
 		return 0;
 
-	con->age = con->age_cnt;
-
 	max = con->margin_bottom + 1 - con->margin_top;
 	if (num > max)
 		num = max;
@@ -378,6 +621,7 @@ static int screen_scroll_down(struct tsm_screen *con, unsigned int num)
 
 	for (i = 0; i < num; ++i) {
 		cache[i] = con->lines[con->margin_bottom - i];
+		cache[i]->age = con->age_cnt;
 		for (j = 0; j < con->size_x; ++j)
 			cell_init(con, &cache[i]->cells[j]);
 	}
@@ -390,6 +634,7 @@ static int screen_scroll_down(struct tsm_screen *con, unsigned int num)
 
 	memcpy(&con->lines[con->margin_top],
 	       cache, num * sizeof(struct line*));
+	scroll_note(con, con->margin_top, con->margin_bottom, -(int)num);
 
 	if (con->sel_active) {
 		if (!con->sel_start.line && con->sel_start.y >= 0)
@@ -423,6 +668,7 @@ static void screen_write(struct tsm_screen *con, unsigned int x,
 			sizeof(struct cell) * (con->size_x - len - x));
 	}
 
+	line->cell_age = con->age_cnt;
 	line->cells[x].age = con->age_cnt;
 	line->cells[x].ch = ch;
 	line->cells[x].width = len;
@@ -445,7 +691,6 @@ void tsm_screen_erase_region(struct tsm_screen *con,
 	struct line *line;
 
 	inc_age(con);
-	con->age = con->age_cnt;
 
 	if (y_to >= con->size_y)
 		y_to = con->size_y - 1;
@@ -467,7 +712,8 @@ void tsm_screen_erase_region(struct tsm_screen *con,
 			if (protect && line->cells[x_from].attr.protect)
 				continue;
 
-			cell_init_chg(con, &line->cells[x_from]);
+			if (cell_init_chg(con, &line->cells[x_from]))
+				line->cell_age = con->age_cnt;
 		}
 		x_from = 0;
 	}
@@ -555,6 +801,9 @@ void tsm_screen_unref(struct tsm_screen *con)
 		line_free(con->main_lines[i]);
 		line_free(con->alt_lines[i]);
 	}
+	sb_release_all(con);
+	tsm_sbindex_free(con);
+	free(con->sb_cells);
 	free(con->main_lines);
 	free(con->alt_lines);
 	free(con->tab_ruler);
@@ -887,7 +1136,7 @@ void tsm_screen_set_max_sb(struct tsm_screen *con,
 				con->sel_end.y = SELECTION_TOP;
 			}
 		}
-		line_free(line);
+		sb_release(con);
 	}
 
 	con->sb_max = max;
@@ -897,20 +1146,14 @@ void tsm_screen_set_max_sb(struct tsm_screen *con,
 SHL_EXPORT
 void tsm_screen_clear_sb(struct tsm_screen *con)
 {
-	struct line *iter, *tmp;
-
 	if (!con)
 		return;
 
 	inc_age(con);
 	con->age = con->age_cnt;
 
-	for (iter = con->sb_first; iter; ) {
-		tmp = iter;
-		iter = iter->next;
-		line_free(tmp);
-	}
-
+	sb_release_all(con);
+	tsm_sbindex_free(con);
 	con->sb_first = NULL;
 	con->sb_last = NULL;
 	con->sb_count = 0;
@@ -1189,6 +1432,65 @@ int tsm_screen_write(struct tsm_screen *con, tsm_symbol_t ch,
 	return rv;
 }
 
+/*
+ * Same behavior as calling tsm_screen_write for each byte, but the caller
+ * guarantees that the run is printable ASCII (0x20..0x7e) so every symbol
+ * is a single column wide. The part of the run that fits on the current line
+ * is copied into the cells directly, wrapping, scrolling and insert mode are
+ * left to tsm_screen_write.
+ */
+SHL_EXPORT
+int tsm_screen_write_ascii(struct tsm_screen *con, const uint8_t *u8,
+			  size_t len, const struct tui_screen_attr *attr)
+{
+	struct line *line;
+	unsigned int last, i, n;
+	int rv = 0;
+
+	if (!con)
+		return 0;
+
+	if (!attr)
+		attr = &con->def_attr;
+
+	while (len) {
+		if (con->cursor_y <= con->margin_bottom ||
+		    con->cursor_y >= con->size_y)
+			last = con->margin_bottom;
+		else
+			last = con->size_y - 1;
+
+		if (con->cursor_x >= con->size_x || con->cursor_y > last ||
+		    (con->flags & TSM_SCREEN_INSERT_MODE)) {
+			rv = tsm_screen_write(con, *u8++, attr);
+			--len;
+			continue;
+		}
+
+		n = con->size_x - con->cursor_x;
+		if (n > len)
+			n = len;
+
+		inc_age(con);
+		line = con->lines[con->cursor_y];
+		line->cell_age = con->age_cnt;
+
+		for (i = 0; i < n; ++i) {
+			struct cell *cell = &line->cells[con->cursor_x + i];
+			cell->age = con->age_cnt;
+			cell->ch = u8[i];
+			cell->width = 1;
+			memcpy(&cell->attr, attr, sizeof(*attr));
+		}
+
+		move_cursor(con, con->cursor_x + n, con->cursor_y);
+		u8 += n;
+		len -= n;
+	}
+
+	return rv;
+}
+
 struct export_metadata {
 	uint8_t magic[4];
 	uint32_t sb_count;
@@ -1582,7 +1884,6 @@ void tsm_screen_insert_lines(struct tsm_screen *con, unsigned int num)
 		return;
 
 	inc_age(con);
-	con->age = con->age_cnt;
 
 	max = con->margin_bottom - con->cursor_y + 1;
 	if (num > max)
@@ -1592,6 +1893,7 @@ void tsm_screen_insert_lines(struct tsm_screen *con, unsigned int num)
 
 	for (i = 0; i < num; ++i) {
 		cache[i] = con->lines[con->margin_bottom - i];
+		cache[i]->age = con->age_cnt;
 		for (j = 0; j < con->size_x; ++j)
 			cell_init(con, &cache[i]->cells[j]);
 	}
@@ -1603,6 +1905,7 @@ void tsm_screen_insert_lines(struct tsm_screen *con, unsigned int num)
 
 		memcpy(&con->lines[con->cursor_y],
 		       cache, num * sizeof(struct line*));
+		scroll_note(con, con->cursor_y, con->margin_bottom, -(int)num);
 	}
 
 	con->cursor_x = 0;
@@ -1621,7 +1924,6 @@ void tsm_screen_delete_lines(struct tsm_screen *con, unsigned int num)
 		return;
 
 	inc_age(con);
-	con->age = con->age_cnt;
 
 	max = con->margin_bottom - con->cursor_y + 1;
 	if (num > max)
@@ -1631,6 +1933,7 @@ void tsm_screen_delete_lines(struct tsm_screen *con, unsigned int num)
 
 	for (i = 0; i < num; ++i) {
 		cache[i] = con->lines[con->cursor_y + i];
+		cache[i]->age = con->age_cnt;
 		for (j = 0; j < con->size_x; ++j)
 			cell_init(con, &cache[i]->cells[j]);
 	}
@@ -1642,6 +1945,7 @@ void tsm_screen_delete_lines(struct tsm_screen *con, unsigned int num)
 
 		memcpy(&con->lines[con->cursor_y + (max - num)],
 		       cache, num * sizeof(struct line*));
+		scroll_note(con, con->cursor_y, con->margin_bottom, num);
 	}
 
 	con->cursor_x = 0;
@@ -1657,12 +1961,12 @@ void tsm_screen_insert_chars(struct tsm_screen *con, unsigned int num)
 		return;
 
 	inc_age(con);
-	con->age = con->age_cnt;
 
 	if (con->cursor_x >= con->size_x)
 		con->cursor_x = con->size_x - 1;
 	if (con->cursor_y >= con->size_y)
 		con->cursor_y = con->size_y - 1;
+	con->lines[con->cursor_y]->age = con->age_cnt;
 
 	max = con->size_x - con->cursor_x;
 	if (num > max)
@@ -1689,12 +1993,12 @@ void tsm_screen_delete_chars(struct tsm_screen *con, unsigned int num)
 		return;
 
 	inc_age(con);
-	con->age = con->age_cnt;
 
 	if (con->cursor_x >= con->size_x)
 		con->cursor_x = con->size_x - 1;
 	if (con->cursor_y >= con->size_y)
 		con->cursor_y = con->size_y - 1;
+	con->lines[con->cursor_y]->age = con->age_cnt;
 
 	max = con->size_x - con->cursor_x;
 	if (num > max)
@@ -1910,21 +2214,26 @@ void tsm_screen_selection_target(struct tsm_screen *con,
 	selection_set(con, &con->sel_end, posx, posy);
 }
 
-static unsigned int copy_line(struct line *line, char *buf,
-			      unsigned int start, unsigned int len, bool conv)
+static unsigned int copy_line(struct tsm_screen *con, struct line *line,
+			      char *buf, unsigned int start, unsigned int len,
+			      bool conv)
 {
 	unsigned int i, end;
 	char *pos = buf;
+	struct cell *cells = line_cells(con, line);
+
+	if (!cells)
+		return 0;
 
 	end = start + len;
 	for (i = start; i < line->size && i < end; ++i) {
-		if (i < line->size || !line->cells[i].ch){
+		if (i < line->size || !cells[i].ch){
 			if (!conv){
-				memcpy(pos, &line->cells[i].ch, 4);
+				memcpy(pos, &cells[i].ch, 4);
 				pos += 4;
 			}
 			else
-				pos += tsm_ucs4_to_utf8(line->cells[i].ch, pos);
+				pos += tsm_ucs4_to_utf8(cells[i].ch, pos);
 		}
 		else{
 			if (!conv){
@@ -2087,22 +2396,22 @@ int tsm_screen_selection_copy(struct tsm_screen *con, char **out, bool conv)
 					len = end->x - start->x + 1;
 				else
 					len = iter->size - start->x;
-				pos += copy_line(iter, pos, start->x, len, conv);
+				pos += copy_line(con, iter, pos, start->x, len, conv);
 			}
 			break;
 		} else if (iter == start->line) {
 			if (iter->size > start->x)
-				pos += copy_line(iter, pos, start->x,
+				pos += copy_line(con, iter, pos, start->x,
 						 iter->size - start->x, conv);
 		} else if (iter == end->line) {
 			if (iter->size > end->x)
 				len = end->x + 1;
 			else
 				len = iter->size;
-			pos += copy_line(iter, pos, 0, len, conv);
+			pos += copy_line(con, iter, pos, 0, len, conv);
 			break;
 		} else {
-			pos += copy_line(iter, pos, 0, iter->size, conv);
+			pos += copy_line(con, iter, pos, 0, iter->size, conv);
 		}
 
 		if (conv){
@@ -2129,22 +2438,22 @@ int tsm_screen_selection_copy(struct tsm_screen *con, char **out, bool conv)
 						len = end->x - start->x + 1;
 					else
 						len = con->size_x - start->x;
-					pos += copy_line(iter, pos, start->x, len, conv);
+					pos += copy_line(con, iter, pos, start->x, len, conv);
 				}
 				break;
 			} else if (!start->line && start->y == i) {
 				if (con->size_x > start->x)
-					pos += copy_line(iter, pos, start->x,
+					pos += copy_line(con, iter, pos, start->x,
 							 con->size_x - start->x, conv);
 			} else if (end->y == i) {
 				if (con->size_x > end->x)
 					len = end->x + 1;
 				else
 					len = con->size_x;
-				pos += copy_line(iter, pos, 0, len, conv);
+				pos += copy_line(con, iter, pos, 0, len, conv);
 				break;
 			} else {
-				pos += copy_line(iter, pos, 0, con->size_x, conv);
+				pos += copy_line(con, iter, pos, 0, con->size_x, conv);
 			}
 
 			if (conv){
@@ -2165,12 +2474,12 @@ int tsm_screen_selection_copy(struct tsm_screen *con, char **out, bool conv)
 }
 
 SHL_EXPORT
-tsm_age_t tsm_screen_draw(struct tsm_screen *con, tsm_screen_draw_cb draw_cb,
-			  void *data)
+tsm_age_t tsm_screen_draw(struct tsm_screen *con, tsm_age_t since,
+			  tsm_screen_draw_cb draw_cb, void *data)
 {
 	unsigned int i, j, k;
 	struct line *iter, *line = NULL;
-	struct cell *cell, empty;
+	struct cell *cell, *cells, empty;
 	struct tui_screen_attr attr;
 	const uint32_t *ch;
 	size_t len;
@@ -2181,6 +2490,17 @@ tsm_age_t tsm_screen_draw(struct tsm_screen *con, tsm_screen_draw_cb draw_cb,
 	if (!con || !draw_cb)
 		return 0;
 
+	/* a scroll that nobody has consumed means that the lines have moved */
+	if (con->scroll_delta || con->scroll_mixed) {
+		con->age = con->age_cnt;
+		con->scroll_delta = 0;
+		con->scroll_mixed = false;
+	}
+
+	/* lines where nothing is newer than [since] can be skipped as a whole,
+	 * unless the selection needs to be tracked through them */
+	bool skip = since && !con->age_reset && con->age <= since && !con->sel_active;
+
 	cell_init(con, &empty);
 
 	/* push ech character into rendering pipeline */
@@ -2228,9 +2548,15 @@ tsm_age_t tsm_screen_draw(struct tsm_screen *con, tsm_screen_draw_cb draw_cb,
 			was_sel = false;
 		}
 
+		if (skip && line->size >= con->size_x &&
+		    line->age <= since && line->cell_age <= since)
+			continue;
+
+		cells = line_cells(con, line);
+
 		for (j = 0; j < con->size_x; ++j) {
-			if (j < line->size)
-				cell = &line->cells[j];
+			if (cells && j < line->size)
+				cell = &cells[j];
 			else
 				cell = &empty;
 			memcpy(&attr, &cell->attr, sizeof(attr));
@@ -0,0 +1,399 @@
+/*
+ * Scrollback search index
+ *
+ * Each line that is packed into the scrollback has its character trigrams
+ * hashed into a fixed set of buckets. A bucket holds the ascending list of
+ * blocks (SB_INDEX_BLOCK consecutive lines) where one of its trigrams occurs.
+ * As lines are only appended, a block is added to a bucket by comparing
+ * against the last entry.
+ *
+ * A query intersects the lists for the trigrams of the needle, newest block
+ * first, and only the lines of candidate blocks are compared against the
+ * needle. Hash collisions just add candidates. Needles shorter than a trigram
+ * and lines that were added while the index couldn't be allocated fall back
+ * to comparing every line.
+ *
+ * Evicted lines are never removed explicitly. The blocks before the one
+ * holding sb_first are ignored, and are trimmed from the lists once enough
+ * of them have accumulated.
+ */
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../../arcan_shmif.h"
+#include "../../arcan_tui.h"
+#include "libtsm.h"
+
+typedef void* TTF_Font;
+#include "libtsm_int.h"
+
+/* number of dead blocks before they are trimmed from the index */
+#define SB_INDEX_TRIM 256
+
+static inline uint32_t trigram_hash(uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t h = a * 0x9e3779b1 ^ b * 0x85ebca77 ^ c * 0xc2b2ae3d;
+	return (h ^ (h >> 15)) & (SB_INDEX_BUCKETS - 1);
+}
+
+/* blank cells are stored as 0 but should match a space in the needle */
+static inline uint32_t search_ch(tsm_symbol_t ch)
+{
+	return ch ? ch : ' ';
+}
+
+static inline uint32_t line_block(struct line *line)
+{
+	return (line->sb_id - 1) / SB_INDEX_BLOCK;
+}
+
+static void index_reset(struct sb_index *idx, uint64_t valid_from)
+{
+	for (size_t i = 0; i < SB_INDEX_BUCKETS; i++)
+		idx->buckets[i].first = idx->buckets[i].count = 0;
+
+	idx->n_blocks = 0;
+	idx->valid_from = valid_from;
+}
+
+static bool posting_add(struct sb_posting *post, uint32_t block)
+{
+	if (post->count > post->first && post->blocks[post->count - 1] == block)
+		return true;
+
+	if (post->count == post->size){
+		uint32_t nsz = post->size ? post->size * 2 : 8;
+		uint32_t* blocks = realloc(post->blocks, nsz * sizeof(uint32_t));
+		if (!blocks)
+			return false;
+		post->blocks = blocks;
+		post->size = nsz;
+	}
+
+	post->blocks[post->count++] = block;
+	return true;
+}
+
+/* first entry in [post] that is >= [block] */
+static uint32_t posting_seek(struct sb_posting *post, uint32_t block)
+{
+	uint32_t lo = post->first, hi = post->count;
+
+	while (lo < hi){
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (post->blocks[mid] < block)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* drop the blocks that only hold evicted lines */
+static void index_trim(struct sb_index* idx, uint32_t live_block)
+{
+	uint32_t dead = live_block - idx->block_base;
+
+	for (size_t i = 0; i < SB_INDEX_BUCKETS; i++){
+		struct sb_posting* post = &idx->buckets[i];
+		post->first = posting_seek(post, live_block);
+
+		if (post->first > post->count / 2){
+			post->count -= post->first;
+			memmove(post->blocks,
+				&post->blocks[post->first], post->count * sizeof(uint32_t));
+			post->first = 0;
+		}
+	}
+
+	idx->n_blocks -= dead;
+	memmove(idx->block_lines,
+		&idx->block_lines[dead], idx->n_blocks * sizeof(struct line*));
+	idx->block_base = live_block;
+}
+
+void tsm_sbindex_add(struct tsm_screen *con, struct line *line)
+{
+	struct sb_index* idx = con->sb_index;
+
+	if (!idx){
+		idx = con->sb_index = calloc(1, sizeof(struct sb_index));
+		if (!idx)
+			return;
+		idx->valid_from = line->sb_id;
+	}
+
+	uint32_t block = line_block(line);
+	uint32_t live_block = line_block(con->sb_first);
+
+	if (idx->n_blocks && live_block > idx->block_base &&
+		live_block - idx->block_base >= SB_INDEX_TRIM)
+		index_trim(idx, live_block);
+
+/* first line of a new block */
+	if (!idx->n_blocks || block >= idx->block_base + idx->n_blocks){
+		if (!idx->n_blocks)
+			idx->block_base = block;
+
+		if (idx->n_blocks == idx->size){
+			uint32_t nsz = idx->size ? idx->size * 2 : 64;
+			struct line** lines =
+				realloc(idx->block_lines, nsz * sizeof(struct line*));
+			if (!lines)
+				goto fail;
+			idx->block_lines = lines;
+			idx->size = nsz;
+		}
+
+		idx->block_lines[idx->n_blocks++] = line;
+	}
+
+	uint32_t a = 0, b = 0;
+	unsigned int width;
+	size_t n = 0;
+
+	for (size_t i = 0; i < line->n_chars; i++){
+		uint32_t c = search_ch(sb_line_ch(line, i, &width));
+		if (!width)
+			continue;
+
+		if (n++ >= 2 &&
+			!posting_add(&idx->buckets[trigram_hash(a, b, c)], block))
+			goto fail;
+
+		a = b;
+		b = c;
+	}
+	return;
+
+/* start over from the next line, the ones before will be scanned */
+fail:
+	index_reset(idx, line->sb_id + 1);
+}
+
+void tsm_sbindex_free(struct tsm_screen *con)
+{
+	struct sb_index* idx = con->sb_index;
+	if (!idx)
+		return;
+
+	for (size_t i = 0; i < SB_INDEX_BUCKETS; i++)
+		free(idx->buckets[i].blocks);
+
+	free(idx->block_lines);
+	free(idx);
+	con->sb_index = NULL;
+}
+
+struct search {
+	const uint32_t *needle;
+	size_t len;
+	uint64_t last_id;
+	uint64_t newest;
+	size_t *out;
+	size_t n;
+	size_t count;
+	uint32_t *buf;
+	size_t buf_sz;
+	bool ascii;
+};
+
+/* byte version for the common case of an ascii needle and line */
+static bool ascii_match(struct search *s, struct line *line)
+{
+	const uint8_t *chars = (const uint8_t *)&line->runs[line->n_runs];
+	const uint8_t *end = &chars[line->n_chars - s->len + 1];
+	const uint8_t *pos = chars;
+	uint8_t first = s->needle[0];
+
+	while (pos < end){
+		if (first != ' '){
+			pos = memchr(pos, first, end - pos);
+			if (!pos)
+				return false;
+		}
+		else if (*pos && *pos != ' '){
+			pos++;
+			continue;
+		}
+
+		size_t i = 1;
+		while (i < s->len && search_ch(pos[i]) == s->needle[i])
+			i++;
+
+		if (i == s->len)
+			return true;
+		pos++;
+	}
+
+	return false;
+}
+
+static bool line_match(struct search *s, struct line *line)
+{
+	unsigned int width;
+	size_t n = 0;
+
+	if (line->n_chars < s->len)
+		return false;
+
+	if (line->ascii && s->ascii)
+		return ascii_match(s, line);
+
+	if (s->buf_sz < line->n_chars){
+		uint32_t* buf = realloc(s->buf, line->n_chars * sizeof(uint32_t));
+		if (!buf)
+			return false;
+		s->buf = buf;
+		s->buf_sz = line->n_chars;
+	}
+
+	for (size_t i = 0; i < line->n_chars; i++){
+		uint32_t c = search_ch(sb_line_ch(line, i, &width));
+		if (width)
+			s->buf[n++] = c;
+	}
+
+	for (size_t i = 0; i + s->len <= n; i++){
+		if (s->buf[i] == s->needle[0] &&
+			memcmp(&s->buf[i], s->needle, s->len * sizeof(uint32_t)) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* compare the lines from [first] up to [last_id] newest first, returns false
+ * when there is no more room for matches */
+static bool search_range(struct search *s, struct line *first, uint64_t last_id)
+{
+	struct line *line = first;
+
+	if (last_id > s->last_id)
+		last_id = s->last_id;
+
+	if (first->sb_id > last_id)
+		return true;
+
+	while (line->next && line->sb_id < last_id)
+		line = line->next;
+
+	for (;;){
+		if (line_match(s, line)){
+			s->out[s->count++] = s->newest - line->sb_id + 1;
+			if (s->count == s->n)
+				return false;
+		}
+
+		if (line == first)
+			return true;
+		line = line->prev;
+	}
+}
+
+static void search_index(struct tsm_screen *con, struct search *s)
+{
+	struct sb_index* idx = con->sb_index;
+	struct sb_posting* lists[s->len];
+	size_t n_lists = 0;
+
+	if (!idx->n_blocks)
+		return;
+
+	int64_t live_block = line_block(con->sb_first);
+	if (live_block < idx->block_base)
+		live_block = idx->block_base;
+
+	int64_t block = (s->last_id - 1) / SB_INDEX_BLOCK;
+	if (block >= idx->block_base + idx->n_blocks)
+		block = idx->block_base + idx->n_blocks - 1;
+
+/* the shortest list drives, the others are probed */
+	for (size_t i = 2; i < s->len; i++){
+		struct sb_posting* post = &idx->buckets[
+			trigram_hash(s->needle[i-2], s->needle[i-1], s->needle[i])];
+
+		lists[n_lists++] = post;
+		if (post->count - post->first < lists[0]->count - lists[0]->first){
+			lists[n_lists-1] = lists[0];
+			lists[0] = post;
+		}
+	}
+
+	uint32_t pos = n_lists ? posting_seek(lists[0], block + 1) : 0;
+
+	for (;;){
+		int64_t cand;
+
+		if (n_lists){
+			if (pos == lists[0]->first)
+				return;
+			cand = lists[0]->blocks[--pos];
+		}
+		else
+			cand = block--;
+
+		if (cand < live_block)
+			return;
+
+		size_t i = 1;
+		for (; i < n_lists; i++){
+			uint32_t ofs = posting_seek(lists[i], cand);
+			if (ofs == lists[i]->count || lists[i]->blocks[ofs] != cand)
+				break;
+		}
+		if (i < n_lists)
+			continue;
+
+/* in the oldest block, the first indexed line might have been evicted */
+		struct line* first = idx->block_lines[cand - idx->block_base];
+		uint64_t first_id = (uint64_t)cand * SB_INDEX_BLOCK + 1;
+		if (first_id < idx->valid_from)
+			first_id = idx->valid_from;
+		if (first_id < con->sb_first->sb_id)
+			first = con->sb_first;
+
+		if (!search_range(s, first, (uint64_t)(cand + 1) * SB_INDEX_BLOCK))
+			return;
+	}
+}
+
+SHL_EXPORT
+size_t tsm_screen_sb_search(struct tsm_screen *con,
+	const uint32_t *needle, size_t len, size_t after, size_t *out, size_t n)
+{
+	if (!con || !needle || !len || !out || !n ||
+		!con->sb_last || after >= con->sb_count)
+		return 0;
+
+	struct search s = {
+		.needle = needle,
+		.len = len,
+		.newest = con->sb_last->sb_id,
+		.last_id = con->sb_last->sb_id - after,
+		.out = out,
+		.n = n,
+		.ascii = true
+	};
+
+	for (size_t i = 0; i < len; i++)
+		if (!needle[i] || needle[i] > 0x7f)
+			s.ascii = false;
+
+/* the index covers the newer part, anything before it is compared as is */
+	uint64_t valid_from = s.newest + 1;
+	if (con->sb_index){
+		valid_from = con->sb_index->valid_from;
+		if (s.last_id >= valid_from)
+			search_index(con, &s);
+	}
+
+	if (s.count < n && valid_from > con->sb_first->sb_id)
+		search_range(&s, con->sb_first, valid_from - 1);
+
+	free(s.buf);
+	return s.count;
+}
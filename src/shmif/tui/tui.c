@@ -214,6 +214,46 @@ size_t arcan_tui_get_handles(
 	return ret;
 }
 
+/*
+ * Milliseconds until a dirty context should be synched, 0 if it should be
+ * done now. Updates are collected until the frame interval has passed and the
+ * previous frame has been consumed, so a client that refreshes after every
+ * write doesn't produce a frame for each one. Nothing is held back for longer
+ * than the latency cap, and not at all shortly after a key press so that echo
+ * stays immediate.
+ */
+static int refresh_delay(struct tui_context* tui, long long now)
+{
+	if (!tui->coalesce.interval ||
+		now - tui->coalesce.input < tui->coalesce.latency)
+		return 0;
+
+	if (!tui->coalesce.pending)
+		tui->coalesce.pending = now;
+
+	long long cap = tui->coalesce.pending + tui->coalesce.latency - now;
+	if (cap <= 0)
+		return 0;
+
+	long long left = tui->coalesce.last + tui->coalesce.interval - now;
+
+/* -2 means that the last frame hasn't been consumed yet, synching now would
+ * just block, so keep collecting and check again after another interval */
+	int jitter, errc;
+	int deadline = arcan_shmif_deadline(&tui->acon, 0, &jitter, &errc);
+	if (deadline == -2){
+		if (left <= 0)
+			left = tui->coalesce.interval;
+	}
+	else if (deadline > 0 && deadline / 1000 > left)
+		left = deadline / 1000;
+
+	if (left <= 0)
+		return 0;
+
+	return left < cap ? left : cap;
+}
+
 struct tui_process_res arcan_tui_process(
 	struct tui_context** contexts, size_t n_contexts,
 	int* fdset, size_t fdset_sz, int timeout)
@@ -236,13 +276,18 @@ struct tui_process_res arcan_tui_process(
 		return res;
 	}
 
-/* if any of the contexts are in a dirty state, the timeout will be changed */
+/* if any of the contexts are in a dirty state, the timeout is reduced to when
+ * the next refresh should go out */
+	long long now = arcan_timemillis();
 	for (size_t i = 0; i < n_contexts; i++){
 		if (!contexts[i]->acon.addr){
 			res.bad |= 1 << i;
 		}
-		else if (contexts[i]->dirty)
-			timeout = 0;
+		else if (contexts[i]->dirty){
+			int delay = refresh_delay(contexts[i], now);
+			if (timeout < 0 || delay < timeout)
+				timeout = delay;
+		}
 	}
 
 	if (res.bad){
@@ -323,6 +368,14 @@ int arcan_tuiint_dirty(struct tui_context* tui)
 	return tui->dirty;
 }
 
+/* same as the frametime= argument, for contexts that are refreshed outside
+ * of a process loop and would never get a held back update out */
+void arcan_tuiint_set_frametime(struct tui_context* tui, unsigned ms)
+{
+	tui->coalesce.interval = ms;
+	tui->coalesce.pending = 0;
+}
+
 int arcan_tui_refresh(struct tui_context* tui)
 {
 	if (!tui || !tui->acon.addr){
@@ -331,6 +384,14 @@ int arcan_tui_refresh(struct tui_context* tui)
 	}
 
 	if (tui->dirty){
+		long long now = arcan_timemillis();
+		if (refresh_delay(tui, now)){
+			errno = EAGAIN;
+			return -1;
+		}
+
+		tui->coalesce.pending = 0;
+		tui->coalesce.last = now;
 		return tui_screen_refresh(tui);
 	}
 
@@ -665,6 +726,20 @@ bool arcan_tui_writeu8(struct tui_context* c,
 		if (state == TSM_UTF8_ACCEPT || state == TSM_UTF8_REJECT){
 			uint32_t ucs4 = tsm_utf8_mach_get(c->ucsconv);
 			arcan_tui_write(c, ucs4, attr);
+
+/* an accepted ASCII byte leaves the decoder idle, any printable ASCII that
+ * follows decodes to itself and can go to the screen as one run */
+			if (ucs4 >= 0x20 && ucs4 < 0x7f){
+				size_t run = 0;
+				while (i + 1 + run < len && u8[i+1+run] >= 0x20 && u8[i+1+run] < 0x7f)
+					run++;
+
+				if (run){
+					tsm_screen_write_ascii(c->screen, &u8[i+1], run, attr);
+					flag_cursor(c);
+					i += run;
+				}
+			}
 		}
 	}
 	return true;
@@ -888,6 +963,32 @@ void arcan_tui_scroll_down(struct tui_context* c, size_t n)
 	flag_cursor(c);
 }
 
+size_t arcan_tui_search_sb(struct tui_context* c,
+	const char* needle, size_t after, size_t* out, size_t n)
+{
+	struct tsm_utf8_mach* mach;
+	if (!c || !needle || !out || !n || tsm_utf8_mach_new(&mach))
+		return 0;
+
+	size_t len = strlen(needle);
+	uint32_t* ucs4 = malloc(sizeof(uint32_t) * (len + 1));
+	size_t n_ucs4 = 0;
+
+	for (size_t i = 0; ucs4 && i < len; i++){
+		int state = tsm_utf8_mach_feed(mach, needle[i]);
+		if (state == TSM_UTF8_ACCEPT || state == TSM_UTF8_REJECT)
+			ucs4[n_ucs4++] = tsm_utf8_mach_get(mach);
+	}
+	tsm_utf8_mach_free(mach);
+
+	size_t res = 0;
+	if (ucs4)
+		res = tsm_screen_sb_search(c->screen, ucs4, n_ucs4, after, out, n);
+
+	free(ucs4);
+	return res;
+}
+
 void arcan_tui_reset_tabstop(struct tui_context* c)
 {
 	if (c)
@@ -23,6 +23,12 @@ struct tui_font;
 struct tui_raster_context;
 struct tui_context;
 
+/* range of columns on a row that may differ between front and back,
+ * x1 > x2 when there is none */
+struct tui_span {
+	uint16_t x1, x2;
+};
+
 struct tui_context {
 /* cfg->nal / state control */
 	struct tsm_screen* screen;
@@ -42,8 +48,15 @@ struct tui_context {
 	struct tui_cell* base;
 	struct tui_cell* front;
 	struct tui_cell* back;
+	struct tui_span* spans; /* per row, also aliased into base */
 	uint8_t fstamp;
 
+/* scroll applied to front/back but not yet packed */
+	struct {
+		int delta;
+		unsigned top, bottom;
+	} scroll;
+
 /* rbuf is used to package / convert the representation in base(front|back)
  * to a line format that can be used to forward to a raster engine. The size
  * is derived when allocating base
@@ -111,6 +124,15 @@ struct tui_context {
 /* track last time counter we did update on to avoid overdraw */
 	uint_fast32_t age;
 
+/* refresh coalescing, timestamps are in arcan_timemillis() */
+	struct {
+		long long last; /* last synch */
+		long long pending; /* first refresh that was held back, 0 if none */
+		long long input; /* last key press */
+		unsigned interval; /* minimum time between synchs, 0 disables */
+		unsigned latency; /* maximum time an update can be held back */
+	} coalesce;
+
 /* upstream connection */
 	struct arcan_shmif_cont acon;
 	struct arcan_shmif_cont clip_in;
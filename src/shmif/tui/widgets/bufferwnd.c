@@ -19,7 +19,7 @@
  * - extended ascii mode? (row # + controllable annotation column)
  * - support alternate type-push window for accessibility, debug
  * - undo/redo controls
- * - dynamic buffer reading (streaming / external populate contents)
+ * - streaming sources (pipes, sockets) for the descriptor backed mode
  * - align to cursor (set as window start ?)
  *
  * Minor nuissances:
@@ -34,6 +34,8 @@
 #include <ctype.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 #ifndef COUNT_OF
 #define COUNT_OF(x) \
@@ -43,6 +45,35 @@
 #define BUFFERWND_MAGIC 0xfadef00f
 const int min_meta_rows = 7;
 
+/*
+ * When the contents come from a file descriptor, the file is read in
+ * windows of BUFFERWND_WINDOW bytes when a byte inside of them is first
+ * needed, and the least recently used one is dropped to make room. The
+ * windows on either side of a newly read one are hinted to the kernel so
+ * that stepping across a window boundary doesn't stall on I/O. Only the
+ * visible rows are ever drawn, so the cost of a redraw or a seek does not
+ * depend on the size of the file.
+ *
+ * The windows are private copies rather than shared mappings, the file may
+ * be truncated by someone else while we are looking at it and a mapping
+ * would then fault on the missing pages. Edits are kept in an overlay and
+ * only written to the file on commit.
+ */
+#define BUFFERWND_WINDOW (4 * 1024 * 1024)
+#define BUFFERWND_MAPS 4
+
+struct bufferwnd_map {
+	uint8_t* base;
+	size_t index;
+	size_t sz;
+	uint64_t last_use;
+};
+
+struct bufferwnd_edit {
+	size_t pos;
+	uint8_t ch;
+};
+
 struct bufferwnd_meta {
 	uint32_t magic;
 	struct tui_cbcfg old_handlers;
@@ -63,6 +94,17 @@ struct bufferwnd_meta {
 	size_t buffer_ofs;
 	size_t buffer_lend;
 
+/* set instead of buffer for the descriptor backed mode */
+	int fd;
+	struct bufferwnd_map maps[BUFFERWND_MAPS];
+	struct bufferwnd_map* last_map;
+	uint64_t map_clock;
+
+/* uncommitted edits in the descriptor backed mode, sorted on pos */
+	struct bufferwnd_edit* edits;
+	size_t edits_n;
+	size_t edits_cap;
+
 /* window- local coordinates */
 	size_t cursor_x, cursor_y;
 
@@ -95,6 +137,189 @@ static bool validate_context(struct tui_context* T, struct bufferwnd_meta** M)
 	return true;
 }
 
+static void drop_maps(struct bufferwnd_meta* M)
+{
+	for (size_t i = 0; i < BUFFERWND_MAPS; i++){
+		free(M->maps[i].base);
+		M->maps[i] = (struct bufferwnd_map){0};
+	}
+
+	M->last_map = NULL;
+	free(M->edits);
+	M->edits = NULL;
+	M->edits_n = M->edits_cap = 0;
+
+	if (-1 != M->fd){
+		close(M->fd);
+		M->fd = -1;
+	}
+}
+
+static void prefetch_window(struct bufferwnd_meta* M, size_t index)
+{
+	size_t ofs = index * BUFFERWND_WINDOW;
+	if (ofs >= M->buffer_sz)
+		return;
+
+	for (size_t i = 0; i < BUFFERWND_MAPS; i++)
+		if (M->maps[i].base && M->maps[i].index == index)
+			return;
+
+#ifdef POSIX_FADV_WILLNEED
+	posix_fadvise(M->fd, ofs, BUFFERWND_WINDOW, POSIX_FADV_WILLNEED);
+#endif
+}
+
+static struct bufferwnd_map* map_window(struct bufferwnd_meta* M, size_t index)
+{
+	struct bufferwnd_map* dst = &M->maps[0];
+
+	for (size_t i = 0; i < BUFFERWND_MAPS; i++){
+		if (M->maps[i].base && M->maps[i].index == index){
+			dst = &M->maps[i];
+			goto out;
+		}
+		if (!M->maps[i].base || M->maps[i].last_use < dst->last_use)
+			dst = &M->maps[i];
+	}
+
+	free(dst->base);
+
+	size_t ofs = index * BUFFERWND_WINDOW;
+	size_t sz = M->buffer_sz - ofs;
+	if (sz > BUFFERWND_WINDOW)
+		sz = BUFFERWND_WINDOW;
+
+	*dst = (struct bufferwnd_map){
+		.index = index,
+		.sz = sz
+	};
+
+	uint8_t* base = malloc(sz);
+	if (!base)
+		return NULL;
+
+/* the file might have been truncated since setup, what is missing reads as 0 */
+	size_t got = 0;
+	while (got < sz){
+		ssize_t nr = pread(M->fd, &base[got], sz - got, ofs + got);
+		if (-1 == nr && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (nr <= 0)
+			break;
+		got += nr;
+	}
+	memset(&base[got], '\0', sz - got);
+	dst->base = base;
+
+	if (index)
+		prefetch_window(M, index - 1);
+	prefetch_window(M, index + 1);
+
+out:
+	dst->last_use = ++M->map_clock;
+	M->last_map = dst;
+	return dst;
+}
+
+/* binary search the overlay, [ind] is set to the match or insertion point */
+static bool find_edit(struct bufferwnd_meta* M, size_t pos, size_t* ind)
+{
+	size_t lo = 0, hi = M->edits_n;
+	while (lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+		if (M->edits[mid].pos < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	*ind = lo;
+	return lo < M->edits_n && M->edits[lo].pos == pos;
+}
+
+/* retrieve the byte at buffer position [pos] (< buffer_sz) regardless of mode,
+ * 0 if the file couldn't be read */
+static uint8_t buffer_byte(struct bufferwnd_meta* M, size_t pos)
+{
+	if (-1 == M->fd)
+		return M->buffer[pos];
+
+	size_t ind;
+	if (M->edits_n && find_edit(M, pos, &ind))
+		return M->edits[ind].ch;
+
+	size_t index = pos / BUFFERWND_WINDOW;
+	struct bufferwnd_map* map = M->last_map;
+	if (!map || map->index != index){
+		map = map_window(M, index);
+		if (!map)
+			return 0;
+	}
+
+	return map->base[pos % BUFFERWND_WINDOW];
+}
+
+/* for the descriptor backed mode the write goes to the overlay, see
+ * commit_edits for when it reaches the file */
+static bool buffer_write(struct bufferwnd_meta* M, size_t pos, uint8_t ch)
+{
+	if (-1 == M->fd){
+		M->buffer[pos] = ch;
+		return true;
+	}
+
+	size_t ind;
+	if (find_edit(M, pos, &ind)){
+		M->edits[ind].ch = ch;
+		return true;
+	}
+
+	if (M->edits_n == M->edits_cap){
+		size_t new_cap = M->edits_cap ? M->edits_cap * 2 : 64;
+		struct bufferwnd_edit* new_edits =
+			realloc(M->edits, new_cap * sizeof(struct bufferwnd_edit));
+		if (!new_edits)
+			return false;
+		M->edits = new_edits;
+		M->edits_cap = new_cap;
+	}
+
+	memmove(&M->edits[ind + 1], &M->edits[ind],
+		(M->edits_n - ind) * sizeof(struct bufferwnd_edit));
+	M->edits[ind] = (struct bufferwnd_edit){
+		.pos = pos,
+		.ch = ch
+	};
+	M->edits_n++;
+	return true;
+}
+
+/* write the overlay to the file, on failure whatever didn't make it is kept
+ * so that the commit can be retried */
+static bool commit_edits(struct bufferwnd_meta* M)
+{
+	size_t i = 0;
+	for (; i < M->edits_n; i++){
+		if (1 != pwrite(M->fd, &M->edits[i].ch, 1, M->edits[i].pos))
+			break;
+
+/* the cached window would otherwise still show the old value */
+		struct bufferwnd_map* map = NULL;
+		size_t index = M->edits[i].pos / BUFFERWND_WINDOW;
+		for (size_t j = 0; j < BUFFERWND_MAPS; j++)
+			if (M->maps[j].base && M->maps[j].index == index)
+				map = &M->maps[j];
+		if (map)
+			map->base[M->edits[i].pos % BUFFERWND_WINDOW] = M->edits[i].ch;
+	}
+
+	memmove(M->edits, &M->edits[i],
+		(M->edits_n - i) * sizeof(struct bufferwnd_edit));
+	M->edits_n -= i;
+	return 0 == M->edits_n;
+}
+
 void arcan_tui_bufferwnd_release(struct tui_context* T)
 {
 	struct bufferwnd_meta* meta;
@@ -112,6 +337,8 @@ void arcan_tui_bufferwnd_release(struct tui_context* T)
 	arcan_tui_update_handlers(T, &meta->old_handlers, NULL, sizeof(struct tui_cbcfg));
 	arcan_tui_reset_labels(T);
 
+	drop_maps(meta);
+
 /* LTO could possibly do something about this, but basically just safeguard
  * on a safeguard (UAF detection) for the bufferwnd_meta after freeing it */
 	*meta = (struct bufferwnd_meta){
@@ -246,9 +473,9 @@ static void draw_footer(struct tui_context* T, struct bufferwnd_meta* M,
 	arcan_tui_move_to(T, 0, c_row++);\
 	write_mask(T, lbl, &def, work, &def_text, w);
 
-	size_t buf_sz = M->buffer_sz - M->buffer_pos;
-	memcpy(&vbuf, &M->buffer[M->buffer_pos + M->buffer_ofs],
-		buf_sz < sizeof(vbuf) ? buf_sz : sizeof(vbuf));
+	size_t pos = M->buffer_pos + M->buffer_ofs;
+	for (size_t i = 0; i < sizeof(vbuf) && pos + i < M->buffer_sz; i++)
+		((uint8_t*) &vbuf)[i] = buffer_byte(M, pos + i);
 
 	const char row1_label[] =
 	"x8:     x16:       x32:            "
@@ -282,10 +509,10 @@ static void draw_footer(struct tui_context* T, struct bufferwnd_meta* M,
   "                        ";
 	DO_ROW(row4_label, row4_data, vbuf.f, vbuf.lf);
 
-	size_t pos = sizeof(row4_label) - 1;
-	arcan_tui_move_to(T, pos, c_row-1);
-	for (size_t i = 0; i < *cols - pos && i < M->row_bytelen; i++){
-		uint8_t ch = M->buffer[M->buffer_pos + M->buffer_ofs + i];
+	size_t lbl_w = sizeof(row4_label) - 1;
+	arcan_tui_move_to(T, lbl_w, c_row-1);
+	for (size_t i = 0; i < *cols - lbl_w && i < M->row_bytelen; i++){
+		uint8_t ch = pos + i < M->buffer_sz ? buffer_byte(M, pos + i) : 0;
 		if (!isprint(ch))
 			ch = '_';
 		arcan_tui_writeu8(T, &ch, 1, &def_text);
@@ -368,7 +595,7 @@ static void redraw_hex(struct tui_context* T, struct bufferwnd_meta* M,
 				M->cursor_x = col + (M->cursor_halfb ? 1 : 0);
 				M->cursor_y = row;
 			}
-			uint8_t ch = M->buffer[i + M->buffer_pos];
+			uint8_t ch = buffer_byte(M, i + M->buffer_pos);
 
 			struct tui_screen_attr cattr = def;
 
@@ -462,7 +689,7 @@ static void redraw_text(struct tui_context* T, struct bufferwnd_meta* M,
 	bool new_row = false, first_row = true, cursor_found = false;
 	for (size_t i = 0; i < wndbuf_sz && i + M->buffer_pos < M->buffer_sz; i++){
 		struct tui_screen_attr cattr = def;
-		uint8_t ch = M->buffer[i + M->buffer_pos];
+		uint8_t ch = buffer_byte(M, i + M->buffer_pos);
 
 /* tracking this makes row down easier */
 		if (new_row && first_row && !mask_write){
@@ -497,7 +724,7 @@ static void redraw_text(struct tui_context* T, struct bufferwnd_meta* M,
 /* interpret CR as LF unless followed by LF, then just step */
 			else if (ch == '\r' && M->opts.wrap_mode == BUFFERWND_WRAP_ACCEPT_CR_LF){
 				if (i + M->buffer_pos + 1 < M->buffer_sz){
-					if (M->buffer[i + M->buffer_pos + 1] == '\n'){
+					if (buffer_byte(M, i + M->buffer_pos + 1) == '\n'){
 					}
 					else {
 						M->col = cols;
@@ -517,7 +744,7 @@ static void redraw_text(struct tui_context* T, struct bufferwnd_meta* M,
 		}
 
 		if (!mask_write)
-			arcan_tui_writeu8(T, &M->buffer[i + M->buffer_pos], 1, &cattr);
+			arcan_tui_writeu8(T, &ch, 1, &cattr);
 
 /* advance cursor position, take wrapping etc. into account */
 		if (!step_col(T, M, rows, cols, start_row, start_col, &new_row))
@@ -886,7 +1113,8 @@ static bool on_u8(struct tui_context* T, const char* u8, size_t len, void* tag)
 				return true;
 			}
 		}
-		M->buffer[M->buffer_pos + M->buffer_ofs] = *u8;
+		if (!buffer_write(M, M->buffer_pos + M->buffer_ofs, *u8))
+			return true;
 		step_cursor_e(T, M);
 		redraw_bufferwnd(T, M);
 	break;
@@ -907,7 +1135,7 @@ static bool on_u8(struct tui_context* T, const char* u8, size_t len, void* tag)
 			}
 		}
 		uint8_t ch = *u8;
-		uint8_t inb = M->buffer[M->buffer_pos + M->buffer_ofs];
+		uint8_t inb = buffer_byte(M, M->buffer_pos + M->buffer_ofs);
 		if (ch >= '0' && ch <= '9'){
 			ch = ch - '0';
 		}
@@ -921,7 +1149,8 @@ static bool on_u8(struct tui_context* T, const char* u8, size_t len, void* tag)
 			ch = ch + (inb & 0xf0);
 		}
 
-		M->buffer[M->buffer_pos + M->buffer_ofs] = ch;
+		if (!buffer_write(M, M->buffer_pos + M->buffer_ofs, ch))
+			return true;
 		step_cursor_e(T, M);
 		redraw_bufferwnd(T, M);
 		return true;
@@ -1021,7 +1250,7 @@ static void scroll_row_up(struct tui_context* T, struct bufferwnd_meta* M)
 
 		while (cofs < M->buffer_pos && cols){
 /* we are already at a renderable / split point, so increment first */
-			uint8_t ch = M->buffer[M->buffer_pos - cofs];
+			uint8_t ch = buffer_byte(M, M->buffer_pos - cofs);
 
 /* line-breaks, for UTF we'd need to also consider, at least, non-advancing
  * whitespace and all that kind of jazz */
@@ -1257,6 +1486,15 @@ static void on_key_input(struct tui_context* T, uint32_t keysym,
 			return;
 
 		M->exit_status = keysym == TUIK_RETURN ? 0 : -1;
+
+/* in the descriptor backed mode this is where edits reach the file */
+		if (-1 != M->fd){
+			if (-1 == M->exit_status)
+				M->edits_n = 0;
+			else if (!commit_edits(M))
+				M->exit_status = 1;
+			redraw_bufferwnd(T, M);
+		}
 	}
 	else
 		;
@@ -1269,6 +1507,7 @@ void arcan_tui_bufferwnd_synch(
 	if (!buf || !buf_sz || !validate_context(T, &M))
 		return;
 
+	drop_maps(M);
 	M->buffer = buf;
 	M->buffer_sz = buf_sz;
 	M->buffer_ofs = 0;
@@ -1303,8 +1542,13 @@ void arcan_tui_bufferwnd_seek(struct tui_context* T, size_t buf_pos)
 	size_t n_rows = M->cursor_ofs_row_end - M->cursor_ofs_row;
 	size_t bpp = n_rows * M->row_bytelen;
 
+/* nothing has been drawn yet, so the page size isn't known */
+	if (!bpp){
+		M->buffer_pos = buf_pos;
+		M->buffer_ofs = 0;
+	}
 /* first page */
-	if (buf_pos < bpp){
+	else if (buf_pos < bpp){
 		M->buffer_pos = 0;
 		M->buffer_ofs = buf_pos;
 	}
@@ -1360,8 +1604,8 @@ static void mouse_button(struct tui_context* T,
 	redraw_bufferwnd(T, M);
 }
 
-void arcan_tui_bufferwnd_setup(struct tui_context* T,
-	uint8_t* buf, size_t buf_sz, struct tui_bufferwnd_opts* opts, size_t opt_sz)
+static struct bufferwnd_meta* setup(struct tui_context* T,
+	uint8_t* buf, size_t buf_sz, int fd, struct tui_bufferwnd_opts* opts)
 {
 	static bool first_call = true;
 	if (first_call){
@@ -1371,12 +1615,13 @@ void arcan_tui_bufferwnd_setup(struct tui_context* T,
 
 	struct bufferwnd_meta* meta = malloc(sizeof(struct bufferwnd_meta));
 	if (!meta)
-		return;
+		return NULL;
 
 	*meta = (struct bufferwnd_meta){
 		.magic = BUFFERWND_MAGIC,
 		.buffer = buf,
 		.buffer_sz = buf_sz,
+		.fd = fd,
 		.exit_status = 1
 	};
 
@@ -1405,6 +1650,47 @@ void arcan_tui_bufferwnd_setup(struct tui_context* T,
 
 	arcan_tui_reset_labels(T);
 	redraw_bufferwnd(T, meta);
+	return meta;
+}
+
+void arcan_tui_bufferwnd_setup(struct tui_context* T,
+	uint8_t* buf, size_t buf_sz, struct tui_bufferwnd_opts* opts, size_t opt_sz)
+{
+	setup(T, buf, buf_sz, -1, opts);
+}
+
+bool arcan_tui_bufferwnd_setup_fd(struct tui_context* T,
+	int fd, struct tui_bufferwnd_opts* opts, size_t opt_sz)
+{
+	struct stat fs;
+	if (!T || -1 == fstat(fd, &fs) || !S_ISREG(fs.st_mode) || fs.st_size <= 0)
+		return false;
+
+	if ((uint64_t) fs.st_size > SIZE_MAX)
+		return false;
+
+	int flags = fcntl(fd, F_GETFL);
+	if (-1 == flags)
+		return false;
+
+	int dfd = arcan_shmif_dupfd(fd, -1, true);
+	if (-1 == dfd)
+		return false;
+
+/* edits are written back to the file, so that has to be possible */
+	struct tui_bufferwnd_opts lopts = {0};
+	if (opts)
+		lopts = *opts;
+
+	if ((flags & O_ACCMODE) == O_RDONLY)
+		lopts.read_only = true;
+
+	if (!setup(T, NULL, fs.st_size, dfd, &lopts)){
+		close(dfd);
+		return false;
+	}
+
+	return true;
 }
 
 int arcan_tui_bufferwnd_status(struct tui_context* T)
@@ -1438,45 +1724,30 @@ int main(int argc, char** argv)
 
 	if (argc > 1){
 		char* infile = argv[1];
+		opts.read_only = true;
 		if (infile[0] == '+'){
 			opts.read_only = false;
 			infile = &infile[1];
-			fprintf(stdout, "opening %s in fake- rw mode\n", infile);
+			fprintf(stdout, "opening %s in rw mode\n", infile);
 		}
 
-		FILE* fpek = fopen(infile, "r");
-		if (!fpek){
+		int fd = open(infile, opts.read_only ? O_RDONLY : O_RDWR);
+		if (-1 == fd){
 			fprintf(stderr, "couldn't open file: (%s)\n", argv[1]);
 			return EXIT_FAILURE;
 		}
 
-		fseek(fpek, 0, SEEK_END);
-		long pos = ftell(fpek);
-		if (pos <= 0){
-			fprintf(stderr, "invalid buffer size: %ld\n", pos);
-			return EXIT_FAILURE;
-		}
-
-		char* buf = malloc(pos);
-		if (!buf){
-			fprintf(stderr, "couldn't prepare buffer of %ld bytes\n", pos);
-			return EXIT_FAILURE;
-		}
-
-		fseek(fpek, 0, SEEK_SET);
-		if (0 == fread(buf, pos, 1, fpek)){
-			fprintf(stderr, "couldn't read %ld bytes from %s\n", pos, argv[1]);
+/* the file is read on demand rather than all at once */
+		if (!arcan_tui_bufferwnd_setup_fd(tui,
+			fd, &opts, sizeof(struct tui_bufferwnd_opts))){
+			fprintf(stderr, "couldn't use file: (%s)\n", argv[1]);
 			return EXIT_FAILURE;
 		}
-
-		fclose(fpek);
-		dst_buf = buf;
-		dst_buf_sz = pos;
+		close(fd);
 	}
-
-/* switch to bufferwnd mode */
-	arcan_tui_bufferwnd_setup(tui, (uint8_t*) dst_buf,
-		dst_buf_sz, &opts, sizeof(struct tui_bufferwnd_opts));
+	else
+		arcan_tui_bufferwnd_setup(tui, (uint8_t*) dst_buf,
+			dst_buf_sz, &opts, sizeof(struct tui_bufferwnd_opts));
 
 /* and normal processing loop */
 	while(1){
@@ -16,7 +16,7 @@
  *    more difficult is adding an expand-collapse so selection would expand
  *  - handle accessibility subwindow (provide only selected item for t2s)
  *  - allow multiple weighted column formats for wider windows
- *  - prefix typing for searching
+ *  - prefix typing for searching with static lists
  */
 
 #ifndef COUNT_OF
@@ -27,15 +27,53 @@
 #define INACTIVE_ITEM (LIST_SEPARATOR | LIST_LABEL | LIST_PASSIVE | LIST_HIDE)
 #define HIDDEN_ITEM (LIST_HIDE)
 
+/*
+ * With a list source, entries are fetched in windows of LISTWND_CACHE around
+ * the one that is needed, and nothing else is kept. Typing filters the list:
+ * the source is scanned LISTWND_SCAN_STEP entries per tick for labels that
+ * contain the filter string, and the matches so far are shown in its place.
+ * Extending the filter only rescans the previous matches.
+ */
+#define LISTWND_CACHE 64
+#define LISTWND_SCAN_CHUNK 1024
+#define LISTWND_SCAN_STEP 65536
+#define LISTWND_FILTER_MAX 64
+
+struct listwnd_filter {
+	char needle[LISTWND_FILTER_MAX];
+	size_t len;
+
+/* ascending source indices that match needle */
+	size_t* matches;
+	size_t n_matches, matches_sz;
+
+/* when narrowing, the matches of the previous needle are scanned instead */
+	size_t* domain;
+	size_t n_domain;
+	bool narrow;
+
+	size_t scan_pos;
+	bool done;
+};
+
 #define LISTWND_MAGIC 0xfadef00e
 struct listwnd_meta {
 /* debug-help, check against LISTWND_MAGIC */
 	uint32_t magic;
 
-/* actual entries, flags can mutate, size cannot */
+/* actual entries, flags can mutate, size cannot, list_sz is the number of
+ * entries in the view, i.e. source count or filter matches for a source */
 	struct tui_list_entry* list;
 	size_t list_sz;
 
+/* alternative to list, with a window of fetched entries */
+	struct tui_list_source source;
+	struct tui_list_entry cache[LISTWND_CACHE];
+	size_t cache_ofs, cache_n;
+	struct tui_list_entry* scan;
+	struct tui_list_entry selected;
+	struct listwnd_filter filter;
+
 /* current logical cursor position and resolved screen position */
 	size_t list_pos;
 	size_t list_row;
@@ -57,6 +95,71 @@ struct listwnd_meta {
 	int old_flags;
 };
 
+static struct tui_list_entry blank_entry = {
+	.label = "",
+	.attributes = LIST_PASSIVE
+};
+
+static bool has_filter(struct listwnd_meta* M)
+{
+	return M->filter.len > 0;
+}
+
+static struct tui_list_entry* fetch_entry(struct listwnd_meta* M, size_t i)
+{
+	if (i - M->cache_ofs < M->cache_n)
+		return &M->cache[i - M->cache_ofs];
+
+/* keep a few entries before so stepping backwards doesn't refetch */
+	size_t ofs = i > LISTWND_CACHE / 8 ? i - LISTWND_CACHE / 8 : 0;
+	M->cache_ofs = ofs;
+	M->cache_n = M->source.fetch(M->source.tag, ofs, LISTWND_CACHE, M->cache);
+	if (M->cache_n > LISTWND_CACHE)
+		M->cache_n = LISTWND_CACHE;
+
+	if (i - M->cache_ofs < M->cache_n)
+		return &M->cache[i - M->cache_ofs];
+
+	return &blank_entry;
+}
+
+/* map a view index to the source index */
+static size_t source_index(struct listwnd_meta* M, size_t i)
+{
+	return has_filter(M) ? M->filter.matches[i] : i;
+}
+
+static struct tui_list_entry* get_entry(struct listwnd_meta* M, size_t i)
+{
+	if (!M->source.fetch)
+		return &M->list[i];
+
+	return fetch_entry(M, source_index(M, i));
+}
+
+/* the source is free to grow, so the count is refreshed on each redraw */
+static void update_count(struct listwnd_meta* M)
+{
+	if (!M->source.fetch)
+		return;
+
+	M->list_sz = has_filter(M) ?
+		M->filter.n_matches : M->source.count(M->source.tag);
+
+	if (M->list_pos >= M->list_sz)
+		M->list_pos = M->list_sz ? M->list_sz - 1 : 0;
+	if (M->list_ofs > M->list_pos)
+		M->list_ofs = M->list_pos;
+}
+
+/* the filter prompt takes the last row */
+static size_t list_rows(struct tui_context* T, struct listwnd_meta* M)
+{
+	size_t rows, cols;
+	arcan_tui_dimensions(T, &rows, &cols);
+	return has_filter(M) && rows > 1 ? rows - 1 : rows;
+}
+
 /* context validation, perform on every exported symbol */
 static bool validate(struct tui_context* T, struct listwnd_meta** M)
 {
@@ -76,15 +179,28 @@ static bool validate(struct tui_context* T, struct listwnd_meta** M)
 	return true;
 }
 
-static size_t get_visible_offset(struct listwnd_meta* M)
+/*
+ * Move list_ofs forward so that list_pos is on the page, walking back from
+ * list_pos rather than forward from list_ofs so this is bounded by the page
+ * size and not by the distance to the previous position.
+ */
+static void align_offset(struct listwnd_meta* M, size_t rows)
 {
-	size_t ofs = 0;
-	for (size_t i = M->list_ofs; i < M->list_pos; i++){
-		if (M->list[i].attributes & HIDDEN_ITEM)
+	if (M->list_pos < M->list_ofs){
+		M->list_ofs = M->list_pos;
+		return;
+	}
+
+	size_t ofs = M->list_pos;
+	for (size_t vis = 1; ofs > M->list_ofs; ofs--){
+		if (get_entry(M, ofs - 1)->attributes & HIDDEN_ITEM)
 			continue;
-		ofs++;
+		if (vis == rows)
+			break;
+		vis++;
 	}
-	return ofs;
+
+	M->list_ofs = ofs;
 }
 
 ssize_t arcan_tui_listwnd_tell(struct tui_context* T)
@@ -93,9 +209,27 @@ ssize_t arcan_tui_listwnd_tell(struct tui_context* T)
 	if (!validate(T, &M))
 		return -1;
 
+	if (M->source.fetch && M->list_sz)
+		return source_index(M, M->list_pos);
+
 	return M->list_pos;
 }
 
+static void draw_filter(struct tui_context* T,
+	struct listwnd_meta* M, size_t row, size_t cols, struct tui_screen_attr* attr)
+{
+	char buf[LISTWND_FILTER_MAX + 32];
+	snprintf(buf, sizeof(buf), "/%s (%zu%s)", M->filter.needle,
+		M->filter.n_matches, M->filter.done ? "" : "...");
+
+	arcan_tui_defattr(T, attr);
+	arcan_tui_erase_region(T, 0, row, cols, 1, false);
+	arcan_tui_move_to(T, 0, row);
+
+	size_t len = strlen(buf);
+	arcan_tui_writeu8(T, (const uint8_t*) buf, len < cols ? len : cols, attr);
+}
+
 static void redraw(struct tui_context* T, struct listwnd_meta* M)
 {
 	size_t c_row = 0;
@@ -105,10 +239,13 @@ static void redraw(struct tui_context* T, struct listwnd_meta* M)
 	if (!rows)
 		return;
 
+	update_count(M);
+	size_t prompt_row = rows - 1;
+	rows = list_rows(T, M);
+
 /* safeguard that we fit in the current screen, else we search */
-	for (size_t ofs = get_visible_offset(M); ofs > rows; M->list_ofs++){
-		ofs = get_visible_offset(M);
-	}
+	if (M->list_sz)
+		align_offset(M, rows);
 
 	struct tui_screen_attr reset_def = arcan_tui_defattr(T, NULL);
 	struct tui_screen_attr def = arcan_tui_defcattr(T, TUI_COL_LABEL);
@@ -123,8 +260,9 @@ static void redraw(struct tui_context* T, struct listwnd_meta* M)
 /* now we can just clear / draw the items on the page */
 	c_row = 0;
 	for (size_t i = M->list_ofs; rows && i < M->list_sz; i++){
-		int lattr = M->list[i].attributes;
-		const char* label = M->list[i].label;
+		struct tui_list_entry* ent = get_entry(M, i);
+		int lattr = ent->attributes;
+		const char* label = ent->label ? ent->label : "";
 
 		if (lattr & HIDDEN_ITEM)
 			continue;
@@ -157,7 +295,7 @@ static void redraw(struct tui_context* T, struct listwnd_meta* M)
 
 /* tactic: draw as much as possible from starting label offset,
  * recall (& 0xc0) != 0x80 for utf8- start */
-		arcan_tui_move_to(T, 1+M->list[i].indent, c_row);
+		arcan_tui_move_to(T, 1+ent->indent, c_row);
 		for (size_t vofs = 0; vofs < cols - 2 && label[ofs]; vofs++){
 			size_t end = ofs + 1;
 			while (label[end] && (label[end] & 0xc0) == 0x80) end++;
@@ -178,6 +316,9 @@ static void redraw(struct tui_context* T, struct listwnd_meta* M)
 		c_row++;
 	}
 
+	if (has_filter(M))
+		draw_filter(T, M, prompt_row, cols, &label);
+
 	arcan_tui_defattr(T, &reset_def);
 }
 
@@ -187,6 +328,23 @@ void arcan_tui_listwnd_setpos(struct tui_context* T, size_t n)
 	if (!validate(T, &M))
 		return;
 
+/* with a filter, the position is a source index that needs to match */
+	if (M->source.fetch && has_filter(M)){
+		size_t lo = 0, hi = M->filter.n_matches;
+		while (lo < hi){
+			size_t mid = lo + (hi - lo) / 2;
+			if (M->filter.matches[mid] < n)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo == M->filter.n_matches || M->filter.matches[lo] != n)
+			return;
+		n = lo;
+	}
+	else
+		update_count(M);
+
 	if (n < M->list_sz)
 		M->list_pos = n;
 
@@ -195,28 +353,52 @@ void arcan_tui_listwnd_setpos(struct tui_context* T, size_t n)
 
 static void select_current(struct tui_context* T, struct listwnd_meta* M)
 {
-	int flags = M->list[M->list_pos].attributes;
+	if (!M->list_sz)
+		return;
+
+	int flags = get_entry(M, M->list_pos)->attributes;
 	if (flags & INACTIVE_ITEM)
 		return;
 	M->entry_state = 1;
 	M->entry_pos = M->list_pos;
 }
 
+static void clear_filter(struct listwnd_meta* M)
+{
+	size_t pos = M->list_sz ? source_index(M, M->list_pos) : 0;
+
+	free(M->filter.matches);
+	free(M->filter.domain);
+	M->filter = (struct listwnd_filter){0};
+
+/* keep the cursor at the same entry */
+	M->list_pos = pos;
+	M->list_ofs = 0;
+}
+
 static void cancel(struct tui_context* T, struct listwnd_meta* M)
 {
+	if (has_filter(M)){
+		clear_filter(M);
+		redraw(T, M);
+		return;
+	}
+
 	M->entry_state = -1;
 }
 
 static void step_page_s(struct tui_context* T, struct listwnd_meta* M)
 {
-	size_t rows, cols;
-	arcan_tui_dimensions(T, &rows, &cols);
+	if (!M->list_sz)
+		return;
+
+	size_t rows = list_rows(T, M);
 
 /* increment offset half- a page */
 	rows = (rows >> 1) + 1;
 	size_t c_row;
 	for (c_row = M->list_ofs; c_row < M->list_sz && rows; c_row++){
-		if (M->list[c_row].attributes & INACTIVE_ITEM)
+		if (get_entry(M, c_row)->attributes & INACTIVE_ITEM)
 			continue;
 
 		rows--;
@@ -234,7 +416,7 @@ static void step_page_s(struct tui_context* T, struct listwnd_meta* M)
 
 /* step cursor to next sane */
 	for (c_row = M->list_pos; c_row < M->list_sz; c_row++){
-		if (!(M->list[c_row].attributes & INACTIVE_ITEM)){
+		if (!(get_entry(M, c_row)->attributes & INACTIVE_ITEM)){
 			M->list_pos = c_row;
 			break;
 		}
@@ -249,14 +431,18 @@ static void step_page_n(struct tui_context* T, struct listwnd_meta* M)
 
 static void step_cursor_n(struct tui_context* T, struct listwnd_meta* M)
 {
+	if (!M->list_sz)
+		return;
+
 	size_t current = M->list_pos;
 	size_t vis_step = 0;
 	do {
 		current = current > 0 ? current - 1 : M->list_sz - 1;
-		if (!(M->list[current].attributes & HIDDEN_ITEM))
+		int lattr = get_entry(M, current)->attributes;
+		if (!(lattr & HIDDEN_ITEM))
 			vis_step++;
 
-		if (!(M->list[current].attributes & INACTIVE_ITEM))
+		if (!(lattr & INACTIVE_ITEM))
 			break;
 
 	} while (current != M->list_pos);
@@ -272,8 +458,10 @@ static void step_cursor_n(struct tui_context* T, struct listwnd_meta* M)
 
 static void step_cursor_s(struct tui_context* T, struct listwnd_meta* M)
 {
-	size_t rows, cols;
-	arcan_tui_dimensions(T, &rows, &cols);
+	if (!M->list_sz)
+		return;
+
+	size_t rows = list_rows(T, M);
 
 /* find the next selectable item, and detect if it is on this page or not */
 	size_t current = M->list_pos;
@@ -282,7 +470,8 @@ static void step_cursor_s(struct tui_context* T, struct listwnd_meta* M)
 
 	do {
 		current = (current + 1) % M->list_sz;
-		if (!(M->list[current].attributes & HIDDEN_ITEM)){
+		int lattr = get_entry(M, current)->attributes;
+		if (!(lattr & HIDDEN_ITEM)){
 			vis_step++;
 
 /* track the first visible on the next page */
@@ -292,7 +481,7 @@ static void step_cursor_s(struct tui_context* T, struct listwnd_meta* M)
 			}
 		}
 
-		if (!(M->list[current].attributes & INACTIVE_ITEM))
+		if (!(lattr & INACTIVE_ITEM))
 			break;
 
 /* end condition is wrap */
@@ -323,6 +512,139 @@ void arcan_tui_listwnd_dirty(struct tui_context* T)
 	redraw(T, M);
 }
 
+/* ascii case insensitive substring match */
+static bool label_match(const char* label, const char* needle, size_t len)
+{
+	if (!label)
+		return false;
+
+	for (; *label; label++){
+		size_t i = 0;
+		while (i < len && label[i] &&
+			tolower((uint8_t)label[i]) == tolower((uint8_t)needle[i]))
+			i++;
+		if (i == len)
+			return true;
+	}
+
+	return false;
+}
+
+static bool add_match(struct listwnd_filter* F, size_t i)
+{
+	if (F->n_matches == F->matches_sz){
+		size_t nsz = F->matches_sz ? F->matches_sz * 2 : 256;
+		size_t* matches = realloc(F->matches, nsz * sizeof(size_t));
+		if (!matches)
+			return false;
+		F->matches = matches;
+		F->matches_sz = nsz;
+	}
+
+	F->matches[F->n_matches++] = i;
+	return true;
+}
+
+/*
+ * Test up to [budget] more entries against the filter, returns true if any
+ * matches were added
+ */
+static bool filter_step(struct listwnd_meta* M, size_t budget)
+{
+	struct listwnd_filter* F = &M->filter;
+	size_t found = F->n_matches;
+
+	while (!F->done && budget){
+		size_t end = F->narrow ? F->n_domain : M->source.count(M->source.tag);
+		if (F->scan_pos >= end){
+			F->done = true;
+			break;
+		}
+
+/* narrowing goes through the old matches one by one, the display cache
+ * works as well as anything for those */
+		if (F->narrow){
+			size_t i = F->domain[F->scan_pos++];
+			budget--;
+			if (label_match(fetch_entry(M, i)->label, F->needle, F->len) &&
+				!add_match(F, i))
+				F->done = true;
+			continue;
+		}
+
+		size_t n = end - F->scan_pos;
+		if (n > LISTWND_SCAN_CHUNK)
+			n = LISTWND_SCAN_CHUNK;
+
+/* any fetch invalidates the strings from the previous one, so the display
+ * cache has to be refilled on the next lookup */
+		n = M->source.fetch(M->source.tag, F->scan_pos, n, M->scan);
+		M->cache_n = 0;
+		if (!n){
+			F->done = true;
+			break;
+		}
+
+		for (size_t i = 0; i < n; i++){
+			if (M->scan[i].attributes & (LIST_SEPARATOR | LIST_HIDE))
+				continue;
+			if (label_match(M->scan[i].label, F->needle, F->len) &&
+				!add_match(F, F->scan_pos + i)){
+				F->done = true;
+				break;
+			}
+		}
+
+		F->scan_pos += n;
+		budget = budget > n ? budget - n : 0;
+	}
+
+	if (F->done){
+		free(F->domain);
+		F->domain = NULL;
+		F->n_domain = 0;
+	}
+
+	return F->n_matches != found;
+}
+
+/* restart the filter scan with [needle], narrow when it extends the old one */
+static void set_filter(struct listwnd_meta* M, const char* needle, size_t len)
+{
+	struct listwnd_filter* F = &M->filter;
+
+	if (!len){
+		clear_filter(M);
+		return;
+	}
+
+	bool narrow = F->len && F->done && len > F->len &&
+		memcmp(needle, F->needle, F->len) == 0;
+
+	free(F->domain);
+	F->domain = NULL;
+	F->n_domain = 0;
+
+	if (narrow){
+		F->domain = F->matches;
+		F->n_domain = F->n_matches;
+		F->matches = NULL;
+		F->matches_sz = 0;
+	}
+
+	F->n_matches = 0;
+	F->narrow = narrow;
+	F->scan_pos = 0;
+	F->done = false;
+
+	memcpy(F->needle, needle, len);
+	F->needle[len] = '\0';
+	F->len = len;
+
+	M->list_pos = M->list_ofs = 0;
+	filter_step(M, LISTWND_SCAN_STEP);
+}
+
 static bool u8(struct tui_context* T, const char* u8, size_t len, void* tag)
 {
 /* not necessarily terminated, so terminate */
@@ -331,6 +653,21 @@ static bool u8(struct tui_context* T, const char* u8, size_t len, void* tag)
 	cp[len] = '\0';
 
 	struct listwnd_meta* M = tag;
+
+/* with a source there is no list to search for shortcuts, typing filters */
+	if (M->source.fetch){
+		if (M->filter.len + len >= LISTWND_FILTER_MAX || !len ||
+			(len == 1 && !isprint((uint8_t)*u8)))
+			return false;
+
+		char needle[LISTWND_FILTER_MAX];
+		memcpy(needle, M->filter.needle, M->filter.len);
+		memcpy(&needle[M->filter.len], u8, len);
+		set_filter(M, needle, M->filter.len + len);
+		redraw(T, M);
+		return true;
+	}
+
 	for (size_t i = 0; i < M->list_sz; i++){
 		if (M->list[i].shortcut && strcmp(M->list[i].shortcut, cp) == 0){
 			if (M->list[i].attributes & ~(INACTIVE_ITEM)){
@@ -356,9 +693,16 @@ bool arcan_tui_listwnd_status(struct tui_context* T, struct tui_list_entry** out
 /* user requested cancellation */
 	else if (M->entry_state == -1 && out)
 		*out = NULL;
-/* or selected a real item */
-	else if (M->entry_state == 1 && out)
-		*out = &M->list[M->entry_pos];
+/* or selected a real item, a fetched entry gets copied out as the cache can
+ * change underneath it */
+	else if (M->entry_state == 1 && out){
+		if (M->source.fetch){
+			M->selected = *get_entry(M, M->entry_pos);
+			*out = &M->selected;
+		}
+		else
+			*out = &M->list[M->entry_pos];
+	}
 
 	M->entry_state = 0;
 	return true;
@@ -447,6 +791,17 @@ static void key_input(struct tui_context* T, uint32_t keysym,
 	uint8_t scancode, uint8_t mods, uint16_t subid, void* tag)
 {
 	struct listwnd_meta* M = tag;
+	if (keysym == TUIK_BACKSPACE && has_filter(M)){
+		char needle[LISTWND_FILTER_MAX];
+		size_t len = M->filter.len - 1;
+		while (len && (M->filter.needle[len] & 0xc0) == 0x80)
+			len--;
+		memcpy(needle, M->filter.needle, len);
+		set_filter(M, needle, len);
+		redraw(T, M);
+		return;
+	}
+
 	for (size_t i = 0; i < COUNT_OF(labels); i++){
 		if ((keysym && keysym == labels[i].alt) ||
 			keysym == labels[i].ent.initial)
@@ -470,6 +825,10 @@ void arcan_tui_listwnd_release(struct tui_context* T)
 
 	arcan_tui_reset_labels(T);
 
+	free(M->filter.matches);
+	free(M->filter.domain);
+	free(M->scan);
+
 /* it would make sense to 'fake' a resize here as well, but from some design
  * oversights with the event, that requires tracking or exposing shmif_ context
  * contents, or breaking ABI - so assume the caller actually has the sense to
@@ -506,6 +865,14 @@ static void resize(struct tui_context* T,
 static void tick(struct tui_context* T, void* t)
 {
 /* if current item is cropped, scroll it */
+
+/* continue the filter scan, the page only changes if it isn't full yet but
+ * the match count in the prompt does */
+	struct listwnd_meta* M = t;
+	if (has_filter(M) && !M->filter.done){
+		filter_step(M, LISTWND_SCAN_STEP);
+		redraw(T, M);
+	}
 }
 
 static void geohint(struct tui_context* T,
@@ -546,8 +913,12 @@ static void mouse_motion(struct tui_context* T,
 		return;
 	}
 
-	for (size_t i = M->list_ofs, yp = 0; i < M->list_sz; i++){
-		if (M->list[i].attributes & HIDDEN_ITEM)
+	if (mouse_y < 0)
+		return;
+
+	for (size_t i = M->list_ofs, yp = 0;
+		i < M->list_sz && yp <= (size_t) mouse_y; i++){
+		if (get_entry(M, i)->attributes & HIDDEN_ITEM)
 			continue;
 
 /* find matching position */
@@ -608,22 +979,8 @@ static bool on_label_query(struct tui_context* T,
 	return true;
 }
 
-bool arcan_tui_listwnd_setup(
-	struct tui_context* T, struct tui_list_entry* L, size_t n_entries)
+static void setup(struct tui_context* T, struct listwnd_meta* meta)
 {
-	if (!T || !L || n_entries == 0)
-		return false;
-
-	struct listwnd_meta* meta = malloc(sizeof(struct listwnd_meta));
-	if (!meta)
-		return false;
-
-	*meta = (struct listwnd_meta){
-		.magic = LISTWND_MAGIC,
-		.list_sz = n_entries,
-		.list = L,
-	};
-
 /* save old flags and just set clean + ALTERNATE */
 	meta->old_flags = arcan_tui_set_flags(T, 0);
 	arcan_tui_reset_flags(T, ~0);
@@ -659,7 +1016,51 @@ bool arcan_tui_listwnd_setup(
 /* requery label through new handles (removes existing ones) */
 	arcan_tui_reset_labels(T);
 	redraw(T, meta);
+}
+
+bool arcan_tui_listwnd_setup(
+	struct tui_context* T, struct tui_list_entry* L, size_t n_entries)
+{
+	if (!T || !L || n_entries == 0)
+		return false;
+
+	struct listwnd_meta* meta = malloc(sizeof(struct listwnd_meta));
+	if (!meta)
+		return false;
+
+	*meta = (struct listwnd_meta){
+		.magic = LISTWND_MAGIC,
+		.list_sz = n_entries,
+		.list = L,
+	};
+
+	setup(T, meta);
+	return true;
+}
+
+bool arcan_tui_listwnd_setup_source(
+	struct tui_context* T, struct tui_list_source* S, size_t source_sz)
+{
+	if (!T || !S || source_sz < sizeof(struct tui_list_source) ||
+		!S->count || !S->fetch)
+		return false;
+
+	struct listwnd_meta* meta = malloc(sizeof(struct listwnd_meta));
+	if (!meta)
+		return false;
+
+	*meta = (struct listwnd_meta){
+		.magic = LISTWND_MAGIC,
+		.source = *S,
+		.scan = malloc(LISTWND_SCAN_CHUNK * sizeof(struct tui_list_entry))
+	};
 
+	if (!meta->scan){
+		free(meta);
+		return false;
+	}
+
+	setup(T, meta);
 	return true;
 }
 
@@ -688,12 +1089,36 @@ static struct tui_list_entry test_easy[] = {
 	}
 };
 
+/* ten million entries that are only ever formatted when they are fetched */
+static size_t test_count(void* tag)
+{
+	return 10000000;
+}
+
+static size_t test_fetch(
+	void* tag, size_t ofs, size_t n, struct tui_list_entry* dst)
+{
+	static char labels[LISTWND_SCAN_CHUNK][32];
+	static size_t next;
+
+	for (size_t i = 0; i < n && ofs + i < 10000000; i++){
+		char* buf = labels[next++ % LISTWND_SCAN_CHUNK];
+		snprintf(buf, 32, "entry %zu", ofs + i);
+		dst[i] = (struct tui_list_entry){
+			.label = buf,
+			.tag = ofs + i
+		};
+	}
+
+	return ofs + n > 10000000 ? 10000000 - ofs : n;
+}
+
 int main(int argc, char** argv)
 {
 	struct tui_cbcfg cbcfg = {0};
 	arcan_tui_conn* conn = arcan_tui_open_display("test", "");
 	struct tui_context* tui = arcan_tui_setup(conn, NULL, &cbcfg, sizeof(cbcfg));
-	size_t test_cases = 2;
+	size_t test_cases = 3;
 	size_t index = 0;
 
 	if (argc > 1){
@@ -726,6 +1151,12 @@ int main(int argc, char** argv)
 		arcan_tui_listwnd_setup(tui, ent, 256);
 	}
 	break;
+	case 2:
+		arcan_tui_listwnd_setup_source(tui, &(struct tui_list_source){
+			.count = test_count,
+			.fetch = test_fetch
+		}, sizeof(struct tui_list_source));
+	break;
 	}
 
 	while(1){
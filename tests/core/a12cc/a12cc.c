@@ -0,0 +1,188 @@
+/*
+ * Congestion control harness for a12.
+ *
+ * A sender and a receiver state run in the same process, connected through a
+ * socketpair where the sender to receiver direction is throttled by a token
+ * bucket to a fixed rate (the return direction is unthrottled). The sender is
+ * greedy and produces a new frame whenever the state does not report being
+ * congested, so without congestion control the queue would grow without bound.
+ *
+ * The test checks that the link capacity estimate converges on the throttled
+ * rate and that the queueing delay stays bounded.
+ *
+ * Usage: a12cc [rate in kbit/s] [duration in seconds]
+ */
+#include <arcan_shmif.h>
+#include <arcan_shmif_server.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <sys/socket.h>
+
+#include "a12.h"
+
+void arcan_fatal(const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+	vfprintf(stderr, msg, args);
+	va_end(args);
+	exit(EXIT_FAILURE);
+}
+
+static uint64_t now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char** argv)
+{
+	size_t rate_kbps = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+	size_t duration = argc > 2 ? strtoul(argv[2], NULL, 10) : 10;
+	size_t rate = rate_kbps * 1000 / 8;
+
+	if (!rate || !duration){
+		fprintf(stderr, "usage: a12cc [rate kbit/s] [duration s]\n");
+		return EXIT_FAILURE;
+	}
+
+	int sv[2];
+	if (-1 == socketpair(AF_UNIX, SOCK_STREAM, 0, sv)){
+		fprintf(stderr, "couldn't build socketpair\n");
+		return EXIT_FAILURE;
+	}
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+
+	struct a12_context_options* opts =
+		a12_sensitive_alloc(sizeof(struct a12_context_options));
+	opts->disable_authenticity = true;
+
+	struct a12_state* S = a12_open(opts);
+	struct a12_state* R = a12_build(opts);
+	if (!S || !R){
+		fprintf(stderr, "couldn't build a12 state machines\n");
+		return EXIT_FAILURE;
+	}
+
+/* small noise frames, incompressible and small enough to stay raw */
+	size_t w = 64, h = 64;
+	shmif_pixel* px = malloc(w * h * sizeof(shmif_pixel));
+	for (size_t i = 0; i < w * h; i++)
+		px[i] = SHMIF_RGBA(rand() % 256, rand() % 256, rand() % 256, 0xff);
+
+	struct shmifsrv_vbuffer vb = {
+		.buffer = px,
+		.w = w,
+		.h = h,
+		.pitch = w,
+		.stride = w * sizeof(shmif_pixel)
+	};
+
+	uint8_t inbuf[65536];
+	uint8_t* sbuf = NULL;
+	size_t sbuf_sz = 0;
+	size_t tokens = 0;
+	size_t frames = 0;
+	size_t max_delay = 0;
+	size_t sum_delay = 0;
+	size_t n_delay = 0;
+	struct a12_iostat ios = {};
+
+	uint64_t start = now_ms();
+	uint64_t last = start;
+	uint64_t last_sample = start;
+
+	while (now_ms() - start < duration * 1000){
+		uint64_t ts = now_ms();
+
+/* refill the token bucket, allow a small burst */
+		tokens += rate * (ts - last) / 1000;
+		if (tokens > 16384)
+			tokens = 16384;
+		last = ts;
+
+/* greedy producer */
+		ios = a12_state_iostat(S);
+		if (!ios.congested){
+			px[frames % (w * h)] ^= 0x00ffffff;
+			a12_channel_vframe(S, &vb, (struct a12_vframe_opts){
+				.method = VFRAME_METHOD_NORMAL
+			});
+			frames++;
+		}
+
+/* sender -> socket */
+		if (!sbuf_sz)
+			sbuf_sz = a12_flush(S, &sbuf, A12_FLUSH_ALL);
+
+		if (sbuf_sz){
+			ssize_t nw = write(sv[0], sbuf, sbuf_sz);
+			if (nw > 0){
+				sbuf += nw;
+				sbuf_sz -= nw;
+			}
+		}
+
+/* throttled socket -> receiver */
+		size_t cap = tokens > sizeof(inbuf) ? sizeof(inbuf) : tokens;
+		if (cap){
+			ssize_t nr = read(sv[1], inbuf, cap);
+			if (nr > 0){
+				tokens -= nr;
+				a12_unpack(R, inbuf, nr, NULL, NULL);
+			}
+		}
+
+/* receiver -> sender, unthrottled */
+		uint8_t* rbuf;
+		size_t rbuf_sz;
+		while ((rbuf_sz = a12_flush(R, &rbuf, A12_FLUSH_ALL)))
+			a12_unpack(S, rbuf, rbuf_sz, NULL, NULL);
+
+/* queueing delay implied by what is not yet delivered, skip warm-up */
+		if (ts - last_sample >= 100){
+			ios = a12_state_iostat(S);
+			size_t delay = ios.b_pending * 1000 / rate;
+			if (ts - start > 2000){
+				if (delay > max_delay)
+					max_delay = delay;
+				sum_delay += delay;
+				n_delay++;
+			}
+			printf("t=%"PRIu64":bps=%zu:rtt=%u:pending=%zu:delay=%zu:congested=%d\n",
+				ts - start, ios.bps, ios.rtt_ms, ios.b_pending, delay, ios.congested);
+			last_sample = ts;
+		}
+
+		usleep(1000);
+	}
+
+	ios = a12_state_iostat(S);
+	size_t avg_delay = n_delay ? sum_delay / n_delay : 0;
+	printf("frames=%zu:rate=%zu:estimate=%zu:avg_delay=%zu:max_delay=%zu\n",
+		frames, rate, ios.bps, avg_delay, max_delay);
+
+	bool ok = true;
+	if (ios.bps < rate / 2 || ios.bps > rate * 3 / 2){
+		fprintf(stderr, "estimate (%zu) too far from link rate (%zu)\n", ios.bps, rate);
+		ok = false;
+	}
+
+/* queue bound is the latency target on top of the round-trip, with some
+ * slack for the frame being produced when the state was just below it */
+	size_t bound = 3 * (ios.latency_target + ios.rtt_min_ms) +
+		w * h * sizeof(shmif_pixel) * 1000 / rate;
+	if (max_delay > bound){
+		fprintf(stderr, "queueing delay (%zu) above bound (%zu)\n", max_delay, bound);
+		ok = false;
+	}
+
+	free(px);
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
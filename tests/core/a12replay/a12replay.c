@@ -0,0 +1,199 @@
+/*
+ * Replay benchmark for a12 video encoding.
+ *
+ * Takes a recording produced with arcan-net -r and runs the frames from one
+ * segment through the encoder of a sender state and the decoder of a receiver
+ * state in the same process, once for each requested method. This makes it
+ * possible to compare methods and to catch regressions on captured sessions
+ * rather than synthetic content.
+ *
+ * Reported per method: frames/s through encode+decode, bytes on the wire per
+ * frame and the CPU time spent per frame in the encoder and the decoder.
+ *
+ * Frames that carry a TPACK buffer are always sent as TPACK, the method only
+ * applies to frames with pixel contents.
+ *
+ * Usage: a12replay recording [channel-id] [method,method,...]
+ */
+#include <arcan_shmif.h>
+#include <arcan_shmif_server.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+
+#include "a12.h"
+#include "a12_record.h"
+
+void arcan_fatal(const char* msg, ...)
+{
+	va_list args;
+	va_start(args, msg);
+	vfprintf(stderr, msg, args);
+	va_end(args);
+	exit(EXIT_FAILURE);
+}
+
+static struct {
+	const char* name;
+	enum a12_vframe_method method;
+} methods[] = {
+	{"normal", VFRAME_METHOD_NORMAL},
+	{"raw", VFRAME_METHOD_RAW_NOALPHA},
+	{"rgb565", VFRAME_METHOD_RAW_RGB565},
+	{"dpng", VFRAME_METHOD_DPNG},
+	{"h264", VFRAME_METHOD_H264}
+};
+
+struct result {
+	size_t frames;
+	size_t bytes;
+	uint64_t wall_ns;
+	uint64_t enc_ns;
+	uint64_t dec_ns;
+};
+
+static uint64_t clock_ns(clockid_t id)
+{
+	struct timespec ts;
+	clock_gettime(id, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * The receiver has no real segment to resize, so the destination is swapped
+ * for one of the right dimensions whenever the source changes size.
+ */
+static void prepare_dst(struct a12_state* R,
+	struct arcan_shmif_cont* cont, struct shmifsrv_vbuffer* vb)
+{
+	int hints = vb->flags.tpack ? SHMIF_RHINT_TPACK : 0;
+
+	if (cont->w == vb->w && cont->h == vb->h && cont->hints == hints)
+		return;
+
+	free(cont->vidb);
+	*cont = (struct arcan_shmif_cont){
+		.vidb = malloc(vb->w * vb->h * sizeof(shmif_pixel)),
+		.w = vb->w,
+		.h = vb->h,
+		.pitch = vb->w,
+		.stride = vb->w * sizeof(shmif_pixel),
+		.hints = hints
+	};
+	cont->vidp = (shmif_pixel*) cont->vidb;
+	a12_set_destination(R, cont, 0);
+}
+
+static bool run(int fd, int chid,
+	enum a12_vframe_method method, struct result* out)
+{
+	*out = (struct result){};
+
+	if (-1 == lseek(fd, 0, SEEK_SET) || !a12_record_check(fd)){
+		fprintf(stderr, "couldn't read recording header\n");
+		return false;
+	}
+
+	struct a12_context_options* opts =
+		a12_sensitive_alloc(sizeof(struct a12_context_options));
+	opts->disable_authenticity = true;
+
+	struct a12_state* S = a12_open(opts);
+	struct a12_state* R = a12_build(opts);
+	if (!S || !R){
+		fprintf(stderr, "couldn't build a12 state machines\n");
+		return false;
+	}
+
+	struct arcan_shmif_cont cont = {};
+	struct a12_record_frame frame;
+	uint64_t wall = clock_ns(CLOCK_MONOTONIC);
+
+	while (a12_record_read(fd, &frame)){
+		if (frame.chid != chid){
+			free(frame.vb.buffer_bytes);
+			continue;
+		}
+
+		prepare_dst(R, &cont, &frame.vb);
+
+		uint8_t* buf;
+		size_t buf_sz;
+		size_t nb = 0;
+
+		uint64_t ts = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+		a12_channel_vframe(S, &frame.vb, (struct a12_vframe_opts){
+			.method = frame.vb.flags.tpack ? VFRAME_METHOD_TPACK : method,
+			.bias = VFRAME_BIAS_BALANCED
+		});
+		out->enc_ns += clock_ns(CLOCK_PROCESS_CPUTIME_ID) - ts;
+
+/* the states are not connected in the other direction, so there is no link
+ * estimate and nothing will be held back for congestion */
+		while ((buf_sz = a12_flush(S, &buf, A12_FLUSH_ALL))){
+			nb += buf_sz;
+			ts = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+			a12_unpack(R, buf, buf_sz, NULL, NULL);
+			out->dec_ns += clock_ns(CLOCK_PROCESS_CPUTIME_ID) - ts;
+		}
+
+		out->bytes += nb;
+		out->frames++;
+		free(frame.vb.buffer_bytes);
+	}
+
+	out->wall_ns = clock_ns(CLOCK_MONOTONIC) - wall;
+	a12_free(S);
+	a12_free(R);
+	free(cont.vidb);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2){
+		fprintf(stderr, "usage: a12replay recording [channel-id] [method,...]\n");
+		return EXIT_FAILURE;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	if (-1 == fd){
+		fprintf(stderr, "couldn't open %s: %s\n", argv[1], strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	int chid = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+	char* filter = argc > 3 ? argv[3] : NULL;
+
+	printf("method:frames:frames_s:bytes_frame:enc_ms_frame:dec_ms_frame\n");
+	for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++){
+		if (filter){
+			char* pos = strstr(filter, methods[i].name);
+			size_t len = strlen(methods[i].name);
+			if (!pos || (pos[len] != '\0' && pos[len] != ','))
+				continue;
+		}
+
+		struct result res;
+		if (!run(fd, chid, methods[i].method, &res))
+			return EXIT_FAILURE;
+
+		if (!res.frames){
+			fprintf(stderr, "no frames for channel %d in recording\n", chid);
+			return EXIT_FAILURE;
+		}
+
+		printf("%s:%zu:%.2f:%zu:%.3f:%.3f\n", methods[i].name, res.frames,
+			(double) res.frames * 1000000000.0 / (double) res.wall_ns,
+			res.bytes / res.frames,
+			(double) res.enc_ns / (double) res.frames / 1000000.0,
+			(double) res.dec_ns / (double) res.frames / 1000000.0
+		);
+	}
+
+	close(fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,138 @@
+/*
+ * 'cat' throughput benchmark for afsrv_terminal (or any other terminal).
+ *
+ * Run it inside the terminal to measure. It writes a generated log to stdout
+ * as fast as the pty accepts it, so the time it takes is bounded by how fast
+ * the terminal consumes and parses its input. Most of the log is plain
+ * printable ASCII split into lines, with an optional share of lines carrying
+ * SGR color changes and utf-8 to exercise the slower parser paths.
+ *
+ * When done, the throughput is written to stderr (and also visible in the
+ * terminal itself as the last line).
+ *
+ * Usage: termcat [megabytes] [escape-percent]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+static uint64_t clock_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const char* words[] = {
+	"INFO", "connection", "accepted", "from", "127.0.0.1:51234", "frame",
+	"dropped", "queue", "depth", "=", "42", "while", "processing", "request",
+	"GET", "/index.html", "HTTP/1.1", "200", "OK", "bytes", "sent", "in",
+	"0.003s", "worker", "[3]", "state", "->", "idle", "{ret: 0}", "#include"
+};
+
+static const char* escapes[] = {
+	"\033[1;31m", "\033[32m", "\033[0m", "\033[4m", "\033[38;5;208m", "\033[7m"
+};
+
+static const char* utf8[] = {
+	"\xc3\xa5\xc3\xa4\xc3\xb6", "\xe2\x94\x80\xe2\x94\x80", "\xce\xbb"
+};
+
+/*
+ * build a fixed buffer of log lines that is written over and over, this keeps
+ * the generator cost out of the measurement
+ */
+static char* build_log(size_t sz, int esc_pct)
+{
+	char* buf = malloc(sz);
+	if (!buf)
+		return NULL;
+
+	size_t pos = 0;
+	size_t nw = sizeof(words) / sizeof(words[0]);
+	unsigned seed = 1;
+
+	while (pos < sz){
+		char line[256];
+		int ofs = 0;
+		bool esc = (int)(rand_r(&seed) % 100) < esc_pct;
+		size_t count = 4 + rand_r(&seed) % 14;
+
+		for (size_t i = 0; i < count && ofs < 160; i++){
+			if (esc && rand_r(&seed) % 3 == 0){
+				const char* pre = escapes[rand_r(&seed) % 6];
+				ofs += snprintf(&line[ofs], sizeof(line) - ofs, "%s", pre);
+			}
+			if (esc && rand_r(&seed) % 5 == 0){
+				ofs += snprintf(&line[ofs], sizeof(line) - ofs, "%s ", utf8[rand_r(&seed) % 3]);
+			}
+			ofs += snprintf(&line[ofs], sizeof(line) - ofs, "%s ", words[rand_r(&seed) % nw]);
+		}
+		if (esc)
+			ofs += snprintf(&line[ofs], sizeof(line) - ofs, "\033[0m");
+		line[ofs++] = '\n';
+
+/* don't cut a line (and possibly an escape sequence) at the wrap-around */
+		if ((size_t)ofs > sz - pos){
+			memset(&buf[pos], '\n', sz - pos);
+			break;
+		}
+		memcpy(&buf[pos], line, ofs);
+		pos += ofs;
+	}
+
+	return buf;
+}
+
+static bool write_all(int fd, const char* buf, size_t sz)
+{
+	while (sz){
+		ssize_t nw = write(fd, buf, sz);
+		if (nw == -1){
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+		buf += nw;
+		sz -= nw;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	size_t mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 100;
+	int esc_pct = argc > 2 ? strtol(argv[2], NULL, 10) : 0;
+	if (!mb)
+		mb = 100;
+	if (esc_pct < 0 || esc_pct > 100)
+		esc_pct = 0;
+
+	size_t chunk = 1024 * 1024;
+	char* buf = build_log(chunk, esc_pct);
+	if (!buf){
+		fprintf(stderr, "couldn't allocate log buffer\n");
+		return EXIT_FAILURE;
+	}
+
+	uint64_t start = clock_ns();
+	for (size_t i = 0; i < mb; i++){
+		if (!write_all(STDOUT_FILENO, buf, chunk)){
+			fprintf(stderr, "write failed after %zu MiB\n", i);
+			return EXIT_FAILURE;
+		}
+	}
+	uint64_t elapsed = clock_ns() - start;
+	double sec = (double)elapsed / 1000000000.0;
+
+	fprintf(stderr, "\033[0m\ntermcat: %zu MiB (%d%% escaped lines) in %.3f s, %.2f MiB/s\n",
+		mb, esc_pct, sec, (double)mb / sec);
+
+	free(buf);
+	return EXIT_SUCCESS;
+}
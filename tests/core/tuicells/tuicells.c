@@ -0,0 +1,267 @@
+/*
+ * Conversion tests for the TUI cell grid.
+ *
+ * Feeds packed frames to tui_raster_grid_update and verifies the instances
+ * that the GPU path would draw: positions, glyph slots, colors, line marks,
+ * cursor, scrolling and the range of rows reported as changed. Lastly the
+ * CPU fallback is compared against rasterizing the same frame directly.
+ *
+ * Uses the builtin bitmap font so that no GL context or font files are
+ * needed, exits with a failure status on the first mismatch.
+ *
+ * Usage: tuicells
+ */
+#include <arcan_shmif.h>
+#include <inttypes.h>
+
+#include "arcan_ttf.h"
+#include "raster.h"
+#include "pixelfont.h"
+
+#define COLS 8
+#define ROWS 4
+
+static int fails;
+
+#define CHECK(X, ...) do { if (!(X)){\
+	fprintf(stderr, "%s:%d: (%s) ", __FILE__, __LINE__, #X);\
+	fprintf(stderr, __VA_ARGS__);\
+	fprintf(stderr, "\n");\
+	fails++;\
+}} while(0)
+
+static void pack_u32(uint32_t val, uint8_t* dst)
+{
+	dst[0] = val;
+	dst[1] = val >> 8;
+	dst[2] = val >> 16;
+	dst[3] = val >> 24;
+}
+
+struct frame {
+	uint8_t buf[4096];
+	struct tui_raster_header hdr;
+	size_t ofs;
+};
+
+static void frame_begin(struct frame* f, int flags, uint8_t cursor)
+{
+	f->hdr = (struct tui_raster_header){
+		.flags = flags,
+		.bgc = {0x10, 0x20, 0x30, 0xff},
+		.cursor_state = cursor
+	};
+	f->ofs = raster_hdr_sz + (flags & RPACK_SCROLL ? raster_hdr_scroll_sz : 0);
+}
+
+/* add a line with [text] at [row], [col], every cell gets [attr] */
+static void frame_line(struct frame* f,
+	size_t row, size_t col, const char* text, uint8_t attr)
+{
+	struct tui_raster_line line = {
+		.start_line = row,
+		.offset = col,
+		.ncells = strlen(text)
+	};
+	memcpy(&f->buf[f->ofs], &line, sizeof(line));
+	f->ofs += raster_line_sz;
+	f->hdr.lines++;
+
+	for (size_t i = 0; text[i]; i++){
+		uint8_t* cell = &f->buf[f->ofs];
+		cell[0] = 0xf0;
+		cell[1] = 0x80 + i;
+		cell[2] = 0x40;
+		cell[3] = 0x01;
+		cell[4] = 0x02 + row;
+		cell[5] = 0x03;
+		cell[6] = attr;
+		cell[7] = 0;
+		pack_u32(text[i] == ' ' ? 0 : (uint8_t) text[i], &cell[8]);
+		f->ofs += raster_cell_sz;
+		f->hdr.cells++;
+	}
+}
+
+static size_t frame_end(struct frame* f)
+{
+	f->hdr.data_sz = f->ofs;
+	memcpy(f->buf, &f->hdr, raster_hdr_sz +
+		(f->hdr.flags & RPACK_SCROLL ? raster_hdr_scroll_sz : 0));
+	return f->ofs;
+}
+
+static struct tui_raster_instance* cell_at(
+	struct tui_raster_grid* grid, size_t col, size_t row)
+{
+	size_t cols, rows;
+	struct tui_raster_instance* cells = tui_raster_grid_cells(grid, &cols, &rows);
+	return &cells[row * cols + col];
+}
+
+static void check_positions(struct tui_raster_grid* grid)
+{
+	size_t cols, rows;
+	struct tui_raster_instance* cells = tui_raster_grid_cells(grid, &cols, &rows);
+
+	for (size_t i = 0; i < cols * rows; i++)
+		CHECK(cells[i].col == i % cols && cells[i].row == i / cols,
+			"cell %zu at %"PRIu16",%"PRIu16, i, cells[i].col, cells[i].row);
+}
+
+int main(int argc, char** argv)
+{
+	struct tui_font fonts[2] = {};
+	struct tui_font* slots[2] = {&fonts[0], &fonts[1]};
+	size_t cell_w = 0, cell_h = 0;
+
+	fonts[0].bitmap = tui_pixelfont_open(64);
+	if (!fonts[0].bitmap){
+		fprintf(stderr, "couldn't open builtin font\n");
+		return EXIT_FAILURE;
+	}
+	tui_pixelfont_setsz(fonts[0].bitmap, 8, &cell_w, &cell_h);
+
+	struct tui_raster_context* raster = tui_raster_setup(cell_w, cell_h);
+	if (!raster){
+		fprintf(stderr, "couldn't setup raster\n");
+		return EXIT_FAILURE;
+	}
+	tui_raster_setfont(raster, slots, 2);
+
+	struct tui_raster_grid* grid = NULL;
+	struct frame f;
+	size_t first, count, sz;
+
+/* full frame: everything is drawn, missing cells are background */
+	frame_begin(&f, RPACK_IFRAME, CURSOR_ACTIVE);
+	frame_line(&f, 0, 0, "abca", 0);
+	frame_line(&f, 1, 2, "x y", 1 << CATTR_UNDERLINE);
+	frame_line(&f, 2, 0, "z", (1 << CATTR_STRIKETHROUGH) | (1 << CATTR_CURSOR));
+	sz = frame_end(&f);
+
+	CHECK(1 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "iframe");
+	CHECK(first == 0 && count == ROWS, "iframe range %zu+%zu", first, count);
+	check_positions(grid);
+
+	struct tui_raster_instance* a = cell_at(grid, 0, 0);
+	struct tui_raster_instance* b = cell_at(grid, 1, 0);
+	CHECK(a->flags == RINST_GLYPH && b->flags == RINST_GLYPH, "glyph flags");
+	CHECK(a->glyph != b->glyph, "distinct glyphs share slot %"PRIu16, a->glyph);
+	CHECK(a->glyph == cell_at(grid, 3, 0)->glyph, "same glyph, different slots");
+	CHECK(memcmp(b->fg, (uint8_t[]){0xf0, 0x81, 0x40, 0xff}, 4) == 0,
+		"fg %02x%02x%02x%02x", b->fg[0], b->fg[1], b->fg[2], b->fg[3]);
+	CHECK(memcmp(b->bg, (uint8_t[]){0x01, 0x02, 0x03, 0xff}, 4) == 0,
+		"bg %02x%02x%02x%02x", b->bg[0], b->bg[1], b->bg[2], b->bg[3]);
+
+	struct tui_raster_instance* blank = cell_at(grid, 5, 0);
+	CHECK(blank->flags == 0, "blank flags %"PRIu16, blank->flags);
+	CHECK(memcmp(blank->bg, f.hdr.bgc, 4) == 0, "blank not background");
+
+	CHECK(cell_at(grid, 2, 1)->flags == (RINST_GLYPH | RINST_UNDERLINE),
+		"underline %"PRIu16, cell_at(grid, 2, 1)->flags);
+	CHECK(cell_at(grid, 3, 1)->flags == 0,
+		"underlined blank %"PRIu16, cell_at(grid, 3, 1)->flags);
+
+	struct tui_raster_instance* cur = cell_at(grid, 0, 2);
+	CHECK(cur->flags == (RINST_GLYPH | RINST_STRIKETHROUGH),
+		"strikethrough %"PRIu16, cur->flags);
+	CHECK(memcmp(cur->bg, (uint8_t[]){0x00, 0xaa, 0x00, 0xff}, 4) == 0,
+		"cursor color %02x%02x%02x", cur->bg[0], cur->bg[1], cur->bg[2]);
+
+/* the same cells again change nothing */
+	frame_begin(&f, RPACK_DFRAME, CURSOR_ACTIVE);
+	frame_line(&f, 0, 0, "abca", 0);
+	sz = frame_end(&f);
+	CHECK(0 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "unchanged");
+
+/* one changed cell gives its row */
+	frame_begin(&f, RPACK_DFRAME, CURSOR_ACTIVE);
+	frame_line(&f, 1, 2, "xqy", 1 << CATTR_UNDERLINE);
+	sz = frame_end(&f);
+	CHECK(1 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "delta");
+	CHECK(first == 1 && count == 1, "delta range %zu+%zu", first, count);
+	CHECK((cell_at(grid, 3, 1)->flags & RINST_GLYPH) &&
+		cell_at(grid, 3, 1)->glyph != cell_at(grid, 2, 1)->glyph, "delta glyph");
+
+/* cursor state changes the rows with cursor cells */
+	frame_begin(&f, RPACK_DFRAME, CURSOR_NONE);
+	sz = frame_end(&f);
+	CHECK(1 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "cursor");
+	CHECK(first == 2 && count == 1, "cursor range %zu+%zu", first, count);
+	CHECK(memcmp(cur->bg, (uint8_t[]){0x01, 0x04, 0x03, 0xff}, 4) == 0,
+		"cursor cleared %02x%02x%02x", cur->bg[0], cur->bg[1], cur->bg[2]);
+
+/* scroll the whole screen up one row */
+	uint16_t glyph_x = cell_at(grid, 2, 1)->glyph;
+	frame_begin(&f, RPACK_DFRAME | RPACK_SCROLL, CURSOR_NONE);
+	f.hdr.scroll = 1;
+	f.hdr.scroll_top = 0;
+	f.hdr.scroll_bottom = ROWS - 1;
+	sz = frame_end(&f);
+	CHECK(1 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "scroll");
+	CHECK(first == 0 && count == ROWS, "scroll range %zu+%zu", first, count);
+	check_positions(grid);
+	CHECK(cell_at(grid, 2, 0)->glyph == glyph_x &&
+		cell_at(grid, 2, 0)->flags == (RINST_GLYPH | RINST_UNDERLINE), "scrolled");
+	CHECK(cell_at(grid, 0, 1)->flags == (RINST_GLYPH | RINST_STRIKETHROUGH),
+		"scrolled strikethrough");
+
+/* a scroll that doesn't fit the region is dropped, not the frame */
+	frame_begin(&f, RPACK_DFRAME | RPACK_SCROLL, CURSOR_NONE);
+	f.hdr.scroll = ROWS;
+	f.hdr.scroll_bottom = ROWS - 1;
+	frame_line(&f, 3, 0, "x", 0);
+	sz = frame_end(&f);
+	CHECK(1 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "bad scroll");
+	CHECK(first == 3 && count == 1, "bad scroll range %zu+%zu", first, count);
+	CHECK(cell_at(grid, 2, 0)->glyph == glyph_x, "bad scroll kept rows");
+
+/* the fallback draws the same pixels as the raster does */
+	frame_begin(&f, RPACK_IFRAME, CURSOR_ACTIVE);
+	frame_line(&f, 0, 0, "Hello, W", 1 << CATTR_UNDERLINE);
+	frame_line(&f, 1, 0, "orld!  $", 0);
+	frame_line(&f, 2, 0, "  <>[] _", 1 << CATTR_CURSOR);
+	frame_line(&f, 3, 0, "~~~~~~~~", 1 << CATTR_STRIKETHROUGH);
+	sz = frame_end(&f);
+
+	struct arcan_shmif_cont cont = {
+		.w = COLS * cell_w + 1,
+		.h = ROWS * cell_h + 1
+	};
+	cont.pitch = cont.w;
+	cont.stride = cont.w * sizeof(shmif_pixel);
+	cont.vidp = calloc(cont.w * cont.h, sizeof(shmif_pixel));
+	shmif_pixel* vidp = calloc(cont.w * cont.h, sizeof(shmif_pixel));
+	if (!cont.vidp || !vidp){
+		fprintf(stderr, "couldn't allocate output\n");
+		return EXIT_FAILURE;
+	}
+
+	CHECK(1 == tui_raster_grid_update(
+		raster, &grid, COLS, ROWS, f.buf, sz, &first, &count), "fallback");
+	tui_raster_grid_draw(raster, grid, vidp, cont.pitch, cont.w, cont.h, 0, ROWS);
+	tui_raster_render(raster, &cont, f.buf, sz);
+	CHECK(memcmp(vidp, cont.vidp, cont.w * cont.h * sizeof(shmif_pixel)) == 0,
+		"fallback and raster differ");
+
+	free(vidp);
+	free(cont.vidp);
+	tui_raster_grid_free(grid);
+	tui_raster_free(raster);
+	tui_pixelfont_close(fonts[0].bitmap);
+
+	if (fails){
+		fprintf(stderr, "%d checks failed\n", fails);
+		return EXIT_FAILURE;
+	}
+
+	printf("ok\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+/*
+ * Throughput benchmark for the TUI cell raster.
+ *
+ * Builds a full screen of cells (mixed text, colors and bold / italic
+ * attributes, similar to what a busy terminal produces) and rasters it
+ * repeatedly through tui_raster_render into a local buffer, reporting how
+ * many cells per second that amounts to. The first frame is reported on its
+ * own as that is where any glyph caches are populated.
+ *
+ * Usage: tuiraster [font.ttf | builtin] [columns] [rows] [size] [frames]
+ *
+ * The size is in pt for vector fonts and in px for the builtin bitmap font.
+ */
+#include <arcan_shmif.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "arcan_ttf.h"
+#include "raster.h"
+#include "pixelfont.h"
+
+static uint64_t clock_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void pack_u32(uint32_t val, uint8_t* dst)
+{
+	dst[0] = val;
+	dst[1] = val >> 8;
+	dst[2] = val >> 16;
+	dst[3] = val >> 24;
+}
+
+/*
+ * Same layout as tui_screen_refresh produces, a header followed by each line
+ * and its cells, every line is sent in full.
+ */
+static uint8_t* build_screen(size_t cols, size_t rows, size_t* out_sz)
+{
+	size_t sz = raster_hdr_sz + rows * raster_line_sz + rows * cols * raster_cell_sz;
+	uint8_t* buf = malloc(sz);
+	if (!buf)
+		return NULL;
+
+	struct tui_raster_header hdr = {
+		.data_sz = sz,
+		.lines = rows,
+		.cells = rows * cols,
+		.flags = RPACK_IFRAME,
+		.bgc = {0x10, 0x10, 0x10, 0xff}
+	};
+	memcpy(buf, &hdr, raster_hdr_sz);
+	uint8_t* pos = &buf[raster_hdr_sz];
+
+	static const char text[] =
+		"int main(int argc, char** argv){ return printf(\"%d\\n\", argc); } "
+		"The quick brown fox jumps over the lazy dog 0123456789 [](){}<>";
+
+	for (size_t y = 0; y < rows; y++){
+		struct tui_raster_line line = {
+			.start_line = y,
+			.ncells = cols
+		};
+		memcpy(pos, &line, sizeof(line));
+		pos += raster_line_sz;
+
+		for (size_t x = 0; x < cols; x++){
+			size_t ofs = (y * 7 + x) % (sizeof(text) - 1);
+			uint8_t attr = 0;
+
+/* keywords bold, comments italic, some of both */
+			if (ofs % 13 < 3)
+				attr |= 1 << CATTR_BOLD;
+			if (y % 5 == 0)
+				attr |= 1 << CATTR_ITALIC;
+
+			uint8_t hue = (ofs * 37) & 0xff;
+			pos[0] = 0xa0 + (hue >> 3);
+			pos[1] = 0xff - (hue >> 2);
+			pos[2] = 0x80 + (hue >> 1);
+			pos[3] = pos[4] = pos[5] = 0x10;
+			pos[6] = attr;
+			pos[7] = 0;
+			pack_u32(text[ofs] == ' ' ? 0 : (uint8_t) text[ofs], &pos[8]);
+			pos += raster_cell_sz;
+		}
+	}
+
+	*out_sz = sz;
+	return buf;
+}
+
+static bool setup_font(struct tui_font* font,
+	const char* name, size_t size, size_t* cell_w, size_t* cell_h)
+{
+	if (strcmp(name, "builtin") == 0){
+		font->vector = false;
+		font->bitmap = tui_pixelfont_open(64);
+		if (!font->bitmap)
+			return false;
+		tui_pixelfont_setsz(font->bitmap, size, cell_w, cell_h);
+		return true;
+	}
+
+	font->vector = true;
+	font->truetype = TTF_OpenFont(name, size, 96, 96);
+	if (!font->truetype)
+		return false;
+
+/* same probing as fontmgmt does for the cell size */
+	static const char* probe[] = {"A", "a", "!", "_", "J", "j", "G", "g", "M", "m"};
+	for (size_t i = 0; i < sizeof(probe) / sizeof(probe[0]); i++){
+		int w = 0, h = 0;
+		TTF_SizeUTF8(font->truetype, probe[i], &w, &h, TTF_STYLE_BOLD);
+		if (w > *cell_w)
+			*cell_w = w;
+		if (h > *cell_h)
+			*cell_h = h;
+	}
+
+	TTF_SetFontHinting(font->truetype, TTF_HINTING_LIGHT);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	const char* name = argc > 1 ? argv[1] : "builtin";
+	size_t cols = argc > 2 ? strtoul(argv[2], NULL, 10) : 200;
+	size_t rows = argc > 3 ? strtoul(argv[3], NULL, 10) : 80;
+	size_t size = argc > 4 ? strtoul(argv[4], NULL, 10) : 14;
+	size_t frames = argc > 5 ? strtoul(argv[5], NULL, 10) : 100;
+
+	if (!cols || !rows || !size || !frames){
+		fprintf(stderr,
+			"usage: tuiraster [font.ttf | builtin] [columns] [rows] [size] [frames]\n");
+		return EXIT_FAILURE;
+	}
+
+	struct tui_font fonts[2] = {};
+	struct tui_font* slots[2] = {&fonts[0], &fonts[1]};
+	size_t cell_w = 0, cell_h = 0;
+
+	if (!setup_font(&fonts[0], name, size, &cell_w, &cell_h) || !cell_w || !cell_h){
+		fprintf(stderr, "couldn't load font: %s\n", name);
+		return EXIT_FAILURE;
+	}
+
+	size_t buf_sz;
+	uint8_t* buf = build_screen(cols, rows, &buf_sz);
+	struct tui_raster_context* raster = tui_raster_setup(cell_w, cell_h);
+	if (!buf || !raster){
+		fprintf(stderr, "couldn't setup raster\n");
+		return EXIT_FAILURE;
+	}
+	tui_raster_setfont(raster, slots, 2);
+
+/* the raster only draws cells that fit entirely, leave a pixel of margin */
+	struct arcan_shmif_cont cont = {
+		.w = cols * cell_w + 1,
+		.h = rows * cell_h + 1,
+	};
+	cont.pitch = cont.w;
+	cont.stride = cont.w * sizeof(shmif_pixel);
+	cont.vidp = malloc(cont.w * cont.h * sizeof(shmif_pixel));
+	if (!cont.vidp){
+		fprintf(stderr, "couldn't allocate %zu*%zu output\n", cont.w, cont.h);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t ts = clock_ns();
+	tui_raster_render(raster, &cont, buf, buf_sz);
+	uint64_t first = clock_ns() - ts;
+
+	ts = clock_ns();
+	for (size_t i = 0; i < frames; i++)
+		tui_raster_render(raster, &cont, buf, buf_sz);
+	uint64_t total = clock_ns() - ts;
+
+	double cells = (double)(cols * rows);
+	printf("font:cols:rows:cell_w:cell_h:first_ms:frame_ms:cells_s\n");
+	printf("%s:%zu:%zu:%zu:%zu:%.3f:%.3f:%.0f\n", name, cols, rows, cell_w, cell_h,
+		(double) first / 1000000.0,
+		(double) total / (double) frames / 1000000.0,
+		cells * (double) frames * 1000000000.0 / (double) total
+	);
+
+	tui_raster_free(raster);
+	free(cont.vidp);
+	free(buf);
+	return EXIT_SUCCESS;
+}